@@ -0,0 +1,101 @@
+#include <sys/wait.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "judge/compare.hpp"
+using namespace std;
+using namespace judge;
+namespace fs = std::filesystem;
+
+/**
+ * 比较 exec/compare 中基于 diff 的比较脚本和原生比较器（compare_files）比较大输出的耗时
+ * 生成指定大小的标准输出（每行若干个整数），以及以下几种选手输出：
+ * 完全相同（AC）、使用 CRLF 换行（AC）、最后一行多了行末空格（PE）、最后一个数字不同（WA）。
+ * 不同之处都在文件末尾，两种实现都必须读完整个文件。
+ * 最后给出内置的词法比较器（compare_tokens）比较相同的几种输出的耗时，没有对应的 diff 脚本。
+ *
+ * 用法：compare_benchmark [exec/compare 文件夹] [标准输出大小，单位为 MB] [临时文件夹]
+ */
+
+static void write_file(const fs::path &dir, const string &content) {
+    fs::create_directories(dir);
+    ofstream(dir / "testdata.out", ios::binary) << content;
+}
+
+static int run_script(const fs::path &script, const fs::path &user, const fs::path &answer) {
+    string command = "bash " + script.string() + " /dev/null " + user.string() + " " + answer.string() + " /dev/null";
+    int status = system(command.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+template <typename F>
+static double measure(F &&f, int &result) {
+    auto begin = chrono::steady_clock::now();
+    result = f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char *argv[]) {
+    fs::path scripts = argc > 1 ? argv[1] : "exec/compare";
+    size_t size = (argc > 2 ? stoul(argv[2]) : 256) << 20;
+    fs::path workdir = fs::absolute(argc > 3 ? argv[3] : "/tmp/compare_benchmark");
+
+    mt19937 rng(1);
+    string answer;
+    answer.reserve(size + 64);
+    while (answer.size() < size) {
+        for (int i = 0; i < 10; ++i) {
+            if (i) answer += ' ';
+            answer += to_string(rng() % 1000000000);
+        }
+        answer += '\n';
+    }
+
+    string crlf;
+    crlf.reserve(answer.size() + answer.size() / 32);
+    for (char c : answer) {
+        if (c == '\n') crlf += '\r';
+        crlf += c;
+    }
+    string trailing = answer;
+    trailing.insert(trailing.size() - 1, "  ");
+    string wrong = answer;
+    wrong[wrong.size() - 2] = wrong[wrong.size() - 2] == '0' ? '1' : '0';
+
+    write_file(workdir / "answer", answer);
+    vector<pair<string, string>> cases = {{"identical", answer}, {"crlf", crlf}, {"trailing", trailing}, {"wrong", wrong}};
+    for (auto &[name, content] : cases) write_file(workdir / name, content);
+
+    cout << "output size: " << (answer.size() >> 20) << "MB" << endl;
+    cout << setw(20) << "mode" << setw(12) << "case" << setw(16) << "diff (ms)" << setw(16) << "native (ms)" << setw(10) << "result" << endl;
+    for (auto mode_name : {"diff-all", "diff-ign-space", "diff-ign-trailing"}) {
+        compare_mode mode = *parse_compare_mode(mode_name);
+        for (auto &[name, content] : cases) {
+            fs::path user = workdir / name, script = scripts / mode_name / "run";
+            int expected = 0, actual = 0;
+            double diff_time = fs::exists(script) ? measure([&] { return run_script(script, user, workdir / "answer"); }, expected) : 0;
+            double native_time = measure([&] { return compare_files(user / "testdata.out", workdir / "answer" / "testdata.out", mode).result; }, actual);
+            cout << setw(20) << mode_name << setw(12) << name << setw(16) << fixed << setprecision(1) << diff_time << setw(16) << native_time << setw(10) << actual;
+            if (diff_time > 0 && expected != actual) cout << " (diff: " << expected << ")";
+            cout << endl;
+        }
+    }
+
+    auto token = *parse_token_compare("token:abs=1e-6");
+    mapped_file answer_file(workdir / "answer" / "testdata.out");
+    for (auto &[name, content] : cases) {
+        mapped_file user(workdir / name / "testdata.out");
+        int actual = 0;
+        double native_time = measure([&] { return compare_tokens(user.view(), answer_file.view(), token).result; }, actual);
+        cout << setw(20) << "token:abs=1e-6" << setw(12) << name << setw(16) << "-" << setw(16) << fixed << setprecision(1) << native_time << setw(10) << actual << endl;
+    }
+
+    fs::remove_all(workdir);
+}
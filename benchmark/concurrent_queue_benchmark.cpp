@@ -0,0 +1,123 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/concurrent_queue.hpp"
+using namespace std;
+
+/**
+ * 比较原来的互斥锁队列、concurrent_queue 和 bounded_queue 在不同读写者比例下的吞吐量
+ * 写者推送带有字符串成员的元素（模拟 rabbitmq 的待发送报告），读者用 pop_for 阻塞等待并弹出，
+ * 测试读多写少、写多读少和读写均衡三种情况。
+ *
+ * 用法：concurrent_queue_benchmark [每个写者推送的元素数] [bounded_queue 的容量]
+ */
+
+struct message {
+    string body;
+    string routing_key;
+};
+
+// 原来的实现：std::queue 加一把互斥锁，弹出时拷贝元素
+struct mutex_queue {
+    bool try_pop(message &element) {
+        unique_lock<mutex> mlock(mut);
+        if (q.empty()) return false;
+        element = q.front();
+        q.pop();
+        return true;
+    }
+
+    template <typename Rep, typename Period>
+    bool pop_for(message &element, const chrono::duration<Rep, Period> &timeout) {
+        unique_lock<mutex> mlock(mut);
+        cond.wait_for(mlock, timeout, [&] { return !q.empty(); });
+        if (q.empty()) return false;
+        element = q.front();
+        q.pop();
+        return true;
+    }
+
+    void push(const message &value) {
+        unique_lock<mutex> mlock(mut);
+        q.push(value);
+        mlock.unlock();
+        cond.notify_one();
+    }
+
+private:
+    queue<message> q;
+    mutex mut;
+    condition_variable cond;
+};
+
+template <typename Queue>
+void push(Queue &queue, message &&value) {
+    queue.push(move(value));
+}
+
+template <typename Queue>
+double run(Queue &queue, size_t producers, size_t consumers, size_t messages_per_producer) {
+    vector<thread> threads;
+    atomic<bool> start = false;
+    atomic<size_t> popped = 0;
+    const size_t total = producers * messages_per_producer;
+
+    for (size_t i = 0; i < producers; ++i) {
+        threads.emplace_back([&, i] {
+            while (!start) this_thread::yield();
+            for (size_t j = 0; j < messages_per_producer; ++j)
+                push(queue, {"{\"sub_id\":" + to_string(i * messages_per_producer + j) + ",\"report\":\"judge result payload\"}", "judge_report"});
+        });
+    }
+    for (size_t i = 0; i < consumers; ++i) {
+        threads.emplace_back([&] {
+            while (!start) this_thread::yield();
+            message value;
+            while (popped < total)
+                if (queue.pop_for(value, chrono::milliseconds(10)))
+                    ++popped;
+        });
+    }
+
+    auto begin = chrono::steady_clock::now();
+    start = true;
+    for (auto &thd : threads) thd.join();
+    auto end = chrono::steady_clock::now();
+
+    double seconds = chrono::duration<double>(end - begin).count();
+    return total / seconds;
+}
+
+int main(int argc, char *argv[]) {
+    size_t messages_per_producer = argc > 1 ? stoul(argv[1]) : 200000;
+    size_t capacity = argc > 2 ? stoul(argv[2]) : 1024;
+
+    cout << setw(14) << "producers" << setw(12) << "consumers"
+         << setw(18) << "mutex_queue op/s" << setw(23) << "concurrent_queue op/s" << setw(20) << "bounded_queue op/s" << endl;
+    for (auto [producers, consumers] : vector<pair<size_t, size_t>>{{1, 1}, {1, 8}, {8, 1}, {4, 4}, {16, 16}}) {
+        size_t per_producer = messages_per_producer / producers;
+
+        mutex_queue baseline;
+        double baseline_ops = run(baseline, producers, consumers, per_producer);
+
+        judge::concurrent_queue<message> unbounded;
+        double unbounded_ops = run(unbounded, producers, consumers, per_producer);
+
+        judge::bounded_queue<message> bounded(capacity);
+        double bounded_ops = run(bounded, producers, consumers, per_producer);
+
+        cout << setw(14) << producers << setw(12) << consumers
+             << setw(18) << fixed << setprecision(0) << baseline_ops
+             << setw(23) << unbounded_ops
+             << setw(20) << bounded_ops << endl;
+    }
+    return 0;
+}
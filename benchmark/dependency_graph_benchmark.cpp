@@ -0,0 +1,159 @@
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "judge/dependency_graph.hpp"
+using namespace std;
+
+/**
+ * 比较 process 中逐个遍历评测任务和使用 dependency_graph 处理依赖关系的开销
+ * 模拟一个提交的完整评测过程：评测任务按照推送顺序依次评测结束，每个评测任务结束后
+ * 查找依赖它的评测任务并推送（或者在依赖不满足时跳过整棵子树），然后判断提交是否评测完成。
+ *
+ * 用法：dependency_graph_benchmark [评测任务数] [重复次数]
+ */
+
+enum class task_state { PENDING, RUNNING, FINISHED };
+
+// 原来的实现：遍历所有评测任务寻找子任务，递归跳过子树，遍历所有结果判断是否还有正在评测的任务
+struct naive_submission {
+    const vector<int> &depends_on;
+    vector<task_state> states;
+    size_t finished = 0;
+    size_t checks = 0;
+
+    explicit naive_submission(const vector<int> &depends_on)
+        : depends_on(depends_on), states(depends_on.size(), task_state::PENDING) {}
+
+    void process(size_t id, bool satisfied, deque<size_t> &queue, bool is_summarize = true) {
+        states[id] = task_state::FINISHED;
+        for (size_t i = 0; i < depends_on.size(); ++i) {
+            if (depends_on[i] == (int)id) {
+                if (satisfied) {
+                    states[i] = task_state::RUNNING;
+                    queue.push_back(i);
+                } else {
+                    process(i, false, queue, false);
+                }
+            }
+        }
+        ++finished;
+        if (!is_summarize || finished == depends_on.size()) return;
+        for (size_t i = 0; i < depends_on.size(); ++i) {
+            ++checks;
+            if (states[i] == task_state::RUNNING) break;
+        }
+    }
+};
+
+// 新的实现：使用预先计算的依赖关系图
+struct graph_submission {
+    judge::dependency_graph graph;
+    size_t checks = 0;
+
+    explicit graph_submission(const vector<int> &depends_on) : graph(depends_on) {}
+
+    void skip_subtree(size_t id) {
+        vector<size_t> stack = {id};
+        while (!stack.empty()) {
+            size_t i = stack.back();
+            stack.pop_back();
+            graph.skip(i);
+            auto &children = graph.children(i);
+            stack.insert(stack.end(), children.begin(), children.end());
+        }
+    }
+
+    void process(size_t id, bool satisfied, deque<size_t> &queue) {
+        graph.finish(id);
+        for (size_t i : graph.children(id)) {
+            if (satisfied) {
+                graph.start(i);
+                queue.push_back(i);
+            } else {
+                skip_subtree(i);
+            }
+        }
+        if (!graph.completed()) checks += graph.running() > 0;
+    }
+};
+
+/**
+ * @param fail 评测结束时依赖不满足的评测任务，模拟未通过标准测试导致后续测试被跳过
+ * @return 每个提交的平均处理时间（微秒）
+ */
+template <typename Submission>
+double run(const vector<int> &depends_on, const vector<bool> &fail, size_t repeat) {
+    size_t checks = 0;
+    auto begin = chrono::steady_clock::now();
+    for (size_t r = 0; r < repeat; ++r) {
+        Submission submit(depends_on);
+        deque<size_t> queue;
+        for (size_t i = 0; i < depends_on.size(); ++i) {
+            if (depends_on[i] < 0) queue.push_back(i);
+        }
+        if constexpr (is_same_v<Submission, graph_submission>) {
+            for (size_t i : queue) submit.graph.start(i);
+        }
+        while (!queue.empty()) {
+            size_t id = queue.front();
+            queue.pop_front();
+            submit.process(id, !fail[id], queue);
+        }
+        checks += submit.checks;
+    }
+    auto end = chrono::steady_clock::now();
+    // 防止编译器优化掉整个评测过程
+    if (checks == (size_t)-1) cout << checks;
+    return chrono::duration<double, micro>(end - begin).count() / repeat;
+}
+
+int main(int argc, char *argv[]) {
+    size_t tasks = argc > 1 ? stoul(argv[1]) : 1000;
+    size_t repeat = argc > 2 ? stoul(argv[2]) : 100;
+
+    struct scenario {
+        string name;
+        vector<int> depends_on;
+        vector<bool> fail;
+    };
+    vector<scenario> scenarios;
+
+    {  // 编译任务之后是全部依赖编译任务的标准测试
+        scenario s{"compile + standard", vector<int>(tasks, 0), vector<bool>(tasks, false)};
+        s.depends_on[0] = -1;
+        scenarios.push_back(s);
+    }
+
+    {  // 每个标准测试之后是依赖它的内存测试，一半的标准测试未通过
+        scenario s{"standard + memory", vector<int>(tasks, 0), vector<bool>(tasks, false)};
+        s.depends_on[0] = -1;
+        for (size_t i = 1; i < tasks; ++i) {
+            if (i % 2 == 0) s.depends_on[i] = i - 1;
+            if (i % 4 == 1) s.fail[i] = true;
+        }
+        scenarios.push_back(s);
+    }
+
+    {  // 编译失败，所有评测任务被跳过
+        scenario s{"compilation error", vector<int>(tasks, 0), vector<bool>(tasks, false)};
+        s.depends_on[0] = -1;
+        s.fail[0] = true;
+        scenarios.push_back(s);
+    }
+
+    cout << setw(20) << "scenario" << setw(14) << "rescan us" << setw(14) << "graph us" << setw(10) << "speedup" << endl;
+    for (auto &s : scenarios) {
+        double naive = run<naive_submission>(s.depends_on, s.fail, repeat);
+        double graph = run<graph_submission>(s.depends_on, s.fail, repeat);
+        cout << setw(20) << s.name
+             << setw(14) << fixed << setprecision(1) << naive
+             << setw(14) << graph
+             << setw(10) << setprecision(2) << naive / graph << endl;
+    }
+    return 0;
+}
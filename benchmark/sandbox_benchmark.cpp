@@ -0,0 +1,145 @@
+#include <sched.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "judge/sandbox_pool.hpp"
+using namespace std;
+namespace fs = std::filesystem;
+
+/**
+ * 比较每个测试点准备 chroot 环境的开销：原来 runguard 在新的 mount namespace 中挂载 chroot 环境的 overlay、
+ * 绑定 /proc 并创建字符设备，进程退出时内核卸载这些挂载点；使用 sandbox_pool 时只需要取出预先挂载好的运行环境，
+ * 运行环境的重置由后台线程在测试点运行期间完成。两种方式都会 unshare 一个新的 mount namespace，与 runguard 一致。
+ * 每次准备好运行环境后等待一段时间模拟选手程序的运行，只统计准备运行环境的耗时。
+ *
+ * 需要 root 权限。
+ * 用法：sandbox_benchmark <chroot 文件夹> [临时文件夹] [每个线程运行的次数] [模拟的运行时间，单位为毫秒]
+ */
+
+static fs::path workdir;
+static fs::path chrootdir;
+static chrono::milliseconds runtime;
+
+// 在子进程中模拟 runguard 的行为，返回子进程是否成功
+template <typename F>
+static bool in_namespace(F &&f) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (unshare(CLONE_NEWNS) != 0) _exit(1);
+        if (mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) != 0) _exit(1);
+        _exit(f() ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// 原来的实现：每次运行都在运行文件夹中挂载 chroot 环境
+static bool mount_per_run(int thread, int run, chrono::nanoseconds &setup) {
+    fs::path rundir = workdir / "per-run" / (to_string(thread) + "-" + to_string(run));
+    fs::path work = rundir / "work", ofs = rundir / "ofs", merged = rundir / "merged";
+    fs::create_directories(work);
+    fs::create_directories(ofs);
+    fs::create_directories(merged);
+
+    auto begin = chrono::steady_clock::now();
+    bool ok = in_namespace([&] {
+        string options = "lowerdir=" + chrootdir.string() + ",upperdir=" + work.string() + ",workdir=" + ofs.string();
+        if (mount("overlay", merged.c_str(), "overlay", 0, options.c_str()) != 0) return false;
+        fs::path proc = merged / "proc", dev = merged / "dev";
+        mkdir(proc.c_str(), 0755);
+        if (mount("/proc", proc.c_str(), nullptr, MS_BIND, nullptr) != 0) return false;
+        mkdir(dev.c_str(), 0755);
+        for (auto [name, major, minor] : {tuple{"full", 1, 7}, {"null", 1, 3}, {"ptmx", 5, 2}, {"random", 1, 8}, {"tty", 5, 0}, {"urandom", 1, 9}}) {
+            fs::path path = dev / name;
+            unlink(path.c_str());
+            if (mknod(path.c_str(), S_IFCHR | 0666, makedev(major, minor)) != 0) return false;
+        }
+        return true;
+    });
+    setup = chrono::steady_clock::now() - begin;
+    this_thread::sleep_for(runtime);
+    fs::remove_all(rundir);
+    return ok;
+}
+
+static bool mount_pooled(judge::sandbox_pool &pool, int thread, chrono::nanoseconds &setup) {
+    auto begin = chrono::steady_clock::now();
+    auto sandbox = pool.acquire(thread);
+    if (!sandbox) return false;
+    bool ok = in_namespace([&] { return fs::exists(sandbox.root() / "dev" / "null"); });
+    setup = chrono::steady_clock::now() - begin;
+    this_thread::sleep_for(runtime);
+    return ok;
+}
+
+// 返回平均每次运行准备运行环境的耗时
+template <typename F>
+static double run(int threads, int count, F &&f) {
+    atomic<int> failures = 0;
+    atomic<long long> total = 0;
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < count; ++i) {
+                chrono::nanoseconds setup(0);
+                if (!f(t, i, setup)) ++failures;
+                total += setup.count();
+            }
+        });
+    for (auto &worker : workers) worker.join();
+    if (failures > 0) cerr << failures << " runs failed" << endl;
+    return total / 1000.0 / threads / count;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <chrootdir> [workdir] [runs per thread]" << endl;
+        return 1;
+    }
+    if (geteuid() != 0) {
+        cerr << "sandbox_benchmark must be run as root" << endl;
+        return 1;
+    }
+    chrootdir = fs::absolute(argv[1]);
+    workdir = fs::absolute(argc > 2 ? argv[2] : "/tmp/sandbox_benchmark");
+    int count = argc > 3 ? stoi(argv[3]) : 100;
+    runtime = chrono::milliseconds(argc > 4 ? stoi(argv[4]) : 10);
+
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+
+    cout << "runs per thread: " << count << ", runtime: " << runtime.count() << "ms" << endl;
+    cout << setw(8) << "threads" << setw(20) << "per-run setup (us)" << setw(20) << "pooled setup (us)" << endl;
+    unsigned cores = max(thread::hardware_concurrency(), 1u);
+    for (unsigned threads : {1u, 4u, cores, 64u}) {
+        double per_run = run(threads, count, mount_per_run);
+
+        // 每个线程相当于一个 worker，使用自己编号的运行环境
+        double pooled;
+        {
+            judge::sandbox_pool pool(workdir / "pool", chrootdir, 2, 64 << 20);
+            set<unsigned> ids;
+            for (unsigned t = 0; t < threads; ++t) ids.insert(t);
+            pool.prepare(ids);
+            pooled = run(threads, count, [&](int t, int, chrono::nanoseconds &setup) { return mount_pooled(pool, t, setup); });
+        }
+        cout << setw(8) << threads << setw(20) << fixed << setprecision(1) << per_run << setw(20) << pooled << endl;
+    }
+    fs::remove_all(workdir);
+    return 0;
+}
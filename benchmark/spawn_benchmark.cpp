@@ -0,0 +1,82 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/utils.hpp"
+using namespace std;
+
+/**
+ * 比较原来的 fork + execvp + waitpid 和 process_builder（posix_spawn + pidfd）启动外部程序的延迟
+ * 评测系统进程中有大量缓存时 fork 需要复制的页表很大，因此先分配并写入指定大小的内存，
+ * 再用不同数量的线程并发启动 /bin/true，统计每次启动到回收子进程的平均延迟。
+ *
+ * 用法：spawn_benchmark [每个线程启动的进程数] [父进程占用的内存，单位为 MB]
+ */
+
+// 原来的实现：fork 后在子进程中设置环境变量，再 execvp
+static int fork_exec(const char **argv) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGINT, SIG_IGN);
+        setenv("BENCHMARK", "1", 1);
+        execvp(argv[0], (char **)argv);
+        _exit(EXIT_FAILURE);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int spawn(const char **argv) {
+    return process_builder().environment("BENCHMARK", 1).run(argv[0]);
+}
+
+template <typename F>
+static double run(int threads, int count, F &&f) {
+    const char *argv[] = {"/bin/true", nullptr};
+    atomic<int> failures = 0;
+    auto begin = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&] {
+            for (int i = 0; i < count; ++i)
+                if (f(argv) != 0) ++failures;
+        });
+    for (auto &worker : workers) worker.join();
+    auto elapsed = chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count();
+    if (failures > 0) cerr << failures << " spawns failed" << endl;
+    // 每个线程串行启动进程，因此平均延迟为总时间除以每个线程启动的进程数
+    return elapsed / count;
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? stoi(argv[1]) : 200;
+    size_t memory = (argc > 2 ? stoul(argv[2]) : 1024) << 20;
+
+    // 不输出 process_builder 的调试日志
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+
+    // 模拟评测系统的缓存，写入内存以确保页表已经建立
+    vector<char> cache(memory);
+    memset(cache.data(), 1, cache.size());
+
+    cout << "parent memory: " << (memory >> 20) << "MB, spawns per thread: " << count << endl;
+    cout << setw(8) << "threads" << setw(20) << "fork+exec (us)" << setw(20) << "posix_spawn (us)" << endl;
+    unsigned cores = max(thread::hardware_concurrency(), 1u);
+    for (unsigned threads : {1u, 4u, cores, cores * 4}) {
+        double forked = run(threads, count, fork_exec);
+        double spawned = run(threads, count, spawn);
+        cout << setw(8) << threads << setw(20) << fixed << setprecision(1) << forked << setw(20) << spawned << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/concurrent_queue.hpp"
+#include "common/work_stealing_queue.hpp"
+using namespace std;
+
+/**
+ * 比较 concurrent_queue 和 work_stealing_queue 的推送、弹出吞吐量
+ * 每个线程模拟一个 worker：弹出一个任务后推送若干个后续任务（类似 process 推送依赖当前数据点的数据点），
+ * 在队列为空时结束。任务带有字符串成员，模拟 client_task 的拷贝开销。
+ *
+ * 用法：task_queue_benchmark [每个线程的初始任务数]
+ */
+
+struct task {
+    size_t id;
+    string name;
+    size_t fanout;
+};
+
+template <typename Queue>
+void attach(Queue &, size_t) {}
+
+template <typename T>
+void attach(judge::work_stealing_queue<T> &queue, size_t slot) {
+    queue.attach(slot);
+}
+
+template <typename Queue>
+double run(Queue &queue, size_t threads, size_t tasks_per_thread) {
+    vector<thread> workers;
+    atomic<size_t> ready = 0;
+    atomic<bool> start = false;
+    atomic<size_t> processed = 0;
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i] {
+            attach(queue, i);
+            for (size_t j = 0; j < tasks_per_thread; ++j)
+                queue.push({j, "testcase-" + to_string(j), 3});
+            ++ready;
+            while (!start) this_thread::yield();
+
+            size_t local = 0;
+            task t;
+            while (queue.try_pop(t)) {
+                ++local;
+                // 每个根任务推送 fanout 个子任务，子任务不再推送
+                for (size_t k = 0; k < t.fanout; ++k)
+                    queue.push({t.id, t.name, 0});
+            }
+            processed += local;
+        });
+    }
+    while (ready < threads) this_thread::yield();
+    auto begin = chrono::steady_clock::now();
+    start = true;
+    for (auto &worker : workers) worker.join();
+    auto end = chrono::steady_clock::now();
+
+    // 每个被处理的任务都经历了一次推送和一次弹出
+    double seconds = chrono::duration<double>(end - begin).count();
+    return processed / seconds;
+}
+
+int main(int argc, char *argv[]) {
+    size_t tasks_per_thread = argc > 1 ? stoul(argv[1]) : 20000;
+
+    cout << setw(8) << "threads" << setw(24) << "concurrent_queue op/s" << setw(26) << "work_stealing_queue op/s" << setw(10) << "speedup" << endl;
+    for (size_t threads : {8, 32, 64}) {
+        judge::concurrent_queue<task> global;
+        double global_ops = run(global, threads, tasks_per_thread);
+
+        judge::work_stealing_queue<task> stealing(threads);
+        double stealing_ops = run(stealing, threads, tasks_per_thread);
+
+        cout << setw(8) << threads
+             << setw(24) << fixed << setprecision(0) << global_ops
+             << setw(26) << stealing_ops
+             << setw(10) << setprecision(2) << stealing_ops / global_ops << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+#include "judge/compare.hpp"
+
+using namespace std;
+using namespace judge;
+namespace fs = std::filesystem;
+
+/**
+ * 原生比较器，替代 exec/compare 中基于 diff 的比较脚本，比较方式由编译时的 COMPARE_MODE 决定
+ * 用法：run <std.in> <user.out> <std.out> [feedback]
+ * 返回值：42 为 Accepted，43 为 Wrong Answer，44 为 Presentation Error，1 为内部错误
+ * 第一处不同的位置输出到标准输出，评测系统会将其附加到评测日志中
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " <std.in> <user.out> <std.out> [feedback]" << endl;
+        return EXIT_FAILURE;
+    }
+
+    auto mode = parse_compare_mode(COMPARE_MODE);
+    if (!mode) {
+        cerr << "Unknown compare mode " << COMPARE_MODE << endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        mapped_file user(fs::path(argv[2]) / "testdata.out"), answer(fs::path(argv[3]) / "testdata.out");
+        compare_report report = compare_output(user.view(), answer.view(), *mode);
+        if (report.result != RESULT_AC) {
+            cout << (report.result == RESULT_WA ? "Wrong Answer" : "Presentation Error") << "\n"
+                 << describe_difference(user.view(), answer.view(), report) << flush;
+        }
+        return report.result;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
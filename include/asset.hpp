@@ -2,6 +2,8 @@
 
 #include <filesystem>
 #include <memory>
+#include <optional>
+#include <string>
 
 namespace judge {
 
@@ -29,6 +31,13 @@ struct asset {
      */
     virtual void fetch(const std::filesystem::path &dir) = 0;
 
+    /**
+     * @brief 读取文件内容，用于计算评测结果缓存的键，见 result_cache
+     * @param content 保存文件内容
+     * @return 无法读取文件内容时返回 false
+     */
+    virtual bool read_content(std::string &content);
+
     virtual ~asset() = default;
 };
 
@@ -41,6 +50,7 @@ struct local_asset : public asset {
     local_asset(const std::string &name, const std::filesystem::path &path);
 
     void fetch(const std::filesystem::path &dir) override;
+    bool read_content(std::string &content) override;
 };
 
 /**
@@ -52,6 +62,7 @@ struct text_asset : public asset {
     text_asset(const std::string &name, const std::string &text);
 
     void fetch(const std::filesystem::path &dir) override;
+    bool read_content(std::string &content) override;
 };
 
 /**
@@ -63,6 +74,14 @@ struct remote_asset : public asset {
     remote_asset(const std::string &name, const std::string &url_get);
 
     void fetch(const std::filesystem::path &dir) override;
+
+    /**
+     * @brief 下载文件并读取内容，下载的内容会保存下来，之后 fetch 时不再重复下载
+     */
+    bool read_content(std::string &content) override;
+
+private:
+    std::optional<std::string> downloaded;
 };
 
 typedef std::shared_ptr<asset> asset_ptr;
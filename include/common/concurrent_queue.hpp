@@ -1,27 +1,140 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <mutex>
-#include <queue>
+#include <optional>
+#include <utility>
+#include <vector>
 
 namespace judge {
 
 /**
- * @brief 并发队列，写者读者模型
+ * @brief 无锁队列的阻塞等待辅助
+ * 等待线程登记后在互斥锁下重试，生产者只有在存在等待线程时才需要加锁唤醒，
+ * 因此没有线程等待时推送和弹出不会触碰这里的互斥锁。
+ */
+class queue_waiters {
+public:
+    /**
+     * @brief 阻塞直到 attempt 返回 true、被 wake_one/wake_all 唤醒或者超过 deadline
+     * @param attempt 非阻塞地尝试完成操作
+     * @param deadline 截止时间，为 nullptr 时不会超时
+     * @return attempt 是否成功
+     */
+    template <typename Attempt>
+    bool wait(Attempt &&attempt, const std::chrono::steady_clock::time_point *deadline) {
+        std::unique_lock<std::mutex> mlock(mut);
+        std::size_t current_epoch = epoch;
+        waiting.fetch_add(1);
+        // 与 notify 中的内存屏障配对：要么 attempt 看到了生产者的修改，要么生产者看到了等待线程
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool result = false;
+        while (true) {
+            if (attempt()) {
+                result = true;
+                break;
+            }
+            if (epoch != current_epoch) break;
+            if (wakeups > 0) {
+                --wakeups;
+                break;
+            }
+            if (!deadline) {
+                cond.wait(mlock);
+            } else if (cond.wait_until(mlock, *deadline) == std::cv_status::timeout) {
+                result = attempt();
+                break;
+            }
+        }
+        waiting.fetch_sub(1);
+        return result;
+    }
+
+    /**
+     * @brief 生产者完成操作后唤醒一个等待线程
+     */
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) == 0) return;
+        // 等待线程在检查和睡眠之间一直持有锁，加锁保证唤醒不会丢失
+        { std::lock_guard<std::mutex> mlock(mut); }
+        cond.notify_one();
+    }
+
+    /**
+     * @brief 唤醒一个等待线程，如果当前没有线程在等待，那么下一个开始等待的线程会立刻返回
+     */
+    void wake_one() {
+        std::unique_lock<std::mutex> mlock(mut);
+        ++wakeups;
+        mlock.unlock();
+        cond.notify_one();
+    }
+
+    /**
+     * @brief 唤醒所有正在等待的线程
+     */
+    void wake_all() {
+        std::unique_lock<std::mutex> mlock(mut);
+        ++epoch;
+        mlock.unlock();
+        cond.notify_all();
+    }
+
+private:
+    std::mutex mut;
+    std::condition_variable cond;
+    std::atomic<std::size_t> waiting = 0;
+
+    // wake_one 发出但还没有被等待线程消费的唤醒次数
+    std::size_t wakeups = 0;
+
+    // wake_all 的次数，等待线程发现该值变化后返回
+    std::size_t epoch = 0;
+};
+
+/**
+ * @brief 无界并发队列，多写者多读者模型
+ * 采用 Michael-Scott 双锁链表队列：推送只锁队尾，弹出只锁队头，读者和写者之间没有锁竞争。
+ * 元素在入队和出队时都是移动而不是拷贝。
  * @param <T> 队列元素类型
  */
 template <typename T>
 struct concurrent_queue {
+    concurrent_queue() : head(new node), tail(head) {}
+
+    concurrent_queue(const concurrent_queue &) = delete;
+    concurrent_queue &operator=(const concurrent_queue &) = delete;
+
+    ~concurrent_queue() {
+        while (head) {
+            node *next = head->next.load(std::memory_order_relaxed);
+            delete head;
+            head = next;
+        }
+    }
+
     /**
      * @brief 尝试从队列中弹出队头元素，如果队列为空返回 false
      * @param element 如果队列有元素，则保存队头元素，否则不变
      * @return 是否成功弹出队列头元素
      */
     bool try_pop(T &element) {
-        std::unique_lock<std::mutex> mlock(mut);
-        if (q.empty()) return false;
-        element = q.front();
-        q.pop();
+        std::unique_lock<std::mutex> mlock(head_mut);
+        node *first = head->next.load(std::memory_order_acquire);
+        if (!first) return false;
+        element = std::move(*first->value);
+        // first 成为新的哨兵节点
+        first->value.reset();
+        node *old = head;
+        head = first;
+        mlock.unlock();
+        delete old;
         return true;
     }
 
@@ -30,27 +143,262 @@ struct concurrent_queue {
      * @return 队列头元素
      */
     T pop() {
-        std::unique_lock<std::mutex> mlock(mut);
-        while (q.empty()) cond.wait(mlock);
-        auto result = q.front();
-        q.pop();
+        T result;
+        while (!wait_pop(result)) continue;
         return result;
     }
 
+    /**
+     * @brief 从队列中弹出队头元素，如果队列为空则阻塞等待，直到有元素或者被 wake_one/wake_all 唤醒为止
+     * @param element 如果队列有元素，则保存队头元素，否则不变
+     * @return 是否成功弹出队列头元素，被唤醒时返回 false
+     */
+    bool wait_pop(T &element) {
+        if (try_pop(element)) return true;
+        return waiters.wait([&] { return try_pop(element); }, nullptr);
+    }
+
+    /**
+     * @brief 从队列中弹出队头元素，如果队列为空则至多阻塞等待 timeout 时长
+     * @param element 如果队列有元素，则保存队头元素，否则不变
+     * @param timeout 最长等待时间
+     * @return 是否成功弹出队列头元素，超时或者被唤醒时返回 false
+     */
+    template <typename Rep, typename Period>
+    bool pop_for(T &element, const std::chrono::duration<Rep, Period> &timeout) {
+        if (try_pop(element)) return true;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        return waiters.wait([&] { return try_pop(element); }, &deadline);
+    }
+
     /**
      * @brief 向队列中插入一个新元素
      */
     void push(const T &value) {
-        std::unique_lock<std::mutex> mlock(mut);
-        q.push(value);
-        mlock.unlock();
-        cond.notify_one();
+        push_node(new node(value));
+    }
+
+    /**
+     * @brief 向队列中移入一个新元素
+     */
+    void push(T &&value) {
+        push_node(new node(std::move(value)));
+    }
+
+    /**
+     * @brief 唤醒一个正在 wait_pop/pop_for 中等待的线程，即使队列为空
+     * 如果当前没有线程在等待，那么下一个开始等待的线程会立刻返回
+     */
+    void wake_one() {
+        waiters.wake_one();
+    }
+
+    /**
+     * @brief 唤醒所有正在 wait_pop/pop_for 中等待的线程，即使队列为空
+     */
+    void wake_all() {
+        waiters.wake_all();
     }
 
 private:
-    std::queue<T> q;
-    std::mutex mut;
-    std::condition_variable cond;
+    struct node {
+        node() = default;
+
+        template <typename U>
+        explicit node(U &&value) : value(std::forward<U>(value)) {}
+
+        // 哨兵节点没有值
+        std::optional<T> value;
+        std::atomic<node *> next = nullptr;
+    };
+
+    // 弹出时移动 head，推送时移动 tail，两者分别加锁
+    node *head;
+    node *tail;
+    std::mutex head_mut;
+    std::mutex tail_mut;
+    queue_waiters waiters;
+
+    void push_node(node *n) {
+        {
+            std::lock_guard<std::mutex> mlock(tail_mut);
+            tail->next.store(n, std::memory_order_release);
+            tail = n;
+        }
+        waiters.notify();
+    }
+};
+
+/**
+ * @brief 有界并发队列，多写者多读者模型
+ * 采用 Vyukov 的无锁环形队列：每个槽位带有序号，写者和读者通过 CAS 领取槽位，不需要加锁。
+ * 队列满时推送阻塞（或者超时失败），可以用来限制生产者的速度。
+ * @param <T> 队列元素类型
+ */
+template <typename T>
+struct bounded_queue {
+    /**
+     * @param capacity 队列容量，将向上取整为 2 的幂
+     */
+    explicit bounded_queue(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        cells = std::vector<cell>(size);
+        for (std::size_t i = 0; i < size; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bounded_queue(const bounded_queue &) = delete;
+    bounded_queue &operator=(const bounded_queue &) = delete;
+
+    /**
+     * @brief 队列容量
+     */
+    std::size_t capacity() const {
+        return mask + 1;
+    }
+
+    /**
+     * @brief 尝试向队列中移入一个新元素，如果队列已满返回 false
+     * @param value 推送成功时被移走，否则不变
+     */
+    bool try_push(T &&value) {
+        if (!enqueue(value)) return false;
+        not_empty.notify();
+        return true;
+    }
+
+    /**
+     * @brief 向队列中移入一个新元素，如果队列已满则阻塞等待，直到有空位或者被 wake_all 唤醒为止
+     * @return 是否成功推送，被唤醒时返回 false
+     */
+    bool push(T &&value) {
+        if (try_push(std::move(value))) return true;
+        if (!not_full.wait([&] { return enqueue(value); }, nullptr)) return false;
+        not_empty.notify();
+        return true;
+    }
+
+    /**
+     * @brief 向队列中移入一个新元素，如果队列已满则至多阻塞等待 timeout 时长
+     * @return 是否成功推送，超时或者被唤醒时返回 false
+     */
+    template <typename Rep, typename Period>
+    bool push_for(T &&value, const std::chrono::duration<Rep, Period> &timeout) {
+        if (try_push(std::move(value))) return true;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        if (!not_full.wait([&] { return enqueue(value); }, &deadline)) return false;
+        not_empty.notify();
+        return true;
+    }
+
+    /**
+     * @brief 尝试从队列中弹出队头元素，如果队列为空返回 false
+     * @param element 如果队列有元素，则保存队头元素，否则不变
+     */
+    bool try_pop(T &element) {
+        if (!dequeue(element)) return false;
+        not_full.notify();
+        return true;
+    }
+
+    /**
+     * @brief 从队列中弹出队头元素，如果队列为空则阻塞等待，直到有元素或者被 wake_one/wake_all 唤醒为止
+     * @return 是否成功弹出队列头元素，被唤醒时返回 false
+     */
+    bool wait_pop(T &element) {
+        if (try_pop(element)) return true;
+        if (!not_empty.wait([&] { return dequeue(element); }, nullptr)) return false;
+        not_full.notify();
+        return true;
+    }
+
+    /**
+     * @brief 从队列中弹出队头元素，如果队列为空则至多阻塞等待 timeout 时长
+     * @return 是否成功弹出队列头元素，超时或者被唤醒时返回 false
+     */
+    template <typename Rep, typename Period>
+    bool pop_for(T &element, const std::chrono::duration<Rep, Period> &timeout) {
+        if (try_pop(element)) return true;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        if (!not_empty.wait([&] { return dequeue(element); }, &deadline)) return false;
+        not_full.notify();
+        return true;
+    }
+
+    /**
+     * @brief 唤醒一个正在 wait_pop/pop_for 中等待的线程，即使队列为空
+     */
+    void wake_one() {
+        not_empty.wake_one();
+    }
+
+    /**
+     * @brief 唤醒所有正在等待的读者和写者
+     */
+    void wake_all() {
+        not_empty.wake_all();
+        not_full.wake_all();
+    }
+
+private:
+    struct cell {
+        // 等于位置时可写，等于位置 + 1 时可读
+        std::atomic<std::size_t> sequence;
+        std::optional<T> value;
+    };
+
+    std::vector<cell> cells;
+    std::size_t mask;
+
+    // 写者和读者的位置放在不同的缓存行上，避免伪共享
+    alignas(64) std::atomic<std::size_t> enqueue_pos = 0;
+    alignas(64) std::atomic<std::size_t> dequeue_pos = 0;
+
+    queue_waiters not_empty;
+    queue_waiters not_full;
+
+    bool enqueue(T &value) {
+        std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &cells[pos & mask];
+            std::size_t seq = c->sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;  // 队列已满
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        c->value.emplace(std::move(value));
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool dequeue(T &element) {
+        std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &cells[pos & mask];
+            std::size_t seq = c->sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;  // 队列为空
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        element = std::move(*c->value);
+        c->value.reset();
+        c->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
 };
 
 }  // namespace judge
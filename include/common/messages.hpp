@@ -1,8 +1,6 @@
 #pragma once
 
-#include <boost/thread/latch.hpp>
-#include <condition_variable>
-#include <mutex>
+#include <string>
 #include <vector>
 
 #include "judge/submission.hpp"
@@ -40,29 +38,12 @@ struct client_task {
      * @brief 执行该评测任务至多花费多少秒
      */
     double expect_runtime;
-};
-
-/**
- * @brief 获取CPU核心
- */
-struct core_request {
-    std::vector<size_t> *core_ids;
-
-    std::mutex *write_lock;
 
     /**
-     * @brief 在分配核心后从 worker 调用该锁
-     * 当核心数足够后锁被释放，主 worker 将开始评测
+     * @brief 与本测试点合并分发的其他测试点的 id
+     * 这些测试点与本测试点通过一次 runguard 批量运行，见 BATCH_CHECK_SIZE
      */
-    boost::latch *lock;
-
-    /**
-     * @brief 从 worker 的等待评测完成所用的锁
-     * 主 worker 在评测结束后将释放该锁
-     */
-    std::condition_variable *cv;
-
-    std::mutex *mut;
+    std::vector<std::size_t> batch;
 };
 
 }  // namespace judge::message
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace judge {
+
+/**
+ * @brief 调度策略，决定一个任务队列中元素的出队顺序
+ * 每个 worker 的本地队列都有一个调度策略实例，调度策略本身不需要考虑并发，
+ * 由 work_stealing_queue 负责加锁。
+ * @param <T> 队列元素类型
+ */
+template <typename T>
+struct scheduling_policy {
+    virtual ~scheduling_policy() = default;
+
+    /**
+     * @brief 加入一个元素
+     */
+    virtual void push(T &&element) = 0;
+
+    /**
+     * @brief 队列所属的 worker 取出下一个元素
+     * @return 队列为空时返回 false
+     */
+    virtual bool pop(T &element) = 0;
+
+    /**
+     * @brief 其他 worker 从该队列窃取一个元素
+     * @return 队列为空时返回 false
+     */
+    virtual bool steal(T &element) = 0;
+
+    /**
+     * @brief 移除所有满足条件的元素，剩余元素的出队顺序不变
+     * @return 移除的元素个数
+     */
+    virtual std::size_t remove_if(const std::function<bool(const T &)> &pred) = 0;
+
+    virtual bool empty() const = 0;
+
+    /**
+     * @brief 元素是否可以留在推送者的本地队列中
+     * 返回 false 时 work_stealing_queue 将所有元素推送到共享队列，出队顺序对所有 worker 全局成立，
+     * 代价是所有 worker 竞争同一个锁。
+     */
+    virtual bool per_worker() const {
+        return false;
+    }
+};
+
+/**
+ * @brief 局部性优先：所属 worker 先进先出，窃取者从队尾窃取
+ * worker 推送的元素（比如刚编译完成后的数据点）留在该 worker 的本地队列中，评测所需文件仍在缓存中。
+ * 所属 worker 按推送顺序评测，靠前的数据点先评测，开启 fail-fast 时可以尽早发现错误；
+ * 窃取者从队尾取走所属 worker 最晚才会评测的元素。
+ */
+template <typename T>
+struct locality_policy : public scheduling_policy<T> {
+    void push(T &&element) override {
+        elements.push_back(std::move(element));
+    }
+
+    bool pop(T &element) override {
+        if (elements.empty()) return false;
+        element = std::move(elements.front());
+        elements.pop_front();
+        return true;
+    }
+
+    bool steal(T &element) override {
+        if (elements.empty()) return false;
+        element = std::move(elements.back());
+        elements.pop_back();
+        return true;
+    }
+
+    std::size_t remove_if(const std::function<bool(const T &)> &pred) override {
+        auto it = std::remove_if(elements.begin(), elements.end(), pred);
+        std::size_t removed = elements.end() - it;
+        elements.erase(it, elements.end());
+        return removed;
+    }
+
+    bool empty() const override {
+        return elements.empty();
+    }
+
+    bool per_worker() const override {
+        return true;
+    }
+
+private:
+    std::deque<T> elements;
+};
+
+/**
+ * @brief 先进先出：所属 worker 和窃取者都按推送顺序取出元素
+ */
+template <typename T>
+struct fifo_policy : public locality_policy<T> {
+    bool steal(T &element) override {
+        return locality_policy<T>::pop(element);
+    }
+
+    bool per_worker() const override {
+        return false;
+    }
+};
+
+/**
+ * @brief 最短预计运行时间优先：每次取出 key 最小的元素，key 相同时先进先出
+ * @param key 计算元素预计运行时间的函数
+ */
+template <typename T>
+struct shortest_first_policy : public scheduling_policy<T> {
+    explicit shortest_first_policy(std::function<double(const T &)> key)
+        : key(std::move(key)) {}
+
+    void push(T &&element) override {
+        heap.push_back({key(element), sequence++, std::move(element)});
+        std::push_heap(heap.begin(), heap.end(), compare);
+    }
+
+    bool pop(T &element) override {
+        if (heap.empty()) return false;
+        std::pop_heap(heap.begin(), heap.end(), compare);
+        element = std::move(heap.back().element);
+        heap.pop_back();
+        return true;
+    }
+
+    bool steal(T &element) override {
+        // 窃取者同样优先评测最短的任务，以减少提交的平均等待时间
+        return pop(element);
+    }
+
+    std::size_t remove_if(const std::function<bool(const T &)> &pred) override {
+        auto it = std::remove_if(heap.begin(), heap.end(), [&](const entry &e) { return pred(e.element); });
+        std::size_t removed = heap.end() - it;
+        heap.erase(it, heap.end());
+        // 序号保证了 key 相同的元素仍然先进先出
+        std::make_heap(heap.begin(), heap.end(), compare);
+        return removed;
+    }
+
+    bool empty() const override {
+        return heap.empty();
+    }
+
+private:
+    struct entry {
+        double key;
+        std::size_t sequence;
+        T element;
+    };
+
+    // 大根堆的比较函数，使得 key 最小、推送最早的元素在堆顶
+    static bool compare(const entry &a, const entry &b) {
+        if (a.key != b.key) return a.key > b.key;
+        return a.sequence > b.sequence;
+    }
+
+    std::function<double(const T &)> key;
+    std::vector<entry> heap;
+    std::size_t sequence = 0;
+};
+
+/**
+ * @brief 公平调度：在不同分组（比如不同提交）之间轮流取出元素，组内先进先出
+ * 避免拥有大量任务的分组阻塞其他分组。
+ * @param group 计算元素所属分组的函数
+ */
+template <typename T, typename GroupT = unsigned>
+struct fair_share_policy : public scheduling_policy<T> {
+    explicit fair_share_policy(std::function<GroupT(const T &)> group)
+        : group(std::move(group)) {}
+
+    void push(T &&element) override {
+        GroupT id = group(element);
+        auto &elements = groups[id];
+        if (elements.empty()) rotation.push_back(id);
+        elements.push_back(std::move(element));
+    }
+
+    bool pop(T &element) override {
+        if (rotation.empty()) return false;
+        GroupT id = rotation.front();
+        rotation.pop_front();
+
+        auto it = groups.find(id);
+        element = std::move(it->second.front());
+        it->second.pop_front();
+        // 该分组还有元素，排到轮转队列的最后
+        if (it->second.empty())
+            groups.erase(it);
+        else
+            rotation.push_back(id);
+        return true;
+    }
+
+    bool steal(T &element) override {
+        return pop(element);
+    }
+
+    std::size_t remove_if(const std::function<bool(const T &)> &pred) override {
+        std::size_t removed = 0;
+        for (auto it = rotation.begin(); it != rotation.end();) {
+            auto &elements = groups[*it];
+            auto last = std::remove_if(elements.begin(), elements.end(), pred);
+            removed += elements.end() - last;
+            elements.erase(last, elements.end());
+            // 分组没有元素后退出轮转
+            if (elements.empty()) {
+                groups.erase(*it);
+                it = rotation.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return removed;
+    }
+
+    bool empty() const override {
+        return rotation.empty();
+    }
+
+private:
+    std::function<GroupT(const T &)> group;
+    std::map<GroupT, std::deque<T>> groups;
+    // 还有元素的分组，按轮转顺序排列
+    std::deque<GroupT> rotation;
+};
+
+}  // namespace judge
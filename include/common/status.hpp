@@ -140,7 +140,13 @@ enum class status {
      * @brief 内部错误，评测系统出错
      * 比如 runguard 或 server 或 client 出错。
      */
-    SYSTEM_ERROR = 20
+    SYSTEM_ERROR = 20,
+
+    /**
+     * @brief 提交的评测结果已经确定，当前评测任务被取消
+     * 启用 fail fast 的提交在有评测任务未通过后，剩余的评测任务不再评测，正在评测的评测任务将被终止。
+     */
+    SKIPPED = 21
 };
 
 const char *get_display_message(status);
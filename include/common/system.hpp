@@ -1,4 +1,16 @@
 #pragma once
 
 int get_userid(const char *name);
-int get_groupid(const char *name);
\ No newline at end of file
+int get_groupid(const char *name);
+
+/**
+ * @brief 获取 path 所在文件系统中非特权用户可用的空闲空间
+ * @return 空闲空间字节数，获取失败时返回 -1
+ */
+long long get_free_disk_space(const char *path);
+
+/**
+ * @brief 获取系统可用内存（/proc/meminfo 中的 MemAvailable）
+ * @return 可用内存字节数，获取失败时返回 -1
+ */
+long long get_available_memory();
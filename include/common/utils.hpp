@@ -1,5 +1,7 @@
 #pragma once
 
+#include <sys/types.h>
+
 #include <fmt/core.h>
 
 #include <boost/lexical_cast.hpp>
@@ -149,8 +151,38 @@ struct process_builder {
      */
     process_builder &directory(const std::filesystem::path &path);
 
+    /**
+     * @brief 程序运行期间每隔 period 秒在调用 run 的线程中调用一次 callback
+     * @param period 调用间隔，单位为秒
+     */
     process_builder &awake_period(int period, std::function<void()> callback);
 
+    /**
+     * @brief 获取程序所在的进程组，以便通过 kill(-pgid, sig) 终止程序及其产生的所有子进程
+     * 程序总是运行在新的进程组中
+     * @param callback 程序启动后在父进程中调用，参数为新进程组的 id（即子进程的 pid）
+     */
+    process_builder &process_group(std::function<void(pid_t)> callback);
+
+    /**
+     * @brief 将程序的标准输出和标准错误追加到文件中
+     * @param file 输出文件，不存在时创建
+     */
+    process_builder &output(const std::filesystem::path &file);
+
+    /**
+     * @brief 将文件描述符 fd 传给程序，在程序中的编号为 target
+     * 程序启动后 fd 在父进程中被关闭（无论启动是否成功），比如管道的一端交给程序后，父进程不再持有这一端
+     * @param fd 父进程中的文件描述符，应该设置 FD_CLOEXEC，避免被其他线程同时启动的程序继承
+     */
+    process_builder &pass_fd(int fd, int target);
+
+    /**
+     * @brief 关闭还没有传给程序的 fd
+     * 调用 pass_fd 后没能调用 run 启动程序时（比如准备参数时抛出了异常）需要调用，run 在返回或者抛出异常前都会调用
+     */
+    void close_passed_fds();
+
     /**
      * @brief 调用外部程序
      * @param args 转送给应用程序的参数列表，比如可以传入 filesystem::path 给 args[0] 来表示应用程序路径
@@ -185,6 +217,7 @@ struct process_builder {
 private:
     /**
      * @brief 执行外部命令
+     * 通过 posix_spawn 启动外部命令，通过 pidfd 等待外部命令结束
      * @param argv 外部命令的路径 (argv[0]) 和 参数 (argv)
      * @return 外部命令的返回值，如果外部命令因为信号崩溃而没有返回码，则返回 -1
      */
@@ -196,9 +229,16 @@ private:
     int period = -1;
     std::function<void()> callback;
 
+    std::function<void(pid_t)> group_callback;
+
     bool epath = false;
     std::filesystem::path path;
 
+    std::filesystem::path output_file;
+
+    // file descriptors passed to the child, (fd in parent, fd in child)
+    std::vector<std::pair<int, int>> passed_fds;
+
     int exitcode;
 };
 
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "common/scheduling_policy.hpp"
+
+namespace judge {
+
+/**
+ * @brief 支持任务窃取的并发队列
+ * 每个 worker 拥有一个本地双端队列，worker 推送的元素进入自己的本地队列尾部，
+ * 弹出时优先从本地队列头部取（先进先出，刚刚推送的任务所需的文件仍在缓存中），
+ * 本地队列为空时从共享队列头部取，再为空时从其他 worker 本地队列的尾部窃取。
+ * 不是 worker 的线程（比如单元测试的线程）推送的元素进入共享队列。
+ * 每个队列内部的出队顺序由调度策略决定，上述顺序为默认的 locality_policy。
+ * 其他调度策略的出队顺序需要对所有 worker 全局成立，元素都推送到共享队列，本地队列不会被使用。
+ *
+ * 这样 worker 之间只在窃取时才会竞争同一个锁，避免所有 worker 竞争同一个队列。
+ * @param <T> 队列元素类型
+ */
+template <typename T>
+struct work_stealing_queue {
+    typedef std::function<std::unique_ptr<scheduling_policy<T>>()> policy_factory;
+
+    /**
+     * @param slots 本地队列的个数，worker 调用 attach 时传入的编号必须小于该值
+     * @param factory 为每个队列创建调度策略的函数
+     */
+    explicit work_stealing_queue(std::size_t slots = 0, const policy_factory &factory = default_policy)
+        : local(slots) {
+        for (auto &slot : local) slot = std::make_unique<deque_slot>(factory());
+        shared = std::make_unique<deque_slot>(factory());
+        per_worker = shared->policy->per_worker();
+    }
+
+    work_stealing_queue(const work_stealing_queue &) = delete;
+    work_stealing_queue &operator=(const work_stealing_queue &) = delete;
+
+    /**
+     * @brief 将当前线程绑定到第 slot 个本地队列
+     * 绑定后当前线程推送的元素都会进入该本地队列
+     * @param slot 本地队列编号，一般为 worker 占有的 CPU id
+     */
+    void attach(std::size_t slot) {
+        if (slot >= local.size()) throw std::out_of_range("work_stealing_queue: slot out of range");
+        current_queue = this;
+        current_slot = slot;
+    }
+
+    /**
+     * @brief 尝试弹出一个元素，如果所有队列都为空返回 false
+     * @param element 如果成功弹出，则保存弹出的元素，否则不变
+     * @return 是否成功弹出元素
+     */
+    bool try_pop(T &element) {
+        if (count.load() == 0) return false;
+
+        std::size_t self = local.size();
+        if (current_queue == this) {
+            self = current_slot;
+            if (pop(*local[self], element)) return true;
+        }
+
+        if (pop(*shared, element)) return true;
+
+        // 从下一个 worker 开始轮流窃取，避免所有 worker 都从同一个 worker 窃取
+        for (std::size_t i = 1; i <= local.size(); ++i) {
+            std::size_t victim = (self + i) % local.size();
+            if (victim == self) continue;
+            if (steal(*local[victim], element)) return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief 弹出一个元素，如果所有队列都为空则阻塞等待直到有元素为止
+     * @return 弹出的元素
+     */
+    T pop() {
+        T element;
+        while (!wait_pop(element))
+            ;
+        return element;
+    }
+
+    /**
+     * @brief 弹出一个元素，如果所有队列都为空则阻塞等待，直到有元素或者被 wake_one/wake_all 唤醒为止
+     * @param element 如果成功弹出，则保存弹出的元素，否则不变
+     * @return 是否成功弹出元素，被唤醒时返回 false
+     */
+    bool wait_pop(T &element) {
+        std::unique_lock<std::mutex> mlock(park_mut);
+        std::size_t current_epoch = epoch;
+        while (true) {
+            mlock.unlock();
+            if (try_pop(element)) return true;
+            mlock.lock();
+
+            ++sleepers;
+            park_cond.wait(mlock, [&] { return count.load() > 0 || wakeups > 0 || epoch != current_epoch; });
+            --sleepers;
+            if (consume_wakeup(current_epoch)) return false;
+        }
+    }
+
+    /**
+     * @brief 弹出一个元素，如果所有队列都为空则至多阻塞等待 timeout 时长
+     * @param element 如果成功弹出，则保存弹出的元素，否则不变
+     * @param timeout 最长等待时间
+     * @return 是否成功弹出元素，超时或者被唤醒时返回 false
+     */
+    template <typename Rep, typename Period>
+    bool pop_for(T &element, const std::chrono::duration<Rep, Period> &timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::unique_lock<std::mutex> mlock(park_mut);
+        std::size_t current_epoch = epoch;
+        while (true) {
+            mlock.unlock();
+            if (try_pop(element)) return true;
+            mlock.lock();
+
+            ++sleepers;
+            bool ready = park_cond.wait_until(mlock, deadline, [&] { return count.load() > 0 || wakeups > 0 || epoch != current_epoch; });
+            --sleepers;
+            if (consume_wakeup(current_epoch) || !ready) return false;
+        }
+    }
+
+    /**
+     * @brief 推送一个元素
+     * 如果当前线程已经绑定到本地队列，则推送到本地队列，否则推送到共享队列
+     */
+    void push(const T &value) {
+        push(T(value));
+    }
+
+    /**
+     * @brief 推送一个元素
+     * 如果当前线程已经绑定到本地队列，则推送到本地队列，否则推送到共享队列
+     */
+    void push(T &&value) {
+        deque_slot &slot = current_queue == this && per_worker ? *local[current_slot] : *shared;
+        {
+            std::scoped_lock<std::mutex> lock(slot.mut);
+            slot.policy->push(std::move(value));
+            ++slot.size;
+            ++count;
+        }
+        notify();
+    }
+
+    /**
+     * @brief 从所有队列中移除满足条件的元素，比如取消一个提交的所有评测任务
+     * @param pred 判断元素是否需要移除的函数，调用时持有队列的锁，不可以在其中操作该队列
+     * @return 移除的元素个数
+     */
+    std::size_t remove_if(const std::function<bool(const T &)> &pred) {
+        std::size_t removed = 0;
+        for (auto &slot : local) removed += remove_if(*slot, pred);
+        removed += remove_if(*shared, pred);
+        return removed;
+    }
+
+    /**
+     * @brief 唤醒一个正在 wait_pop/pop_for 中等待的线程，即使队列为空
+     * 如果当前没有线程在等待，那么下一个开始等待的线程会立刻返回
+     */
+    void wake_one() {
+        std::unique_lock<std::mutex> mlock(park_mut);
+        ++wakeups;
+        mlock.unlock();
+        park_cond.notify_one();
+    }
+
+    /**
+     * @brief 唤醒所有正在 wait_pop/pop_for 中等待的线程，即使队列为空
+     */
+    void wake_all() {
+        std::unique_lock<std::mutex> mlock(park_mut);
+        ++epoch;
+        mlock.unlock();
+        park_cond.notify_all();
+    }
+
+    /**
+     * @brief 所有队列中元素的总数，由于并发修改，该值只是一个近似值
+     */
+    std::size_t size() const {
+        return count.load();
+    }
+
+private:
+    struct alignas(64) deque_slot {
+        std::mutex mut;
+        std::unique_ptr<scheduling_policy<T>> policy;
+        // 本地队列元素个数，窃取时跳过空队列，避免加锁
+        std::atomic<std::size_t> size = 0;
+
+        explicit deque_slot(std::unique_ptr<scheduling_policy<T>> &&policy)
+            : policy(std::move(policy)) {}
+    };
+
+    std::vector<std::unique_ptr<deque_slot>> local;
+    std::unique_ptr<deque_slot> shared;
+    // 调度策略是否允许元素留在推送者的本地队列中
+    bool per_worker;
+
+    // 所有队列中元素的总数
+    std::atomic<std::size_t> count = 0;
+
+    // 空闲 worker 阻塞等待新元素所用的锁
+    std::mutex park_mut;
+    std::condition_variable park_cond;
+    std::atomic<std::size_t> sleepers = 0;
+    std::size_t wakeups = 0;
+    std::size_t epoch = 0;
+
+    static std::unique_ptr<scheduling_policy<T>> default_policy() {
+        return std::make_unique<locality_policy<T>>();
+    }
+
+    static thread_local work_stealing_queue *current_queue;
+    static thread_local std::size_t current_slot;
+
+    bool pop(deque_slot &slot, T &element) {
+        if (slot.size.load() == 0) return false;
+        std::scoped_lock<std::mutex> lock(slot.mut);
+        if (!slot.policy->pop(element)) return false;
+        --slot.size;
+        --count;
+        return true;
+    }
+
+    bool steal(deque_slot &slot, T &element) {
+        if (slot.size.load() == 0) return false;
+        std::scoped_lock<std::mutex> lock(slot.mut);
+        if (!slot.policy->steal(element)) return false;
+        --slot.size;
+        --count;
+        return true;
+    }
+
+    std::size_t remove_if(deque_slot &slot, const std::function<bool(const T &)> &pred) {
+        if (slot.size.load() == 0) return 0;
+        std::scoped_lock<std::mutex> lock(slot.mut);
+        std::size_t removed = slot.policy->remove_if(pred);
+        slot.size -= removed;
+        count -= removed;
+        return removed;
+    }
+
+    void notify() {
+        // 等待者先增加 sleepers 再检查 count，推送者先增加 count 再检查 sleepers，
+        // 因此两者至少有一方能看到对方的修改，不会丢失唤醒
+        if (sleepers.load() > 0) {
+            { std::scoped_lock<std::mutex> lock(park_mut); }
+            park_cond.notify_one();
+        }
+    }
+
+    /**
+     * @brief 在持有 park_mut 的情况下检查当前等待是否是被 wake_one/wake_all 唤醒的
+     */
+    bool consume_wakeup(std::size_t current_epoch) {
+        if (epoch != current_epoch) return true;
+        if (wakeups > 0 && count.load() == 0) {
+            --wakeups;
+            return true;
+        }
+        return false;
+    }
+};
+
+template <typename T>
+thread_local work_stealing_queue<T> *work_stealing_queue<T>::current_queue = nullptr;
+
+template <typename T>
+thread_local std::size_t work_stealing_queue<T>::current_slot = 0;
+
+}  // namespace judge
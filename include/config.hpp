@@ -161,6 +161,54 @@ extern std::filesystem::path CHROOT_DIR;
  */
 extern std::filesystem::path SCRIPT_DIR;
 
+/**
+ * @brief 同时评测的提交数上限，0 表示不限制
+ * 正在评测的提交数达到上限时，拉取线程暂停向评测队列分发新的提交，直到有提交评测结束。
+ */
+extern size_t MAX_INFLIGHT_SUBMISSIONS;
+
+/**
+ * @brief RUN_DIR（以及启用时的 DATA_DIR）所在文件系统至少需要保留的空闲空间，单位为字节
+ * 空闲空间不足时拉取线程暂停分发新的提交，避免选手程序的编译产物和输出写满磁盘导致大量提交评测失败。
+ */
+extern long long MIN_FREE_DISK;
+
+/**
+ * @brief 系统至少需要保留的可用内存，单位为字节
+ * 可用内存不足时拉取线程暂停分发新的提交，避免评测过程中触发 OOM 导致评测结果不稳定。
+ */
+extern long long MIN_FREE_MEMORY;
+
+/**
+ * @brief 是否由评测系统直接执行标准评测流程（check script 为 standard 时）
+ * 开启时评测系统在进程内准备运行文件夹并调用 runguard，不再启动 exec/check/standard/run 脚本，见 run_standard_check。
+ * 关闭时回退到脚本实现，便于排查两者行为不一致的问题。
+ */
+extern bool NATIVE_CHECK;
+
+/**
+ * @brief 一次 runguard 批量运行最多包含多少个测试点，为 1 时不批量运行
+ * 同一提交中同时可以评测的标准评测任务（不生成随机数据、没有 actions）会被合并成一个评测任务分发，
+ * 由一次 runguard --batch 依次运行，见 run_standard_check_batch。只在 NATIVE_CHECK 开启时有效。
+ * 一次批量运行只创建一次 mount 命名空间、根目录和 cgroup，每个测试点只挂载自己的文件夹并重置 cgroup 的计数。
+ */
+extern std::size_t BATCH_CHECK_SIZE;
+
+/**
+ * @brief 边运行边比较时选手输出允许超出标准输出长度的字节数，为 0 时不边运行边比较
+ * 开启时比较器为 diff-* 的标准评测任务不再等选手程序结束后才比较输出，评测系统通过管道读取选手程序的输出并逐行比较，
+ * 一旦确定答案错误，或者输出超过标准输出的长度加上这个值（以及输出限制），就提前结束选手程序，见 run_standard_check。
+ * 只在 NATIVE_CHECK 开启时有效，批量运行的评测任务不会边运行边比较。
+ */
+extern std::size_t STREAM_CHECK_SLACK;
+
+/**
+ * @brief 是否为选手程序加载系统调用白名单
+ * 开启时，如果选手程序的语言（exec/compile/<语言>/seccomp）和运行脚本（exec/run/<运行脚本>/seccomp）都提供了白名单，
+ * 选手程序只能调用两者中的系统调用。只在 NATIVE_CHECK 开启时有效。
+ */
+extern bool SECCOMP_PROFILE;
+
 /**
  * @brief 是否开启 DEBUG 模式
  * 如果开启 DEBUG 模式，评测系统将不再检查程序是否在特权模式下执行，
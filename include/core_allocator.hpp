@@ -0,0 +1,158 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace judge {
+
+/**
+ * @brief CPU 核心的拓扑信息
+ */
+struct cpu_topology {
+    /**
+     * @brief CPU 编号（逻辑核心）
+     */
+    unsigned cpu = 0;
+
+    /**
+     * @brief 所属物理核心的编号，同一物理核心上的逻辑核心互为超线程
+     */
+    int core_id = 0;
+
+    /**
+     * @brief 所属 CPU 插槽的编号
+     */
+    int package_id = 0;
+
+    /**
+     * @brief 所属 NUMA 节点的编号
+     */
+    int node = 0;
+
+    /**
+     * @brief 从 /sys/devices/system/cpu 读取 CPU 拓扑信息，读取失败的字段为 0
+     */
+    static cpu_topology read(unsigned cpu);
+};
+
+/**
+ * @brief 多核评测任务的核心分配器
+ * 每个 worker 占有一个 CPU 核心，多核评测任务（比如 CI 任务、并行的 gtest 测试）需要额外占用其他 worker 的核心。
+ * 被占用的 worker 在评测任务结束之前不会再领取新的评测任务。
+ *
+ * 为了避免多个多核评测任务各自占用一部分核心并互相等待导致死锁，同一时刻只有最早申请的多核评测任务
+ * 可以占用核心，其他申请者排队等待。排队的申请者的核心也可以被占用，被占用后申请失败，需要将评测任务
+ * 放回评测队列，等到核心被释放后再重新申请。
+ *
+ * 分配核心时优先选择与申请者在同一 NUMA 节点、且不与已分配核心互为超线程的核心。
+ */
+class core_allocator {
+public:
+    /**
+     * @param cores 所有 worker 占有的 CPU 核心，将从系统读取拓扑信息
+     */
+    explicit core_allocator(const std::set<unsigned> &cores);
+
+    /**
+     * @param topology 所有 worker 占有的 CPU 核心及其拓扑信息
+     */
+    explicit core_allocator(const std::vector<cpu_topology> &topology);
+
+    /**
+     * @brief worker 开始等待评测任务，此时该核心可以被多核评测任务占用
+     */
+    void park(unsigned core);
+
+    /**
+     * @brief worker 领取到了评测任务
+     * @return 如果该核心已经被多核评测任务占用，返回 false，此时 worker 需要将评测任务放回评测队列，
+     * 并调用 wait_released 等待核心被释放
+     */
+    bool unpark(unsigned core);
+
+    /**
+     * @brief 阻塞直到该核心不再被多核评测任务占用，或者调用了 interrupt
+     */
+    void wait_released(unsigned core);
+
+    /**
+     * @brief 为在 core 上运行的评测任务申请核心
+     * 阻塞直到申请到足够的核心。申请的核心数超过 worker 数量时只分配所有的核心。
+     * @param core 申请者的核心，调用前必须已经调用 unpark
+     * @param count 评测任务需要的核心数（包括申请者的核心）
+     * @return 分配到的所有核心，第一个为申请者的核心；如果等待过程中申请者的核心被其他多核评测任务占用，
+     * 或者调用了 interrupt，返回空数组
+     */
+    std::vector<unsigned> acquire(unsigned core, std::size_t count);
+
+    /**
+     * @brief 评测任务结束后释放 acquire 分配的核心
+     * @param cores acquire 的返回值
+     */
+    void release(const std::vector<unsigned> &cores);
+
+    /**
+     * @brief 空闲（等待评测任务且没有被占用）的核心数
+     */
+    std::size_t idle_cores() const;
+
+    /**
+     * @brief 唤醒所有等待中的申请者和被占用的 worker，用于停止评测
+     */
+    void interrupt();
+
+private:
+    enum class activity {
+        /**
+         * @brief worker 正在评测
+         */
+        BUSY,
+
+        /**
+         * @brief worker 正在等待评测任务
+         */
+        PARKED,
+
+        /**
+         * @brief worker 正在等待 acquire 分配核心
+         */
+        WAITING
+    };
+
+    struct core_state {
+        cpu_topology topology;
+        activity state = activity::BUSY;
+
+        /**
+         * @brief 该核心是否被多核评测任务占用
+         */
+        bool reserved = false;
+    };
+
+    mutable std::mutex mut;
+    std::condition_variable cond;
+    std::map<unsigned, core_state> states;
+
+    /**
+     * @brief 排队申请核心的申请者，只有队头的申请者可以占用核心
+     */
+    std::deque<unsigned> requests;
+
+    bool interrupted = false;
+
+    core_state &at(unsigned core);
+
+    /**
+     * @brief 从可占用的核心中选出最适合分配给申请者的核心
+     * @return 是否找到了可占用的核心
+     */
+    bool pick(unsigned requester, const std::vector<unsigned> &chosen, unsigned &result) const;
+
+    void unreserve(const std::vector<unsigned> &cores);
+};
+
+}  // namespace judge
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace judge {
+
+/**
+ * @brief 比较器的返回值，与 exec/utils/utils.sh 一致
+ */
+enum compare_result {
+    RESULT_AC = 42,
+    RESULT_WA = 43,
+    RESULT_PE = 44,
+    RESULT_PC = 54
+};
+
+/**
+ * @brief 内置比较器的比较方式，与 exec/compare 中的脚本一一对应
+ */
+enum class compare_mode {
+    /**
+     * @brief diff-all：忽略行末的 \r，空白字符和空行的差异判为 PE
+     */
+    all,
+
+    /**
+     * @brief diff-ign-space：忽略行末空白字符、空行，连续的空白字符视为一个空格，不会判为 PE
+     */
+    ignore_space,
+
+    /**
+     * @brief diff-ign-trailing：忽略行末空白字符和空行，行内空白字符的差异判为 PE
+     */
+    ignore_trailing
+};
+
+/**
+ * @brief 根据比较脚本名得到内置比较器的比较方式
+ * @return 不是内置比较器时返回空
+ */
+std::optional<compare_mode> parse_compare_mode(std::string_view name);
+
+/**
+ * @brief 比较的结果
+ */
+struct compare_report {
+    /**
+     * @brief RESULT_AC、RESULT_WA 或 RESULT_PE
+     */
+    int result = RESULT_AC;
+
+    /**
+     * @brief 第一处不同在选手输出和标准输出中的字节偏移，结果为 AC 时无意义
+     */
+    std::size_t user_offset = 0, answer_offset = 0;
+};
+
+/**
+ * @brief 比较选手输出和标准输出，语义与 exec/compare 中对应的 diff 脚本一致
+ *
+ * diff 脚本需要先宽松地比较一次（diff -b -B -Z），相同时再严格地比较一次来区分 AC 和 PE。
+ * 这里只扫描一遍：先用 SIMD 找到两个输出第一个不同的字节，在这之前的内容不需要再处理；
+ * 从这一行开始按照严格的规则比较，相同则为 AC；否则从严格比较失败的那一行开始按照宽松的规则比较，
+ * 不同则为 WA，否则为 PE。宽松比较时两个输出完全相同的部分同样用 SIMD 跳过。
+ *
+ * 忽略空行时直接跳过空行，而 diff -B 只忽略全部由空行组成的差异块，取决于 diff 如何对齐两个输出的行：
+ * 比如 "a\n\n" 和 "\n\na"，diff 将空行对齐后得到的差异块包含非空行，因此判为不同，这里则判为相同。
+ */
+compare_report compare_output(std::string_view user, std::string_view answer, compare_mode mode);
+
+/**
+ * @brief 通过 mmap 读取文件并比较
+ * @throw std::system_error 文件无法打开时
+ */
+compare_report compare_files(const std::filesystem::path &user, const std::filesystem::path &answer, compare_mode mode);
+
+/**
+ * @brief 计算字节偏移所在的行号和列号，均从 1 开始
+ */
+std::pair<std::size_t, std::size_t> line_column(std::string_view text, std::size_t offset);
+
+/**
+ * @brief 内置的词法比较器的参数
+ * 词法比较器逐个比较以空白字符分隔的 token，不关心空白字符和换行，结果只有 AC 和 WA。
+ * 两个 token 相同、忽略大小写时相同，或者都是十进制数且误差在绝对误差或相对误差（相对于标准输出）以内时视为相同。
+ */
+struct token_compare_options {
+    /**
+     * @brief 允许的绝对误差，参数 abs=<误差>，均为 0 时数字也按照字符串比较
+     */
+    double absolute_error = 0;
+
+    /**
+     * @brief 允许的相对误差，参数 rel=<误差>
+     */
+    double relative_error = 0;
+
+    /**
+     * @brief 忽略 token 的大小写，参数 ignore-case
+     */
+    bool ignore_case = false;
+
+    /**
+     * @brief 不关心行的顺序，参数 unordered-lines
+     * 每一行作为一个整体，空行被忽略，两个输出的行排序后逐行比较。排序时数字按照数值比较，
+     * 因此只有误差以内的数字才能改变两行的顺序，这种情况下可能将实际上可以一一对应的输出判为 WA。
+     */
+    bool unordered_lines = false;
+};
+
+/**
+ * @brief 解析内置词法比较器的比较脚本名，格式为 token 或者 token:<参数>,<参数>...，比如 token:abs=1e-6,rel=1e-6
+ * @return 不是词法比较器时返回空
+ * @throw std::invalid_argument 参数不合法时
+ */
+std::optional<token_compare_options> parse_token_compare(std::string_view name);
+
+/**
+ * @brief 按照词法比较器的规则比较选手输出和标准输出，在评测系统进程内执行，代替题目提供的特判程序
+ * 与 compare_output 一样先用 SIMD 跳过相同的前缀，只有不同的 token 才需要解析数字
+ */
+compare_report compare_tokens(std::string_view user, std::string_view answer, const token_compare_options &opt);
+
+/**
+ * @brief 描述第一处不同的位置，包括两个输出中的行号、列号以及转义后的附近内容，结果为 AC 时为空
+ */
+std::string describe_difference(std::string_view user, std::string_view answer, const compare_report &report);
+
+/**
+ * @brief 在选手程序运行时逐块比较输出，尽早发现答案错误
+ *
+ * 两个输出按照最宽松的规则（diff-ign-space）逐行规范化之后只要有一行不同，无论哪种比较方式结果都是 WA，
+ * 因此每读到完整的一行就可以和标准输出的对应行比较，不需要等选手程序结束。区分 AC 和 PE 仍然需要完整的输出，
+ * 由选手程序结束后的 compare_output 完成。与标准输出完全相同的行直接用 memcmp 比较，不需要规范化。
+ */
+class stream_checker {
+public:
+    /**
+     * @param answer 标准输出，在比较结束前必须有效
+     */
+    explicit stream_checker(std::string_view answer);
+
+    /**
+     * @brief 追加一块选手输出
+     * @return 已经确定为 WA 时返回 false，之后不应该再追加输出
+     */
+    bool feed(std::string_view data);
+
+    /**
+     * @brief 选手输出结束，比较最后一行以及标准输出剩余的行
+     * @return 确定为 WA 时返回 false
+     */
+    bool finish();
+
+private:
+    bool check_line(std::string_view line);
+
+    std::string_view answer;
+    std::size_t answer_pos = 0;
+    std::string pending;  // 还没有读到换行符的一行
+    std::string user_line, answer_line;
+};
+
+/**
+ * @brief 只读地 mmap 整个文件，空文件不会映射
+ */
+class mapped_file {
+public:
+    /**
+     * @throw std::system_error 文件无法打开或者映射时
+     */
+    explicit mapped_file(const std::filesystem::path &path);
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+    ~mapped_file();
+
+    std::string_view view() const;
+
+private:
+    void *data = nullptr;
+    std::size_t size = 0;
+};
+
+}  // namespace judge
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace judge {
+
+/**
+ * @brief 提交中评测任务的依赖关系图
+ * 每个评测任务至多依赖一个在它之前的评测任务，因此依赖关系构成森林。
+ * 在 verify 时预先计算每个评测任务的子任务列表，并维护等待评测、正在评测、已经结束的评测任务数量，
+ * 使得评测任务结束后查找子任务、判断提交是否评测完成的开销只与子任务数量有关，而与评测任务总数无关。
+ * @note 依赖关系图不加锁，调用方需要持有提交的锁
+ */
+class dependency_graph {
+public:
+    dependency_graph() = default;
+
+    /**
+     * @param depends_on 每个评测任务依赖的评测任务下标，小于 0 表示不依赖任何评测任务
+     * @throw std::invalid_argument 如果存在评测任务依赖自己或者之后的评测任务（可能成环）
+     */
+    explicit dependency_graph(const std::vector<int> &depends_on);
+
+    /**
+     * @brief 评测任务总数
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief 不依赖任何评测任务、可以直接开始评测的评测任务
+     */
+    const std::vector<std::size_t> &roots() const;
+
+    /**
+     * @brief 直接依赖评测任务 id 的评测任务
+     */
+    const std::vector<std::size_t> &children(std::size_t id) const;
+
+    /**
+     * @brief 评测任务开始评测
+     * @return 如果评测任务不在等待评测，返回 false
+     */
+    bool start(std::size_t id);
+
+    /**
+     * @brief 评测任务评测结束
+     * @return 如果评测任务不在评测中，返回 false
+     */
+    bool finish(std::size_t id);
+
+    /**
+     * @brief 评测任务因依赖不满足而跳过，不需要评测
+     * @return 如果评测任务不在等待评测，返回 false
+     */
+    bool skip(std::size_t id);
+
+    /**
+     * @brief 等待评测的评测任务数
+     */
+    std::size_t pending() const;
+
+    /**
+     * @brief 正在评测的评测任务数
+     */
+    std::size_t running() const;
+
+    /**
+     * @brief 已经结束（包括跳过）的评测任务数
+     */
+    std::size_t finished() const;
+
+    /**
+     * @brief 是否所有评测任务都已经结束
+     */
+    bool completed() const;
+
+private:
+    enum class state {
+        PENDING,
+        RUNNING,
+        FINISHED
+    };
+
+    std::vector<std::vector<std::size_t>> edges;
+    std::vector<std::size_t> entries;
+    std::vector<state> states;
+    std::size_t pending_count = 0;
+    std::size_t running_count = 0;
+    std::size_t finished_count = 0;
+};
+
+}  // namespace judge
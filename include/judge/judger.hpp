@@ -1,7 +1,7 @@
 #pragma once
 
 #include <functional>
-#include "common/concurrent_queue.hpp"
+#include "common/work_stealing_queue.hpp"
 #include "common/messages.hpp"
 #include "judge/submission.hpp"
 
@@ -33,7 +33,7 @@ struct judger {
      * @param submit 要被评测的提交信息
      * @return true 若成功分发子任务
      */
-    virtual bool distribute(concurrent_queue<message::client_task> &task_queue, submission &submit) const = 0;
+    virtual bool distribute(work_stealing_queue<message::client_task> &task_queue, submission &submit) const = 0;
 
     /**
      * @brief 当前从消息队列中取到该消息的 worker 将评测子任务发给 judger 进行实际的评测
@@ -41,7 +41,7 @@ struct judger {
      * @param task_queue 允许子任务评测完成后继续分发后续的子任务评测
      * @param execcpuset 当前评测任务可以使用哪些 cpu 核心进行评测
      */
-    virtual void judge(const message::client_task &task, concurrent_queue<message::client_task> &task_queue, const std::string &execcpuset) const = 0;
+    virtual void judge(const message::client_task &task, work_stealing_queue<message::client_task> &task_queue, const std::string &execcpuset) const = 0;
 
     /**
      * @brief 注册评测结束的事件回调函数
@@ -52,9 +52,9 @@ struct program_output_judger : public judger {
 
     bool verify(submission &submit) const override;
 
-    bool distribute(concurrent_queue<message::client_task> &task_queue, submission &submit) const override;
+    bool distribute(work_stealing_queue<message::client_task> &task_queue, submission &submit) const override;
 
-    void judge(const message::client_task &task, concurrent_queue<message::client_task> &task_queue, const std::string &execcpuset) const override;
+    void judge(const message::client_task &task, work_stealing_queue<message::client_task> &task_queue, const std::string &execcpuset) const override;
 };
 
 }  // namespace judge
@@ -1,14 +1,18 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <boost/rational.hpp>
 #include <filesystem>
 #include <map>
+#include <memory>
+#include <set>
 
-#include "common/concurrent_queue.hpp"
+#include "common/work_stealing_queue.hpp"
 #include "common/io_utils.hpp"
 #include "common/messages.hpp"
 #include "common/status.hpp"
+#include "judge/dependency_graph.hpp"
 #include "judge/judger.hpp"
 #include "judge/submission.hpp"
 #include "program.hpp"
@@ -23,6 +27,10 @@
  */
 namespace judge {
 
+namespace server {
+class report_coalescer;
+}
+
 /**
  * @brief 表示一组标准测试数据
  * 标准测试数据和测试点的顺序没有必然关系，比如一道题同时存在
@@ -57,6 +65,9 @@ struct test_case_data {
 };
 
 struct judge_task;
+class result_journal;
+class result_cache;
+class sandbox_pool;
 
 struct judge_task_result;
 
@@ -403,6 +414,49 @@ struct programming_submission : public submission {
      */
     std::size_t finished = 0;
 
+    /**
+     * @brief 评测任务的依赖关系图，在 verify 时根据 judge_tasks 构建
+     */
+    dependency_graph graph;
+
+    /**
+     * @brief 是否在评测结果确定后立刻取消剩余的评测任务（fail fast）
+     * 评测结果确定是指有评测任务没有通过（不是 Accepted），适用于第一个未通过的测试点就决定了评测结果的题目，
+     * 比如 ACM 赛制的题目。此时下标更大的评测任务不再评测，正在评测的被终止，评测结果均为 SKIPPED；
+     * 下标更小的评测任务继续评测，因此编号最小的未通过的评测任务一定会被评测，与评测任务的调度顺序无关。
+     * 评测服务器可以为每个提交单独设置，programming_judger 也可以为整个评测服务器的提交启用。
+     */
+    bool fail_fast = false;
+
+    /**
+     * @brief 启用 fail fast 时，目前下标最小的未通过的评测任务，下标比它大的评测任务已经被取消，
+     * 没有未通过的评测任务时为 SIZE_MAX
+     */
+    std::size_t cancelled_after = SIZE_MAX;
+
+    /**
+     * @brief 评测任务是否已经被 fail fast 取消
+     * @param id 评测任务下标
+     */
+    bool cancelled(std::size_t id) const {
+        return id > cancelled_after;
+    }
+
+    /**
+     * @brief 正在评测的评测任务的进程组 id，键为评测任务下标，取消评测任务时用于终止评测程序
+     */
+    std::map<std::size_t, pid_t> process_groups;
+
+    /**
+     * @brief 提交在评测结果缓存中的键，为空表示提交不使用缓存，见 result_cache
+     */
+    std::string cache_key;
+
+    /**
+     * @brief 评测该提交已经占用的 CPU 核心时间，单位为秒，即评测任务用时乘以占用的核心数之和
+     */
+    double core_seconds = 0;
+
     /**
      * @brief 题目读锁，提交销毁后会自动释放锁
      * 正在评测的提交需要使用读锁锁住题目文件夹以避免题目更新时导致数据错误。
@@ -421,13 +475,51 @@ struct programming_submission : public submission {
  * @brief 评测编程题的 Judger 类，编程题评测的逻辑都在这个类里
  */
 struct programming_judger : public judger {
+    /**
+     * @param fail_fast_categories 这些评测服务器的提交都启用 fail fast，见 programming_submission::fail_fast
+     * @param journal 评测结果日志，为空时不记录评测结果，评测系统重启后重新收到的提交需要完整地重新评测
+     * @param cache 评测结果缓存，为空时所有提交都需要评测
+     * @param reporter 合并中途评测报告，为空时每次评测结果变化都立刻发送中途评测报告
+     * @param sandboxes 预先挂载好的运行环境池，为空时每个测试点都重新挂载运行环境
+     */
+    explicit programming_judger(std::set<std::string> fail_fast_categories = {}, std::shared_ptr<result_journal> journal = nullptr, std::shared_ptr<result_cache> cache = nullptr, std::shared_ptr<server::report_coalescer> reporter = nullptr, std::shared_ptr<sandbox_pool> sandboxes = nullptr);
+
     std::string type() const override;
 
     bool verify(submission &submit) const override;
 
-    bool distribute(concurrent_queue<message::client_task> &task_queue, submission &submit) const override;
+    bool distribute(work_stealing_queue<message::client_task> &task_queue, submission &submit) const override;
+
+    void judge(const message::client_task &task, work_stealing_queue<message::client_task> &task_queue, const std::string &execcpuset) const override;
+
+    /**
+     * @brief 评测结果日志，未启用时返回 nullptr
+     */
+    result_journal *get_journal() const;
+
+    /**
+     * @brief 评测结果缓存，未启用时返回 nullptr
+     */
+    result_cache *get_cache() const;
+
+    /**
+     * @brief 发送提交的中途评测报告（不做 ACK），启用合并时可能延迟发送
+     * 调用方必须持有 submit.mut
+     */
+    void report_progress(submission &submit) const;
+
+    /**
+     * @brief 发送提交的最终评测报告，并丢弃尚未发送的中途评测报告
+     * 调用方必须持有 submit.mut，或者确保没有其他线程访问该提交
+     */
+    void report_final(submission &submit) const;
 
-    void judge(const message::client_task &task, concurrent_queue<message::client_task> &task_queue, const std::string &execcpuset) const override;
+private:
+    std::set<std::string> fail_fast_categories;
+    std::shared_ptr<result_journal> journal;
+    std::shared_ptr<result_cache> cache;
+    std::shared_ptr<server::report_coalescer> reporter;
+    std::shared_ptr<sandbox_pool> sandboxes;
 };
 
 }  // namespace judge
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <prometheus/counter.h>
+#include <prometheus/registry.h>
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "judge/programming.hpp"
+
+namespace judge {
+
+/**
+ * @brief 评测结果缓存，内容完全相同的提交直接使用之前的评测结果
+ * 学生经常重复提交完全相同的代码，比赛中也有大量相同的模板代码。缓存的键是提交内容的 SHA-1，
+ * 包括所有源文件和辅助文件的内容、语言、编译选项、题目更新时间和所有评测任务的定义，
+ * 题目更新后旧的评测结果自然失效。
+ *
+ * 评测结果不确定的提交不会被缓存，比如使用随机测试、包含读取文件或上传文件操作的提交，以及存在系统错误的评测结果。
+ * 缓存只保存在内存中，总大小超过上限时淘汰最久没有使用的评测结果。
+ */
+class result_cache {
+public:
+    /**
+     * @param capacity 缓存的评测结果的总大小上限，单位为字节
+     * @param excluded_categories 这些评测服务器的提交不使用缓存
+     * @param registry 导出命中次数和节省的评测时间的 prometheus 注册表，为空时不导出
+     */
+    result_cache(std::size_t capacity, std::set<std::string> excluded_categories = {}, std::shared_ptr<prometheus::Registry> registry = nullptr);
+
+    /**
+     * @brief 计算提交的缓存键
+     * 会读取提交的源文件内容，远程文件会被下载（下载的内容将在编译时复用）
+     * @return 提交不能使用缓存时返回空
+     */
+    std::optional<std::string> key_of(programming_submission &submit) const;
+
+    /**
+     * @brief 查找缓存的评测结果，并更新命中率统计
+     * @param key 缓存键，见 key_of
+     * @param category 提交所属的评测服务器，用于区分统计信息
+     * @param results 命中时保存评测结果
+     * @return 是否命中
+     */
+    bool lookup(const std::string &key, const std::string &category, std::vector<judge_task_result> &results);
+
+    /**
+     * @brief 保存提交的评测结果
+     * @param core_seconds 评测该提交占用的 CPU 核心时间，命中时计入节省的评测时间
+     */
+    void store(const std::string &key, const std::vector<judge_task_result> &results, double core_seconds);
+
+    /**
+     * @brief 当前缓存的评测结果总大小，单位为字节
+     */
+    std::size_t size() const;
+
+private:
+    struct entry {
+        std::string key;
+        std::vector<judge_task_result> results;
+        double core_seconds;
+        std::size_t bytes;
+    };
+
+    std::size_t capacity;
+    std::set<std::string> excluded_categories;
+
+    mutable std::mutex mut;
+    // 最近使用的评测结果在链表头部
+    std::list<entry> entries;
+    std::unordered_map<std::string, std::list<entry>::iterator> index;
+    std::size_t bytes = 0;
+
+    prometheus::Family<prometheus::Counter> *lookups = nullptr;
+    prometheus::Family<prometheus::Counter> *saved_core_seconds = nullptr;
+};
+
+}  // namespace judge
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "judge/programming.hpp"
+
+namespace judge {
+
+/**
+ * @brief 评测结果日志，保存正在评测的提交中已经结束的评测任务的评测结果
+ * 评测系统重启后，消息队列会重新投递所有没有 ACK 的提交。此时已经结束的评测任务直接从日志中恢复评测结果，
+ * 只需要评测剩余的评测任务，避免滚动重启时重复评测。
+ *
+ * 日志文件只追加写入，每行一条 JSON 记录。记录先保存在内存中，由后台线程批量写入文件，
+ * fsync 的频率可以配置，因此记录评测结果不会阻塞 worker。提交评测完成并返回评测结果后写入完成标记，
+ * 打开日志时丢弃已经完成的提交和过期的提交，并重写日志文件回收空间。
+ */
+class result_journal {
+public:
+    /**
+     * @brief 日志中保存的一个评测任务的评测结果
+     */
+    struct entry {
+        judge_task_result result;
+
+        /**
+         * @brief 评测任务实际使用的测试数据，见 judge_task::testcase_id 和 judge_task::subcase_id
+         * 随机测试在评测时才确定使用哪组测试数据，恢复评测结果时需要一并恢复，以便依赖它的评测任务使用同一组数据
+         */
+        int testcase_id = -1;
+        int subcase_id = -1;
+    };
+
+    /**
+     * @param path 日志文件路径，文件不存在时创建
+     * @param batch_size 积累多少条记录后立刻写入文件，否则每隔 flush_interval 毫秒写入一次
+     * @param fsync_interval 写入后至多间隔多少毫秒调用 fdatasync。0 表示每次写入后都调用，
+     * 负数表示从不调用，此时只能保证评测系统进程退出后记录不丢失，无法保证系统断电后记录不丢失
+     * @param flush_interval 记录在内存中至多停留多少毫秒
+     * @throw std::system_error 如果无法打开日志文件
+     */
+    explicit result_journal(const std::filesystem::path &path, std::size_t batch_size = 64, int fsync_interval = 1000, int flush_interval = 100);
+
+    /**
+     * @brief 写入所有记录并停止后台线程
+     */
+    ~result_journal();
+
+    result_journal(const result_journal &) = delete;
+    result_journal &operator=(const result_journal &) = delete;
+
+    /**
+     * @brief 提交在日志中的标识，由评测服务器、提交 id 和题目更新时间组成
+     * 题目更新后旧的评测结果不再有效，因此题目更新时间也是标识的一部分
+     */
+    static std::string key_of(const submission &submit);
+
+    /**
+     * @brief 记录一个评测任务的评测结果，不会阻塞等待写入文件
+     * @param key 提交的标识，见 key_of
+     * @param task 评测任务，用于记录实际使用的测试数据
+     * @param result 评测结果
+     */
+    void append(const std::string &key, const judge_task &task, const judge_task_result &result);
+
+    /**
+     * @brief 提交已经评测完成并返回了评测结果，之后不再需要恢复
+     */
+    void complete(const std::string &key);
+
+    /**
+     * @brief 获取日志中保存的提交的评测结果
+     * @return 评测任务下标到评测结果的映射，同一个评测任务有多条记录时以最后一条为准
+     */
+    std::map<std::size_t, entry> recover(const std::string &key) const;
+
+    /**
+     * @brief 阻塞直到当前所有记录都写入文件
+     */
+    void flush();
+
+private:
+    std::filesystem::path path;
+    std::size_t batch_size;
+    int fsync_interval;
+    int flush_interval;
+    int fd = -1;
+
+    mutable std::mutex mut;
+    std::condition_variable cond;
+    std::condition_variable flushed_cond;
+    std::thread writer;
+    bool stopping = false;
+
+    /**
+     * @brief 尚未完成的提交的所有记录，用于恢复评测结果和重写日志文件
+     */
+    std::map<std::string, std::vector<std::string>> live;
+    std::size_t live_bytes = 0;
+
+    /**
+     * @brief 等待写入文件的记录
+     */
+    std::string pending;
+    std::size_t pending_records = 0;
+
+    // 已经追加的记录数、已经写入文件的记录数和 flush 等待写入的记录数
+    std::size_t appended = 0;
+    std::size_t written = 0;
+    std::size_t flush_target = 0;
+
+    // 以下成员只由后台线程访问：日志文件的大小（超过阈值时重写日志文件）、上次 fdatasync 的时间、是否有尚未同步的写入
+    std::size_t file_bytes = 0;
+    std::chrono::steady_clock::time_point last_sync;
+    bool dirty = false;
+
+    void load();
+    void rewrite(const std::vector<std::string> &records);
+    bool write_all(int out, const std::string &buffer);
+    void append_file(const std::string &buffer);
+    void write_loop();
+    void push_record(const std::string &record);
+    void sync();
+};
+
+}  // namespace judge
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace judge {
+
+/**
+ * @brief 预先挂载好的运行环境池
+ * 原来每个测试点都需要为选手程序和比较器各挂载一次 chroot 环境的 overlay 和 /proc，运行结束后再卸载。
+ * 并发评测时大量的 mount/umount 会竞争内核中挂载点的全局锁，挂载的耗时随并发数增长。
+ *
+ * 本类为每个 CPU 核心预先准备 per_core 个运行环境，每个运行环境以 tmpfs 中的空文件夹作为 upperdir，
+ * 以 CHROOT_DIR 作为 lowerdir 挂载成 overlay，并绑定 /proc、创建 /dev 下的字符设备。
+ * 评测任务从所在核心的运行环境中取出一个使用，归还后由后台线程卸载，并以全新的 upperdir 重新挂载，
+ * 因此上一个测试点写入的文件不会被下一个测试点看到，重置的开销也不在评测任务的关键路径上。
+ * 所有的挂载和卸载都由一个后台线程串行完成，不会出现并发的挂载风暴。
+ *
+ * 运行环境的目录结构：
+ * <dir>                 // tmpfs，所有运行环境共用
+ * └── <core>-<index>
+ *     ├── upper-<n>     // overlay 的 upperdir（work）和 workdir（ofs），每次重置都换成新的文件夹
+ *     └── root          // overlay 挂载点，作为 runguard 的 --root
+ */
+class sandbox_pool {
+public:
+    /**
+     * @brief 从运行环境池中取出的运行环境，析构时归还
+     */
+    class lease {
+    public:
+        lease() = default;
+        lease(lease &&other) noexcept;
+        lease &operator=(lease &&other) noexcept;
+        lease(const lease &) = delete;
+        lease &operator=(const lease &) = delete;
+        ~lease();
+
+        /**
+         * @brief 运行环境的根目录，没有取得运行环境时为空
+         */
+        const std::filesystem::path &root() const;
+
+        explicit operator bool() const;
+
+    private:
+        friend class sandbox_pool;
+        lease(sandbox_pool *pool, unsigned core, std::filesystem::path dir);
+
+        sandbox_pool *pool = nullptr;
+        unsigned core = 0;
+        std::filesystem::path dir, root_dir;
+    };
+
+    /**
+     * @param dir 运行环境所在的文件夹
+     * @param chrootdir 运行环境的 lowerdir，一般为 CHROOT_DIR
+     * @param per_core 每个核心预先准备的运行环境个数
+     * @param tmpfs_size 平均每个运行环境可以使用的 tmpfs 空间，单位为字节，选手程序在工作文件夹以外写入的文件占用这部分空间
+     */
+    sandbox_pool(std::filesystem::path dir, std::filesystem::path chrootdir, std::size_t per_core, std::size_t tmpfs_size);
+
+    /**
+     * @brief 停止后台线程并卸载所有运行环境，调用前必须归还所有运行环境
+     */
+    ~sandbox_pool();
+
+    sandbox_pool(const sandbox_pool &) = delete;
+    sandbox_pool &operator=(const sandbox_pool &) = delete;
+
+    /**
+     * @brief 为这些核心挂载运行环境，挂载失败的运行环境会被跳过，只能调用一次
+     * 上次评测系统异常退出时残留的挂载点会先被卸载
+     */
+    void prepare(const std::set<unsigned> &cores);
+
+    /**
+     * @brief 取出核心 core 的一个运行环境，如果运行环境都在使用或者正在重置，阻塞直到有运行环境可用
+     * @return 如果该核心没有可用的运行环境（未调用 prepare 或者挂载全部失败），返回空的 lease，
+     * 调用方需要自行挂载运行环境
+     */
+    lease acquire(unsigned core);
+
+private:
+    struct shard {
+        /**
+         * @brief 可以直接使用的运行环境
+         */
+        std::deque<std::filesystem::path> ready;
+
+        /**
+         * @brief 该核心仍然可以使用的运行环境个数，包括正在使用和正在重置的
+         */
+        std::size_t alive = 0;
+    };
+
+    std::filesystem::path dir, chrootdir;
+    std::size_t per_core, tmpfs_size;
+
+    std::mutex mut;
+    std::condition_variable cond;
+    std::map<unsigned, shard> shards;
+
+    /**
+     * @brief 等待重置的运行环境
+     */
+    std::deque<std::pair<unsigned, std::filesystem::path>> dirty;
+    std::thread resetter;
+    bool stopping = false;
+    bool tmpfs_mounted = false;
+
+    /**
+     * @brief 用于生成新的 upperdir 的名字，只在 prepare 和后台线程中使用
+     */
+    unsigned long generation = 0;
+
+    void release(unsigned core, const std::filesystem::path &sandbox);
+    void reset_loop();
+
+    /**
+     * @brief 挂载运行环境
+     * @return 是否挂载成功，失败时已经卸载了挂载到一半的运行环境
+     */
+    bool mount_sandbox(const std::filesystem::path &sandbox);
+    void umount_sandbox(const std::filesystem::path &sandbox);
+};
+
+}  // namespace judge
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/utils.hpp"
+#include "judge/compare.hpp"
+#include "program.hpp"
+
+namespace judge {
+
+/**
+ * @brief 标准评测流程的参数，与 exec/check/standard/run 的命令行参数一致
+ */
+struct standard_check_options {
+    /**
+     * @brief 测试数据文件夹，包含 input 和 output 文件夹
+     */
+    std::filesystem::path datadir;
+
+    /**
+     * @brief 选手程序的时间限制，单位为秒
+     */
+    double time_limit;
+
+    /**
+     * @brief 是否按照墙钟时间限制选手程序，否则按照 CPU 时间限制
+     */
+    bool wall_time = false;
+
+    /**
+     * @brief 选手程序和比较器可以使用的 CPU 核心
+     */
+    std::string cpuset;
+
+    std::filesystem::path chrootdir;
+
+    /**
+     * @brief 从 sandbox_pool 取出的运行环境的根目录，已经挂载好 chroot 环境和 /proc
+     * 为空时在运行文件夹中为本次评测挂载 chroot 环境
+     */
+    std::filesystem::path sandbox;
+
+    /**
+     * @brief 评测任务的运行文件夹，评测过程中的所有文件都保存在这里，必须为空文件夹
+     */
+    std::filesystem::path rundir;
+
+    /**
+     * @brief 选手程序基于哪些文件夹运行，这些文件夹通过 overlay 挂载到选手程序的工作文件夹
+     */
+    std::vector<std::string> basedirs;
+
+    /**
+     * @brief 运行选手程序的脚本所在的文件夹
+     */
+    std::filesystem::path run_script;
+
+    /**
+     * @brief 比较器所在的文件夹
+     */
+    std::filesystem::path compare_script;
+
+    /**
+     * @brief 边运行边比较时使用的内置比较器，为空时选手程序结束后再通过 runguard 运行比较器
+     * 只有比较器为 exec/compare 中的 diff-* 时才能边运行边比较，见 STREAM_CHECK_SLACK
+     */
+    std::optional<compare_mode> stream_compare;
+
+    /**
+     * @brief 比较脚本为内置的词法比较器时的参数，此时 compare_script 为空，选手程序结束后直接在进程内比较输出
+     * @see parse_token_compare
+     */
+    std::optional<token_compare_options> token_compare;
+
+    /**
+     * @brief 传递给选手程序的参数
+     */
+    std::vector<std::string> run_args;
+
+    /**
+     * @brief 选手程序的系统调用白名单，为空时不限制系统调用
+     * @see runguard 的 --seccomp-profile
+     */
+    std::vector<std::filesystem::path> seccomp_profiles;
+
+    /**
+     * @brief 选手程序的内存、输出和进程数限制
+     */
+    program_limit limit;
+};
+
+/**
+ * @brief 在评测系统进程内执行标准评测流程，代替 exec/check/standard/run 脚本
+ * 评测流程与脚本完全一致：准备运行文件夹，通过 runguard 运行选手程序，再通过 runguard 运行比较器，
+ * 最后根据 runguard 的 meta 文件和比较器的返回值得到评测结果。区别在于文件夹由评测系统直接创建，
+ * 文件系统的挂载由 runguard 通过 --mount 直接完成，不再需要启动 bash 和 mount、chmod 等命令，
+ * 对于运行时间只有几毫秒的测试点，这些开销是选手程序运行时间的好几倍。
+ *
+ * 评测日志与脚本一样写入运行文件夹下的 system.out。
+ *
+ * 设置了 opt.stream_compare 时，选手程序的标准输出通过管道交给评测系统，评测系统一边写入 run/testdata.out 一边逐行比较，
+ * 确定答案错误或者输出过长时提前关闭管道结束选手程序，选手程序结束后在进程内比较完整的输出，不再运行比较器。
+ * 设置了 opt.token_compare 时同样不运行比较器，选手程序结束后在进程内按照词法比较器的规则比较输出。
+ * @param opt 评测参数
+ * @param pb 用于启动 runguard，调用方可以预先设置 awake_period 和 process_group
+ * @return 评测结果，与 check script 的返回值一致，见 error_codes
+ */
+int run_standard_check(const standard_check_options &opt, process_builder &pb);
+
+/**
+ * @brief 在评测系统进程内执行交互评测流程（check script 为 interactive 时）
+ * 选手程序和交互器（题目的比较器）在各自的 runguard 中同时运行，选手程序的标准输出通过管道连接到交互器的标准输入，
+ * 交互器的标准输出通过管道连接到选手程序的标准输入，选手程序的输出不再写入文件再交给比较器。
+ * 交互器的调用方式为 /compare/run /data/input /data/output /feedback，返回值与比较器一致。
+ * 选手程序使用 opt 中的时间和资源限制，交互器使用比较器的资源限制，墙钟时间限制加上选手程序的时间限制。
+ *
+ * 评测结果综合两者得到：交互器判定答案错误时，选手程序的崩溃（比如写入已关闭的管道收到 SIGPIPE）不影响评测结果；
+ * 选手程序超时、超出内存限制时以选手程序的评测结果为准；其余情况与 run_standard_check 一致。
+ * @param opt 评测参数，compare_script 为交互器所在的文件夹
+ * @param pb 用于启动选手程序的 runguard，调用方可以预先设置 process_group，交互器的 runguard 在另一个线程中启动
+ * @return 评测结果，见 error_codes
+ */
+int run_interactive_check(const standard_check_options &opt, process_builder &pb);
+
+/**
+ * @brief 通过一次 runguard --batch 执行多个测试点的标准评测流程
+ * 每个测试点的选手程序和比较器在批量文件中各占一行，runguard 按顺序运行，每一行都有独立的资源限制和 meta 文件，
+ * 运行结果通过 --out-record 按行的顺序逐条写回。测试点的运行文件夹和评测日志与 run_standard_check 一致，
+ * 批量文件 batch.args 和 runguard 的输出 batch.out 保存在第一个测试点的运行文件夹中。
+ * 整个批量运行只创建一次 mount 命名空间和 cgroup，根目录使用第一个测试点的 sandbox，没有设置时只挂载一次 chroot 环境的 overlay
+ * 并执行一次 --prepare-root；每一行只挂载、卸载该测试点的 /judge 等评测文件夹，并重置 cgroup 的计数和限制。
+ * 测试点写入 /judge 以外的文件（比如 /tmp）会被后面的测试点看到，也不能使用内置的比较器（stream_compare、token_compare）。
+ * @param opts 各个测试点的评测参数
+ * @param pb 用于启动 runguard
+ * @return 各个测试点的评测结果，与 opts 一一对应
+ */
+std::vector<int> run_standard_check_batch(const std::vector<standard_check_options> &opts, process_builder &pb);
+
+}  // namespace judge
@@ -118,6 +118,11 @@ struct submission {
      */
     std::any config;
 
+    /**
+     * @brief 给 judge_server 保存已经发送的评测报告的状态的地方，比如用于只发送变化的评测结果
+     */
+    std::any report_state;
+
     std::mutex mut;
 };
 
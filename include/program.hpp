@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include "asset.hpp"
@@ -68,6 +69,12 @@ struct program_limit {
      * @note ，小于 0 的数表示不限制进程数
      */
     int proc_limit = -1;
+
+    /**
+     * @brief 指令数限制，根据应用程序执行的指令数判定是否超时，适合对运行时间判定的稳定性要求高的题目
+     * @note 小于 0 的数表示按照运行时间判定，否则 time_limit 只作为强制结束应用程序的上限
+     */
+    int64_t instruction_limit = -1;
 };
 
 struct executable;
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
 #include "common/status.hpp"
+#include "runguard_record.hpp"
 
 namespace judge {
 
@@ -41,9 +46,53 @@ struct runguard_result {
      */
     int memory = -1;
 
+    /**
+     * @brief 用户态执行的指令数，runguard 没有打开性能计数器时为 -1
+     */
+    int64_t instructions = -1;
+
+    /**
+     * @brief 用户态的 CPU 周期数
+     */
+    int64_t cycles = -1;
+
+    /**
+     * @brief 进程实际占用 CPU 的时间，由性能计数器统计
+     * 单位为秒
+     */
+    double task_clock = -1;
+
+    /**
+     * @brief 硬件性能计数器不可用，instructions 和 cycles 是由 task_clock 估算的
+     */
+    bool perf_emulated = false;
+
     std::string time_result;
+
+    /**
+     * @brief 超出内存限制时为 oom
+     */
+    std::string memory_result;
+
+    /**
+     * @brief 被截断的输出，如 stderr,stdout，只有 meta 文件中才有
+     */
+    std::string output_truncated;
 };
 
+/**
+ * @brief 读取 runguard 写入的 meta 文件中的所有项
+ * @return 键为 meta 文件每行冒号前的内容，值为冒号后的内容
+ */
+std::map<std::string, std::string> read_runguard_metadata(const std::filesystem::path &metafile);
+
 runguard_result read_runguard_result(const std::filesystem::path &metafile);
 
+/**
+ * @brief 从 runguard 的 --out-record 指定的文件描述符（一般是管道的读端）读取运行结果
+ * 只读取第一条记录，不需要解析文本
+ * @return runguard 没有写入完整的记录（比如 runguard 崩溃）或者记录的版本不一致时返回空
+ */
+std::optional<runguard_result> read_runguard_record(int fd);
+
 }  // namespace judge
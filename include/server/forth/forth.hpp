@@ -22,6 +22,11 @@ struct configuration : public judge_server {
 
     std::string category_name;
 
+    /**
+     * @brief 中途评测报告是否只包含变化的评测结果，由配置文件的 deltaReport 项指定，默认为 false
+     */
+    bool delta_report = false;
+
     configuration();
 
     std::string category() const override;
@@ -57,6 +57,12 @@ struct judge_server {
      * @brief 获取服务器对应的 executable manager
      */
     virtual const executable_manager &get_executable_manager() const = 0;
+
+    /**
+     * @brief 是否允许内容完全相同的提交复用之前的评测结果，见 result_cache
+     * 如果 summarize 需要读取评测任务的运行文件夹，则不能复用评测结果，因为缓存的评测结果没有运行文件夹
+     */
+    virtual bool cache_results() const { return true; }
 };
 
 }  // namespace judge::server
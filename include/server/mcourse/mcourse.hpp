@@ -67,6 +67,11 @@ struct configuration : public judge_server {
      * @param submit 不合法的提交
      */
     void summarize_invalid(submission &submit) override;
+
+    /**
+     * @brief mcourse 的评测报告包含选手程序的输出，需要读取运行文件夹，因此不能复用评测结果
+     */
+    bool cache_results() const override;
 };
 
 }  // namespace judge::server::mcourse
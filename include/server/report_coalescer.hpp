@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "judge/submission.hpp"
+
+namespace judge::server {
+
+/**
+ * @brief 合并同一个提交的中途评测报告
+ * 每个评测任务结束都会产生一次中途评测报告，评测服务器需要序列化整个提交的评测报告并发送到消息队列，
+ * 对于有几百个评测任务的题目，评测报告的序列化和发送的开销远大于评测本身。
+ *
+ * 同一个提交的中途评测报告至多每隔 interval 发送一次，间隔内的更新合并为一次报告，
+ * 由后台线程在间隔结束后发送，因此最后一次更新不会丢失。最终评测报告不经过本类，总是立刻发送。
+ * 评测服务器可以在 judge_server::summarize 中通过 submission::report_state 只发送变化的评测结果。
+ */
+class report_coalescer {
+public:
+    explicit report_coalescer(std::chrono::milliseconds interval);
+
+    /**
+     * @brief 停止后台线程，尚未发送的中途评测报告被丢弃
+     */
+    ~report_coalescer();
+
+    report_coalescer(const report_coalescer &) = delete;
+    report_coalescer &operator=(const report_coalescer &) = delete;
+
+    /**
+     * @brief 提交的评测结果发生了变化，需要发送中途评测报告（不做 ACK）
+     * 调用方必须持有 submit.mut
+     */
+    void report(submission &submit);
+
+    /**
+     * @brief 提交即将发送最终评测报告，丢弃尚未发送的中途评测报告
+     * 调用方必须持有 submit.mut，或者确保没有其他线程访问该提交。调用后本类不会再访问该提交，提交可以被销毁
+     */
+    void complete(submission &submit);
+
+    /**
+     * @brief 停止后台线程，尚未发送的中途评测报告被丢弃，之后的中途评测报告不再合并
+     */
+    void stop();
+
+private:
+    struct state {
+        std::chrono::steady_clock::time_point last_report;
+        bool pending = false;
+    };
+
+    std::chrono::milliseconds interval;
+
+    std::mutex mut;
+    std::condition_variable cond;
+    std::map<submission *, state> states;
+    std::thread flusher;
+    bool stopping = false;
+
+    void flush_loop();
+};
+
+}  // namespace judge::server
@@ -2,9 +2,11 @@
 
 #include <set>
 #include <thread>
+#include <vector>
 
-#include "common/concurrent_queue.hpp"
 #include "common/messages.hpp"
+#include "common/work_stealing_queue.hpp"
+#include "core_allocator.hpp"
 #include "judge/judger.hpp"
 #include "monitor/monitor.hpp"
 #include "server/judge_server.hpp"
@@ -17,8 +19,9 @@
  * 然后评测服务端会根据参数，开启 submission fetcher，然后
  * 进入循环不断尝试获取 fetcher。
  * 
- * 每个 worker 都会访问这里的函数，如果遇到评测队列为空的情况，worker 需要调用 fetch_submission 函
- * 数来拉取评测（TODO: 测试潜在的多个 worker 同时访问 fetch_submission 导致评测队列过长的问题）。
+ * 每个评测服务器都有一个拉取线程，拉取线程运行在 worker 以外的 CPU 核心上，负责提前拉取并检查提交，
+ * 在有空闲 worker、正在评测的提交数不超过上限、磁盘和内存余量充足时才将提交的评测任务分发到评测队列。
+ * 空闲 worker 阻塞在评测队列上，直到有新的评测任务推送进来才被唤醒，因此 worker 占有的核心只用于评测。
  * 在评测完成后，通过调用 judger::process 函数来完成数据点的统计，如果发现评测完了一个提交，则立刻返回。
  * 因此大部分情况下评测队列不会过长：只会拉取适量的评测，确保评测队列不会过长。
  */
@@ -66,21 +69,47 @@ void register_monitor(std::unique_ptr<monitor> &&monitor);
  */
 void report_error(const std::string &message);
 
+/**
+ * @brief 根据名称获取评测队列的调度策略
+ * 可选的调度策略：
+ * locality: 默认策略，worker 按推送顺序优先评测自己推送的评测任务，评测所需文件仍在缓存中
+ * fifo: 按评测任务推送的顺序评测
+ * shortest: 优先评测预计运行时间（client_task.expect_runtime）最短的评测任务
+ * fair: 在正在评测的提交之间轮流评测，避免大量评测任务的提交阻塞其他提交
+ * fifo、shortest、fair 的顺序对所有 worker 全局成立，评测任务都进入共享队列
+ * @param name 调度策略名称
+ * @throw std::invalid_argument 如果调度策略不存在
+ */
+work_stealing_queue<message::client_task>::policy_factory get_scheduling_policy(const std::string &name);
+
 /**
  * @brief 启动评测 worker 线程
  * 注意评测服务端客户端收发消息直接通过发送指针实现，因此 worker 不能通过 fork
  * 生成。
  * 
  * @param core_id worker 运行的 CPU 核心
- * @param task_queue 评测服务端发送评测信息的队列
- * @param core_queue 核心申请队列，对于多核编程题，获取到提交的 worker 将发送核心获取申请，
- * 其他 worker 发现申请后将当前 CPU 分配给之前申请的 worker，并阻塞当前 worker 的处理直到
- * 该多核提交评测完成为止。
+ * @param task_queue 评测服务端发送评测信息的队列，worker 以 core_id 作为自己的本地队列编号，
+ * 评测过程中推送的后续评测任务会优先由当前 worker 评测，空闲的 worker 会窃取其他 worker 的评测任务
+ * @param allocator 核心分配器，对于多核评测任务，领取到评测任务的 worker 将通过核心分配器占用其他空闲
+ * worker 的核心，被占用的 worker 在该评测任务完成之前不会领取新的评测任务。
  * @return 产生的线程
  * 
  * 选手代码、测试数据、随机数据生成器、标准程序、SPJ 等资源的
  * 下载均由客户端完成。服务端只完成提交的拉取和数据点的分发。
  */
-std::thread start_worker(size_t core_id, concurrent_queue<message::client_task> &task_queue, concurrent_queue<message::core_request> &core_queue);
+std::thread start_worker(size_t core_id, work_stealing_queue<message::client_task> &task_queue, core_allocator &allocator);
+
+/**
+ * @brief 为每个已注册的评测服务器启动拉取线程
+ * 拉取线程负责拉取提交、检查提交的合法性，并在准入条件满足时分发评测任务，
+ * 准入条件见 MAX_INFLIGHT_SUBMISSIONS、MIN_FREE_DISK、MIN_FREE_MEMORY。
+ * 停止 worker 后，拉取线程分发完已经拉取的提交后退出。
+ * 
+ * @param worker_cores 所有 worker 占有的 CPU 核心，拉取线程将运行在其余的 CPU 核心上
+ * @param task_queue 评测服务端发送评测信息的队列
+ * @param allocator 核心分配器，拉取线程根据空闲的核心数决定是否分发新的提交
+ * @return 产生的线程
+ */
+std::vector<std::thread> start_intake(const std::set<unsigned> &worker_cores, work_stealing_queue<message::client_task> &task_queue, core_allocator &allocator);
 
 }  // namespace judge
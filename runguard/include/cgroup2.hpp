@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "cgroup_pool.hpp"
+#include "runguard_options.hpp"
+
+/**
+ * @brief cgroup 统计的受控程序资源使用情况
+ */
+struct cgroup_usage {
+    int64_t memory_bytes = 0;  // 内存使用峰值
+    double cpu_time = 0;       // 单位为秒
+    double user_time = 0;
+    double sys_time = 0;
+    bool oom = false;  // 是否有进程因为超出内存限制而被杀死
+};
+
+/**
+ * @brief cgroup v2 的管理器，直接读写 cgroup 文件系统，不依赖 libcgroup
+ *
+ * 与 cgroup v1 不同，cgroup v2 所有的 controller 都在同一个层级中，
+ * 通过父 cgroup 的 cgroup.subtree_control 启用子 cgroup 可以使用的 controller。
+ * runguard 在委派给评测系统的子树（默认为 /sys/fs/cgroup/judger）下为每次运行创建一个 cgroup：
+ * 1. memory.max 和 memory.swap.max 限制内存并禁止交换，memory.oom.group 使得 OOM 时杀死整个 cgroup；
+ * 2. cpuset.cpus 限制受控程序可以使用的 CPU；
+ * 3. memory.peak 和 cpu.stat 统计内存峰值和 CPU 时间；
+ * 4. memory.events 的 oom_kill 记录是否发生了 OOM，文件变化时内核会产生 inotify 事件，
+ *    因此 runguard 可以在 OOM 发生时立刻知道，而不必等受控程序结束后再检查；
+ * 5. 结束时通过 cgroup.kill 一次杀死 cgroup 内的所有进程。
+ */
+struct cgroup2 {
+    /**
+     * @param path cgroup 在 cgroup 文件系统中的完整路径
+     */
+    explicit cgroup2(std::string path);
+
+    /**
+     * @brief 系统是否只挂载了 cgroup v2（unified 模式）
+     */
+    static bool available();
+
+    /**
+     * @brief 在内核中创建这个 cgroup 并设置资源限制
+     * 父 cgroup 不存在时会创建，并沿途启用需要的 controller，cgroup 已经存在时只更新资源限制
+     * @throw std::system_error 创建或设置失败时
+     */
+    void create(const runguard_options &opt);
+
+    /**
+     * @brief 将当前进程移入本 cgroup
+     */
+    void attach();
+
+    /**
+     * @brief 监听 memory.events 的变化
+     * @return inotify 的文件描述符，可读时调用 oom_kills 检查是否发生了 OOM
+     */
+    int watch_oom();
+
+    /**
+     * @brief 读取 memory.events，得到因为超出内存限制而被杀死的进程数
+     */
+    int64_t oom_kills() const;
+
+    /**
+     * @brief cgroup 内是否还有进程，包括已经被杀死但还没有退出的进程
+     */
+    bool populated() const;
+
+    /**
+     * @brief 复用 cgroup 前清零计数器，必须先杀死 cgroup 内的所有进程
+     * 回收上次运行留下的页缓存，并清零 memory.peak（需要 6.12 以上的内核），
+     * cpu.stat 和 memory.events 无法清零，记录到 baseline 中
+     */
+    void reset(cgroup_baseline &baseline);
+
+    /**
+     * @brief 读取资源使用情况
+     * @param baseline 复用的 cgroup 在本次运行开始前的计数器
+     */
+    cgroup_usage usage(const cgroup_baseline &baseline = {}) const;
+
+    /**
+     * @brief 只读取 cpu.stat 中的 CPU 时间，用于在受控程序运行时检查 CPU 时间限制
+     * @return 单位为秒
+     */
+    double cpu_time(const cgroup_baseline &baseline = {}) const;
+
+    /**
+     * @brief 杀死 cgroup 内的所有进程
+     */
+    void kill();
+
+    /**
+     * @brief 从内核中删除这个 cgroup，必须先调用 kill
+     */
+    void remove();
+
+    const std::string &get_path() const;
+
+private:
+    std::string path;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include "runguard_options.hpp"
+
+/**
+ * @brief 复用的 cgroup 在本次运行开始前的计数器
+ * 有些计数器无法清零，统计时需要减去运行开始前的值
+ */
+struct cgroup_baseline {
+    bool reused = false;   // 是否使用了复用的 cgroup
+    double cpu_time = 0;   // cgroup v2 的 cpu.stat 无法清零，单位为秒
+    double user_time = 0;
+    double sys_time = 0;
+    int64_t oom_kill = 0;  // memory.events（v2）或 memory.oom_control（v1）中的 oom_kill 无法清零
+    int peak_fd = -1;      // cgroup v2 中清零过的 memory.peak，只有通过这个文件描述符才能读到清零后的峰值
+};
+
+/**
+ * @brief 从 cgroup 池中取出一个空闲的 cgroup
+ *
+ * 每次运行都创建和删除 cgroup 的开销并不小，cgroup 的创建和删除在内核中需要竞争全局锁，
+ * 大量 runguard 同时启动时这部分时间会达到数毫秒。因此 runguard 按照 cpuset 为每组 CPU 核心
+ * 保留若干个 cgroup（/judger/pool_<cpuset>_<slot>），运行结束后不删除，留给下一次运行使用。
+ *
+ * 每个 cgroup 对应 /run/runguard 中的一个锁文件，runguard 通过 flock 独占一个 cgroup，
+ * runguard 退出时锁自动释放，因此 runguard 异常退出也不会导致 cgroup 无法再被使用。
+ * 取出 cgroup 后会先杀死并等待残留的进程全部退出，再清零内存峰值、CPU 时间等计数器，
+ * 无法清零的计数器记录在 baseline 中。
+ *
+ * @param opt 取得 cgroup 时 opt.cgroupname 被设置为该 cgroup
+ * @param baseline 本次运行开始前的计数器
+ * @return 是否取得了 cgroup，所有 cgroup 都在使用时返回 false，此时应该创建新的 cgroup
+ */
+bool cgroup_pool_acquire(struct runguard_options &opt, cgroup_baseline &baseline);
+
+/**
+ * @brief 杀死 cgroup 内残留的进程，按照 opt 更新资源限制并清零计数器，cgroup 不存在时创建
+ * 取出 cgroup 时调用；批量运行的各项共用一个 cgroup，每一项开始前也调用一次
+ */
+void cgroup_pool_reset(const struct runguard_options &opt, cgroup_baseline &baseline);
+
+/**
+ * @brief 杀死 cgroup 内的所有进程，将 cgroup 留给下一次运行
+ */
+void cgroup_pool_release(const struct runguard_options &opt, cgroup_baseline &baseline);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+/**
+ * @brief 硬件性能计数器的统计结果
+ */
+struct perf_result {
+    int64_t instructions = 0;  // 用户态执行的指令数
+    int64_t cycles = 0;        // 用户态的 CPU 周期数
+    double task_clock = 0;     // 进程实际占用 CPU 的时间，单位为秒
+    bool emulated = false;     // 硬件计数器不可用，instructions 和 cycles 由 task_clock 估算
+};
+
+/**
+ * @brief 统计受控程序及其所有子进程执行的指令数、CPU 周期数和 task-clock
+ *
+ * 繁忙的机器上 CPU 时间和时钟时间受其他进程、缓存和频率的影响，同一份代码重测时可能在超时和不超时之间变化，
+ * 而执行的指令数基本只由程序本身决定。
+ *
+ * 计数器通过 perf_event_open 打开，指定 inherit 以统计受控程序 fork 出的所有子进程（也就是 cgroup 内的所有进程），
+ * 指定 enable_on_exec 以只统计 exec 之后的选手程序。为了确保 exec 发生在计数器打开之后，子进程在 exec 之前
+ * 通过管道等待父进程打开计数器。
+ *
+ * 虚拟机中一般无法访问硬件 PMU，此时只打开软件计数器 task-clock，并按照每纳秒 1 条指令、1 个周期估算
+ * instructions 和 cycles。task-clock 只统计进程实际在 CPU 上运行的时间，仍然比 CPU 时间和时钟时间稳定。
+ */
+class perf_counters {
+public:
+    perf_counters() = default;
+    perf_counters(const perf_counters &) = delete;
+    perf_counters &operator=(const perf_counters &) = delete;
+    ~perf_counters();
+
+    /**
+     * @brief 创建与子进程同步的管道，必须在 fork 之前调用
+     */
+    void prepare();
+
+    /**
+     * @brief 在子进程 exec 之前调用，等待父进程打开计数器
+     */
+    void wait_for_parent();
+
+    /**
+     * @brief 在父进程 fork 之后调用，为子进程打开计数器，并通知子进程继续运行
+     */
+    void attach(pid_t pid);
+
+    /**
+     * @brief 是否已经打开了计数器
+     */
+    bool enabled() const;
+
+    /**
+     * @brief 读取计数器，在子进程结束后调用
+     */
+    perf_result read() const;
+
+private:
+    int pipefd[2] = {-1, -1};
+    int instructions_fd = -1, cycles_fd = -1, task_clock_fd = -1;
+};
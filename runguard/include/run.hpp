@@ -1,5 +1,8 @@
 #pragma once
 
+#include <optional>
+#include <vector>
+
 #include "runguard_options.hpp"
 
 /**
@@ -11,10 +14,10 @@
  * 4. 检查 runguard 进程的内存限制
  * 5. 调用 fork 创建子进程，并等待子进程结束
  *    1. 对于父进程
- *       1. 监听子进程的 SIGALRM 来进行时间限制、SIGTERM 来清除进程树
- *       2. 创建 itimer 来限制 real time，并注册 sigaction，在遇到 SIGALRM 时终止子进程并记录信息到 meta 文件中
+ *       1. 通过 signalfd 监听 SIGTERM 来清除进程树
+ *       2. 创建 timerfd 来限制 real time，并定期检查 cgroup 的 CPU 时间
  *       3. 与子进程建立管道连接，必要时重定向到文件
- *       4. 等待子进程结束
+ *       4. 在同一个 poll 中等待子进程结束（pidfd）、超时和 OOM，超时或 OOM 时立刻杀死 cgroup 内的所有进程
  *    2. 对于子进程，添加子进程资源限制，并与父进程建立管道重定向输入输出
  *       1. 必要时清除 PATH 环境变量
  *       2. 通过 rlimit 限制 CPU time
@@ -31,3 +34,20 @@
  * 9. 删除创建的 cgroup，并记录所有的信息到 meta 文件中
  */
 int runit(struct runguard_options opt);
+
+/**
+ * @brief 在同一套运行环境中依次运行多项，比如同一提交的多个测试点的选手程序和比较器
+ *
+ * batch 中的设置只准备一次：从 cgroup 池中取出（或者创建）一个 cgroup，分离 mount 命名空间并挂载 batch.mounts
+ * （比如以 chroot 环境为 lowerdir 的根目录 overlay，以及 --prepare-root），分离或者进入网络命名空间。
+ * 每一项只挂载自己的 mounts（比如以该测试点的 run 文件夹为可写层的 /judge），在子进程中以 batch_entry 调用 runit，
+ * 结束后卸载，因此各项之间只重置了各自挂载的可写层；cgroup 在每一项开始前杀死残留的进程、按照该项更新资源限制并清零计数器。
+ * 根目录 overlay 的可写层在各项之间共用，选手程序写入 /judge 以外（比如 /tmp）的文件对之后的项可见。
+ *
+ * 每一项向 batch.record_fd 写入一条运行结果记录，顺序与 entries 一致。参数不合法、挂载失败或者 runit 崩溃的项
+ * 写入带有 internal_error 的记录，因此记录的条数总是与项数相同。
+ *
+ * @param entries 各项的设置，参数不合法的项为空。各项的 cgroup 和 cpuset 设置被忽略
+ * @return 所有项都写入了正常的记录时返回 0，否则返回 1
+ */
+int run_batch(struct runguard_options batch, std::vector<std::optional<struct runguard_options>> entries);
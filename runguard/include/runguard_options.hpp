@@ -11,12 +11,28 @@ struct time_limit {
     double soft, hard;
 };
 
+/**
+ * @brief 在新的 mount 命名空间中挂载的文件系统
+ */
+struct mount_option {
+    std::string type;    // overlay 或 bind
+    std::string source;  // bind 的源路径
+    std::string target;
+    std::string data;    // overlay 的挂载参数，如 lowerdir=...,upperdir=...,workdir=...
+    bool readonly = false;
+};
+
 struct runguard_options {
     std::string cgroupname;
+    bool cgroup_v2 = false;                          // 使用 cgroup v2，系统只挂载了 cgroup v2 时启用
+    std::string cgroup_root = "/sys/fs/cgroup/judger";  // cgroup v2 中委派给评测系统的子树
+    bool reuse_cgroup = false;                       // 从 cgroup 池中取出 cgroup，运行结束后不删除
     std::string chroot_dir;
     std::string work_dir;
     size_t nproc = std::numeric_limits<size_t>::max();
     std::string preexecute;
+    std::vector<mount_option> mounts;  // 按顺序挂载，在 preexecute 之前执行
+    bool prepare_root = false;         // 在 root 中挂载 /proc 并创建设备文件
     std::string user;
     std::string group;
     int user_id = -1;
@@ -30,6 +46,8 @@ struct runguard_options {
     struct time_limit cpu_limit;  // CPU time
 
     int64_t memory_limit = -1;  // Memory limit in bytes
+    bool perf_counters = false;      // report instructions, cycles and task-clock
+    int64_t instruction_limit = -1;  // judge time limit by instructions instead of soft time limits
     int file_limit = -1;        // Output limit
     bool no_core_dumps = false;
 
@@ -38,14 +56,28 @@ struct runguard_options {
      */
     std::vector<int> syscalls;
 
+    /**
+     * Files listing allowed syscall names, loaded as seccomp filter before exec
+     */
+    std::vector<std::string> seccomp_profiles;
+
     std::string stdin_filename;
     std::string stdout_filename;
     std::string stderr_filename;
 
+    /**
+     * Inherited file descriptors used as stdin/stdout of the command (e.g. pipes to an interactor),
+     * closed in runguard after fork so that the other end sees EOF once the command exits
+     */
+    int stdin_fd = -1;
+    int stdout_fd = -1;
+
     bool preserve_sys_env = false;
     std::vector<std::string> env;
 
     std::string metafile_path;
+    int record_fd = -1;  // inherited file descriptor to write a runguard_record to, see runguard_record.hpp
+    bool batch_entry = false;  // run by run_batch, which has already set up the cgroup, mount and network namespaces
     std::vector<std::string> command;
 
     friend std::ostream& operator<<(std::ostream& out, runguard_options& opt);  // for debug
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief runguard 通过 --out-record 指定的文件描述符写入的运行结果
+ *
+ * meta 文件的每一项都需要 runguard 格式化成文本、写入文件，评测系统再读取文件、逐行解析，
+ * 而且 runguard 崩溃时可能只写入了一半。运行结果记录是定长的二进制结构，runguard 结束前通过一次 write 写入，
+ * 小于 PIPE_BUF 的写入对于管道是原子的，因此评测系统要么读到完整的记录，要么读不到记录（runguard 崩溃）。
+ *
+ * 评测系统（include/runguard.hpp）和 runguard 共用本文件，修改结构时必须增加 RUNGUARD_RECORD_VERSION。
+ * 受控程序启动失败时 runguard fork 出的子进程会先写入一条带有 internal_error 的记录，因此读取方只使用第一条记录。
+ * meta 文件仍然会写入，以便调试。
+ */
+struct runguard_record {
+    uint32_t magic;    // RUNGUARD_RECORD_MAGIC
+    uint32_t version;  // RUNGUARD_RECORD_VERSION
+
+    int32_t exitcode;
+    int32_t signal;  // 没有被信号杀死时为 -1
+
+    double wall_time;  // 单位均为秒
+    double user_time;
+    double sys_time;
+    double cpu_time;
+
+    int64_t memory_bytes;
+
+    int64_t instructions;  // 没有打开性能计数器时为 -1
+    int64_t cycles;
+    double task_clock;
+
+    uint8_t time_result;    // 0 为未超时，1 为 soft-timelimit，2 为 hard-timelimit
+    uint8_t oom;            // 对应 meta 文件中的 memory-result: oom
+    uint8_t perf_emulated;  // 对应 meta 文件中的 perf-source: software
+    uint8_t seccomp_violation;
+    uint8_t reserved[4];
+
+    char internal_error[256];  // 以 '\0' 结尾，过长时被截断
+};
+
+constexpr uint32_t RUNGUARD_RECORD_MAGIC = 0x52475244;  // "RGRD"
+constexpr uint32_t RUNGUARD_RECORD_VERSION = 1;
+
+static_assert(sizeof(runguard_record) <= 512, "runguard_record must be written to a pipe atomically");
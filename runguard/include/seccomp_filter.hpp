@@ -0,0 +1,26 @@
+#pragma once
+
+#include <linux/filter.h>
+
+#include <vector>
+
+#include "runguard_options.hpp"
+
+/**
+ * @brief 编译系统调用白名单
+ *
+ * 白名单由 --allowed-syscall 指定的系统调用号和 --seccomp-profile 指定的系统调用规则组成，规则可以限制系统调用的参数，
+ * 不在白名单中的系统调用会使内核以 SIGSYS 杀死整个进程（SECCOMP_RET_KILL_PROCESS）。
+ * 白名单在 exec 之前加载，因此 execve 总是被允许的。
+ *
+ * 使用 libseccomp 生成 BPF 程序的开销比加载 BPF 程序大得多，编译好的 BPF 程序按照白名单的内容
+ * 缓存在 /run/runguard 中，相同白名单的运行（比如同一语言的所有测试点）直接读取缓存。
+ *
+ * @return BPF 程序，没有指定白名单时为空
+ */
+std::vector<sock_filter> compile_seccomp_filter(const struct runguard_options &opt);
+
+/**
+ * @brief 在子进程 exec 之前加载 BPF 程序，加载之后子进程及其子进程都无法再调用白名单以外的系统调用
+ */
+void load_seccomp_filter(const std::vector<sock_filter> &program);
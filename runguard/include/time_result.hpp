@@ -0,0 +1,32 @@
+#pragma once
+
+#include <optional>
+
+#include "perf.hpp"
+#include "runguard_options.hpp"
+
+/**
+ * @brief 受控程序结束后按照软时间限制判定的结果
+ * 超过硬时间限制的受控程序在运行中就被结束，不在这里判定
+ */
+struct soft_limit_result {
+    bool cpu = false;   // 超过 CPU 时间限制，设置了指令数限制时为超过指令数限制
+    bool wall = false;  // 超过时钟时间限制
+};
+
+/**
+ * @brief 判定受控程序是否超过软时间限制
+ * 设置了指令数限制并且打开了性能计数器时只按照指令数判定，时间限制只用于强制结束程序；
+ * 否则按照 CPU 时间和时钟时间判定。评测系统的单元测试也使用本函数，因此只依赖头文件。
+ * @param counters 性能计数器的统计结果，没有打开性能计数器时为空
+ */
+inline soft_limit_result check_soft_limits(const runguard_options &opt, double cpu_time, double wall_time, const std::optional<perf_result> &counters) {
+    soft_limit_result result;
+    if (opt.instruction_limit > 0 && counters) {
+        result.cpu = counters->instructions > opt.instruction_limit;
+    } else {
+        result.wall = opt.use_wall_limit && wall_time > opt.wall_limit.soft;
+        result.cpu = opt.use_cpu_limit && cpu_time > opt.cpu_limit.soft;
+    }
+    return result;
+}
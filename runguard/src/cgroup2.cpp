@@ -0,0 +1,222 @@
+#include "cgroup2.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/log/trivial.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+using namespace std;
+
+static const string CGROUP2_MOUNT = "/sys/fs/cgroup";
+
+/**
+ * @brief 受控程序需要的 controller
+ */
+static const char *const CONTROLLERS[] = {"memory", "cpu", "cpuset"};
+
+static void write_file(const string &file, const string &value) {
+    int fd = open(file.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) throw system_error(errno, system_category(), fmt::format("unable to open {}", file));
+    ssize_t ret = write(fd, value.data(), value.size());
+    int err = errno;
+    close(fd);
+    if (ret < 0) throw system_error(err, system_category(), fmt::format("unable to write {} to {}", value, file));
+}
+
+static string read_file(const string &file) {
+    ifstream fin(file);
+    if (!fin) throw system_error(errno, system_category(), fmt::format("unable to read {}", file));
+    stringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
+
+/**
+ * @brief 读取 memory.events、cpu.stat 这类每行为 "键 值" 的文件
+ * @return 键对应的值，不存在时返回 0
+ */
+static int64_t read_keyed(const string &file, const string &key) {
+    istringstream fin(read_file(file));
+    string name;
+    int64_t value;
+    while (fin >> name >> value)
+        if (name == key) return value;
+    return 0;
+}
+
+/**
+ * @brief 在 cgroup 的 cgroup.subtree_control 中启用子 cgroup 需要的 controller
+ */
+static void enable_controllers(const string &cgroup) {
+    istringstream available(read_file(cgroup + "/cgroup.controllers"));
+    istringstream subtree_control(read_file(cgroup + "/cgroup.subtree_control"));
+    set<string> enabled{istream_iterator<string>(subtree_control), istream_iterator<string>()};
+    for (string controller; available >> controller;) {
+        if (find(begin(CONTROLLERS), end(CONTROLLERS), controller) == end(CONTROLLERS)) continue;
+        if (enabled.count(controller)) continue;
+        try {
+            write_file(cgroup + "/cgroup.subtree_control", "+" + controller);
+        } catch (system_error &e) {
+            BOOST_LOG_TRIVIAL(warning) << e.what();
+        }
+    }
+}
+
+cgroup2::cgroup2(string path) : path(move(path)) {}
+
+bool cgroup2::available() {
+    return access((CGROUP2_MOUNT + "/cgroup.controllers").c_str(), F_OK) == 0;
+}
+
+void cgroup2::create(const runguard_options &opt) {
+    // 父 cgroup 一般只在第一次运行时需要创建，之后 cgroup.subtree_control 中已经启用了 controller
+    filesystem::path parent = filesystem::path(path).parent_path();
+    filesystem::path cgroup = CGROUP2_MOUNT;
+    enable_controllers(cgroup);
+    for (auto &component : filesystem::relative(parent, CGROUP2_MOUNT)) {
+        cgroup /= component;
+        if (mkdir(cgroup.c_str(), 0755) != 0 && errno != EEXIST)
+            throw system_error(errno, system_category(), fmt::format("unable to create cgroup {}", cgroup.string()));
+        enable_controllers(cgroup);
+    }
+
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+        throw system_error(errno, system_category(), fmt::format("unable to create cgroup {}", path));
+
+    // 将交换空间限制为 0 可以强制不发生交换，与 cgroup v1 中将 RAM 和 RAM+交换 的大小限制设为一样相同
+    write_file(path + "/memory.max", opt.memory_limit < 0 ? "max" : to_string(opt.memory_limit));
+    if (access((path + "/memory.swap.max").c_str(), F_OK) == 0)
+        write_file(path + "/memory.swap.max", "0");
+    write_file(path + "/memory.oom.group", "1");
+
+    if (!opt.cpuset.empty()) {
+        // 设置选手程序能使用的 CPU（我们必须让这些程序独占 CPU 以避免时间计量不准确
+        // cpuset.mems 为空时继承父 cgroup 的内存节点
+        write_file(path + "/cpuset.cpus", opt.cpuset);
+    } else {
+        BOOST_LOG_TRIVIAL(info) << "cpuset undefined";
+    }
+}
+
+void cgroup2::attach() {
+    write_file(path + "/cgroup.procs", to_string(getpid()));
+}
+
+int cgroup2::watch_oom() {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) throw system_error(errno, system_category(), "inotify_init1");
+    if (inotify_add_watch(fd, (path + "/memory.events").c_str(), IN_MODIFY) < 0) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, system_category(), fmt::format("unable to watch {}/memory.events", path));
+    }
+    return fd;
+}
+
+int64_t cgroup2::oom_kills() const {
+    return read_keyed(path + "/memory.events", "oom_kill");
+}
+
+bool cgroup2::populated() const {
+    return read_keyed(path + "/cgroup.events", "populated") != 0;
+}
+
+void cgroup2::reset(cgroup_baseline &baseline) {
+    // 上次运行写入的文件的页缓存仍然计入本 cgroup，memory.reclaim 需要 5.19 以上的内核
+    if (access((path + "/memory.reclaim").c_str(), F_OK) == 0) {
+        try {
+            write_file(path + "/memory.reclaim", read_file(path + "/memory.current"));
+        } catch (system_error &e) {
+            // 无法回收全部内存时内核返回 EAGAIN，剩余的页缓存不影响选手程序的运行
+            BOOST_LOG_TRIVIAL(debug) << e.what();
+        }
+    }
+
+    string stat = path + "/cpu.stat";
+    baseline.cpu_time = read_keyed(stat, "usage_usec") / 1e6;
+    baseline.user_time = read_keyed(stat, "user_usec") / 1e6;
+    baseline.sys_time = read_keyed(stat, "system_usec") / 1e6;
+    baseline.oom_kill = oom_kills();
+
+    // 向 memory.peak 写入任意内容会清零这个文件描述符看到的峰值，旧的内核不支持写入
+    int fd = open((path + "/memory.peak").c_str(), O_RDWR | O_CLOEXEC);
+    if (fd >= 0 && write(fd, "reset\n", 6) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    baseline.peak_fd = fd;
+}
+
+cgroup_usage cgroup2::usage(const cgroup_baseline &baseline) const {
+    cgroup_usage usage;
+
+    // memory.peak 需要 5.19 以上的内核，复用的 cgroup 还需要能清零 memory.peak，
+    // 否则退回到 runguard 已经回收的子进程的最大常驻内存
+    if (baseline.peak_fd >= 0) {
+        char buf[32] = {};
+        if (pread(baseline.peak_fd, buf, sizeof(buf) - 1, 0) < 0)
+            throw system_error(errno, system_category(), fmt::format("unable to read {}/memory.peak", path));
+        usage.memory_bytes = stoll(buf);
+    } else if (!baseline.reused && access((path + "/memory.peak").c_str(), F_OK) == 0) {
+        usage.memory_bytes = stoll(read_file(path + "/memory.peak"));
+    } else {
+        struct rusage ru;
+        if (getrusage(RUSAGE_CHILDREN, &ru) == 0) usage.memory_bytes = (int64_t)ru.ru_maxrss * 1024;
+    }
+
+    // cpu.stat 中的时间单位为微秒
+    string stat = path + "/cpu.stat";
+    usage.cpu_time = read_keyed(stat, "usage_usec") / 1e6 - baseline.cpu_time;
+    usage.user_time = read_keyed(stat, "user_usec") / 1e6 - baseline.user_time;
+    usage.sys_time = read_keyed(stat, "system_usec") / 1e6 - baseline.sys_time;
+
+    usage.oom = oom_kills() > baseline.oom_kill;
+    return usage;
+}
+
+double cgroup2::cpu_time(const cgroup_baseline &baseline) const {
+    return read_keyed(path + "/cpu.stat", "usage_usec") / 1e6 - baseline.cpu_time;
+}
+
+void cgroup2::kill() {
+    // cgroup.kill 需要 5.14 以上的内核，否则逐个杀死 cgroup 内的进程
+    if (access((path + "/cgroup.kill").c_str(), F_OK) == 0) {
+        write_file(path + "/cgroup.kill", "1");
+        return;
+    }
+
+    while (true) {
+        istringstream procs(read_file(path + "/cgroup.procs"));
+        bool empty = true;
+        for (pid_t pid; procs >> pid; empty = false)
+            ::kill(pid, SIGKILL);
+        if (empty) break;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+void cgroup2::remove() {
+    // 被杀死的进程退出之前 cgroup 无法删除
+    for (int retry = 0; rmdir(path.c_str()) != 0; ++retry) {
+        if (errno != EBUSY || retry >= 1000)
+            throw system_error(errno, system_category(), fmt::format("unable to remove cgroup {}", path));
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+const string &cgroup2::get_path() const {
+    return path;
+}
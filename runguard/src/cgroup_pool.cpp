@@ -0,0 +1,122 @@
+#include "cgroup_pool.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/log/trivial.hpp>
+#include <fstream>
+#include <thread>
+
+#include "cgroup2.hpp"
+#include "limits.hpp"
+
+using namespace std;
+
+static const string LOCK_DIR = "/run/runguard";
+
+/**
+ * @brief 每组 CPU 核心最多保留的 cgroup 个数
+ * 评测系统为每个评测任务分配独占的 CPU 核心，同一组核心上一般只会同时运行一个 runguard
+ */
+static const int SLOTS_PER_CPUSET = 4;
+
+static void write_value(const string &file, const string &value) {
+    ofstream fout(file);
+    if (!(fout << value << flush))
+        BOOST_LOG_TRIVIAL(warning) << "unable to write " << value << " to " << file;
+}
+
+/**
+ * @brief 读取 cgroup v1 的 memory.oom_control 中的 oom_kill
+ */
+static int64_t read_oom_kill(const string &cgroupname) {
+    ifstream fin("/sys/fs/cgroup/memory" + cgroupname + "/memory.oom_control");
+    string token;
+    int64_t value;
+    while (fin >> token >> value)
+        if (token == "oom_kill") return value;
+    return 0;
+}
+
+void cgroup_pool_reset(const runguard_options &opt, cgroup_baseline &baseline) {
+    bool exists = access((opt.cgroup_v2 ? opt.cgroupname : "/sys/fs/cgroup/memory" + opt.cgroupname).c_str(), F_OK) == 0;
+    if (exists) {
+        // 上一次运行结束时已经杀死了所有进程，但 runguard 异常退出时可能还有残留
+        cgroup_kill(opt);
+        if (opt.cgroup_v2) {
+            cgroup2 cg(opt.cgroupname);
+            for (int retry = 0; cg.populated(); ++retry) {
+                if (retry >= 1000) throw runtime_error(fmt::format("processes in cgroup {} cannot be killed", opt.cgroupname));
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        } else {
+            // memory.memsw.limit_in_bytes 不能小于 memory.limit_in_bytes，先取消限制才能调大内存限制
+            write_value("/sys/fs/cgroup/memory" + opt.cgroupname + "/memory.memsw.limit_in_bytes", "-1");
+        }
+    }
+
+    // cgroup 已经存在时只更新资源限制
+    cgroup_create(opt);
+
+    if (opt.cgroup_v2) {
+        cgroup2(opt.cgroupname).reset(baseline);
+    } else {
+        string memory = "/sys/fs/cgroup/memory" + opt.cgroupname;
+        // 回收上次运行留下的页缓存，再将内存峰值重置为当前的内存使用量
+        write_value(memory + "/memory.force_empty", "0");
+        write_value(memory + "/memory.max_usage_in_bytes", "0");
+        write_value(memory + "/memory.memsw.max_usage_in_bytes", "0");
+        write_value("/sys/fs/cgroup/cpuacct" + opt.cgroupname + "/cpuacct.usage", "0");
+        baseline.oom_kill = read_oom_kill(opt.cgroupname);
+    }
+    baseline.reused = true;
+}
+
+bool cgroup_pool_acquire(runguard_options &opt, cgroup_baseline &baseline) {
+    if (mkdir(LOCK_DIR.c_str(), 0755) != 0 && errno != EEXIST) {
+        BOOST_LOG_TRIVIAL(warning) << "unable to create " << LOCK_DIR << ", cgroups will not be reused";
+        return false;
+    }
+
+    string key = opt.cpuset.empty() ? "all" : opt.cpuset;
+    replace(key.begin(), key.end(), ',', '_');
+    for (int slot = 0; slot < SLOTS_PER_CPUSET; ++slot) {
+        string name = fmt::format("pool_{}_{}", key, slot);
+        string lock = LOCK_DIR + "/" + name + ".lock";
+        int fd = open(lock.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            BOOST_LOG_TRIVIAL(warning) << "unable to open " << lock << ", cgroups will not be reused";
+            return false;
+        }
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            close(fd);
+            continue;
+        }
+
+        // 锁在 runguard 退出时释放，因此不关闭 fd
+        opt.cgroupname = opt.cgroup_v2 ? opt.cgroup_root + "/" + name : "/judger/" + name;
+        try {
+            cgroup_pool_reset(opt, baseline);
+        } catch (exception &e) {
+            BOOST_LOG_TRIVIAL(warning) << "unable to reuse cgroup " << opt.cgroupname << ": " << e.what();
+            close(fd);
+            baseline = cgroup_baseline();
+            return false;
+        }
+        BOOST_LOG_TRIVIAL(info) << "reusing cgroup " << opt.cgroupname;
+        return true;
+    }
+    return false;
+}
+
+void cgroup_pool_release(const runguard_options &opt, cgroup_baseline &baseline) {
+    cgroup_kill(opt);
+    if (baseline.peak_fd >= 0) {
+        close(baseline.peak_fd);
+        baseline.peak_fd = -1;
+    }
+}
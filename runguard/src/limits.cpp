@@ -4,7 +4,6 @@
 #include <grp.h>
 #include <libcgroup.h>
 #include <math.h>
-#include <seccomp.h>
 #include <signal.h>
 #include <sys/resource.h>
 #include <unistd.h>
@@ -13,12 +12,18 @@
 #include <system_error>
 
 #include "cgroup.hpp"
+#include "cgroup2.hpp"
 #include "system.hpp"
 #include "utils.hpp"
 
 using namespace std;
 
 void cgroup_create(const struct runguard_options &opt) {
+    if (opt.cgroup_v2) {
+        cgroup2(opt.cgroupname).create(opt);
+        return;
+    }
+
     cgroup_guard cg(opt.cgroupname);
 
     // 初始化 memory 资源管控器
@@ -49,12 +54,22 @@ void cgroup_create(const struct runguard_options &opt) {
 }
 
 void cgroup_attach(const struct runguard_options &opt) {
+    if (opt.cgroup_v2) {
+        cgroup2(opt.cgroupname).attach();
+        return;
+    }
+
     cgroup_guard cg(opt.cgroupname);
     cg.get_cgroup();
     cg.attach_task();
 }
 
 void cgroup_kill(const struct runguard_options &opt) {
+    if (opt.cgroup_v2) {
+        cgroup2(opt.cgroupname).kill();
+        return;
+    }
+
     void *ptr = nullptr;
     pid_t pid;
 
@@ -68,6 +83,11 @@ void cgroup_kill(const struct runguard_options &opt) {
 }
 
 void cgroup_delete(const struct runguard_options &opt) {
+    if (opt.cgroup_v2) {
+        cgroup2(opt.cgroupname).remove();
+        return;
+    }
+
     cgroup_guard cg(opt.cgroupname);
     cg.add_controller("cpuacct");
     cg.add_controller("memory");
@@ -182,10 +202,3 @@ void set_restrictions(const struct runguard_options &opt) {
     if (geteuid() == 0 || getuid() == 0)
         throw runtime_error("you cannot run user command as root");
 }
-
-void set_seccomp(const struct runguard_options &opt) {
-    scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_KILL);
-    for (int syscall : opt.syscalls)
-        seccomp_rule_add(ctx, SCMP_ACT_ALLOW, syscall, 0);
-    seccomp_load(ctx);
-}
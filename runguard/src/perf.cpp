@@ -0,0 +1,106 @@
+#include "perf.hpp"
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/log/trivial.hpp>
+#include <cstring>
+#include <system_error>
+
+using namespace std;
+
+/**
+ * @brief 硬件计数器不可用时，每秒 task-clock 估算的指令数和周期数
+ */
+static const double EMULATED_RATE = 1e9;
+
+static int open_counter(pid_t pid, uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = type == PERF_TYPE_HARDWARE;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * @brief 读取计数器，计数器被复用时按照实际计数的时间比例放大
+ */
+static int64_t read_counter(int fd) {
+    uint64_t values[3];
+    if (::read(fd, values, sizeof(values)) != sizeof(values))
+        throw system_error(errno, system_category(), "unable to read perf counter");
+    if (values[2] == 0) return 0;
+    if (values[2] == values[1]) return values[0];
+    return (int64_t)((double)values[0] * values[1] / values[2]);
+}
+
+perf_counters::~perf_counters() {
+    for (int fd : {pipefd[0], pipefd[1], instructions_fd, cycles_fd, task_clock_fd})
+        if (fd >= 0) close(fd);
+}
+
+void perf_counters::prepare() {
+    if (pipe2(pipefd, O_CLOEXEC) != 0)
+        throw system_error(errno, system_category(), "unable to create pipe for perf counters");
+}
+
+void perf_counters::wait_for_parent() {
+    if (pipefd[0] < 0) return;
+    close(pipefd[1]);
+    char c;
+    // 父进程打开计数器后写入一个字节，父进程异常退出时读到 EOF，两种情况都继续运行
+    while (::read(pipefd[0], &c, 1) < 0 && errno == EINTR)
+        ;
+    close(pipefd[0]);
+}
+
+void perf_counters::attach(pid_t pid) {
+    close(pipefd[0]);
+    pipefd[0] = -1;
+
+    task_clock_fd = open_counter(pid, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+    if (task_clock_fd < 0) {
+        BOOST_LOG_TRIVIAL(warning) << "unable to open perf counters: " << strerror(errno);
+    } else {
+        instructions_fd = open_counter(pid, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        cycles_fd = open_counter(pid, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        if (instructions_fd < 0 || cycles_fd < 0) {
+            BOOST_LOG_TRIVIAL(info) << "hardware perf counters unavailable, estimating from task-clock: " << strerror(errno);
+            for (int *fd : {&instructions_fd, &cycles_fd}) {
+                if (*fd >= 0) close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+    if (write(pipefd[1], "", 1) != 1)
+        BOOST_LOG_TRIVIAL(warning) << "unable to notify child process: " << strerror(errno);
+    close(pipefd[1]);
+    pipefd[1] = -1;
+}
+
+bool perf_counters::enabled() const {
+    return task_clock_fd >= 0;
+}
+
+perf_result perf_counters::read() const {
+    perf_result result;
+    result.task_clock = read_counter(task_clock_fd) / 1e9;  // task-clock 的单位为纳秒
+    if (instructions_fd >= 0 && cycles_fd >= 0) {
+        result.instructions = read_counter(instructions_fd);
+        result.cycles = read_counter(cycles_fd);
+    } else {
+        result.emulated = true;
+        result.instructions = result.cycles = (int64_t)(result.task_clock * EMULATED_RATE);
+    }
+    return result;
+}
@@ -3,11 +3,15 @@
 #include <fcntl.h>
 #include <fmt/core.h>
 #include <math.h>
-#include <seccomp.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/mount.h>
 #include <sys/resource.h>
-#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/timerfd.h>
 #include <sys/times.h>
 #include <sys/types.h>
 #include <sys/user.h>
@@ -19,16 +23,30 @@
 #include <boost/log/trivial.hpp>
 #include <fstream>
 #include <iostream>
+#include <optional>
+#include <sstream>
 #include <system_error>
+#include <thread>
 
 #include "cgroup.hpp"
+#include "cgroup2.hpp"
+#include "cgroup_pool.hpp"
 #include "limits.hpp"
+#include "perf.hpp"
 #include "runguard_options.hpp"
+#include "runguard_record.hpp"
+#include "seccomp_filter.hpp"
 #include "system.hpp"
+#include "time_result.hpp"
 #include "utils.hpp"
 
 using namespace std;
 
+// glibc 2.36 之前没有 pidfd_open 的封装
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
 const struct timespec killdelay = {0, 100000000L};  // 0.1s
 
 const int TIMELIMIT_SOFT = 1;
@@ -38,9 +56,14 @@ int walllimit = 0, cpulimit = 0;
 
 ofstream metafile;
 int child_pid = -1;
-int efd = -1;
-static volatile sig_atomic_t received_SIGCHLD = 0;
+int oomfd = -1;  // 使用 cgroup v2 时监听 memory.events 的 inotify 文件描述符
+static bool oom_detected = false;
+static cgroup_baseline baseline;  // 复用 cgroup 时本次运行开始前的计数器
+static perf_counters perf;
+static vector<sock_filter> seccomp_program;  // 在 exec 之前加载的系统调用白名单
 static volatile sig_atomic_t received_signal = -1;
+static int record_fd = -1;        // --out-record 指定的文件描述符，写入记录后置为 -1
+static runguard_record record{};  // 与 meta 文件同时填写
 
 template <typename... Args>
 void error(int err, Args&&... args) {
@@ -53,13 +76,29 @@ void append_meta(const char* key, T message) {
     metafile << key << ": " << message << endl;
 }
 
+/**
+ * @brief 通过一次 write 写入运行结果记录，每个进程只写入一次
+ * 子进程在 exec 之前出错时也会写入带有 internal_error 的记录，这条记录先于父进程的记录写入
+ */
+static void write_record() {
+    if (record_fd < 0) return;
+    record.magic = RUNGUARD_RECORD_MAGIC;
+    record.version = RUNGUARD_RECORD_VERSION;
+    ssize_t ret;
+    while ((ret = write(record_fd, &record, sizeof(record))) < 0 && errno == EINTR)
+        ;
+    if (ret != (ssize_t)sizeof(record))
+        BOOST_LOG_TRIVIAL(warning) << "unable to write runguard record: " << strerror(errno);
+    close(record_fd);
+    record_fd = -1;
+}
+
 void runguard_terminate_handler() {
     sigset_t sigs;
     /*
-	 * Make sure the signal handler for these (terminate()) does not
-	 * interfere, we are exiting now anyway.
+	 * Make sure SIGTERM does not interfere, we are exiting now anyway.
 	 */
-    sigaddset(&sigs, SIGALRM);
+    sigemptyset(&sigs);
     sigaddset(&sigs, SIGTERM);
     sigprocmask(SIG_BLOCK, &sigs, nullptr);
 
@@ -72,9 +111,12 @@ void runguard_terminate_handler() {
         cerr << e.what() << endl;
 
         append_meta("internal-error", e.what());
+        strncpy(record.internal_error, e.what(), sizeof(record.internal_error) - 1);
     } catch (...) {
         cerr << "Unknown exception occurred" << endl;
+        strncpy(record.internal_error, "unknown exception", sizeof(record.internal_error) - 1);
     }
+    write_record();
 
     /* Make sure that all children are killed before terminating */
     if (child_pid > 0) {
@@ -108,8 +150,51 @@ static void set_propagation(unsigned long flags) {
         BOOST_LOG_TRIVIAL(fatal) << "cannot change root filesystem propagation";
 }
 
+static void mount_one(const mount_option& mnt) {
+    if (mnt.type == "overlay") {
+        if (mount("overlay", mnt.target.c_str(), "overlay", 0, mnt.data.c_str()) != 0)
+            error(errno, "unable to mount overlay on {} with {}", mnt.target, mnt.data);
+    } else {
+        if (mount(mnt.source.c_str(), mnt.target.c_str(), nullptr, MS_BIND, nullptr) != 0)
+            error(errno, "unable to bind {} to {}", mnt.source, mnt.target);
+        // 只读的 bind mount 需要重新挂载一次才能生效
+        if (mnt.readonly && mount(nullptr, mnt.target.c_str(), nullptr, MS_BIND | MS_REMOUNT | MS_RDONLY, nullptr) != 0) {
+            umount2(mnt.target.c_str(), MNT_DETACH);
+            error(errno, "unable to remount {} as read-only", mnt.target);
+        }
+    }
+}
+
+/**
+ * @brief 挂载 mount 命名空间中的文件系统，代替在 preexecute 中调用 mount 命令
+ */
+static void mount_all(const runguard_options& opt) {
+    for (auto& mnt : opt.mounts) mount_one(mnt);
+
+    if (opt.prepare_root) {
+        // 与 exec/utils/chroot_setup.sh 的 chroot_start 一致：Java 需要 /proc/self/stat，
+        // 在 Docker 中直接挂载的字符设备无法访问，因此重新创建字符设备
+        string proc = opt.chroot_dir + "/proc", dev = opt.chroot_dir + "/dev";
+        mkdir(proc.c_str(), 0755);
+        if (mount("/proc", proc.c_str(), nullptr, MS_BIND, nullptr) != 0)
+            error(errno, "unable to bind /proc to {}", proc);
+
+        static const struct {
+            const char* name;
+            unsigned major, minor;
+        } devices[] = {{"full", 1, 7}, {"null", 1, 3}, {"ptmx", 5, 2}, {"random", 1, 8}, {"tty", 5, 0}, {"urandom", 1, 9}};
+        mkdir(dev.c_str(), 0755);
+        for (auto& device : devices) {
+            string path = dev + "/" + device.name;
+            unlink(path.c_str());
+            if (mknod(path.c_str(), S_IFCHR | 0666, makedev(device.major, device.minor)) != 0 || chmod(path.c_str(), 0666) != 0)
+                error(errno, "unable to create device {}", path);
+        }
+    }
+}
+
 static void summarize_cgroup(const runguard_options& opt, int exitcode,
-                             struct timeval starttime, struct timeval endtime,
+                             struct timespec starttime, struct timespec endtime,
                              struct tms startticks, struct tms endticks) {
     static const char output_timelimit_str[4][16] = {
         "",
@@ -118,58 +203,79 @@ static void summarize_cgroup(const runguard_options& opt, int exitcode,
         "hard-timelimit"};
     double cpudiff;
 
-    cgroup_guard guard(opt.cgroupname);
-    guard.get_cgroup();  // prepare for get_controller
+    bool is_oom = false;
+    if (opt.cgroup_v2) {
+        cgroup_usage usage = cgroup2(opt.cgroupname).usage(baseline);
+
+        BOOST_LOG_TRIVIAL(info) << "total memory used: " << usage.memory_bytes / 1024 << "kB";
+        append_meta("memory-bytes", to_string(usage.memory_bytes));
+        record.memory_bytes = usage.memory_bytes;
+        cpudiff = usage.cpu_time;
+        is_oom = usage.oom || oom_detected;
+    } else {
+        cgroup_guard guard(opt.cgroupname);
+        guard.get_cgroup();  // prepare for get_controller
 
-    {
-        cgroup_ctrl ctrl = guard.get_controller("memory");
-        int64_t max_usage = ctrl.get_value_int64("memory.memsw.max_usage_in_bytes");
+        {
+            cgroup_ctrl ctrl = guard.get_controller("memory");
+            int64_t max_usage = ctrl.get_value_int64("memory.memsw.max_usage_in_bytes");
 
-        BOOST_LOG_TRIVIAL(info) << "total memory used: " << max_usage / 1024 << "kB";
-        append_meta("memory-bytes", to_string(max_usage));
-    }
-    {
-        cgroup_ctrl ctrl = guard.get_controller("cpuacct");
-        int64_t cpu_time = ctrl.get_value_int64("cpuacct.usage");  // in ns
-        cpudiff = (double)cpu_time / 1e9;
-    }
+            BOOST_LOG_TRIVIAL(info) << "total memory used: " << max_usage / 1024 << "kB";
+            append_meta("memory-bytes", to_string(max_usage));
+            record.memory_bytes = max_usage;
+        }
+        {
+            cgroup_ctrl ctrl = guard.get_controller("cpuacct");
+            int64_t cpu_time = ctrl.get_value_int64("cpuacct.usage");  // in ns
+            cpudiff = (double)cpu_time / 1e9;
+        }
 
-    bool is_oom = false;
-    {
         ifstream fin("/sys/fs/cgroup/memory" + opt.cgroupname + "/memory.oom_control");
         while (fin.good()) {
             string token;
             fin >> token;
-            if (token == "oom_kill")
-                fin >> is_oom;
+            if (token == "oom_kill") {
+                int64_t oom_kill = 0;
+                fin >> oom_kill;
+                is_oom = oom_kill > baseline.oom_kill;
+            }
         }
     }
 
-    // 另一种实现读取是否发生 OOM 的方法：
-    // uint64_t u;
-    // assert(is_oom == (read(efd, &u, sizeof(uint64_t)) == sizeof(uint64_t)));
-
     if (is_oom)
         append_meta("memory-result", "oom");
     else
         append_meta("memory-result", "");
+    record.oom = is_oom;
 
     // 杀死 cgroup 内所有的进程，以确保父进程结束后不会有
     // so our timing is correct: no child processes can survive longer than
     // our monitored process. Run time of the monitored process is actually
     // the runtime of the whole process group.
-    cgroup_kill(opt);
-    cgroup_delete(opt);
+    if (baseline.reused) {
+        cgroup_pool_release(opt, baseline);
+    } else {
+        cgroup_kill(opt);
+        cgroup_delete(opt);
+    }
 
     unsigned long tps = sysconf(_SC_CLK_TCK);
     append_meta("exitcode", exitcode);
+    record.exitcode = exitcode;
 
     if (received_signal != -1) {
         append_meta("signal", received_signal);
     }
+    record.signal = received_signal;
+
+    // 调用了白名单以外的系统调用
+    if (received_signal == SIGSYS && !seccomp_program.empty()) {
+        append_meta("seccomp-violation", "killed");
+        record.seccomp_violation = true;
+    }
 
     double walldiff = (endtime.tv_sec - starttime.tv_sec) +
-                      (endtime.tv_usec - starttime.tv_usec) * 1E-6;
+                      (endtime.tv_nsec - starttime.tv_nsec) * 1E-9;
     double userdiff = (double)(endticks.tms_cutime - startticks.tms_cutime) / tps;
     double sysdiff = (double)(endticks.tms_cstime - startticks.tms_cstime) / tps;
 
@@ -177,155 +283,342 @@ static void summarize_cgroup(const runguard_options& opt, int exitcode,
     append_meta("user-time", fmt::format("{:.3f}", userdiff));
     append_meta("sys-time", fmt::format("{:.3f}", sysdiff));
     append_meta("cpu-time", fmt::format("{:.3f}", cpudiff));
+    record.wall_time = walldiff;
+    record.user_time = userdiff;
+    record.sys_time = sysdiff;
+    record.cpu_time = cpudiff;
 
     BOOST_LOG_TRIVIAL(info) << fmt::format("run time: real {:.3f}, user {:.3f}, sys {:.3f}", walldiff, userdiff, sysdiff);
 
-    if (opt.use_wall_limit && walldiff > opt.wall_limit.soft) {
+    optional<perf_result> counters;
+    if (perf.enabled()) {
+        counters = perf.read();
+        append_meta("instructions", counters->instructions);
+        append_meta("cycles", counters->cycles);
+        append_meta("task-clock", fmt::format("{:.6f}", counters->task_clock));
+        append_meta("perf-source", counters->emulated ? "software" : "hardware");
+        record.instructions = counters->instructions;
+        record.cycles = counters->cycles;
+        record.task_clock = counters->task_clock;
+        record.perf_emulated = counters->emulated;
+    }
+
+    soft_limit_result soft = check_soft_limits(opt, cpudiff, walldiff, counters);
+    if (soft.wall) {
         walllimit |= TIMELIMIT_SOFT;
         BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (soft wall time)";
     }
-
-    if (opt.use_cpu_limit && cpudiff > opt.cpu_limit.soft) {
+    if (soft.cpu) {
         cpulimit |= TIMELIMIT_SOFT;
-        BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (soft cpu time)";
+        BOOST_LOG_TRIVIAL(warning) << (opt.instruction_limit > 0 && counters ? "Time Limit Exceeded (instructions)" : "Time Limit Exceeded (soft cpu time)");
     }
 
     append_meta("time-result", output_timelimit_str[walllimit | cpulimit]);
+    record.time_result = (walllimit | cpulimit) & TIMELIMIT_HARD ? 2 : (walllimit | cpulimit) ? 1 : 0;
+    write_record();
 }
 
-void terminate(int sig) {
-    struct sigaction sigact;
-
-    /* Reset signal handlers to default */
-    sigact.sa_handler = SIG_DFL;
-    sigact.sa_flags = 0;
-    if (sigemptyset(&sigact.sa_mask) != 0)
-        BOOST_LOG_TRIVIAL(warning) << "could not initialize signal mask";
-    if (sigaction(SIGTERM, &sigact, NULL) != 0)
-        BOOST_LOG_TRIVIAL(warning) << "could not restore signal handler";
-    if (sigaction(SIGALRM, &sigact, NULL) != 0)
-        BOOST_LOG_TRIVIAL(warning) << "could not restore signal handler";
-
-    if (sig == SIGALRM) {
-        walllimit |= TIMELIMIT_HARD;
-        BOOST_LOG_TRIVIAL(warning) << "timelimit exceeded (hard wall time): aborting command";
-    } else {
-        BOOST_LOG_TRIVIAL(warning) << "received signal " << sig << ": aborting command";
-    }
-
-    received_signal = sig;
-
-    /* First try to kill graciously, then hard.
-	   Don't report an already exited process as error. */
-    BOOST_LOG_TRIVIAL(info) << "sending SIGTERM";
-    if (kill(-child_pid, SIGTERM) != 0 && errno != ESRCH) {
-        error(errno, "sending SIGTERM to command");
+/**
+ * @brief cpuset 中的 CPU 核心数，cpuset 的格式如 0-3,5，未指定 cpuset 时为系统的核心数
+ */
+static int cpuset_size(const string& cpuset) {
+    if (cpuset.empty()) return max(1u, thread::hardware_concurrency());
+    int count = 0;
+    istringstream ranges(cpuset);
+    for (string range; getline(ranges, range, ',');) {
+        auto dash = range.find('-');
+        count += dash == string::npos ? 1 : stoi(range.substr(dash + 1)) - stoi(range.substr(0, dash)) + 1;
     }
+    return max(count, 1);
+}
 
-    /* Prefer nanosleep over sleep because of higher resolution and
-	   it does not interfere with signals. */
-    nanosleep(&killdelay, NULL);
+/**
+ * @brief cgroup 统计的受控程序到目前为止使用的 CPU 时间，单位为秒
+ */
+static double cgroup_cpu_time(const runguard_options& opt) {
+    if (opt.cgroup_v2) return cgroup2(opt.cgroupname).cpu_time(baseline);
+
+    // 复用的 cgroup v1 在运行前已经清零了 cpuacct.usage
+    ifstream fin("/sys/fs/cgroup/cpuacct" + opt.cgroupname + "/cpuacct.usage");
+    int64_t usage = 0;
+    fin >> usage;
+    return usage / 1e9;
+}
 
+/**
+ * @brief 立刻杀死受控程序及 cgroup 内的所有进程
+ * 子进程可能还没有将自己移入 cgroup，因此同时直接杀死子进程。unshare 法中子进程是新 PID 命名空间的 init 进程，
+ * 杀死它会使内核杀死命名空间内的所有进程
+ */
+static void kill_child(const runguard_options& opt) {
     BOOST_LOG_TRIVIAL(info) << "sending SIGKILL";
-    if (kill(-child_pid, SIGKILL) != 0 && errno != ESRCH) {
+    if (kill(child_pid, SIGKILL) != 0 && errno != ESRCH)
         error(errno, "sending SIGKILL to command");
-    }
-    BOOST_LOG_TRIVIAL(info) << "killed, waiting for a short period";
-
-    /* Wait another while to make sure the process is killed by now. */
-    nanosleep(&killdelay, NULL);
-    BOOST_LOG_TRIVIAL(info) << "exiting";
+    cgroup_kill(opt);
 }
 
-static void child_handler(int /* signal */) {
-    received_SIGCHLD = true;
-}
+/**
+ * @brief 监视子进程直到子进程结束
+ *
+ * 子进程结束（pidfd）、硬时钟时间限制到期（timerfd）、cgroup v2 中发生 OOM（memory.events 的 inotify）
+ * 以及收到 SIGTERM（signalfd）都在同一个 poll 中处理。超时、OOM 时立刻通过 cgroup 杀死所有进程，
+ * 不再先发送 SIGTERM 再等待固定的时间，也不必等到子进程结束后才在 summarize_cgroup 中发现 OOM。
+ *
+ * CPU 时间的硬限制按照 cgroup 统计的 CPU 时间检查，包括子进程 fork 出的所有进程。CPU 时间的增长不会快于
+ * 时钟时间乘以 cpuset 的核心数，因此 poll 的超时时间取剩余的 CPU 时间除以核心数，超时后重新检查。
+ * RLIMIT_CPU 仍然会在 CPU 时间限制向上取整后以 SIGXCPU 结束单个进程。
+ *
+ * 内核不支持 pidfd（5.3 以下）时通过 signalfd 等待 SIGCHLD。
+ *
+ * @param starttime 子进程开始运行的时间，硬时钟时间限制从这个时间开始计算
+ * @param endtime 发现子进程结束的时间
+ */
+static void wait_child(const runguard_options& opt, int& status, const struct timespec& starttime, struct timespec& endtime) {
+    sigset_t sigmask;
+    if (sigemptyset(&sigmask) != 0 || sigaddset(&sigmask, SIGTERM) != 0) error(errno, "setting signal mask");
+
+    int pidfd = (int)syscall(SYS_pidfd_open, child_pid, 0);
+    if (pidfd < 0) {
+        BOOST_LOG_TRIVIAL(info) << "pidfd unavailable, waiting for SIGCHLD: " << strerror(errno);
+        // SIGCHLD 在 runit 中已经被屏蔽，子进程在 signalfd 创建之前结束时 SIGCHLD 也不会丢失
+        if (sigaddset(&sigmask, SIGCHLD) != 0) error(errno, "setting signal mask");
+    }
+    int sigfd = signalfd(-1, &sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigfd < 0) error(errno, "creating signalfd");
+
+    int timerfd = -1;
+    if (opt.use_wall_limit) {
+        timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timerfd < 0) error(errno, "creating timerfd");
+        struct itimerspec deadline = {};
+        double seconds;
+        deadline.it_value.tv_sec = starttime.tv_sec + (time_t)opt.wall_limit.hard;
+        deadline.it_value.tv_nsec = starttime.tv_nsec + (long)(modf(opt.wall_limit.hard, &seconds) * 1E9);
+        if (deadline.it_value.tv_nsec >= 1000000000L) {
+            deadline.it_value.tv_sec++;
+            deadline.it_value.tv_nsec -= 1000000000L;
+        }
+        if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &deadline, nullptr) != 0)
+            error(errno, "setting timer");
+        BOOST_LOG_TRIVIAL(info) << fmt::format("setting hard wall-time limit to {:.3f} seconds", opt.wall_limit.hard);
+    }
 
-int run_seccomp(runguard_options opt);
-int run_unshare(runguard_options opt);
+    enum { CHILD, SIGNAL, TIMER, OOM };
+    struct pollfd pfds[] = {{pidfd, POLLIN, 0}, {sigfd, POLLIN, 0}, {timerfd, POLLIN, 0}, {oomfd, POLLIN, 0}};
+    const int ncpus = cpuset_size(opt.cpuset);
+    bool killed = false;
+    while (true) {
+        // 子进程结束前 pidfd 不会可读，没有 pidfd 时 SIGCHLD 也可能来自其他进程，因此总是先尝试回收
+        pid_t pid = waitpid(child_pid, &status, WNOHANG);
+        if (pid == -1) error(errno, "waitpid");
+        if (pid == child_pid) break;
+
+        int timeout = -1;
+        if (opt.use_cpu_limit && !killed) {
+            double remaining = opt.cpu_limit.hard - cgroup_cpu_time(opt);
+            if (remaining <= 0) {
+                cpulimit |= TIMELIMIT_HARD;
+                BOOST_LOG_TRIVIAL(warning) << "timelimit exceeded (hard cpu time): aborting command";
+                kill_child(opt);
+                killed = true;
+            } else {
+                timeout = max(1, (int)ceil(remaining * 1000 / ncpus));
+            }
+        }
 
-int runit(struct runguard_options opt) {
-    set_terminate(runguard_terminate_handler);
-    metafile.open(opt.metafile_path.c_str(), ofstream::out);
+        if (poll(pfds, sizeof(pfds) / sizeof(pfds[0]), timeout) < 0) {
+            if (errno == EINTR) continue;
+            error(errno, "polling child process events");
+        }
 
-    {
-        struct sigaction sigact;
-        sigset_t sigmask, emptymask;
-        if (sigemptyset(&emptymask) != 0) error(errno, "creating empty signal mask");
+        if (pfds[SIGNAL].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+                if (info.ssi_signo != SIGTERM || killed) continue;
+                BOOST_LOG_TRIVIAL(warning) << "received signal " << info.ssi_signo << ": aborting command";
+                kill_child(opt);
+                killed = true;
+            }
+        }
 
-        /* unmask all signals, except SIGCHLD: detected in pselect() below */
-        sigmask = emptymask;
-        if (sigaddset(&sigmask, SIGCHLD) != 0) error(errno, "setting signal mask");
-        if (sigprocmask(SIG_SETMASK, &sigmask, NULL) != 0) {
-            error(errno, "unmasking signals");
+        if (pfds[TIMER].revents & POLLIN) {
+            uint64_t expirations;
+            if (read(timerfd, &expirations, sizeof(expirations)) == sizeof(expirations) && !killed) {
+                walllimit |= TIMELIMIT_HARD;
+                BOOST_LOG_TRIVIAL(warning) << "timelimit exceeded (hard wall time): aborting command";
+                kill_child(opt);
+                killed = true;
+            }
         }
 
-        /* Construct signal handler for SIGCHLD detection in pselect(). */
-        received_SIGCHLD = 0;
-        sigact.sa_handler = child_handler;
-        sigact.sa_flags = 0;
-        sigact.sa_mask = emptymask;
-        if (sigaction(SIGCHLD, &sigact, NULL) != 0) {
-            error(errno, "installing signal handler");
+        if (pfds[OOM].revents & POLLIN) {
+            char buf[4096];
+            while (read(oomfd, buf, sizeof(buf)) > 0)
+                ;
+            if (!oom_detected && cgroup2(opt.cgroupname).oom_kills() > baseline.oom_kill) {
+                oom_detected = true;
+                BOOST_LOG_TRIVIAL(warning) << "Memory Limit Exceeded";
+                cgroup_kill(opt);
+            }
         }
     }
 
-    BOOST_LOG_TRIVIAL(info) << "Initializing cgroup";
-
-    cgroup_guard::init();
-
-    opt.cgroupname = fmt::format("/judger/cgroup_{}_{}", getpid(), (int)time(NULL));
+    if (clock_gettime(CLOCK_MONOTONIC, &endtime) != 0)
+        error(errno, "getting time");
+    for (int fd : {pidfd, sigfd, timerfd})
+        if (fd >= 0) close(fd);
+}
 
-    BOOST_LOG_TRIVIAL(info) << "Creating cgroup";
+/**
+ * @brief 在子进程中重定向标准输入输出到文件或者继承的文件描述符
+ */
+static void redirect_standard_files(const runguard_options& opt) {
+    if (opt.stdout_filename.size())
+        if (freopen(opt.stdout_filename.c_str(), "w", stdout) == NULL) {
+            BOOST_LOG_TRIVIAL(warning) << "unable to freopen stdout";
+        }
+    if (opt.stderr_filename.size())
+        if (freopen(opt.stderr_filename.c_str(), "w", stderr) == NULL) {
+            BOOST_LOG_TRIVIAL(warning) << "unable to freopen stderr";
+        }
+    if (opt.stdin_filename.size())
+        if (freopen(opt.stdin_filename.c_str(), "r", stdin) == NULL) {
+            BOOST_LOG_TRIVIAL(warning) << "unable to freopen stdin";
+        }
+    for (auto [fd, target] : {pair{opt.stdin_fd, STDIN_FILENO}, pair{opt.stdout_fd, STDOUT_FILENO}}) {
+        if (fd < 0) continue;
+        if (dup2(fd, target) < 0) error(errno, "unable to redirect fd {} to {}", fd, target);
+        close(fd);
+    }
+}
 
-    cgroup_create(opt);
+/**
+ * @brief 父进程关闭传给子进程的文件描述符，否则管道的另一端在子进程结束后读不到 EOF
+ */
+static void close_standard_fds(const runguard_options& opt) {
+    for (int fd : {opt.stdin_fd, opt.stdout_fd})
+        if (fd >= 0) close(fd);
+}
 
+static void fix_oom_killer() {
     BOOST_LOG_TRIVIAL(info) << "Fixing Linux OOM killer";
 
-    {
-        /* Check if any Linux Out-Of-Memory killer adjustments have to
-         * be made. The oom_adj or oom_score_adj is inherited by child
-         * processes, and at least older versions of sshd seemed to set
-         * it, leading to processes getting a timelimit instead of memory
-         * exceeded, when running via SSH. */
-        const char* OOM_PATH_NEW = "/proc/self/oom_score_adj";
-        const char* OOM_PATH_OLD = "/proc/self/oom_adj";
-        const int OOM_RESET_VALUE = 0;
-
-        FILE* fp = nullptr;
-        string oom_path;
-        int ret;
-        if (!fp && (fp = fopen(OOM_PATH_NEW, "r+"))) oom_path = OOM_PATH_NEW;
-        if (!fp && (fp = fopen(OOM_PATH_OLD, "r+"))) oom_path = OOM_PATH_OLD;
-        if (fp) {
-            if (fscanf(fp, "%d", &ret) != 1) error(errno, "cannot read from '{}'", oom_path);
-            if (ret < 0) {
-                BOOST_LOG_TRIVIAL(info) << "resetting '" << oom_path << "' from " << ret << " to " << OOM_RESET_VALUE;
-                rewind(fp);
-                if (fprintf(fp, "%d\n", OOM_RESET_VALUE) <= 0) {
-                    error(errno, "cannot write to '{}'", oom_path);
-                }
+    /* Check if any Linux Out-Of-Memory killer adjustments have to
+     * be made. The oom_adj or oom_score_adj is inherited by child
+     * processes, and at least older versions of sshd seemed to set
+     * it, leading to processes getting a timelimit instead of memory
+     * exceeded, when running via SSH. */
+    const char* OOM_PATH_NEW = "/proc/self/oom_score_adj";
+    const char* OOM_PATH_OLD = "/proc/self/oom_adj";
+    const int OOM_RESET_VALUE = 0;
+
+    FILE* fp = nullptr;
+    string oom_path;
+    int ret;
+    if (!fp && (fp = fopen(OOM_PATH_NEW, "r+"))) oom_path = OOM_PATH_NEW;
+    if (!fp && (fp = fopen(OOM_PATH_OLD, "r+"))) oom_path = OOM_PATH_OLD;
+    if (fp) {
+        if (fscanf(fp, "%d", &ret) != 1) error(errno, "cannot read from '{}'", oom_path);
+        if (ret < 0) {
+            BOOST_LOG_TRIVIAL(info) << "resetting '" << oom_path << "' from " << ret << " to " << OOM_RESET_VALUE;
+            rewind(fp);
+            if (fprintf(fp, "%d\n", OOM_RESET_VALUE) <= 0) {
+                error(errno, "cannot write to '{}'", oom_path);
             }
-            if (fclose(fp) != 0) error(errno, "closing file '{}'", oom_path);
         }
+        if (fclose(fp) != 0) error(errno, "closing file '{}'", oom_path);
+    }
+}
+
+/**
+ * @brief 进入 ip netns add 创建的网络命名空间
+ */
+static void join_netns(const string& netns) {
+    int netfd = open(("/var/run/netns/" + netns).c_str(), O_RDONLY);
+    if (netfd == -1) error(errno, "opening netns fd " + netns);
+    BOOST_LOG_TRIVIAL(info) << "Associating with existing network namespace " << netns;
+    if (setns(netfd, CLONE_NEWNET) == -1) {
+        close(netfd);
+        error(errno, "setting ns");
     }
+    close(netfd);
+}
+
+/**
+ * @brief 从 cgroup 池中取出 cgroup，池中的 cgroup 都在使用（或者没有指定 --reuse-cgroup）时创建新的 cgroup
+ */
+static void acquire_cgroup(runguard_options& opt, cgroup_baseline& baseline) {
+    if (opt.reuse_cgroup && cgroup_pool_acquire(opt, baseline)) return;
 
-    // 另一种实现读取是否发生 OOM 的方法：
-    // if ((efd = eventfd(0, EFD_NONBLOCK)) < 0) error(errno, "requesting event fd");
-    // int cfd = open(("/sys/fs/cgroup/memory" + opt.cgroupname + "/cgroup.event_control").c_str(), O_WRONLY);
-    // if (cfd < 0) error(errno, "opening cgroup.event_control");
-    // int ofd = open(("/sys/fs/cgroup/memory" + opt.cgroupname + "/memory.oom_control").c_str(), O_RDONLY);
-    // if (ofd < 0) error(errno, "opening memory.oom_control");
-    // string oom = fmt::format("{} {}", efd, ofd);
-    // if (write(cfd, oom.data(), oom.size()) < 0) error(errno, "writing cgroup.event_control");
-    // if (close(cfd) < 0) error(errno, "closing cgroup.event_control");
+    // cgroup v2 中直接使用 cgroup 在 cgroup 文件系统中的完整路径
+    if (opt.cgroup_v2)
+        opt.cgroupname = fmt::format("{}/cgroup_{}_{}", opt.cgroup_root, getpid(), (int)time(NULL));
+    else
+        opt.cgroupname = fmt::format("/judger/cgroup_{}_{}", getpid(), (int)time(NULL));
+
+    BOOST_LOG_TRIVIAL(info) << "Creating cgroup";
+
+    cgroup_create(opt);
+}
 
+static void enter_mount_namespace() {
     unshare(CLONE_NEWNS);
 
     // Linux 内核隔离 mount 命名空间的默认行为是创建 private 的根挂载点
     // systemd 将行为修改为 shared，我们要手动恢复该行为
     // 参见 unshare 命令源代码（util-linux/sys-utils/unshare.c）
     set_propagation(MS_REC | MS_PRIVATE);
+}
+
+int run_seccomp(runguard_options opt);
+int run_unshare(runguard_options opt);
+
+int runit(struct runguard_options opt) {
+    set_terminate(runguard_terminate_handler);
+    metafile.open(opt.metafile_path.c_str(), ofstream::out);
+
+    record = runguard_record{};
+    record.signal = -1;
+    record.instructions = record.cycles = -1;
+    record.task_clock = -1;
+    record_fd = opt.record_fd;
+    // 受控程序不能继承记录的文件描述符，否则可以伪造运行结果
+    if (record_fd >= 0 && fcntl(record_fd, F_SETFD, FD_CLOEXEC) != 0)
+        error(errno, "unable to set close-on-exec flag of fd {}", record_fd);
+
+    {
+        sigset_t sigmask;
+
+        /* unmask all signals, except SIGCHLD: detected in wait_child() */
+        if (sigemptyset(&sigmask) != 0) error(errno, "creating empty signal mask");
+        if (sigaddset(&sigmask, SIGCHLD) != 0) error(errno, "setting signal mask");
+        if (sigprocmask(SIG_SETMASK, &sigmask, NULL) != 0) {
+            error(errno, "unmasking signals");
+        }
+    }
+
+    if (opt.batch_entry) {
+        // 批量运行的各项共用 run_batch 取出的 cgroup，只需要更新资源限制并清零计数器
+        cgroup_pool_reset(opt, baseline);
+    } else {
+        opt.cgroup_v2 = cgroup2::available();
+        if (!opt.cgroup_v2) {
+            BOOST_LOG_TRIVIAL(info) << "Initializing cgroup";
+
+            cgroup_guard::init();
+        }
+        acquire_cgroup(opt, baseline);
+        fix_oom_killer();
+    }
+
+    // cgroup v2 中发生 OOM 时 memory.events 会产生 inotify 事件，在 wait_child 中处理
+    if (opt.cgroup_v2) oomfd = cgroup2(opt.cgroupname).watch_oom();
+
+    // 批量运行的各项在 run_batch 的 mount 命名空间中运行，挂载已经由 run_batch 完成
+    if (!opt.batch_entry) {
+        enter_mount_namespace();
+        mount_all(opt);
+    }
 
     if (!opt.preexecute.empty()) {
         BOOST_LOG_TRIVIAL(info) << "Executing pre-executed command";
@@ -334,6 +627,9 @@ int runit(struct runguard_options opt) {
         BOOST_LOG_TRIVIAL(info) << "Executed pre-executed command";
     }
 
+    // 编译好的白名单可能需要写入缓存，必须在放弃 root 权限之前完成
+    seccomp_program = compile_seccomp_filter(opt);
+
     if (!opt.syscalls.empty())
         return run_seccomp(opt);
     else
@@ -351,48 +647,70 @@ void set_restrictions_parent(const runguard_options& opt) {
         if (setuid(getuid()) != 0) error(errno, "setting watchdog uid");
     }
 
-    sigset_t emptymask;
-    if (sigemptyset(&emptymask) != 0) error(errno, "creating empty signal mask");
-
-    {
-        sigset_t sigmask;
-        struct sigaction sigact;
-
-        /* Construct one-time signal handler to terminate() for TERM
-            and ALRM signals. */
-        sigmask = emptymask;
-        if (sigaddset(&sigmask, SIGALRM) != 0 || sigaddset(&sigmask, SIGTERM) != 0)
-            error(errno, "setting signal mask");
-
-        sigact.sa_handler = terminate;
-        sigact.sa_flags = SA_RESETHAND | SA_RESTART;
-        sigact.sa_mask = sigmask;
+    /* SIGTERM is read from a signalfd in wait_child(), block it so
+       that it does not terminate the watchdog. */
+    sigset_t sigmask;
+    if (sigemptyset(&sigmask) != 0 || sigaddset(&sigmask, SIGTERM) != 0)
+        error(errno, "setting signal mask");
+    if (sigprocmask(SIG_BLOCK, &sigmask, NULL) != 0)
+        error(errno, "blocking signals");
+}
 
-        /* Kill child command when we receive SIGTERM */
-        if (sigaction(SIGTERM, &sigact, NULL) != 0) {
-            error(errno, "installing signal handler");
+/**
+ * @brief fork 之后的父进程，等待子进程结束并记录运行结果
+ * @return 子进程的返回值，被信号杀死时为信号值加 128
+ */
+static int watchdog(const runguard_options& opt) {
+    if (opt.perf_counters) perf.attach(child_pid);
+    close_standard_fds(opt);
+    set_restrictions_parent(opt);
+
+    int status, exitcode;
+    struct tms startticks, endticks;
+    struct timespec starttime, endtime;
+    if (times(&startticks) == (clock_t)-1)
+        error(errno, "getting start clock ticks");
+    if (clock_gettime(CLOCK_MONOTONIC, &starttime) != 0)
+        error(errno, "getting time");
+    wait_child(opt, status, starttime, endtime);
+
+    BOOST_LOG_TRIVIAL(info) << "child process exited";
+
+    if (times(&endticks) == (clock_t)-1)
+        error(errno, "getting end clock ticks");
+
+    if (WIFEXITED(status)) {
+        exitcode = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        // In linux, exitcode is no larger than 127.
+        received_signal = WTERMSIG(status);
+        exitcode = received_signal + 128;
+        switch (received_signal) {
+            case SIGXCPU:
+                cpulimit |= TIMELIMIT_HARD;
+                BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (hard limit)";
+                break;
+            case SIGSYS:
+                BOOST_LOG_TRIVIAL(warning) << "Restricted syscall invoked";
+                break;
+            default:
+                BOOST_LOG_TRIVIAL(warning) << "Command terminated with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
+                break;
         }
+    } else if (WIFSTOPPED(status)) {
+        received_signal = WSTOPSIG(status);
+        exitcode = received_signal + 128;
+        BOOST_LOG_TRIVIAL(warning) << "Command stopped with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
+    } else {
+        throw runtime_error(fmt::format("unknown status: {:x}", status));
+    }
 
-        if (opt.use_wall_limit) {
-            /* Kill child when we receive SIGALRM */
-            if (sigaction(SIGALRM, &sigact, NULL) != 0) {
-                error(errno, "installing signal handler");
-            }
+    if (setuid(getuid()) != 0)
+        error(errno, "dropping root privileges");
 
-            double tmpd;
-            struct itimerval itimer;
-            /* Trigger SIGALRM via setitimer:  */
-            itimer.it_interval.tv_sec = 0;
-            itimer.it_interval.tv_usec = 0;
-            itimer.it_value.tv_sec = (int)opt.wall_limit.hard;
-            itimer.it_value.tv_usec = (int)(modf(opt.wall_limit.hard, &tmpd) * 1E6);
+    summarize_cgroup(opt, exitcode, starttime, endtime, startticks, endticks);
 
-            if (setitimer(ITIMER_REAL, &itimer, NULL) != 0) {
-                error(errno, "setting timer");
-            }
-            BOOST_LOG_TRIVIAL(info) << fmt::format("setting hard wall-time limit to {:.3f} seconds", opt.wall_limit.hard);
-        }
-    }
+    return exitcode;
 }
 
 int run_unshare(runguard_options opt) {
@@ -417,40 +735,26 @@ int run_unshare(runguard_options opt) {
      * 
      * unshare 函数必须放在 fork 之前，这是因为 unshare 本身执行速度很慢，不可以将其运行时间计入选手程序运行时间
      */
-    if (opt.netns.empty()) {
+    if (opt.batch_entry) {
+        // 批量运行已经分离或者进入了网络命名空间，各项共用，创建网络命名空间的开销比其他命名空间大得多
+        unshare(CLONE_FILES | CLONE_NEWPID | CLONE_NEWIPC | CLONE_NEWUTS | CLONE_SYSVSEM);
+    } else if (opt.netns.empty()) {
         BOOST_LOG_TRIVIAL(info) << "Creating new network namespace";
         unshare(CLONE_FILES | CLONE_NEWPID | CLONE_NEWIPC | CLONE_NEWUTS | CLONE_SYSVSEM | CLONE_NEWNET);
     } else {
         unshare(CLONE_FILES | CLONE_NEWPID | CLONE_NEWIPC | CLONE_NEWUTS | CLONE_SYSVSEM);
-        int netfd = open(("/var/run/netns/" + opt.netns).c_str(), O_RDONLY);
-        if (netfd == -1) error(errno, "opening netns fd " + opt.netns);
-        BOOST_LOG_TRIVIAL(info) << "Associating with existing network namespace " << opt.netns;
-        if (setns(netfd, CLONE_NEWNET) == -1) {
-            close(netfd);
-            error(errno, "setting ns");
-        }
-        close(netfd);
+        join_netns(opt.netns);
     }
 
     BOOST_LOG_TRIVIAL(info) << "Starting user program";
 
+    if (opt.perf_counters) perf.prepare();
     switch (child_pid = fork()) {
         case -1:
             throw system_error(errno, system_category(), "unable to fork");
         case 0: {  // child process, run the command
             BOOST_LOG_TRIVIAL(debug) << "Stdout_filename = " << opt.stdout_filename;
-            if (opt.stdout_filename.size())
-                if (freopen(opt.stdout_filename.c_str(), "w", stdout) == NULL) {
-                    BOOST_LOG_TRIVIAL(warning) << "unable to freopen stdout";
-                }
-            if (opt.stderr_filename.size())
-                if (freopen(opt.stderr_filename.c_str(), "w", stderr) == NULL) {
-                    BOOST_LOG_TRIVIAL(warning) << "unable to freopen stderr";
-                }
-            if (opt.stdin_filename.size())
-                if (freopen(opt.stdin_filename.c_str(), "r", stdin) == NULL) {
-                    BOOST_LOG_TRIVIAL(warning) << "unable to freopen stdin";
-                }
+            redirect_standard_files(opt);
 
             set_restrictions(opt);
 
@@ -459,62 +763,16 @@ int run_unshare(runguard_options opt) {
             for (size_t i = 0; i < cmd.size(); ++i) args[i] = cmd[i].data();
             args[cmd.size()] = 0;
 
+            perf.wait_for_parent();
+            load_seccomp_filter(seccomp_program);
             execvp(args[0], args);
 
             BOOST_LOG_TRIVIAL(debug) << "execvp first param = " << args[0];
 
             error(errno, "unable to start command {}", cmd[0]);
         } break;
-        default: {  // watchdog
-            set_restrictions_parent(opt);
-
-            int status, exitcode;
-            struct tms startticks, endticks;
-            struct timeval starttime, endtime;
-            if (times(&startticks) == (clock_t)-1)
-                error(errno, "getting start clock ticks");
-            if (gettimeofday(&starttime, NULL))
-                error(errno, "getting time");
-            if (waitpid(child_pid, &status, 0) == -1)
-                error(errno, "waitpid");
-
-            BOOST_LOG_TRIVIAL(info) << "child process exited";
-
-            if (times(&endticks) == (clock_t)-1)
-                error(errno, "getting end clock ticks");
-            if (gettimeofday(&endtime, NULL))
-                error(errno, "getting time");
-
-            if (WIFEXITED(status)) {
-                exitcode = WEXITSTATUS(status);
-            } else if (WIFSIGNALED(status)) {
-                // In linux, exitcode is no larger than 127.
-                received_signal = WTERMSIG(status);
-                exitcode = received_signal + 128;
-                switch (received_signal) {
-                    case SIGXCPU:
-                        cpulimit |= TIMELIMIT_HARD;
-                        BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (hard limit)";
-                        break;
-                    default:
-                        BOOST_LOG_TRIVIAL(warning) << "Command terminated with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
-                        break;
-                }
-            } else if (WIFSTOPPED(status)) {
-                received_signal = WSTOPSIG(status);
-                exitcode = received_signal + 128;
-                BOOST_LOG_TRIVIAL(warning) << "Command stopped with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
-            } else {
-                throw runtime_error(fmt::format("unknown status: {:x}", status));
-            }
-
-            if (setuid(getuid()) != 0)
-                error(errno, "dropping root privileges");
-
-            summarize_cgroup(opt, exitcode, starttime, endtime, startticks, endticks);
-
-            return exitcode;
-        } break;
+        default:  // watchdog
+            return watchdog(opt);
     }
 
     throw runtime_error("unexpected");
@@ -522,23 +780,13 @@ int run_unshare(runguard_options opt) {
 
 int run_seccomp(runguard_options opt) {
     BOOST_LOG_TRIVIAL(info) << "Monitoring user program by seccomp";
+    if (opt.perf_counters) perf.prepare();
     switch (child_pid = fork()) {
         case -1:
             // using error results in warning: this statement may fall through
             throw system_error(errno, generic_category(), "unable to fork");
         case 0: {  // child process, run the command
-            if (opt.stdout_filename.size())
-                if (freopen(opt.stdout_filename.c_str(), "w", stdout) == NULL) {
-                    BOOST_LOG_TRIVIAL(warning) << "unable to freopen stdout";
-                }
-            if (opt.stderr_filename.size())
-                if (freopen(opt.stderr_filename.c_str(), "w", stderr) == NULL) {
-                    BOOST_LOG_TRIVIAL(warning) << "unable to freopen stderr";
-                }
-            if (opt.stdin_filename.size())
-                if (freopen(opt.stdin_filename.c_str(), "r", stdin) == NULL) {
-                    BOOST_LOG_TRIVIAL(warning) << "unable to freopen stdin";
-                }
+            redirect_standard_files(opt);
 
             set_restrictions(opt);
 
@@ -547,60 +795,150 @@ int run_seccomp(runguard_options opt) {
             for (size_t i = 0; i < cmd.size(); ++i) args[i] = cmd[i].data();
             args[cmd.size()] = 0;
 
-            set_seccomp(opt);
+            // 等待时需要的系统调用可能被 seccomp 禁止
+            perf.wait_for_parent();
+            load_seccomp_filter(seccomp_program);
 
             execvp(args[0], args);
             error(errno, "unable to start command {}", cmd[0]);
         } break;
-        default: {  // watchdog
-            set_restrictions_parent(opt);
-
-            int status, exitcode;
-            struct tms startticks, endticks;
-            struct timeval starttime, endtime;
-            if (times(&startticks) == (clock_t)-1)
-                error(errno, "getting start clock ticks");
-            if (gettimeofday(&starttime, NULL))
-                error(errno, "getting time");
-            if (waitpid(child_pid, &status, 0) == -1)
-                error(errno, "waitpid");
-
-            if (times(&endticks) == (clock_t)-1)
-                error(errno, "getting end clock ticks");
-            if (gettimeofday(&endtime, NULL))
-                error(errno, "getting time");
-
-            if (WIFEXITED(status)) {
-                exitcode = WEXITSTATUS(status);
-            } else if (WIFSIGNALED(status)) {
-                // In linux, exitcode is no larger than 127.
-                received_signal = WTERMSIG(status);
-                exitcode = received_signal + 128;
-                switch (received_signal) {
-                    case SIGXCPU:
-                        cpulimit |= TIMELIMIT_HARD;
-                        BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (hard limit)";
-                        break;
-                    default:
-                        BOOST_LOG_TRIVIAL(warning) << "Command terminated with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
-                        break;
-                }
-            } else if (WIFSTOPPED(status)) {
-                received_signal = WSTOPSIG(status);
-                exitcode = received_signal + 128;
-                BOOST_LOG_TRIVIAL(warning) << "Command stopped with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
-            } else {
-                throw runtime_error(fmt::format("unknown status: {:x}", status));
-            }
+        default:  // watchdog
+            return watchdog(opt);
+    }
 
-            if (setuid(getuid()) != 0)
-                error(errno, "dropping root privileges");
+    throw runtime_error("unexpected");
+}
 
-            summarize_cgroup(opt, exitcode, starttime, endtime, startticks, endticks);
+/**
+ * @brief 批量运行中的一项没有写入运行结果记录时代替它的记录
+ */
+static runguard_record failed_record(const string& message) {
+    runguard_record failed{};
+    failed.magic = RUNGUARD_RECORD_MAGIC;
+    failed.version = RUNGUARD_RECORD_VERSION;
+    failed.exitcode = -1;
+    failed.signal = -1;
+    failed.instructions = failed.cycles = -1;
+    failed.task_clock = -1;
+    strncpy(failed.internal_error, message.c_str(), sizeof(failed.internal_error) - 1);
+    return failed;
+}
 
-            return exitcode;
-        } break;
+/**
+ * @brief 在 run_batch 的 mount 命名空间中运行批量运行的一项
+ * 先挂载该项的文件系统（比如以该测试点的 run 文件夹为可写层的 /judge），再在子进程中调用 runit，
+ * 子进程结束后按照相反的顺序卸载，下一项看不到这一项的可写层。
+ * runit 会修改信号处理、权限等进程状态，因此每一项都在新的子进程中运行。
+ * @return 该项的运行结果记录，子进程没有写入完整的记录时返回带有 internal_error 的记录
+ */
+static runguard_record run_batch_entry(const runguard_options& batch, runguard_options opt) {
+    opt.batch_entry = true;
+    opt.cgroup_v2 = batch.cgroup_v2;
+    opt.cgroupname = batch.cgroupname;
+    opt.cpuset = batch.cpuset;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return failed_record(fmt::format("unable to create pipe: {}", strerror(errno)));
+    opt.record_fd = fds[1];
+
+    string failure;
+    size_t mounted = 0;
+    try {
+        for (; mounted < opt.mounts.size(); ++mounted) mount_one(opt.mounts[mounted]);
+    } catch (exception& e) {
+        failure = e.what();
     }
 
-    throw runtime_error("unexpected");
+    pid_t pid = -1;
+    int status = 0;
+    if (failure.empty()) {
+        cout.flush();
+        pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            int exitcode = runit(opt);
+            cout.flush();
+            _exit(exitcode);
+        }
+        if (pid < 0) failure = fmt::format("unable to fork: {}", strerror(errno));
+    }
+    close(fds[1]);
+    if (pid > 0)
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            ;
+
+    while (mounted-- > 0)
+        if (umount2(opt.mounts[mounted].target.c_str(), MNT_DETACH) != 0)
+            BOOST_LOG_TRIVIAL(warning) << "unable to umount " << opt.mounts[mounted].target << ": " << strerror(errno);
+
+    // 子进程结束后管道的写端全部关闭，记录小于管道的容量，因此等子进程结束后再读取
+    runguard_record result;
+    size_t size = 0;
+    while (size < sizeof(result)) {
+        ssize_t ret = read(fds[0], reinterpret_cast<char*>(&result) + size, sizeof(result) - size);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) break;
+        size += ret;
+    }
+    close(fds[0]);
+
+    if (failure.empty() && (size < sizeof(result) || result.magic != RUNGUARD_RECORD_MAGIC || result.version != RUNGUARD_RECORD_VERSION))
+        failure = WIFSIGNALED(status) ? fmt::format("runguard terminated by signal {}", WTERMSIG(status)) : "runguard did not write a record";
+    if (failure.empty()) return result;
+
+    BOOST_LOG_TRIVIAL(error) << "batch entry failed: " << failure;
+    if (!opt.metafile_path.empty()) ofstream(opt.metafile_path, ios::app) << "internal-error: " << failure << endl;
+    return failed_record(failure);
+}
+
+int run_batch(runguard_options batch, vector<optional<runguard_options>> entries) {
+    set_terminate(runguard_terminate_handler);
+
+    // 准备运行环境失败时每一项都得到带有 internal_error 的记录，评测系统读到的记录数总是与项数一致
+    string failure;
+    cgroup_baseline batch_baseline;
+    try {
+        if (batch.record_fd >= 0 && fcntl(batch.record_fd, F_SETFD, FD_CLOEXEC) != 0)
+            error(errno, "unable to set close-on-exec flag of fd {}", batch.record_fd);
+
+        batch.cgroup_v2 = cgroup2::available();
+        if (!batch.cgroup_v2) cgroup_guard::init();
+        acquire_cgroup(batch, batch_baseline);
+        fix_oom_killer();
+
+        enter_mount_namespace();
+        mount_all(batch);
+
+        if (batch.netns.empty()) {
+            BOOST_LOG_TRIVIAL(info) << "Creating new network namespace";
+            if (unshare(CLONE_NEWNET) != 0) error(errno, "unable to create network namespace");
+        } else {
+            join_netns(batch.netns);
+        }
+    } catch (exception& e) {
+        failure = e.what();
+        BOOST_LOG_TRIVIAL(error) << "unable to prepare batch: " << failure;
+    }
+
+    int ret = 0;
+    for (auto& entry : entries) {
+        runguard_record result = !failure.empty() ? failed_record(failure)
+                                 : entry         ? run_batch_entry(batch, *entry)
+                                                 : failed_record("invalid arguments");
+        if (result.internal_error[0]) ret = 1;
+        if (batch.record_fd >= 0 && write(batch.record_fd, &result, sizeof(result)) != (ssize_t)sizeof(result))
+            BOOST_LOG_TRIVIAL(warning) << "unable to write runguard record: " << strerror(errno);
+    }
+
+    try {
+        if (batch_baseline.reused) {
+            cgroup_pool_release(batch, batch_baseline);
+        } else if (!batch.cgroupname.empty()) {
+            cgroup_kill(batch);
+            cgroup_delete(batch);
+        }
+    } catch (exception& e) {
+        BOOST_LOG_TRIVIAL(warning) << "unable to clean up cgroup " << batch.cgroupname << ": " << e.what();
+    }
+    return ret;
 }
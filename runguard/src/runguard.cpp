@@ -1,3 +1,4 @@
+#include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/log/attributes.hpp>
 #include <boost/log/common.hpp>
@@ -14,6 +15,7 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
 
 #include "run.hpp"
 #include "system.hpp"
@@ -93,19 +95,10 @@ void init_boost_log() {
     boost::log::add_console_log(std::cout, boost::log::keywords::format = log_format);
 }
 
-int main(int argc, const char* argv[]) {
-    ofstream out("/var/log/judge-system/runguard/label", std::ofstream::out);
-    string s = "BOOST_log_dir = " + string{filesystem::path(getenv("BOOST_log_dir")).u8string()};
-    out.write(s.c_str(), 100);
+namespace po = boost::program_options;
 
-    init_boost_log();
-
-    namespace po = boost::program_options;
+static po::options_description runguard_options_description() {
     po::options_description desc("runguard options");
-    po::positional_options_description pos;
-    po::variables_map vm;
-
-    struct runguard_options opt;
 
     // clang-format off
     desc.add_options()
@@ -118,22 +111,41 @@ int main(int argc, const char* argv[]) {
         ("cpu-time,t", po::value<time_limit>(), "set maximum CPU time (floating point is acceptable) consumption of the command in seconds")
         ("memory-limit,m", po::value<size_t>(), "set maximum memory consumption of the command in KB")
         ("file-limit,f", po::value<size_t>(), "set maximum created file size of the command in KB")
+        ("perf-counters", "count instructions, cycles and task-clock of the command by perf_event and write them to meta file. Instructions and cycles are estimated from task-clock if hardware counters are unavailable")
+        ("instruction-limit", po::value<int64_t>(), "report time limit exceeded if the command executes more instructions than this, instead of comparing with soft time limits. Implies --perf-counters")
         ("nproc,p", po::value<size_t>(), "set maximum process living simutanously")
         ("cpuset,P", po::value<string>(), "set the processor IDs that can only be used (e.g. \"0,2-3\")")
+        ("cgroup-root", po::value<string>(), "set the delegated cgroup v2 subtree under which runguard creates a cgroup for each run, default to /sys/fs/cgroup/judger. Only used when the system runs cgroup v2 only")
+        ("reuse-cgroup", "reuse a pooled cgroup for the cpuset instead of creating and deleting a cgroup for this run")
         ("allowed-syscall", po::value<string>(), "set the limited syscall numbers in file separated by spaces")
+        ("seccomp-profile", po::value<vector<string>>()->composing(), "allow only syscalls named in the file (separated by spaces, # for comments). The command is killed by SIGSYS when calling other syscalls. Can be specified multiple times")
         ("no-core-dumps,c", "disable core dumps")
         ("preexecute", po::value<string>(), "run command in new mount namespace before user program execution")
+        ("mount", po::value<vector<string>>()->composing(), "mount in new mount namespace before user program execution, in the given order. Format: overlay:TARGET:OPTIONS, bind:SOURCE:TARGET or bind-ro:SOURCE:TARGET")
+        ("prepare-root", "mount /proc and create device files in the root directory before user program execution")
         ("standard-input-file,i", po::value<string>(), "redirect command standard input fd to file")
         ("standard-output-file,o", po::value<string>(), "redirect command standard output fd to file")
         ("standard-error-file,e", po::value<string>(), "redirect command standard error fd to file")
+        ("standard-input-fd", po::value<int>(), "use the inherited file descriptor (e.g. a pipe) as command standard input, runguard closes it after starting the command")
+        ("standard-output-fd", po::value<int>(), "use the inherited file descriptor (e.g. a pipe) as command standard output, runguard closes it after starting the command")
         ("environment,E", "preseve system environment variables (or only PATH is loaded)")
         ("variable,V", po::value<vector<string>>(), "add additional environment variables (e.g. -Vkey1=value1 -Vkey2=value2)")
         ("out-meta,M", po::value<string>(), "write runguard monitor results (run time, exitcode, memory usage, ...) to file")
-        ("cmd", po::value<vector<string>>()->composing()->required(), "commands")
+        ("out-record", po::value<int>(), "also write the results as a fixed-layout binary record to the inherited file descriptor")
+        ("batch", po::value<string>(), "run each line of the file one after another, arguments in a line are separated by tabs. Mounts, cgroup and network namespace given on the command line are set up once and shared by all lines; mounts given in a line exist only while that line runs. One record per line is written to --out-record")
+        ("cmd", po::value<vector<string>>()->composing(), "commands")
         ("help", "display this help text")
         ("version", "display version of this application");
     // clang-format on
 
+    return desc;
+}
+
+/**
+ * @brief 解析命令行参数，参数不合法时输出错误信息
+ */
+static bool parse_command_line(const po::options_description& desc, int argc, const char* argv[], po::variables_map& vm) {
+    po::positional_options_description pos;
     pos.add("cmd", -1);
 
     try {
@@ -148,22 +160,16 @@ int main(int argc, const char* argv[]) {
         cerr << e.what() << endl
              << endl;
         cerr << desc << endl;
-        return 1;
-    }
-
-    if (vm.count("help")) {
-        cout << "Runguard: Running user program in protected mode with system resource access limitations." << endl
-             << "This app requires root privilege if either 'root' or 'user' option is provided." << endl
-             << "Usage: " << argv[0] << " [options] -- [command]";
-        cout << desc << endl;
-        return 0;
-    }
-
-    if (vm.count("version")) {
-        cout << "runguard" << endl;
-        return 0;
+        return false;
     }
+    return true;
+}
 
+/**
+ * @brief 将解析好的命令行参数转换为 runguard_options
+ * @param command_required 是否必须指定运行的命令，批量运行的公共设置没有命令
+ */
+static bool read_options(const po::variables_map& vm, runguard_options& opt, bool command_required = true) {
     if (vm.count("root")) {
         opt.chroot_dir = vm["root"].as<string>();
     }
@@ -182,6 +188,34 @@ int main(int argc, const char* argv[]) {
 
     if (vm.count("netns")) opt.netns = vm["netns"].as<string>();
     if (vm.count("preexecute")) opt.preexecute = vm["preexecute"].as<string>();
+    if (vm.count("mount")) {
+        for (auto& spec : vm["mount"].as<vector<string>>()) {
+            mount_option mnt;
+            size_t type_end = spec.find(':');
+            mnt.type = spec.substr(0, type_end);
+            string rest = type_end == string::npos ? "" : spec.substr(type_end + 1);
+            if (mnt.type == "overlay") {
+                // overlay 的挂载参数中的 lowerdir 可能包含冒号，因此只按照第一个冒号分隔
+                size_t target_end = rest.find(':');
+                mnt.target = rest.substr(0, target_end);
+                if (target_end != string::npos) mnt.data = rest.substr(target_end + 1);
+            } else if (mnt.type == "bind" || mnt.type == "bind-ro") {
+                size_t source_end = rest.rfind(':');
+                if (source_end != string::npos) mnt.source = rest.substr(0, source_end), mnt.target = rest.substr(source_end + 1);
+                mnt.readonly = mnt.type == "bind-ro";
+                mnt.type = "bind";
+            } else {
+                cerr << "Unrecognized mount type " << mnt.type << endl;
+                return false;
+            }
+            if (mnt.target.empty()) {
+                cerr << "Invalid mount " << spec << endl;
+                return false;
+            }
+            opt.mounts.push_back(mnt);
+        }
+    }
+    if (vm.count("prepare-root")) opt.prepare_root = true;
     if (vm.count("work")) opt.work_dir = vm["work"].as<string>();
 
     if (vm.count("variable")) {
@@ -222,15 +256,100 @@ int main(int argc, const char* argv[]) {
             for (int no; fin >> no;) opt.syscalls.push_back(no);
         }
     }
+    if (vm.count("seccomp-profile")) opt.seccomp_profiles = vm["seccomp-profile"].as<vector<string>>();
     if (vm.count("cpuset")) opt.cpuset = vm["cpuset"].as<string>();
+    if (vm.count("perf-counters")) opt.perf_counters = true;
+    if (vm.count("instruction-limit")) {
+        opt.instruction_limit = vm["instruction-limit"].as<int64_t>();
+        opt.perf_counters = true;
+    }
+    if (vm.count("cgroup-root")) opt.cgroup_root = vm["cgroup-root"].as<string>();
+    if (vm.count("reuse-cgroup")) opt.reuse_cgroup = true;
     if (vm.count("standard-input-file")) opt.stdin_filename = vm["standard-input-file"].as<string>();
     if (vm.count("standard-output-file")) opt.stdout_filename = vm["standard-output-file"].as<string>();
     if (vm.count("standard-error-file")) opt.stderr_filename = vm["standard-error-file"].as<string>();
+    if (vm.count("standard-input-fd")) opt.stdin_fd = vm["standard-input-fd"].as<int>();
+    if (vm.count("standard-output-fd")) opt.stdout_fd = vm["standard-output-fd"].as<int>();
     if (vm.count("environment")) opt.preserve_sys_env = true;
     if (vm.count("out-meta")) opt.metafile_path = vm["out-meta"].as<string>();
+    if (vm.count("out-record")) opt.record_fd = vm["out-record"].as<int>();
+    if (!vm.count("cmd")) {
+        if (!command_required) return true;
+        cerr << "the option '--cmd' is required but missing" << endl;
+        return false;
+    }
     opt.command = vm["cmd"].as<vector<string>>();
+    return true;
+}
+
+/**
+ * @brief 读取批量文件，在命令行指定的公共设置中依次运行其中的每一项，见 run_batch
+ * 批量文件的每一行是一项的参数，参数之间以制表符分隔，比如运行一个测试点的选手程序，再运行该测试点的比较器。
+ * 命令行中的挂载、cgroup 和网络命名空间由所有项共用，只准备一次；每一行的挂载只在该项运行期间存在。
+ * @note 各项的路径都应该是绝对路径，所有项共用 runguard 的工作文件夹
+ */
+static int read_batch(const po::options_description& desc, const runguard_options& batch, const string& file, const char* argv0) {
+    ifstream fin(file);
+    if (!fin) {
+        cerr << "Unable to read batch file " << file << endl;
+        return 1;
+    }
+
+    vector<optional<runguard_options>> entries;
+    for (string line; getline(fin, line);) {
+        if (line.empty()) continue;
+        vector<string> args;
+        boost::split(args, line, boost::is_any_of("\t"));
+        vector<const char*> argv = {argv0};
+        for (auto& arg : args) argv.push_back(arg.c_str());
+
+        po::variables_map vm;
+        runguard_options opt;
+        if (!parse_command_line(desc, (int)argv.size(), argv.data(), vm) || !read_options(vm, opt)) {
+            BOOST_LOG_TRIVIAL(error) << "Invalid arguments in line " << entries.size() + 1 << " of batch file " << file;
+            entries.emplace_back();
+            continue;
+        }
+        BOOST_LOG_TRIVIAL(debug) << "batch " << entries.size() << " opt: " << opt;
+        entries.emplace_back(move(opt));
+    }
+    return run_batch(batch, move(entries));
+}
+
+int main(int argc, const char* argv[]) {
+    ofstream out("/var/log/judge-system/runguard/label", std::ofstream::out);
+    string s = "BOOST_log_dir = " + string{filesystem::path(getenv("BOOST_log_dir")).u8string()};
+    out.write(s.c_str(), 100);
+
+    init_boost_log();
+
+    po::options_description desc = runguard_options_description();
+    po::variables_map vm;
+    if (!parse_command_line(desc, argc, argv, vm)) return 1;
+
+    if (vm.count("help")) {
+        cout << "Runguard: Running user program in protected mode with system resource access limitations." << endl
+             << "This app requires root privilege if either 'root' or 'user' option is provided." << endl
+             << "Usage: " << argv[0] << " [options] -- [command]" << endl
+             << "   or: " << argv[0] << " [options] --batch FILE";
+        cout << desc << endl;
+        return 0;
+    }
+
+    if (vm.count("version")) {
+        cout << "runguard" << endl;
+        return 0;
+    }
+
+    struct runguard_options opt;
+    if (vm.count("batch")) {
+        if (!read_options(vm, opt, false)) return 1;
+        return read_batch(desc, opt, vm["batch"].as<string>(), argv[0]);
+    }
+
+    if (!read_options(vm, opt)) return 1;
 
     BOOST_LOG_TRIVIAL(debug) << "opt: " << opt;
 
     return runit(opt);
-}
\ No newline at end of file
+}
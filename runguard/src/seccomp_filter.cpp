@@ -0,0 +1,220 @@
+#include "seccomp_filter.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <linux/seccomp.h>
+#include <seccomp.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/log/trivial.hpp>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <tuple>
+
+using namespace std;
+
+static const string CACHE_DIR = "/run/runguard";
+
+static bool operator<(const scmp_arg_cmp &a, const scmp_arg_cmp &b) {
+    return tie(a.arg, a.op, a.datum_a, a.datum_b) < tie(b.arg, b.op, b.datum_a, b.datum_b);
+}
+
+/**
+ * @brief 一个系统调用在白名单中的规则
+ * 多个配置文件中同一个系统调用的规则会合并：无条件允许优先于带条件的允许，允许优先于返回错误码
+ */
+struct syscall_rule {
+    bool allow = false;  // 无条件允许
+    set<vector<scmp_arg_cmp>> conditions;  // 满足其中任意一组条件时允许，每组条件需要全部满足
+    int error = 0;  // 不允许时返回的错误码，为 0 时杀死进程
+};
+
+static const map<string, int> ERRNO_NAMES = {{"EPERM", EPERM}, {"EACCES", EACCES}, {"ENOSYS", ENOSYS}};
+
+/**
+ * @brief 解析一个参数条件，格式为 aN==VALUE、aN!=VALUE 或者 aN&MASK==VALUE，数值可以是十进制或者 0x 开头的十六进制
+ */
+static scmp_arg_cmp parse_condition(const string &text) {
+    size_t eq = text.find("==");
+    bool equal = eq != string::npos;
+    if (!equal) eq = text.find("!=");
+    if (text.size() < 2 || text[0] != 'a' || !isdigit(text[1]) || eq == string::npos)
+        throw invalid_argument(fmt::format("invalid syscall argument condition {}", text));
+
+    unsigned arg = text[1] - '0';
+    string lhs = text.substr(2, eq - 2);
+    scmp_datum_t value = stoull(text.substr(eq + 2), nullptr, 0);
+    if (arg > 5 || (!lhs.empty() && (lhs[0] != '&' || !equal)))
+        throw invalid_argument(fmt::format("invalid syscall argument condition {}", text));
+    if (!lhs.empty()) return SCMP_CMP(arg, SCMP_CMP_MASKED_EQ, stoull(lhs.substr(1), nullptr, 0), value);
+    return SCMP_CMP(arg, equal ? SCMP_CMP_EQ : SCMP_CMP_NE, value, 0);
+}
+
+/**
+ * @brief 读取 seccomp 配置文件，每一项以空白字符分隔，# 之后的内容为注释。每一项是以下格式之一：
+ * name                  允许该系统调用
+ * name(cond,cond...)    参数满足所有条件时允许该系统调用，条件的格式见 parse_condition，比如 clone(a0&0x10000==0x10000)
+ * name=ERRNO            该系统调用返回错误码（EPERM、EACCES、ENOSYS）而不杀死进程，比如让 glibc 从 clone3 退回到 clone
+ */
+static void read_profile(const string &profile, map<int, syscall_rule> &rules) {
+    ifstream fin(profile);
+    if (!fin) throw system_error(errno, system_category(), fmt::format("unable to read seccomp profile {}", profile));
+    string line;
+    while (getline(fin, line)) {
+        istringstream words(line.substr(0, line.find('#')));
+        for (string word; words >> word;) {
+            size_t pos = word.find_first_of("(=");
+            string name = word.substr(0, pos);
+            int no = seccomp_syscall_resolve_name(name.c_str());
+            // 有些系统调用只在部分架构中存在，比如 x86_64 的 arch_prctl
+            if (no == __NR_SCMP_ERROR) {
+                BOOST_LOG_TRIVIAL(debug) << "unknown syscall " << name << " in " << profile;
+                continue;
+            }
+
+            syscall_rule &rule = rules[no];
+            if (pos == string::npos) {
+                rule.allow = true;
+            } else if (word[pos] == '=') {
+                auto it = ERRNO_NAMES.find(word.substr(pos + 1));
+                if (it == ERRNO_NAMES.end()) throw invalid_argument(fmt::format("unknown errno in {} of {}", word, profile));
+                rule.error = it->second;
+            } else {
+                if (word.back() != ')') throw invalid_argument(fmt::format("invalid syscall rule {} in {}", word, profile));
+                vector<scmp_arg_cmp> conditions;
+                string list = word.substr(pos + 1, word.size() - pos - 2);
+                for (size_t begin = 0, end; begin <= list.size(); begin = end + 1) {
+                    end = min(list.find(',', begin), list.size());
+                    conditions.push_back(parse_condition(list.substr(begin, end - begin)));
+                }
+                rule.conditions.insert(conditions);
+            }
+        }
+    }
+}
+
+/**
+ * @brief 白名单的规范文本，作为缓存文件名的哈希来源
+ */
+static string describe(const map<int, syscall_rule> &rules) {
+    string key;
+    for (auto &[no, rule] : rules) {
+        key += to_string(no);
+        if (rule.allow) {
+            key += " ";
+            continue;
+        }
+        for (auto &conditions : rule.conditions) {
+            key += "(";
+            for (auto &cmp : conditions)
+                key += fmt::format("{}:{}:{}:{},", cmp.arg, (int)cmp.op, cmp.datum_a, cmp.datum_b);
+            key += ")";
+        }
+        if (rule.conditions.empty()) key += fmt::format("={}", rule.error);
+        key += " ";
+    }
+    return key;
+}
+
+/**
+ * @brief FNV-1a 哈希，缓存文件名在不同的编译器和程序版本之间保持一致
+ */
+static uint64_t fnv1a(const string &text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) hash = (hash ^ c) * 1099511628211ULL;
+    return hash;
+}
+
+static vector<sock_filter> read_program(const string &file) {
+    ifstream fin(file, ios::binary);
+    if (!fin) return {};
+    string data((istreambuf_iterator<char>(fin)), istreambuf_iterator<char>());
+    if (data.empty() || data.size() % sizeof(sock_filter) != 0) return {};
+    vector<sock_filter> program(data.size() / sizeof(sock_filter));
+    memcpy(program.data(), data.data(), data.size());
+    return program;
+}
+
+/**
+ * @brief 使用 libseccomp 生成 BPF 程序并写入缓存文件
+ */
+static void export_program(const map<int, syscall_rule> &rules, const string &file) {
+    scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_KILL_PROCESS);
+    if (!ctx) throw runtime_error("unable to initialize seccomp filter");
+    for (auto &[syscall, rule] : rules) {
+        int ret = 0;
+        if (rule.allow) {
+            ret = seccomp_rule_add(ctx, SCMP_ACT_ALLOW, syscall, 0);
+        } else if (!rule.conditions.empty()) {
+            for (auto &conditions : rule.conditions)
+                if ((ret = seccomp_rule_add_array(ctx, SCMP_ACT_ALLOW, syscall, conditions.size(), conditions.data())) < 0) break;
+        } else if (rule.error) {
+            ret = seccomp_rule_add(ctx, SCMP_ACT_ERRNO(rule.error), syscall, 0);
+        }
+        if (ret < 0) {
+            seccomp_release(ctx);
+            throw system_error(-ret, system_category(), fmt::format("unable to add seccomp rule for syscall {}", syscall));
+        }
+    }
+
+    // 先写入临时文件再重命名，并发的 runguard 不会读到写了一半的缓存
+    string tmp = fmt::format("{}.{}", file, getpid());
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        seccomp_release(ctx);
+        throw system_error(errno, system_category(), fmt::format("unable to create {}", tmp));
+    }
+    int ret = seccomp_export_bpf(ctx, fd);
+    close(fd);
+    seccomp_release(ctx);
+    if (ret < 0 || rename(tmp.c_str(), file.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw system_error(ret < 0 ? -ret : errno, system_category(), "unable to export seccomp filter");
+    }
+}
+
+vector<sock_filter> compile_seccomp_filter(const runguard_options &opt) {
+    if (opt.syscalls.empty() && opt.seccomp_profiles.empty()) return {};
+
+    map<int, syscall_rule> rules;
+    for (int syscall : opt.syscalls) rules[syscall].allow = true;
+    for (auto &profile : opt.seccomp_profiles) read_profile(profile, rules);
+    rules[SYS_execve].allow = true;
+
+    string file = fmt::format("{}/seccomp-{:016x}.bpf", CACHE_DIR, fnv1a(describe(rules)));
+
+    vector<sock_filter> program = read_program(file);
+    if (program.empty()) {
+        if (mkdir(CACHE_DIR.c_str(), 0755) != 0 && errno != EEXIST)
+            throw system_error(errno, system_category(), fmt::format("unable to create {}", CACHE_DIR));
+        BOOST_LOG_TRIVIAL(info) << "compiling seccomp filter to " << file;
+        export_program(rules, file);
+        program = read_program(file);
+        if (program.empty()) throw runtime_error(fmt::format("invalid seccomp filter {}", file));
+    }
+    return program;
+}
+
+void load_seccomp_filter(const vector<sock_filter> &program) {
+    if (program.empty()) return;
+
+    struct sock_fprog prog;
+    prog.len = (unsigned short)program.size();
+    prog.filter = const_cast<sock_filter *>(program.data());
+
+    // 非特权进程加载 seccomp 过滤器必须先设置 no_new_privs
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0)
+        throw system_error(errno, system_category(), "unable to set no_new_privs");
+    if (syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, &prog) != 0)
+        throw system_error(errno, system_category(), "unable to load seccomp filter");
+}
@@ -1,13 +1,21 @@
 #include "asset.hpp"
 #include "common/net_utils.hpp"
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include <boost/uuid/uuid_io.hpp>
 #include <fstream>
 #include "common/exceptions.hpp"
+#include "common/io_utils.hpp"
 
 namespace judge {
 using namespace std;
 
 asset::asset(const string &name) : name(name) {}
 
+bool asset::read_content(string &) {
+    return false;
+}
+
 local_asset::local_asset(const string &name, const filesystem::path &path)
     : asset(name), path(path) {}
 
@@ -15,6 +23,12 @@ void local_asset::fetch(const filesystem::path &path) {
     filesystem::copy(this->path, path / name);
 }
 
+bool local_asset::read_content(string &content) {
+    if (!filesystem::is_regular_file(path)) return false;
+    content = read_file_content(path);
+    return true;
+}
+
 text_asset::text_asset(const string &name, const string &text)
     : asset(name), text(text) {}
 
@@ -23,12 +37,39 @@ void text_asset::fetch(const filesystem::path &path) {
     fout << text;
 }
 
+bool text_asset::read_content(string &content) {
+    content = text;
+    return true;
+}
+
 remote_asset::remote_asset(const string &name, const string &url_get)
     : asset(name), url(url_get) {}
 
 // TODO: 针对 CURLcode throw 更加精确的 exception
 void remote_asset::fetch(const filesystem::path &path) {
+    if (downloaded) {
+        ofstream fout(path / name, ios::binary);
+        fout << *downloaded;
+        return;
+    }
     net::download_file(url, path / name);
 }
 
+bool remote_asset::read_content(string &content) {
+    if (!downloaded) {
+        filesystem::path temp = filesystem::temp_directory_path() / boost::uuids::to_string(boost::uuids::random_generator()());
+        filesystem::create_directories(temp);
+        try {
+            net::download_file(url, temp / "content");
+            downloaded = read_file_content(temp / "content");
+        } catch (exception &) {
+            filesystem::remove_all(temp);
+            return false;
+        }
+        filesystem::remove_all(temp);
+    }
+    content = *downloaded;
+    return true;
+}
+
 }  // namespace judge
@@ -27,7 +27,8 @@ static const unordered_map<status, const char *> status_string = boost::assign::
     (status::FLOATING_POINT_ERROR, "Floating Point Error")
     (status::RANDOM_GEN_ERROR, "Random Gen Error")
     (status::COMPARE_ERROR, "Compare Error")
-    (status::SYSTEM_ERROR, "System Error");
+    (status::SYSTEM_ERROR, "System Error")
+    (status::SKIPPED, "Skipped");
 // clang-format on
 
 const char *get_display_message(status stat) {
@@ -1,5 +1,7 @@
 #include "common/system.hpp"
 #include <errno.h>
+#include <stdio.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
 #include <pwd.h>
 #include <grp.h>
@@ -25,3 +27,24 @@ int get_groupid(const char *name)
     if (!g || errno) return -1;
     return (int) g->gr_gid;
 }
+
+long long get_free_disk_space(const char *path)
+{
+    struct statvfs st;
+    if (statvfs(path, &st) < 0) return -1;
+    return (long long) st.f_bavail * st.f_frsize;
+}
+
+long long get_available_memory()
+{
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp) return -1;
+
+    char line[256];
+    long long kb = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "MemAvailable: %lld kB", &kb) == 1) break;
+    }
+    fclose(fp);
+    return kb < 0 ? -1 : kb * 1024;
+}
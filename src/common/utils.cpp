@@ -1,9 +1,25 @@
 #include "common/utils.hpp"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+
+#include "common/defer.hpp"
 using namespace std;
 
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
 process_builder &process_builder::directory(const std::filesystem::path &path) {
     this->epath = true;
     this->path = path;
@@ -16,45 +32,157 @@ process_builder &process_builder::awake_period(int period, std::function<void()>
     return *this;
 }
 
+process_builder &process_builder::process_group(std::function<void(pid_t)> callback) {
+    this->group_callback = callback;
+    return *this;
+}
+
+/**
+ * @brief 通过 waitpid 轮询等待子进程结束，等待期间每隔 period 秒调用一次 callback
+ * @return waitpid 得到的子进程状态
+ */
+static int poll_child(pid_t pid, int period, const function<void()> &callback) {
+    int status;
+    if (period > 0) {
+        while (true) {
+            int ret = waitpid(pid, &status, WNOHANG);
+            if (ret == -1) throw system_error(errno, system_category(), "waitpid");
+            if (ret != 0) break;
+            sleep(period);
+            callback();
+        }
+    } else if (waitpid(pid, &status, 0) == -1) {
+        throw system_error(errno, system_category(), "waitpid");
+    }
+    return status;
+}
+
+/**
+ * @brief 等待子进程结束，等待期间每隔 period 秒调用一次 callback
+ * 通过 pidfd 和 timerfd 同时等待子进程结束和定时器，子进程结束后立刻返回，回调按照精确的间隔触发。
+ * 内核不支持 pidfd（Linux 5.3 以下）或者无法创建 timerfd、poll 失败时退化为 waitpid 轮询，
+ * 保证子进程总是被回收，不会留下僵尸进程。
+ * @return waitpid 得到的子进程状态
+ */
+static int wait_child(pid_t pid, int period, const function<void()> &callback) {
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0) return poll_child(pid, period, callback);
+    defer { close(pidfd); };
+
+    int timerfd = -1;
+    if (period > 0) {
+        timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (timerfd < 0) {
+            LOG_WARN << "Unable to create timerfd, waiting for child " << pid << " by polling: " << strerror(errno);
+            return poll_child(pid, period, callback);
+        }
+        itimerspec spec = {.it_interval = {.tv_sec = period, .tv_nsec = 0}, .it_value = {.tv_sec = period, .tv_nsec = 0}};
+        timerfd_settime(timerfd, 0, &spec, nullptr);
+    }
+    defer {
+        if (timerfd >= 0) close(timerfd);
+    };
+
+    pollfd fds[2] = {{.fd = pidfd, .events = POLLIN, .revents = 0}, {.fd = timerfd, .events = POLLIN, .revents = 0}};
+    while (true) {
+        if (poll(fds, timerfd >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_WARN << "Unable to poll child " << pid << ", waiting for it by polling: " << strerror(errno);
+            return poll_child(pid, period, callback);
+        }
+        if (fds[0].revents) break;
+        if (fds[1].revents) {
+            uint64_t expirations;
+            if (read(timerfd, &expirations, sizeof(expirations)) == sizeof(expirations)) callback();
+        }
+    }
+
+    // pidfd 可读说明子进程已经结束，waitpid 不会阻塞
+    int status;
+    if (waitpid(pid, &status, 0) == -1) throw system_error(errno, system_category(), "waitpid");
+    return status;
+}
+
+process_builder &process_builder::output(const std::filesystem::path &file) {
+    this->output_file = file;
+    return *this;
+}
+
+process_builder &process_builder::pass_fd(int fd, int target) {
+    passed_fds.emplace_back(fd, target);
+    return *this;
+}
+
+void process_builder::close_passed_fds() {
+    for (auto &[fd, target] : passed_fds) close(fd);
+    passed_fds.clear();
+}
+
 int process_builder::exec_program(const char **argv) {
-    // 使用 POSIX 提供的函数来实现外部程序调用
+    // 评测系统是多线程的，fork 后的子进程中只能调用异步信号安全的函数，而且 fork 需要复制父进程的页表，
+    // 父进程缓存越多越慢。因此使用 posix_spawn（基于 vfork）启动子进程，环境变量和运行目录都在父进程中准备好
+    // 启动子进程前抛出异常时也要关闭传给程序的 fd，否则持有管道另一端的线程永远等不到 EOF
+    defer { close_passed_fds(); };
+    vector<string> envs;
+    for (char **entry = environ; *entry; ++entry) {
+        string_view kv(*entry);
+        if (!env.count(string(kv.substr(0, kv.find('='))))) envs.emplace_back(kv);
+    }
+    for (auto &[key, value] : env) envs.push_back(key + "=" + value);
+    vector<char *> envp;
+    for (auto &entry : envs) envp.push_back(entry.data());
+    envp.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    defer { posix_spawn_file_actions_destroy(&actions); };
+    if (epath) posix_spawn_file_actions_addchdir_np(&actions, path.c_str());
+    if (!output_file.empty()) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, output_file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    }
+    // 子进程中的 dup2 按顺序执行，如果某个 fd 恰好是之前某一项的 target（或者标准输出、标准错误），会先被覆盖；
+    // fd 与自己的 target 相同时 dup2 也不会清除 FD_CLOEXEC。因此先把所有 fd 换到所有 target 之上的编号
+    int max_target = STDERR_FILENO;
+    for (auto &[fd, target] : passed_fds) max_target = max(max_target, target);
+    for (auto &[fd, target] : passed_fds) {
+        if (fd > max_target) continue;
+        int copy = fcntl(fd, F_DUPFD_CLOEXEC, max_target + 1);
+        if (copy < 0) throw system_error(errno, system_category(), "fcntl");
+        close(fd);
+        fd = copy;
+    }
+    for (auto &[fd, target] : passed_fds) posix_spawn_file_actions_adddup2(&actions, fd, target);
+
+    // 子进程总是运行在新的进程组中，终端的中断信号只会发送给评测系统，由评测系统处理，不会终止子进程
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    defer { posix_spawnattr_destroy(&attr); };
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+
     pid_t pid;
-    switch (pid = fork()) {
-        case -1:  // fork 失败
-            throw system_error();
-        case 0:  // 子进程
-            // 避免子进程被终止，要求父进程处理中断信号
-            signal(SIGINT, SIG_IGN);  // 忽略中断信号
-            for (auto &[key, value] : env) {
-                set_env(key, value);
-            }
-            if (epath) filesystem::current_path(path);
-            execvp(argv[0], (char **)argv);
-            _exit(EXIT_FAILURE);
-        default:  // 父进程
-            int status;
-            LOG_DEBUG << "period = " << period;  // debug
-            if (period > 0) {
-                while (true) {
-                    int ret = waitpid(pid, &status, WNOHANG);
-                    LOG_DEBUG << "Father process get child process status = " << status << " child pid = " << pid;  // debug
-                    if (ret == -1) throw system_error(errno, system_category(), "waitpid");
-                    if (ret != 0) break;
-                    sleep(period);
-                    callback();
-                }
-            } else {
-                if (waitpid(pid, &status, 0) == -1) {
-                    throw system_error(errno, system_category(), "waitpid");
-                }
-            }
-
-            if (WIFEXITED(status))           // child exited normally
-                return WEXITSTATUS(status);  // return the code when child exited
-            else
-                return -1;
+    int ret = posix_spawnp(&pid, argv[0], &actions, &attr, (char **)argv, envp.data());
+    close_passed_fds();
+    if (ret == EAGAIN || ret == ENOMEM) {
+        throw system_error(ret, system_category(), "posix_spawn");
+    } else if (ret != 0) {
+        // 与子进程 exec 失败时的返回值保持一致
+        LOG_WARN << "Unable to execute " << argv[0] << ": " << strerror(ret);
+        return EXIT_FAILURE;
     }
-    return 0;
+
+    // posix_spawn 返回时子进程已经设置好进程组
+    if (group_callback) group_callback(pid);
+
+    int status = wait_child(pid, period, callback);
+    if (WIFEXITED(status))           // child exited normally
+        return WEXITSTATUS(status);  // return the code when child exited
+    else
+        return -1;
 }
 
 string get_env(const string &key, const string &def_value) {
@@ -10,6 +10,9 @@ int SCRIPT_MEM_LIMIT = 1 << 18;   // 256M
 int SCRIPT_TIME_LIMIT = 10;       // 10s
 int SCRIPT_FILE_LIMIT = 1 << 19;  // 512M
 long MAX_IO_SIZE = 10240;
+size_t MAX_INFLIGHT_SUBMISSIONS = 0;
+long long MIN_FREE_DISK = 256ll << 20;    // 256M
+long long MIN_FREE_MEMORY = 256ll << 20;  // 256M
 
 filesystem::path EXEC_DIR;
 filesystem::path CACHE_DIR;
@@ -18,6 +21,10 @@ bool USE_DATA_DIR = false;
 filesystem::path RUN_DIR;
 filesystem::path CHROOT_DIR;
 filesystem::path SCRIPT_DIR;
+bool NATIVE_CHECK = true;
+size_t BATCH_CHECK_SIZE = 1;
+size_t STREAM_CHECK_SLACK = 0;
+bool SECCOMP_PROFILE = true;
 bool DEBUG = false;
 
 
@@ -0,0 +1,601 @@
+#include "judge/compare.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace judge {
+using namespace std;
+namespace fs = std::filesystem;
+
+optional<compare_mode> parse_compare_mode(string_view name) {
+    if (name == "diff-all") return compare_mode::all;
+    if (name == "diff-ign-space") return compare_mode::ignore_space;
+    if (name == "diff-ign-trailing") return compare_mode::ignore_trailing;
+    return nullopt;
+}
+
+/**
+ * @brief 两段内存第一个不同的字节的下标，完全相同时返回 n
+ */
+static size_t mismatch(const char *a, const char *b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 64 <= n; i += 64) {
+        __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+        __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 32)), _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+        if ((unsigned)_mm256_movemask_epi8(_mm256_and_si256(eq0, eq1)) == 0xFFFFFFFFu) continue;
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(eq0);
+        if (mask) return i + __builtin_ctz(mask);
+        return i + 32 + __builtin_ctz(~(unsigned)_mm256_movemask_epi8(eq1));
+    }
+#elif defined(__SSE2__)
+    // 每次比较 64 字节，4 个比较结果合并后只需要一次 movemask 和分支
+    for (; i + 64 <= n; i += 64) {
+        __m128i eq[4];
+        for (int k = 0; k < 4; ++k)
+            eq[k] = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 16 * k)), _mm_loadu_si128((const __m128i *)(b + i + 16 * k)));
+        __m128i all = _mm_and_si128(_mm_and_si128(eq[0], eq[1]), _mm_and_si128(eq[2], eq[3]));
+        if (_mm_movemask_epi8(all) == 0xFFFF) continue;
+        for (int k = 0; k < 4; ++k)
+            if (unsigned mask = ~(unsigned)_mm_movemask_epi8(eq[k]) & 0xFFFF) return i + 16 * k + __builtin_ctz(mask);
+    }
+#else
+    // libc 的 memcmp 一般已经向量化，先按块找到不同的块
+    for (; i + 4096 <= n && memcmp(a + i, b + i, 4096) == 0; i += 4096)
+        ;
+#endif
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+/**
+ * @brief 与 diff 的 isspace 一致，但不包括换行符
+ */
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * @brief 规范化输出的规则，对应 diff 的参数
+ */
+struct compare_rules {
+    bool trailing_space;  // --ignore-trailing-space，同时忽略文件末尾缺少的换行符
+    bool space_change;    // --ignore-space-change，连续的空白字符视为一个空格
+    bool blank_lines;     // --ignore-blank-lines
+    // --strip-trailing-cr 总是启用
+};
+
+static const compare_rules EXACT_RULES = {false, false, false};
+static const compare_rules TRAILING_RULES = {true, false, true};
+static const compare_rules LOOSE_RULES = {true, true, true};
+
+/**
+ * @brief 按照规则逐个读取规范化之后的字符
+ * 除了是否在行首以外没有其他状态，因此两个输出的读取位置之后的内容相同、行首状态相同时，
+ * 之后读到的字符也一定相同，这是用 SIMD 跳过相同内容的前提
+ */
+struct cursor {
+    const char *p, *end;
+    const char *line;  // 当前行的开头
+    bool line_start = true;
+
+    cursor(const char *begin, const char *end) : p(begin), end(end), line(begin) {}
+
+    static constexpr int END = -1;
+
+    int next(const compare_rules &rules) {
+        while (p != end) {
+            char c = *p;
+            if (c == '\n') {
+                ++p;
+                bool blank = line_start;
+                line = p;
+                if (blank && rules.blank_lines) continue;
+                line_start = true;
+                return '\n';
+            }
+            if (c == '\r' && p + 1 != end && p[1] == '\n') {
+                ++p;
+                continue;
+            }
+            if (is_space(c) && (rules.trailing_space || rules.space_change)) {
+                const char *q = p;
+                while (q != end && is_space(*q)) ++q;
+                bool eol = q == end || *q == '\n';
+                if (eol && rules.trailing_space) {
+                    p = q;
+                    continue;
+                }
+                if (rules.space_change) {
+                    p = q;
+                    line_start = false;
+                    return ' ';
+                }
+            }
+            ++p;
+            line_start = false;
+            return (unsigned char)c;
+        }
+        if (!line_start && rules.trailing_space) {
+            line = p;
+            line_start = true;
+            return '\n';
+        }
+        return END;
+    }
+};
+
+/**
+ * @brief 按照规则比较两个输出
+ * @return 相同时返回空，否则返回两个读取位置，位于第一个不同的字符之前
+ */
+static optional<pair<cursor, cursor>> compare_from(cursor u, cursor a, const compare_rules &rules) {
+    while (true) {
+        if (u.line_start == a.line_start) {
+            // 之后相同的内容可以直接跳过，但是只能跳到最后一个非空白字符之后：
+            // 空白字符的处理需要向后查看，相同部分之后的内容可能不同
+            size_t n = mismatch(u.p, a.p, min(u.end - u.p, a.end - a.p));
+            size_t k = n;
+            while (k > 0 && is_space(u.p[k - 1])) --k;
+            if (k > 0) {
+                const char *last = u.p + k - 1;
+                if (*last == '\n') {
+                    u.line = u.p + k, a.line = a.p + k;
+                    u.line_start = a.line_start = true;
+                } else {
+                    if (const char *nl = (const char *)memrchr(u.p, '\n', k)) {
+                        u.line = nl + 1, a.line = a.p + (nl + 1 - u.p);
+                    }
+                    u.line_start = a.line_start = false;
+                }
+                u.p += k, a.p += k;
+            }
+        }
+
+        cursor u0 = u, a0 = a;
+        int cu = u.next(rules), ca = a.next(rules);
+        if (cu != ca) return pair{u0, a0};
+        if (cu == cursor::END) return nullopt;
+    }
+}
+
+compare_report compare_output(string_view user, string_view answer, compare_mode mode) {
+    compare_report report;
+    size_t n = mismatch(user.data(), answer.data(), min(user.size(), answer.size()));
+    if (n == user.size() && n == answer.size()) return report;
+
+    // 第一个不同的字节之前的内容完全相同，从这一行的开头开始比较
+    size_t start = n;
+    while (start > 0 && user[start - 1] != '\n') --start;
+    cursor u(user.data(), user.data() + user.size()), a(answer.data(), answer.data() + answer.size());
+    u.p = u.line = user.data() + start;
+    a.p = a.line = answer.data() + start;
+
+    if (mode != compare_mode::ignore_space) {
+        auto strict = compare_from(u, a, mode == compare_mode::all ? EXACT_RULES : TRAILING_RULES);
+        if (!strict) return report;
+
+        // 严格比较相同的行在宽松比较时也一定相同，从严格比较不同的那一行开始宽松比较
+        report.result = RESULT_PE;
+        report.user_offset = strict->first.p - user.data();
+        report.answer_offset = strict->second.p - answer.data();
+        u.p = u.line = strict->first.line;
+        a.p = a.line = strict->second.line;
+    }
+
+    if (auto loose = compare_from(u, a, LOOSE_RULES)) {
+        report.result = RESULT_WA;
+        // 读取位置停在被跳过的空白字符之前时，指向下一个有意义的字符更直观
+        const char *up = loose->first.p, *ap = loose->second.p;
+        while (up != loose->first.end && is_space(*up)) ++up;
+        while (ap != loose->second.end && is_space(*ap)) ++ap;
+        report.user_offset = up - user.data();
+        report.answer_offset = ap - answer.data();
+    }
+    return report;
+}
+
+compare_report compare_files(const fs::path &user, const fs::path &answer, compare_mode mode) {
+    mapped_file user_file(user), answer_file(answer);
+    return compare_output(user_file.view(), answer_file.view(), mode);
+}
+
+optional<token_compare_options> parse_token_compare(string_view name) {
+    constexpr string_view NAME = "token";
+    if (name.substr(0, NAME.size()) != NAME) return nullopt;
+    name.remove_prefix(NAME.size());
+    token_compare_options opt;
+    if (name.empty()) return opt;
+    if (name[0] != ':') return nullopt;
+    name.remove_prefix(1);
+
+    while (!name.empty()) {
+        string_view option = name.substr(0, name.find(','));
+        name.remove_prefix(min(name.size(), option.size() + 1));
+        string_view key = option.substr(0, option.find('='));
+        if (key == "ignore-case" && key.size() == option.size()) {
+            opt.ignore_case = true;
+        } else if (key == "unordered-lines" && key.size() == option.size()) {
+            opt.unordered_lines = true;
+        } else if ((key == "abs" || key == "rel") && key.size() < option.size()) {
+            string value(option.substr(key.size() + 1));
+            char *end;
+            double error = strtod(value.c_str(), &end);
+            if (value.empty() || *end != '\0' || !(error >= 0) || isinf(error))
+                throw invalid_argument("invalid error " + value + " of token comparator");
+            (key == "abs" ? opt.absolute_error : opt.relative_error) = error;
+        } else {
+            throw invalid_argument("unknown option " + string(option) + " of token comparator");
+        }
+    }
+    return opt;
+}
+
+/**
+ * @brief 分隔 token 的字符，包括换行符
+ */
+static inline bool is_separator(char c) {
+    return is_space(c) || c == '\n';
+}
+
+/**
+ * @brief 从 pos 开始读取下一个 token，pos 移动到 token 之后
+ * @return token 的起止位置，没有更多的 token 时均为 text.size()
+ */
+static pair<size_t, size_t> next_token(string_view text, size_t &pos) {
+    while (pos < text.size() && is_separator(text[pos])) ++pos;
+    size_t begin = pos;
+    while (pos < text.size() && !is_separator(text[pos])) ++pos;
+    return {begin, pos};
+}
+
+/**
+ * @brief 解析十进制数，整个 token 都是数字时才成功
+ * 有效数字不超过 19 位、十的指数不超过 22 时尾数和 10 的幂都能精确地表示为 double，一次乘除法就能得到正确舍入的结果
+ * （Clinger 快速路径），输出中的绝大多数数字都满足这个条件；其余情况交给 strtod。
+ */
+static bool parse_number(string_view token, double &value) {
+    static const double POWERS[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    size_t i = 0, n = token.size();
+    bool negative = i < n && token[i] == '-';
+    if (i < n && (token[i] == '-' || token[i] == '+')) ++i;
+
+    uint64_t mantissa = 0;
+    int digits = 0, significant = 0, exponent = 0;
+    for (; i < n && isdigit((unsigned char)token[i]); ++i, ++digits) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (token[i] - '0');
+            if (mantissa) ++significant;
+        } else {
+            ++exponent, ++significant;
+        }
+    }
+    if (i < n && token[i] == '.') {
+        for (++i; i < n && isdigit((unsigned char)token[i]); ++i, ++digits) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (token[i] - '0');
+                if (mantissa) ++significant;
+                --exponent;
+            } else {
+                ++significant;
+            }
+        }
+    }
+    if (digits == 0) return false;
+    if (i < n && (token[i] == 'e' || token[i] == 'E')) {
+        ++i;
+        bool negative_exponent = i < n && token[i] == '-';
+        if (i < n && (token[i] == '-' || token[i] == '+')) ++i;
+        if (i == n) return false;
+        int e = 0;
+        for (; i < n && isdigit((unsigned char)token[i]); ++i)
+            if (e < 100000) e = e * 10 + (token[i] - '0');
+        exponent += negative_exponent ? -e : e;
+    }
+    if (i != n) return false;
+
+    if (significant <= 19 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        value = exponent >= 0 ? (double)mantissa * POWERS[exponent] : (double)mantissa / POWERS[-exponent];
+        if (negative) value = -value;
+    } else {
+        value = strtod(string(token).c_str(), nullptr);
+    }
+    return true;
+}
+
+static bool equal_ignore_case(string_view a, string_view b) {
+    return a.size() == b.size() && equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return tolower((unsigned char)x) == tolower((unsigned char)y);
+           });
+}
+
+static bool token_equal(string_view user, string_view answer, const token_compare_options &opt) {
+    if (user == answer) return true;
+    if (opt.ignore_case && equal_ignore_case(user, answer)) return true;
+    if (opt.absolute_error <= 0 && opt.relative_error <= 0) return false;
+
+    double u, a;
+    if (!parse_number(user, u) || !parse_number(answer, a)) return false;
+    if (!isfinite(u) || !isfinite(a)) return u == a;
+    // 与 testlib 一样额外允许 1e-15 的误差，避免误差恰好等于边界时因为舍入被判错
+    double diff = fabs(u - a);
+    return diff <= opt.absolute_error + 1e-15 || diff <= opt.relative_error * fabs(a) + 1e-15;
+}
+
+/**
+ * @brief 不关心行的顺序时的一行
+ */
+struct token_line {
+    size_t offset;  // 第一个 token 的位置
+    vector<pair<string_view, optional<double>>> tokens;
+};
+
+static vector<token_line> split_lines(string_view text) {
+    vector<token_line> lines;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == string_view::npos) end = text.size();
+        string_view line = text.substr(0, end);
+        token_line current;
+        for (size_t p = pos;;) {
+            auto [begin, stop] = next_token(line, p);
+            if (begin == stop) break;
+            if (current.tokens.empty()) current.offset = begin;
+            double value;
+            string_view token = line.substr(begin, stop - begin);
+            current.tokens.emplace_back(token, parse_number(token, value) ? optional<double>(value) : nullopt);
+        }
+        if (!current.tokens.empty()) lines.push_back(move(current));
+        pos = end + 1;
+    }
+    return lines;
+}
+
+/**
+ * @brief 行的排序：逐个比较 token，数字排在字符串之前，数字按照数值比较，字符串按照（忽略大小写时小写的）字典序比较
+ */
+static bool line_less(const token_line &x, const token_line &y, bool ignore_case) {
+    size_t n = min(x.tokens.size(), y.tokens.size());
+    for (size_t i = 0; i < n; ++i) {
+        auto &[a, va] = x.tokens[i];
+        auto &[b, vb] = y.tokens[i];
+        if (va && vb) {
+            if (*va != *vb) return *va < *vb;
+            continue;
+        }
+        if (va || vb) return va.has_value();
+        auto less = [&](char p, char q) {
+            return ignore_case ? tolower((unsigned char)p) < tolower((unsigned char)q) : (unsigned char)p < (unsigned char)q;
+        };
+        if (lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), less)) return true;
+        if (lexicographical_compare(b.begin(), b.end(), a.begin(), a.end(), less)) return false;
+    }
+    return x.tokens.size() < y.tokens.size();
+}
+
+static compare_report compare_unordered_lines(string_view user, string_view answer, const token_compare_options &opt) {
+    compare_report report;
+    vector<token_line> user_lines = split_lines(user), answer_lines = split_lines(answer);
+    auto less = [&](const token_line &x, const token_line &y) { return line_less(x, y, opt.ignore_case); };
+    sort(user_lines.begin(), user_lines.end(), less);
+    sort(answer_lines.begin(), answer_lines.end(), less);
+
+    for (size_t i = 0; i < max(user_lines.size(), answer_lines.size()); ++i) {
+        if (i >= user_lines.size() || i >= answer_lines.size()) {
+            report.result = RESULT_WA;
+            report.user_offset = i < user_lines.size() ? user_lines[i].offset : user.size();
+            report.answer_offset = i < answer_lines.size() ? answer_lines[i].offset : answer.size();
+            return report;
+        }
+        auto &u = user_lines[i].tokens, &a = answer_lines[i].tokens;
+        for (size_t k = 0; k < max(u.size(), a.size()); ++k) {
+            if (k < u.size() && k < a.size() && token_equal(u[k].first, a[k].first, opt)) continue;
+            // 报告不同的行，而不是行中不同的 token，两个输出中对应的行经过了排序
+            report.result = RESULT_WA;
+            report.user_offset = user_lines[i].offset;
+            report.answer_offset = answer_lines[i].offset;
+            return report;
+        }
+    }
+    return report;
+}
+
+compare_report compare_tokens(string_view user, string_view answer, const token_compare_options &opt) {
+    if (opt.unordered_lines) return compare_unordered_lines(user, answer, opt);
+
+    compare_report report;
+    size_t n = mismatch(user.data(), answer.data(), min(user.size(), answer.size()));
+    if (n == user.size() && n == answer.size()) return report;
+
+    // 相同的前缀中的 token 也相同，从第一个不同的字节所在的 token 开始比较
+    size_t start = n;
+    while (start > 0 && !is_separator(user[start - 1])) --start;
+    size_t u = start, a = start;
+    while (true) {
+        auto [user_begin, user_end] = next_token(user, u);
+        auto [answer_begin, answer_end] = next_token(answer, a);
+        bool user_eof = user_begin == user_end, answer_eof = answer_begin == answer_end;
+        if (user_eof && answer_eof) return report;
+        if (user_eof || answer_eof ||
+            !token_equal(user.substr(user_begin, user_end - user_begin), answer.substr(answer_begin, answer_end - answer_begin), opt)) {
+            report.result = RESULT_WA;
+            report.user_offset = user_begin;
+            report.answer_offset = answer_begin;
+            return report;
+        }
+    }
+}
+
+pair<size_t, size_t> line_column(string_view text, size_t offset) {
+    offset = min(offset, text.size());
+    size_t line = count(text.begin(), text.begin() + offset, '\n') + 1;
+    size_t begin = text.rfind('\n', offset == 0 ? string_view::npos : offset - 1);
+    size_t column = offset - (begin == string_view::npos || offset == 0 ? 0 : begin + 1) + 1;
+    return {line, column};
+}
+
+/**
+ * @brief 第一处不同附近的内容，转义不可见字符以便区分空白字符的差异
+ */
+static string snippet(string_view text, size_t offset) {
+    constexpr size_t LENGTH = 40;
+    if (offset >= text.size()) return "<EOF>";
+    string result;
+    for (size_t i = offset; i < text.size() && i < offset + LENGTH; ++i) {
+        unsigned char c = text[i];
+        switch (c) {
+            case '\n': result += "\\n"; break;
+            case '\r': result += "\\r"; break;
+            case '\t': result += "\\t"; break;
+            case '\\': result += "\\\\"; break;
+            default:
+                if (c < 0x20 || c == 0x7f) {
+                    static const char *HEX = "0123456789abcdef";
+                    result += "\\x";
+                    result += HEX[c >> 4];
+                    result += HEX[c & 0xf];
+                } else {
+                    result += c;
+                }
+        }
+    }
+    if (offset + LENGTH < text.size()) result += "...";
+    return result;
+}
+
+string describe_difference(string_view user, string_view answer, const compare_report &report) {
+    if (report.result == RESULT_AC) return {};
+    string result;
+    for (auto [name, text, offset] : {tuple{"user output", user, report.user_offset}, {"standard output", answer, report.answer_offset}}) {
+        auto [line, column] = line_column(text, offset);
+        result += string(name) + ": line " + to_string(line) + ", column " + to_string(column) + ": " + snippet(text, offset) + "\n";
+    }
+    return result;
+}
+
+/**
+ * @brief 按照 diff-ign-space 的规则规范化一行：去掉行末空白字符，连续的空白字符替换为一个空格
+ * @return 规范化之后的内容，空行返回空
+ */
+static string_view normalize_line(string_view line, string &buffer) {
+    buffer.clear();
+    size_t i = 0;
+    while (i < line.size()) {
+        if (is_space(line[i])) {
+            while (i < line.size() && is_space(line[i])) ++i;
+            if (i < line.size()) buffer += ' ';
+        } else {
+            buffer += line[i++];
+        }
+    }
+    return buffer;
+}
+
+stream_checker::stream_checker(string_view answer) : answer(answer) {}
+
+bool stream_checker::check_line(string_view line) {
+    // 大多数正确的输出与标准输出逐字节相同，相同的一行无论是不是空行都可以直接跳过
+    size_t end = answer.find('\n', answer_pos);
+    if (end == string_view::npos) end = answer.size();
+    if (answer_pos < answer.size() && answer.compare(answer_pos, end - answer_pos, line) == 0) {
+        answer_pos = min(end + 1, answer.size());
+        return true;
+    }
+
+    string_view user = normalize_line(line, user_line);
+    if (user.empty()) return true;
+    while (answer_pos < answer.size()) {
+        end = answer.find('\n', answer_pos);
+        if (end == string_view::npos) end = answer.size();
+        string_view expected = normalize_line(answer.substr(answer_pos, end - answer_pos), answer_line);
+        answer_pos = min(end + 1, answer.size());
+        if (!expected.empty()) return user == expected;
+    }
+    return false;
+}
+
+bool stream_checker::feed(string_view data) {
+    while (!data.empty()) {
+        size_t nl = data.find('\n');
+        if (nl == string_view::npos) {
+            pending.append(data);
+            return true;
+        }
+        bool ok;
+        if (pending.empty()) {
+            ok = check_line(data.substr(0, nl));
+        } else {
+            pending.append(data.substr(0, nl));
+            ok = check_line(pending);
+            pending.clear();
+        }
+        if (!ok) return false;
+        data.remove_prefix(nl + 1);
+    }
+    return true;
+}
+
+bool stream_checker::finish() {
+    if (!pending.empty() && !check_line(pending)) return false;
+    pending.clear();
+    // 标准输出剩余的行只能是空行
+    while (answer_pos < answer.size()) {
+        size_t end = answer.find('\n', answer_pos);
+        if (end == string_view::npos) end = answer.size();
+        if (!normalize_line(answer.substr(answer_pos, end - answer_pos), answer_line).empty()) return false;
+        answer_pos = end + 1;
+    }
+    return true;
+}
+
+mapped_file::mapped_file(const fs::path &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw system_error(errno, system_category(), "unable to open " + path.string());
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, system_category(), "unable to stat " + path.string());
+    }
+    size = st.st_size;
+    if (size > 0) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            int err = errno;
+            close(fd);
+            data = nullptr;
+            throw system_error(err, system_category(), "unable to mmap " + path.string());
+        }
+        // 比较器顺序读取整个文件，提示内核提前预读
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+}
+
+mapped_file::~mapped_file() {
+    if (data) munmap(data, size);
+}
+
+string_view mapped_file::view() const {
+    return {static_cast<const char *>(data), size};
+}
+
+}  // namespace judge
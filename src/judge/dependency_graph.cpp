@@ -0,0 +1,76 @@
+#include "judge/dependency_graph.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace judge {
+using namespace std;
+
+dependency_graph::dependency_graph(const vector<int> &depends_on)
+    : edges(depends_on.size()), states(depends_on.size(), state::PENDING), pending_count(depends_on.size()) {
+    for (size_t i = 0; i < depends_on.size(); ++i) {
+        int parent = depends_on[i];
+        if (parent < 0) {
+            entries.push_back(i);
+        } else if (parent >= (int)i) {
+            // 如果每个任务都只依赖前面的任务，那么这个图将是森林，确保不会出现环
+            throw invalid_argument("Judge task " + to_string(i) + " depends on judge task " + to_string(parent) + " after it");
+        } else {
+            edges[parent].push_back(i);
+        }
+    }
+}
+
+size_t dependency_graph::size() const {
+    return states.size();
+}
+
+const vector<size_t> &dependency_graph::roots() const {
+    return entries;
+}
+
+const vector<size_t> &dependency_graph::children(size_t id) const {
+    return edges.at(id);
+}
+
+bool dependency_graph::start(size_t id) {
+    if (states.at(id) != state::PENDING) return false;
+    states[id] = state::RUNNING;
+    --pending_count;
+    ++running_count;
+    return true;
+}
+
+bool dependency_graph::finish(size_t id) {
+    if (states.at(id) != state::RUNNING) return false;
+    states[id] = state::FINISHED;
+    --running_count;
+    ++finished_count;
+    return true;
+}
+
+bool dependency_graph::skip(size_t id) {
+    if (states.at(id) != state::PENDING) return false;
+    states[id] = state::FINISHED;
+    --pending_count;
+    ++finished_count;
+    return true;
+}
+
+size_t dependency_graph::pending() const {
+    return pending_count;
+}
+
+size_t dependency_graph::running() const {
+    return running_count;
+}
+
+size_t dependency_graph::finished() const {
+    return finished_count;
+}
+
+bool dependency_graph::completed() const {
+    return finished_count == states.size();
+}
+
+}  // namespace judge
@@ -50,7 +50,7 @@ bool program_output_judger::verify(submission &submit) const {
     return true;
 }
 
-bool program_output_judger::distribute(concurrent_queue<message::client_task> &task_queue, submission &submit) const {
+bool program_output_judger::distribute(work_stealing_queue<message::client_task> &task_queue, submission &submit) const {
     // 我们只需要发一个评测请求就行了，以便让 client 能调用我们的 judge 函数
     // 或者我们在 verify 的时候就评测完选择题然后返回 false 也行。
     judge::message::client_task client_task = {
@@ -63,7 +63,7 @@ bool program_output_judger::distribute(concurrent_queue<message::client_task> &t
     return true;
 }
 
-void program_output_judger::judge(const message::client_task &task, concurrent_queue<message::client_task> &, const string &) const {
+void program_output_judger::judge(const message::client_task &task, work_stealing_queue<message::client_task> &, const string &) const {
     auto submit = dynamic_cast<program_output_submission *>(task.submit);
 
     for (auto &q : submit->questions)
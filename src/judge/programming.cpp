@@ -12,6 +12,7 @@
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -21,9 +22,14 @@
 #include "common/stl_utils.hpp"
 #include "common/utils.hpp"
 #include "config.hpp"
+#include "judge/result_cache.hpp"
+#include "judge/result_journal.hpp"
+#include "judge/sandbox_pool.hpp"
+#include "judge/standard_check.hpp"
 #include "logging.hpp"
 #include "runguard.hpp"
 #include "server/judge_server.hpp"
+#include "server/report_coalescer.hpp"
 
 namespace judge {
 using namespace std;
@@ -103,18 +109,45 @@ bool generate_random_data(const filesystem::path &datadir, const filesystem::pat
 }
 
 /**
- * @brief 执行程序评测任务
- * @param client_task 当前评测任务信息
- * @param submit 当前评测任务归属的选手提交信息
- * @param task 当前评测任务数据点的信息
- * @param execcpuset 当前评测任务能允许运行在那些 cpu 核心上
- * @param awake_callback 获取评测任务中途评测部分结果后的 callback，用于返回评测报告
+ * @brief 评测任务运行所需的运行文件夹、测试数据和脚本
+ * 脚本的共享锁在评测结束前一直持有，测试数据拷贝到 DATA_DIR 时，评测结束后删除拷贝的评测数据
  */
-static judge_task_result judge_impl(const message::client_task &client_task, programming_submission &submit, judge_task &task, const string &execcpuset, function<void()> awake_callback) {
-    LOG_INFO << "in the function judge_impl";  // debug
+struct task_environment {
+    string taskname;
+    filesystem::path cachedir, workdir, rundir, datadir;
+    unique_ptr<executable> check_script, run_script;
+    unique_ptr<judge::program> exec_compare_script;
+    judge::program *compare_script = nullptr;
+    scoped_file_lock check_script_lock, run_script_lock, compare_script_lock;
+
+    /**
+     * @brief 比较脚本为内置的词法比较器时的参数，此时 compare_script 为空
+     */
+    optional<token_compare_options> token_compare;
+
+    /**
+     * @brief 选手程序基于哪些评测任务的运行文件夹运行
+     */
+    vector<string> basedirs;
+
+    bool data_copied = false;
+
+    ~task_environment() {
+        if (data_copied) filesystem::remove(datadir);
+    }
+};
+
+/**
+ * @brief 准备评测任务的运行文件夹、脚本和测试数据
+ * @param id 评测任务的编号
+ * @param result 记录运行文件夹和测试数据文件夹，随机测试数据生成失败时记录失败原因
+ * @return 随机测试数据生成失败时返回 false
+ */
+static bool prepare_environment(size_t id, programming_submission &submit, judge_task &task, const string &execcpuset, task_environment &env, judge_task_result &result) {
     // 获取一个类似 5-random_check 的任务名，方便查找提交文件夹
-    string taskid = boost::lexical_cast<string>(client_task.id);
-    string taskname = task.tag;
+    string taskid = boost::lexical_cast<string>(id);
+    string &taskname = env.taskname;
+    taskname = task.tag;
     boost::remove_if(taskname, boost::is_any_of("/\\"));
     boost::replace_all(taskname, " ", "_");
     boost::replace_all(taskname, ":", "_");
@@ -123,30 +156,34 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
     else
         taskname = taskid + "-" + taskname;
 
-    filesystem::path cachedir = get_cache_dir(submit);
-    filesystem::path workdir = get_work_dir(submit);          // 本提交的工作文件夹
-    filesystem::path rundir = workdir / ("run-" + taskname);  // 本测试点的运行文件夹
-    filesystem::create_directories(rundir);
-
-    judge_task_result result{task.tag, client_task.id};
-    result.run_dir = rundir;
+    env.cachedir = get_cache_dir(submit);
+    env.workdir = get_work_dir(submit);              // 本提交的工作文件夹
+    env.rundir = env.workdir / ("run-" + taskname);  // 本测试点的运行文件夹
+    // 从评测结果日志恢复评测时不会清理提交文件夹，运行文件夹可能残留上次被中断的评测产生的文件
+    filesystem::remove_all(env.rundir);
+    filesystem::create_directories(env.rundir);
+    result.run_dir = env.rundir;
 
     auto &exec_mgr = submit.judge_server->get_executable_manager();
 
-    auto check_script = exec_mgr.get_check_script(task.check_script);
-    check_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
-    auto check_script_lock = check_script->shared_lock();
-
-    auto run_script = exec_mgr.get_run_script(task.run_script);
-    run_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
-    auto run_script_lock = run_script->shared_lock();
-
-    unique_ptr<judge::program> exec_compare_script = exec_mgr.get_compare_script(task.compare_script);
-    auto &compare_script = task.compare_script.empty() && submit.compare ? submit.compare : exec_compare_script;
-    compare_script->fetch(execcpuset, cachedir / "compare", CHROOT_DIR, exec_mgr);
-    auto compare_script_lock = compare_script->shared_lock();
+    env.check_script = exec_mgr.get_check_script(task.check_script);
+    env.check_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
+    env.check_script_lock = env.check_script->shared_lock();
+
+    env.run_script = exec_mgr.get_run_script(task.run_script);
+    env.run_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
+    env.run_script_lock = env.run_script->shared_lock();
+
+    // 内置的词法比较器在评测系统进程内执行，不需要获取比较脚本
+    env.token_compare = parse_token_compare(task.compare_script);
+    if (!env.token_compare) {
+        env.exec_compare_script = exec_mgr.get_compare_script(task.compare_script);
+        env.compare_script = task.compare_script.empty() && submit.compare ? submit.compare.get() : env.exec_compare_script.get();
+        env.compare_script->fetch(execcpuset, env.cachedir / "compare", CHROOT_DIR, exec_mgr);
+        env.compare_script_lock = env.compare_script->shared_lock();
+    }
 
-    filesystem::path datadir;
+    filesystem::path &datadir = env.datadir;
 
     int depends_on = task.depends_on;
     judge_task *father = nullptr;
@@ -155,7 +192,7 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
     // 获得输入输出数据，提交发生更新时，将直接清理整个文件夹内所有内容
     if (task.is_random) {
         // 生成随机测试数据
-        filesystem::path random_data_dir = cachedir / "random_data";
+        filesystem::path random_data_dir = env.cachedir / "random_data";
 
         if (father && father->is_random) {  // 如果父测试也是随机测试，那么使用同一个测试数据组
             task.testcase_id = father->testcase_id;
@@ -174,8 +211,8 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
                 scoped_file_lock case_lock = lock_directory(datadir, false);  // 随机目录的写入必须加锁
                 lock.release();
 
-                if (!generate_random_data(datadir, cachedir, number, submit, task, result, execcpuset))
-                    return result;
+                if (!generate_random_data(datadir, env.cachedir, number, submit, task, result, execcpuset))
+                    return false;
             } else {
                 int number = random(0, MAX_RANDOM_DATA_NUM - 1);
                 task.subcase_id = number;  // 标记当前测试点使用了哪个随机测试
@@ -185,14 +222,14 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
                 lock.release();
                 filesystem::path errorpath = datadir / ".error";  // 文件存在表示该组测试数据生成失败
                 if (filesystem::exists(errorpath)) {              // 该组测试数据生成失败则重试，如果仍然失败返回
-                    if (!generate_random_data(datadir, cachedir, number, submit, task, result, execcpuset))
-                        return result;
+                    if (!generate_random_data(datadir, env.cachedir, number, submit, task, result, execcpuset))
+                        return false;
                 }
             }
         }
     } else {
         // 下载标准测试数据
-        filesystem::path standard_data_dir = cachedir / "standard_data";
+        filesystem::path standard_data_dir = env.cachedir / "standard_data";
 
         if (father && !father->is_random && father->testcase_id >= 0) {  // 如果父测试也是标准测试，那么使用同一个测试数据组
             int number = father->testcase_id;
@@ -223,68 +260,65 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
         filesystem::path newdir = DATA_DIR / taskname;
         filesystem::copy(datadir, newdir, filesystem::copy_options::recursive);
         datadir = newdir;
+        env.data_copied = true;
     }
     result.data_dir = datadir;
 
-    defer {  // 评测结束后删除拷贝的评测数据
-        if (USE_DATA_DIR) {
-            filesystem::remove(datadir);
-        }
-    };
-
-    process_builder pb;
-    pb.directory(rundir);
-    if (task.file_limit > 0) pb.environment("FILELIMIT", task.file_limit);
-    if (task.memory_limit > 0) pb.environment("MEMLIMIT", task.memory_limit);
-    if (task.proc_limit > 0) pb.environment("PROCLIMIT", task.proc_limit);
-
-    if (task.actions.size() && task.action_delay > 0) {
-        LOG_INFO << "task.action_delay = " << task.action_delay;  // debug
-        pb.awake_period(task.action_delay, [&]() {
-            result.actions.clear();
-            for (auto &action : task.actions) {
-                action_result res;
-                res.tag = action.tag;
-                res.success = action.act(submit, task, result, res.result);
-                result.actions.push_back(res);
-            }
-
-            awake_callback();
-        });
-    }
-
-    vector<string> basedirs;
     for (int taskid = task.file_depends_on < 0 ? task.depends_on : task.file_depends_on;
          taskid >= 0 && taskid < (int)submit.results.size();
          taskid = submit.judge_tasks[taskid].file_depends_on < 0 ? submit.judge_tasks[taskid].depends_on : submit.judge_tasks[taskid].file_depends_on) {
         // TODO: 暂时未静默跳过未完成测试的运行环境依赖
         if (submit.results[taskid].status == status::PENDING) continue;
-        basedirs.push_back(submit.results[taskid].run_dir.string());
+        env.basedirs.push_back(submit.results[taskid].run_dir.string());
     }
-    reverse(basedirs.begin(), basedirs.end());
+    reverse(env.basedirs.begin(), env.basedirs.end());
+    return true;
+}
 
-    optional<string> walltime;
-    if (execcpuset.find(",") != string::npos || execcpuset.find("-") != string::npos)
-        walltime = "-w";
+/**
+ * @brief 评测任务占用多个核心时按照墙钟时间限制选手程序
+ */
+static bool use_wall_time(const string &execcpuset) {
+    return execcpuset.find(",") != string::npos || execcpuset.find("-") != string::npos;
+}
 
-    LOG_INFO << "in the function judge_impl: before pb.run";  // debug
+/**
+ * @brief 生成由评测系统直接执行标准评测流程的参数，见 run_standard_check
+ */
+static standard_check_options standard_check_of(programming_submission &submit, const judge_task &task, const task_environment &env, const string &execcpuset) {
+    auto &exec_mgr = submit.judge_server->get_executable_manager();
 
-    // 调用 check script 来执行真正的评测，这里会调用 run script 运行选手程序，调用 compare script 运行比较器，并返回评测结果
-    // <check-script> <datadir> <timelimit> <chrootdir> <workdir> <basedir> <run-uuid> <compile-script> <run-script> <compare-script> <source files> <assist files> <run args>
-    int ret = pb.run(check_script->get_run_path() / "run",
-                     "-n", execcpuset, "--",
-                     walltime,
-                     datadir, task.time_limit, CHROOT_DIR, workdir,
-                     boost::algorithm::join(basedirs, ":"),
-                     taskname,
-                     get_run_path(submit.submission->get_compile_script(exec_mgr)),
-                     run_script->get_run_path(),
-                     compare_script->get_run_path(cachedir / "compare"),
-                     boost::algorithm::join(submit.submission->source_files | boost::adaptors::transformed([](auto &a) { return a->name; }), ":"),
-                     boost::algorithm::join(submit.submission->assist_files | boost::adaptors::transformed([](auto &a) { return a->name; }), ":"),
-                     task.run_args);
-    result.report = read_file_content(rundir / "feedback" / "report.txt", "");
-    result.error_log = read_file_content(rundir / "system.out", "No detailed information", judge::MAX_IO_SIZE);
+    standard_check_options opt;
+    opt.datadir = env.datadir;
+    opt.time_limit = task.time_limit;
+    opt.wall_time = use_wall_time(execcpuset);
+    opt.cpuset = execcpuset;
+    opt.chrootdir = CHROOT_DIR;
+    opt.rundir = env.rundir;
+    opt.basedirs = env.basedirs;
+    opt.run_script = env.run_script->get_run_path();
+    if (env.compare_script) opt.compare_script = env.compare_script->get_run_path(env.cachedir / "compare");
+    opt.token_compare = env.token_compare;
+    opt.run_args = task.run_args;
+    opt.limit = task;
+
+    // 选手程序的语言和运行脚本都提供了系统调用白名单时，选手程序只能调用两者中的系统调用。
+    // gtest、valgrind、asan 等运行脚本需要 fork、wait4、dup2 等语言白名单以外的系统调用，它们不提供白名单，因此不受限制
+    filesystem::path language_dir = get_run_path(submit.submission->get_compile_script(exec_mgr));
+    if (SECCOMP_PROFILE && !language_dir.empty() && filesystem::exists(language_dir / "seccomp") && filesystem::exists(opt.run_script / "seccomp")) {
+        opt.seccomp_profiles.push_back(opt.run_script / "seccomp");
+        opt.seccomp_profiles.push_back(language_dir / "seccomp");
+    }
+    return opt;
+}
+
+/**
+ * @brief 根据 check script 的返回值和运行文件夹中的评测结果得到评测任务的评测结果，并执行评测任务的 actions
+ * @param ret check script 的返回值，见 error_codes
+ */
+static void collect_result(programming_submission &submit, judge_task &task, judge_task_result &result, int ret) {
+    result.report = read_file_content(result.run_dir / "feedback" / "report.txt", "");
+    result.error_log = read_file_content(result.run_dir / "system.out", "No detailed information", judge::MAX_IO_SIZE);
     switch (ret) {
         case E_INTERNAL_ERROR:
             result.status = status::SYSTEM_ERROR;
@@ -302,7 +336,7 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
                 // 比较器会将评分（0~1 的分数）存到 score.txt 中。
                 // 不会出现文件不存在的情况，否则 check script 将返回 COMPARE_ERROR
                 // feedback 文件夹的内容参考 check script
-                ifstream fin(rundir / "feedback" / "score.txt");
+                ifstream fin(result.run_dir / "feedback" / "score.txt");
                 int numerator, denominator;
                 fin >> numerator >> denominator;  // 文件中第一个数字是分子，第二个数字是分母
                 result.score = {numerator, denominator};
@@ -340,7 +374,7 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
             break;
     }
 
-    auto metadata = read_runguard_result(rundir / "program.meta");
+    auto metadata = read_runguard_result(result.run_dir / "program.meta");
     result.run_time = metadata.wall_time;  // TODO: 支持题目选择 cpu_time 或者 wall_time 进行时间
     result.memory_used = metadata.memory;
 
@@ -352,9 +386,167 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
         result.actions.push_back(res);
     }
 
+}
+
+/**
+ * @brief 执行程序评测任务
+ * @param client_task 当前评测任务信息
+ * @param submit 当前评测任务归属的选手提交信息
+ * @param task 当前评测任务数据点的信息
+ * @param execcpuset 当前评测任务能允许运行在那些 cpu 核心上
+ * @param sandboxes 预先挂载好的运行环境池，为空时由 runguard 为每次运行挂载运行环境
+ * @param awake_callback 获取评测任务中途评测部分结果后的 callback，用于返回评测报告，参数为中途的评测结果
+ */
+static judge_task_result judge_impl(const message::client_task &client_task, programming_submission &submit, judge_task &task, const string &execcpuset, sandbox_pool *sandboxes, function<void(const judge_task_result &)> awake_callback) {
+    LOG_INFO << "in the function judge_impl";  // debug
+    judge_task_result result{task.tag, client_task.id};
+    task_environment env;
+    if (!prepare_environment(client_task.id, submit, task, execcpuset, env, result))
+        return result;
+
+    auto &exec_mgr = submit.judge_server->get_executable_manager();
+
+    process_builder pb;
+    pb.directory(env.rundir);
+    if (task.file_limit > 0) pb.environment("FILELIMIT", task.file_limit);
+    if (task.memory_limit > 0) pb.environment("MEMLIMIT", task.memory_limit);
+    if (task.proc_limit > 0) pb.environment("PROCLIMIT", task.proc_limit);
+
+    if (task.actions.size() && task.action_delay > 0) {
+        LOG_INFO << "task.action_delay = " << task.action_delay;  // debug
+        pb.awake_period(task.action_delay, [&]() {
+            result.actions.clear();
+            for (auto &action : task.actions) {
+                action_result res;
+                res.tag = action.tag;
+                res.success = action.act(submit, task, result, res.result);
+                result.actions.push_back(res);
+            }
+
+            awake_callback(result);
+        });
+    }
+
+    optional<string> walltime;
+    if (use_wall_time(execcpuset))
+        walltime = "-w";
+
+    // 在新的进程组中运行 check script，使得提交的评测结果确定后可以终止整个评测过程，见 cancel_remaining
+    pb.process_group([&](pid_t pgid) {
+        scoped_lock guard(submit.mut);
+        if (submit.cancelled(client_task.id))
+            kill(-pgid, SIGTERM);
+        else
+            submit.process_groups[client_task.id] = pgid;
+    });
+    defer {
+        scoped_lock guard(submit.mut);
+        submit.process_groups.erase(client_task.id);
+    };
+
+    LOG_INFO << "in the function judge_impl: before pb.run";  // debug
+
+    // 内置的比较器只能由评测系统直接执行的标准评测流程调用
+    if (env.token_compare && !(NATIVE_CHECK && task.check_script == "standard")) {
+        result.status = status::SYSTEM_ERROR;
+        result.error_log = "Compare script " + task.compare_script + " is only supported by the native standard check";
+        return result;
+    }
+
+    int ret;
+    if (task.check_script == "interactive") {
+        // 交互评测需要同时运行选手程序和交互器，只由评测系统直接执行，见 run_interactive_check
+        standard_check_options opt = standard_check_of(submit, task, env, execcpuset);
+
+        sandbox_pool::lease sandbox;
+        if (sandboxes) sandbox = sandboxes->acquire(boost::lexical_cast<unsigned>(execcpuset.substr(0, execcpuset.find(','))));
+        opt.sandbox = sandbox.root();
+        ret = run_interactive_check(opt, pb);
+    } else if (NATIVE_CHECK && task.check_script == "standard") {
+        // 标准评测流程由评测系统直接执行，省去启动 bash 和挂载命令的开销，见 run_standard_check
+        standard_check_options opt = standard_check_of(submit, task, env, execcpuset);
+        // 内置的 diff 比较器可以在选手程序运行时逐行比较输出，答案错误时不必等选手程序输出完
+        if (STREAM_CHECK_SLACK > 0 && !task.compare_script.empty())
+            opt.stream_compare = parse_compare_mode(task.compare_script);
+
+        // 评测任务占用的第一个核心就是 worker 自己的核心
+        sandbox_pool::lease sandbox;
+        if (sandboxes) sandbox = sandboxes->acquire(boost::lexical_cast<unsigned>(execcpuset.substr(0, execcpuset.find(','))));
+        opt.sandbox = sandbox.root();
+        ret = run_standard_check(opt, pb);
+    } else {
+        // 调用 check script 来执行真正的评测，这里会调用 run script 运行选手程序，调用 compare script 运行比较器，并返回评测结果
+        // <check-script> <datadir> <timelimit> <chrootdir> <workdir> <basedir> <run-uuid> <compile-script> <run-script> <compare-script> <source files> <assist files> <run args>
+        ret = pb.run(env.check_script->get_run_path() / "run",
+                     "-n", execcpuset, "--",
+                     walltime,
+                     env.datadir, task.time_limit, CHROOT_DIR, env.workdir,
+                     boost::algorithm::join(env.basedirs, ":"),
+                     env.taskname,
+                     get_run_path(submit.submission->get_compile_script(exec_mgr)),
+                     env.run_script->get_run_path(),
+                     env.compare_script->get_run_path(env.cachedir / "compare"),
+                     boost::algorithm::join(submit.submission->source_files | boost::adaptors::transformed([](auto &a) { return a->name; }), ":"),
+                     boost::algorithm::join(submit.submission->assist_files | boost::adaptors::transformed([](auto &a) { return a->name; }), ":"),
+                     task.run_args);
+    }
+
+    collect_result(submit, task, result, ret);
     return result;
 }
 
+/**
+ * @brief 通过一次 runguard 批量运行执行多个标准评测任务，见 run_standard_check_batch
+ * 所有评测任务共用一个根目录，使用运行环境池时从池中取出一个运行环境，整个批量运行结束后才归还。
+ * @param client_task 合并分发的评测任务，终止评测时通过 client_task.id 找到 runguard 所在的进程组
+ * @param ids 评测任务的编号
+ * @param sandboxes 预先挂载好的运行环境池，为空时由 runguard 为这次批量运行挂载一次运行环境
+ * @return 各个评测任务的评测结果，与 ids 一一对应
+ */
+static vector<judge_task_result> judge_batch_impl(const message::client_task &client_task, programming_submission &submit, const vector<size_t> &ids, const string &execcpuset, sandbox_pool *sandboxes) {
+    vector<judge_task_result> results;
+    vector<unique_ptr<task_environment>> envs;
+    vector<standard_check_options> opts;
+    vector<size_t> batched;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        judge_task &task = submit.judge_tasks[ids[i]];
+        results.emplace_back(task.tag, ids[i]);
+        auto env = make_unique<task_environment>();
+        try {
+            if (!prepare_environment(ids[i], submit, task, execcpuset, *env, results[i])) continue;
+        } catch (exception &ex) {
+            results[i].status = status::SYSTEM_ERROR;
+            results[i].error_log = ex.what();
+            continue;
+        }
+        opts.push_back(standard_check_of(submit, task, *env, execcpuset));
+        envs.push_back(move(env));
+        batched.push_back(i);
+    }
+
+    sandbox_pool::lease sandbox;
+    if (sandboxes) sandbox = sandboxes->acquire(boost::lexical_cast<unsigned>(execcpuset.substr(0, execcpuset.find(','))));
+    for (auto &opt : opts) opt.sandbox = sandbox.root();
+
+    process_builder pb;
+    pb.process_group([&](pid_t pgid) {
+        scoped_lock guard(submit.mut);
+        if (submit.cancelled(client_task.id))
+            kill(-pgid, SIGTERM);
+        else
+            submit.process_groups[client_task.id] = pgid;
+    });
+    defer {
+        scoped_lock guard(submit.mut);
+        submit.process_groups.erase(client_task.id);
+    };
+
+    vector<int> rets = run_standard_check_batch(opts, pb);
+    for (size_t k = 0; k < batched.size(); ++k)
+        collect_result(submit, submit.judge_tasks[ids[batched[k]]], results[batched[k]], rets[k]);
+    return results;
+}
+
 static void compile(judge::program &program, const filesystem::path &workdir, const string &execcpuset, const executable_manager &exec_mgr, const program_limit &limit, judge_task_result &task_result, bool executable) {
     try {
         // 将程序存放在 workdir 下，program.fetch 会自行组织 workdir 内的文件存储结构
@@ -445,6 +637,29 @@ static judge_task_result compile(const message::client_task &client_task, progra
     return result;
 }
 
+programming_judger::programming_judger(set<string> fail_fast_categories, shared_ptr<result_journal> journal, shared_ptr<result_cache> cache, shared_ptr<server::report_coalescer> reporter, shared_ptr<sandbox_pool> sandboxes)
+    : fail_fast_categories(move(fail_fast_categories)), journal(move(journal)), cache(move(cache)), reporter(move(reporter)), sandboxes(move(sandboxes)) {}
+
+result_journal *programming_judger::get_journal() const {
+    return journal.get();
+}
+
+result_cache *programming_judger::get_cache() const {
+    return cache.get();
+}
+
+void programming_judger::report_progress(submission &submit) const {
+    if (reporter)
+        reporter->report(submit);
+    else
+        submit.judge_server->summarize(submit, false);
+}
+
+void programming_judger::report_final(submission &submit) const {
+    if (reporter) reporter->complete(submit);
+    submit.judge_server->summarize(submit);
+}
+
 string programming_judger::type() const {
     return "programming";
 }
@@ -492,16 +707,21 @@ bool programming_judger::verify(submission &submit) const {
         return false;
     }
 
+    // 构建评测任务的依赖关系图，如果每个任务都只依赖前面的任务，那么这个图将是森林，确保不会出现环
+    vector<int> depends_on;
+    for (auto &judge_task : sub->judge_tasks) depends_on.push_back(judge_task.depends_on);
+    try {
+        sub->graph = dependency_graph(depends_on);
+    } catch (invalid_argument &ex) {
+        LOG_WARN << "Submission from [" << sub->category << "-" << sub->prob_id << "-" << sub->sub_id << "] may contains circular dependency: " << ex.what();
+        return false;
+    }
+
     // 检查 judge_server 获取的 sub 是否包含编译任务，且确保至多一个编译任务
     bool has_random_case = false;
     for (size_t i = 0; i < sub->judge_tasks.size(); ++i) {
         auto &judge_task = sub->judge_tasks[i];
 
-        if (judge_task.depends_on >= (int)i) {  // 如果每个任务都只依赖前面的任务，那么这个图将是森林，确保不会出现环
-            LOG_WARN << "Submission from [" << sub->category << "-" << sub->prob_id << "-" << sub->sub_id << "] may contains circular dependency.";
-            return false;
-        }
-
         // 对于 C++ 内存检查，由于需要单独编译一个带 AddressSanitizer 的二进制
         // 因此允许这个编译任务有依赖，并且允许提交中有多个编译任务
 
@@ -521,16 +741,10 @@ bool programming_judger::verify(submission &submit) const {
         return false;
     }
 
-    // 检查是否存在可以直接评测的测试点，如果不存在则直接返回
-    bool sent_testcase = false;
-    for (size_t i = 0; i < sub->judge_tasks.size(); ++i) {
-        if (sub->judge_tasks[i].depends_on < 0) {
-            sent_testcase = true;
-            break;
-        }
-    }
+    if (fail_fast_categories.count(sub->category)) sub->fail_fast = true;
 
-    if (!sent_testcase) {
+    // 检查是否存在可以直接评测的测试点，如果不存在则直接返回
+    if (sub->graph.roots().empty()) {
         // 如果不存在评测任务，直接返回
         LOG_WARN << "Submission from [" << sub->category << "-" << sub->prob_id << "-" << sub->sub_id << "] does not have entry test task.";
         return false;
@@ -539,47 +753,6 @@ bool programming_judger::verify(submission &submit) const {
     return true;
 }
 
-bool programming_judger::distribute(concurrent_queue<message::client_task> &task_queue, submission &submit) const {
-    LOG_DEBUG << "Programming judger start to distribute.";
-
-    auto &sub = dynamic_cast<programming_submission &>(submit);
-
-    std::stringstream info;
-    for (auto &judge_task : sub.judge_tasks) {
-        info << "judge task: tag = " << judge_task.tag << ", check_script = " << judge_task.check_script << ", run_script = " << judge_task.run_script << ", compare_script = " << judge_task.compare_script << ", is_random = " << judge_task.is_random << ", testcase_id = " << judge_task.testcase_id << ", subcase_id = " << judge_task.subcase_id << ", depends_on = " << judge_task.depends_on << std::endl;
-    }
-    LOG_DEBUG << "Submission's judge tasks: " << std::endl
-              << info.str();
-
-    filesystem::path workdir = get_work_dir(sub);
-    sub.submission_lock = lock_directory(workdir, false);
-    clean_locked_directory(workdir);
-
-    verify_timeliness(sub);
-
-    // 初始化当前提交的所有评测任务状态为 PENDING
-    sub.results.resize(sub.judge_tasks.size());
-    for (size_t i = 0; i < sub.results.size(); ++i) {
-        sub.results[i].status = status::PENDING;
-        sub.results[i].id = i;
-    }
-
-    // 寻找没有依赖的评测点，并发送评测消息
-    for (size_t i = 0; i < sub.judge_tasks.size(); ++i) {
-        if (sub.judge_tasks[i].depends_on < 0) {  // 不依赖任何任务的任务可以直接开始评测
-            sub.results[i].status = status::RUNNING;
-            judge::message::client_task client_task = {
-                .submit = &submit,
-                .id = i,
-                .name = sub.judge_tasks[i].tag,
-                .cores = sub.judge_tasks[i].cores,
-                .expect_runtime = sub.judge_tasks[i].time_limit * 5};
-            task_queue.push(client_task);
-        }
-    }
-    return true;
-}
-
 static void call_monitor(function<void(monitor &)> callback) {
     try {
         for (auto &monitor : monitors) callback(*monitor);
@@ -588,11 +761,11 @@ static void call_monitor(function<void(monitor &)> callback) {
     }
 }
 
-static void summarize(programming_submission &submit) {
+static void summarize(const programming_judger &judger, programming_submission &submit) {
     LOG_INFO << "Submission finished in " << submit.judge_time.template duration<chrono::milliseconds>().count() << "ms";
     call_monitor([&](monitor &m) { m.get_judge_time(submit); });
 
-    submit.judge_server->summarize(submit);
+    judger.report_final(submit);
 
     filesystem::path workdir = get_work_dir(submit);
     try {
@@ -609,17 +782,202 @@ static void summarize(programming_submission &submit) {
     }
 }
 
+/**
+ * @brief 评测任务的依赖关系不满足，由于依赖关系是树，因此将子树全部设置为 DEPENDENCY_NOT_SATISFIED
+ * @param id 依赖关系不满足的评测任务
+ */
+static void skip_subtree(programming_submission &submit, size_t id) {
+    vector<size_t> stack = {id};
+    while (!stack.empty()) {
+        size_t i = stack.back();
+        stack.pop_back();
+        if (!submit.graph.skip(i)) continue;
+
+        judge_task_result &result = submit.results[i];
+        result.status = status::DEPENDENCY_NOT_SATISFIED;
+        result.tag = submit.judge_tasks[i].tag;
+        result.id = i;
+        result.score = 0;
+        result.run_time = 0;
+        result.memory_used = 0;
+        result.error_log = "";
+        result.report = "";
+        result.actions.clear();
+
+        auto &children = submit.graph.children(i);
+        stack.insert(stack.end(), children.begin(), children.end());
+    }
+}
+
+/**
+ * @brief 提交的评测结果已经确定，取消下标比 decided 大的所有尚未结束的评测任务，调用方需要持有提交的锁
+ * 还没有满足依赖的评测任务和还在评测队列中的评测任务直接标记为 SKIPPED；
+ * 正在评测的评测任务通过进程组终止，评测结束后在 process 中标记为 SKIPPED。
+ * 下标比 decided 小的评测任务继续评测，如果其中有未通过的评测任务，将以它的下标再次调用。
+ * @param decided 未通过的评测任务下标
+ */
+static void cancel_remaining(work_stealing_queue<message::client_task> &testcase_queue, programming_submission &submit, size_t decided) {
+    submit.cancelled_after = decided;
+
+    auto skip = [&](size_t i) {
+        judge_task_result &result = submit.results[i];
+        result.status = status::SKIPPED;
+        result.tag = submit.judge_tasks[i].tag;
+        result.id = i;
+        result.score = 0;
+    };
+
+    // 批量评测任务的下标都不小于第一个评测任务的下标，第一个评测任务被取消时整个批量评测任务都被取消
+    vector<size_t> removed;
+    testcase_queue.remove_if([&](const message::client_task &task) {
+        if (task.submit != &submit || !submit.cancelled(task.id)) return false;
+        removed.push_back(task.id);
+        removed.insert(removed.end(), task.batch.begin(), task.batch.end());
+        return true;
+    });
+    for (size_t i : removed) {
+        submit.graph.finish(i);
+        skip(i);
+    }
+
+    for (size_t i = decided + 1; i < submit.judge_tasks.size(); ++i) {
+        if (submit.graph.skip(i)) skip(i);
+    }
+
+    size_t terminated = 0;
+    for (auto &[id, pgid] : submit.process_groups) {
+        if (!submit.cancelled(id)) continue;
+        LOG_INFO << "Terminating judge task " << id << " since the result of submission is decided by judge task " << decided;
+        if (kill(-pgid, SIGTERM) != 0 && errno != ESRCH)
+            LOG_WARN << "Unable to terminate process group " << pgid << ": " << strerror(errno);
+        ++terminated;
+    }
+
+    LOG_INFO << "Submission result decided, skipped " << removed.size() << " queued judge tasks, terminated "
+             << terminated << " running judge tasks";
+}
+
+/**
+ * @brief 评测任务 kase 所依赖的评测任务结束后，判断 kase 的依赖条件是否满足
+ * @param result 所依赖的评测任务的评测结果
+ */
+static bool dependency_satisfied(const judge_task &kase, const judge_task_result &result) {
+    switch (kase.depends_cond) {
+        case judge_task::dependency_condition::ACCEPTED:
+            return result.status == status::ACCEPTED;
+        case judge_task::dependency_condition::PARTIAL_CORRECT:
+            return result.status == status::PARTIAL_CORRECT ||
+                   result.status == status::ACCEPTED;
+        case judge_task::dependency_condition::NON_TIME_LIMIT:
+            return result.status != status::SYSTEM_ERROR &&
+                   result.status != status::COMPARE_ERROR &&
+                   result.status != status::COMPILATION_ERROR &&
+                   result.status != status::DEPENDENCY_NOT_SATISFIED &&
+                   result.status != status::TIME_LIMIT_EXCEEDED &&
+                   result.status != status::EXECUTABLE_COMPILATION_ERROR &&
+                   result.status != status::OUT_OF_CONTEST_TIME &&
+                   result.status != status::RANDOM_GEN_ERROR;
+    }
+    return false;
+}
+
+/**
+ * @brief 提交的所有评测任务都已经结束，返回评测结果
+ */
+static void finish(const programming_judger &judger, programming_submission &submit) {
+    summarize(judger, submit);
+    // 评测结果已经返回，评测系统重启后不会再收到该提交，不再需要恢复
+    if (auto journal = judger.get_journal())
+        journal->complete(result_journal::key_of(submit));
+
+    // 系统错误通常是暂时的，这样的评测结果不能提供给之后的相同提交
+    auto cache = judger.get_cache();
+    if (cache && !submit.cache_key.empty() &&
+        none_of(submit.results.begin(), submit.results.end(), [](auto &result) { return result.status == status::SYSTEM_ERROR; }))
+        cache->store(submit.cache_key, submit.results, submit.core_seconds);
+    judger.fire_judge_finished(submit);
+}
+
+/**
+ * @brief 评测任务是否可以与其他评测任务合并为一次 runguard 批量运行
+ * 生成随机测试数据需要启动随机数据生成器，actions 需要在评测过程中定时执行，这些评测任务单独分发
+ */
+static bool batchable(const judge_task &task) {
+    if (!(NATIVE_CHECK && BATCH_CHECK_SIZE > 1 && task.check_script == "standard" && !task.is_random && task.actions.empty()))
+        return false;
+    // 内置的比较器在进程内执行，不能放进 runguard 的批量文件；参数不合法的留给 judge_impl 报告错误
+    try {
+        return !parse_token_compare(task.compare_script);
+    } catch (invalid_argument &) {
+        return false;
+    }
+}
+
+/**
+ * @brief 分发依赖关系已经满足的评测任务
+ * 可以批量运行且占用核心数相同的评测任务每 BATCH_CHECK_SIZE 个合并为一个评测任务分发
+ * @param ids 要分发的评测任务
+ */
+static void dispatch_tasks(work_stealing_queue<message::client_task> &task_queue, programming_submission &submit, const vector<size_t> &ids) {
+    auto client_task_of = [&](size_t i) {
+        return message::client_task{
+            .submit = &submit,
+            .id = i,
+            .name = submit.judge_tasks[i].tag,
+            .cores = submit.judge_tasks[i].cores,
+            .expect_runtime = submit.judge_tasks[i].time_limit * 5};
+    };
+
+    map<size_t, message::client_task> batches;  // 按照占用的核心数分组
+    for (size_t i : ids) {
+        judge_task &kase = submit.judge_tasks[i];
+        if (!batchable(kase)) {
+            task_queue.push(client_task_of(i));
+            continue;
+        }
+
+        auto it = batches.find(kase.cores);
+        if (it == batches.end()) {
+            batches.emplace(kase.cores, client_task_of(i));
+            continue;
+        }
+        auto &batch = it->second;
+        batch.batch.push_back(i);
+        batch.expect_runtime += kase.time_limit * 5;
+        if (batch.batch.size() + 1 >= BATCH_CHECK_SIZE) {
+            task_queue.push(batch);
+            batches.erase(it);
+        }
+    }
+    for (auto &[cores, batch] : batches) task_queue.push(batch);
+}
+
 /**
  * @brief 完成评测结果的统计，如果统计的是编译任务，则会分发具体的评测任务
  * 在评测完成后，通过调用 process 函数来完成数据点的统计，如果发现评测完了一个提交，则立刻返回。
  * 因此大部分情况下评测队列不会过长：只会拉取适量的评测，确保评测队列不会过长。
+ * 依赖当前评测任务的评测任务和提交是否评测完成都通过依赖关系图得到，不需要遍历所有评测任务。
  * 
  * @param result 评测结果
  */
 template <typename DurationT>
-void process(const programming_judger &judger, concurrent_queue<message::client_task> &testcase_queue, programming_submission &submit, const judge_task_result &result, DurationT dur, bool is_summarize = true) {
-    // 记录测试信息
+void process(const programming_judger &judger, work_stealing_queue<message::client_task> &testcase_queue, programming_submission &submit, const judge_task_result &result, DurationT dur) {
+    if (!submit.graph.finish(result.id)) {
+        LOG_ERROR << "Judge task " << result.id << " is not running, ignore its result";
+        return;
+    }
+
+    // 记录测试信息，提交的评测结果确定后才结束的评测任务已经被终止，评测结果无效
     submit.results[result.id] = result;
+    submit.core_seconds += chrono::duration<double>(dur).count() * submit.judge_tasks[result.id].cores;
+    if (submit.cancelled(result.id)) {
+        submit.results[result.id].status = status::SKIPPED;
+        submit.results[result.id].score = 0;
+    }
+
+    // 记录评测结果以便评测系统重启后恢复。系统错误通常是暂时的，重启后应该重新评测
+    if (auto journal = judger.get_journal(); journal && !submit.cancelled(result.id) && result.status != status::SYSTEM_ERROR)
+        journal->append(result_journal::key_of(submit), submit.judge_tasks[result.id], result);
 
     LOG_DEBUG << "Process: result.error_log = " << result.error_log;
 
@@ -630,107 +988,238 @@ void process(const programming_judger &judger, concurrent_queue<message::client_
     if (result.status == status::SYSTEM_ERROR)
         LOG_ERROR << "Testcase error: " << result.error_log;
 
-    for (size_t i = 0; i < submit.judge_tasks.size(); ++i) {
-        judge_task &kase = submit.judge_tasks[i];
-        // 寻找依赖当前评测任务的评测任务
-        if (kase.depends_on == (int)result.id) {
-            bool satisfied;
-            switch (kase.depends_cond) {
-                case judge_task::dependency_condition::ACCEPTED:
-                    satisfied = result.status == status::ACCEPTED;
-                    break;
-                case judge_task::dependency_condition::PARTIAL_CORRECT:
-                    satisfied = result.status == status::PARTIAL_CORRECT ||
-                                result.status == status::ACCEPTED;
-                    break;
-                case judge_task::dependency_condition::NON_TIME_LIMIT:
-                    satisfied = result.status != status::SYSTEM_ERROR &&
-                                result.status != status::COMPARE_ERROR &&
-                                result.status != status::COMPILATION_ERROR &&
-                                result.status != status::DEPENDENCY_NOT_SATISFIED &&
-                                result.status != status::TIME_LIMIT_EXCEEDED &&
-                                result.status != status::EXECUTABLE_COMPILATION_ERROR &&
-                                result.status != status::OUT_OF_CONTEST_TIME &&
-                                result.status != status::RANDOM_GEN_ERROR;
-                    break;
-            }
+    // 启用 fail fast 时，下标最小的未通过的评测任务决定了提交的评测结果。被取消的评测任务的下标都比
+    // cancelled_after 大，因此只有更早的评测任务未通过时才会再次取消
+    if (submit.fail_fast && result.status != status::ACCEPTED && result.id < submit.cancelled_after)
+        cancel_remaining(testcase_queue, submit, result.id);
 
-            if (satisfied) {
-                // 评测任务 i 的依赖关系满足予以评测
-                submit.results[i].status = status::RUNNING;
-                judge::message::client_task client_task = {
-                    .submit = &submit,
-                    .id = i,
-                    .name = kase.tag,
-                    .cores = kase.cores,
-                    .expect_runtime = submit.judge_tasks[i].time_limit * 5};
-                testcase_queue.push(client_task);
-            } else {
-                // 评测任务 i 的依赖关系不满足，由于依赖关系是树，因此将子树全部设置为 DEPENDENCY_NOT_SATISFIED
-                judge_task_result next_result;
-                next_result.status = status::DEPENDENCY_NOT_SATISFIED;
-                next_result.tag = kase.tag;
-                next_result.id = i;
-                next_result.score = 0;
-                next_result.run_time = 0;
-                next_result.memory_used = 0;
-                next_result.error_log = "";
-                next_result.report = "";
-                next_result.actions.clear();
-                process(judger, testcase_queue, submit, next_result, DurationT(), false);
-            }
+    // 寻找依赖当前评测任务的评测任务
+    vector<size_t> ready;
+    for (size_t i : submit.graph.children(result.id)) {
+        // 被取消的评测任务已经被跳过
+        if (submit.cancelled(i)) continue;
+
+        judge_task &kase = submit.judge_tasks[i];
+        if (!submit.cancelled(result.id) && dependency_satisfied(kase, result)) {
+            // 评测任务 i 的依赖关系满足予以评测
+            submit.graph.start(i);
+            submit.results[i].status = status::RUNNING;
+            ready.push_back(i);
+        } else {
+            skip_subtree(submit, i);
         }
     }
+    dispatch_tasks(testcase_queue, submit, ready);
 
-    ++submit.finished;
+    submit.finished = submit.graph.finished();
 
     LOG_INFO << "in function process: submit.finished = " << submit.finished << " submit.judge_tasks.size() = " << submit.judge_tasks.size();  // debug
 
-    if (!is_summarize) return;
-    if (submit.finished == submit.judge_tasks.size()) {
+    if (submit.graph.completed()) {
         // 如果当前提交的所有测试点都完成测试，则返回评测结果
-        summarize(submit);
-        judger.fire_judge_finished(submit);
-    } else if (submit.finished > submit.judge_tasks.size()) {
-        LOG_ERROR << "Test case exceeded";
+        finish(judger, submit);
     } else {
-        // 未完成评测，检查是否存在正在评测的评测任务
-        bool has_running = false;
-        for (size_t i = 0; i < submit.judge_tasks.size(); ++i) {
-            if (submit.results[i].status == status::RUNNING) {
-                has_running = true;
-                break;
+        // 未完成评测，如果当前提交不存在正在评测的任务，则说明有 bug
+        if (submit.graph.running() == 0) {
+            LOG_FATAL << "No succ judge task";
+        }
+
+        // 发送中途的评测报告，不做 ACK
+        judger.report_progress(submit);
+    }
+}
+
+/**
+ * @brief 从评测结果日志中取出提交上次评测被中断前已经结束的评测任务
+ * 评测任务与日志记录不一致（比如题目配置变化）或者运行文件夹已经被删除时，该评测任务需要重新评测
+ */
+static map<size_t, result_journal::entry> recover_results(const result_journal &journal, programming_submission &submit) {
+    map<size_t, result_journal::entry> recovered;
+    try {
+        recovered = journal.recover(result_journal::key_of(submit));
+    } catch (exception &ex) {
+        LOG_ERROR << "Unable to recover judge results from result journal: " << ex.what();
+        return {};
+    }
+
+    for (auto it = recovered.begin(); it != recovered.end();) {
+        auto &result = it->second.result;
+        if (it->first >= submit.judge_tasks.size() || submit.judge_tasks[it->first].tag != result.tag ||
+            (!result.run_dir.empty() && !filesystem::exists(result.run_dir)))
+            it = recovered.erase(it);
+        else
+            ++it;
+    }
+    return recovered;
+}
+
+bool programming_judger::distribute(work_stealing_queue<message::client_task> &task_queue, submission &submit) const {
+    LOG_DEBUG << "Programming judger start to distribute.";
+
+    auto &sub = dynamic_cast<programming_submission &>(submit);
+
+    std::stringstream info;
+    for (auto &judge_task : sub.judge_tasks) {
+        info << "judge task: tag = " << judge_task.tag << ", check_script = " << judge_task.check_script << ", run_script = " << judge_task.run_script << ", compare_script = " << judge_task.compare_script << ", is_random = " << judge_task.is_random << ", testcase_id = " << judge_task.testcase_id << ", subcase_id = " << judge_task.subcase_id << ", depends_on = " << judge_task.depends_on << std::endl;
+    }
+    LOG_DEBUG << "Submission's judge tasks: " << std::endl
+              << info.str();
+
+    filesystem::path workdir = get_work_dir(sub);
+    sub.submission_lock = lock_directory(workdir, false);
+
+    // 内容完全相同的提交已经评测过，直接返回之前的评测结果
+    if (cache) {
+        if (auto key = cache->key_of(sub)) {
+            if (cache->lookup(*key, sub.category, sub.results)) {
+                sub.finished = sub.results.size();
+                LOG_INFO << "Submission [" << sub.category << "-" << sub.prob_id << "-" << sub.sub_id << "] hit the result cache";
+                finish(*this, sub);
+                return true;
             }
+            sub.cache_key = *key;
         }
+    }
 
-        // 如果当前提交不存在正在评测的任务，则说明有 bug
-        if (!has_running) {
-            LOG_FATAL << "No succ judge task";
+    // 评测系统重启后重新收到的提交，保留提交文件夹，以便恢复的评测任务的运行环境可以被依赖它的评测任务继续使用
+    map<size_t, result_journal::entry> recovered;
+    if (journal) recovered = recover_results(*journal, sub);
+    if (recovered.empty()) clean_locked_directory(workdir);
+
+    verify_timeliness(sub);
+
+    // 初始化当前提交的所有评测任务状态为 PENDING
+    sub.results.resize(sub.judge_tasks.size());
+    for (size_t i = 0; i < sub.results.size(); ++i) {
+        sub.results[i].status = status::PENDING;
+        sub.results[i].id = i;
+    }
+
+    // 不依赖任何任务的任务可以直接开始评测。先标记所有任务开始评测再发送评测消息，
+    // 因为评测消息发出后，worker 可能立刻评测完成并在 process 中修改依赖关系图
+    for (size_t i : sub.graph.roots()) {
+        sub.graph.start(i);
+        sub.results[i].status = status::RUNNING;
+    }
+
+    // 恢复的评测任务直接结束，依赖它的评测任务按照恢复的评测结果继续恢复、跳过或者分发
+    vector<size_t> dispatch, stack(sub.graph.roots().rbegin(), sub.graph.roots().rend());
+    size_t decided = SIZE_MAX;
+    while (!stack.empty()) {
+        size_t i = stack.back();
+        stack.pop_back();
+
+        auto it = recovered.find(i);
+        if (it == recovered.end()) {
+            dispatch.push_back(i);
+            continue;
         }
 
-        // 发送中途的评测报告，不做 ACK
-        submit.judge_server->summarize(submit, false);
+        auto &[result, testcase_id, subcase_id] = it->second;
+        sub.graph.finish(i);
+        sub.results[i] = result;
+        sub.judge_tasks[i].testcase_id = testcase_id;
+        sub.judge_tasks[i].subcase_id = subcase_id;
+        if (result.status != status::ACCEPTED) decided = min(decided, i);
+
+        for (size_t child : sub.graph.children(i)) {
+            if (dependency_satisfied(sub.judge_tasks[child], result)) {
+                sub.graph.start(child);
+                sub.results[child].status = status::RUNNING;
+                stack.push_back(child);
+            } else {
+                skip_subtree(sub, child);
+            }
+        }
+    }
+    sub.finished = sub.graph.finished();
+    if (!recovered.empty())
+        LOG_INFO << "Recovered " << sub.finished << " judge tasks from result journal, " << dispatch.size() << " judge tasks to be judged";
+
+    // 恢复的评测结果已经决定了提交的评测结果，分发的评测任务会在 judge 中直接跳过
+    if (sub.fail_fast && decided != SIZE_MAX) cancel_remaining(task_queue, sub, decided);
+
+    if (sub.graph.completed()) {
+        finish(*this, sub);
+        return true;
+    }
+
+    dispatch_tasks(task_queue, sub, dispatch);
+    return true;
+}
+
+/**
+ * @brief 评测合并分发的多个标准评测任务，各个评测任务的评测结果分别统计，评测耗时平均分给各个评测任务
+ */
+static void judge_batch(const programming_judger &judger, const message::client_task &client_task, work_stealing_queue<message::client_task> &task_queue, programming_submission &submit, const string &execcpuset, sandbox_pool *sandboxes) {
+    vector<size_t> ids = {client_task.id};
+    ids.insert(ids.end(), client_task.batch.begin(), client_task.batch.end());
+    vector<judge_task_result> results;
+
+    auto begin = chrono::system_clock::now();
+
+    bool cancelled;
+    {
+        scoped_lock guard(submit.mut);
+        cancelled = submit.cancelled(client_task.id);
+    }
+
+    // 评测任务出队后提交的评测结果才确定，直接跳过评测
+    if (cancelled) {
+        for (size_t i : ids) results.emplace_back(submit.judge_tasks[i].tag, i);
+    } else {
+        try {
+            results = judge_batch_impl(client_task, submit, ids, execcpuset, sandboxes);
+        } catch (exception &ex) {
+            results.clear();
+            for (size_t i : ids) {
+                auto &result = results.emplace_back(submit.judge_tasks[i].tag, i);
+                result.status = status::SYSTEM_ERROR;
+                result.error_log = ex.what();
+            }
+        }
     }
+
+    auto dur = (chrono::system_clock::now() - begin) / ids.size();
+
+    scoped_lock guard(submit.mut);
+    for (auto &result : results)
+        process(judger, task_queue, submit, result, dur);
 }
 
-void programming_judger::judge(const message::client_task &client_task, concurrent_queue<message::client_task> &task_queue, const string &execcpuset) const {
+void programming_judger::judge(const message::client_task &client_task, work_stealing_queue<message::client_task> &task_queue, const string &execcpuset) const {
     auto submit = dynamic_cast<programming_submission *>(client_task.submit);
+    if (!client_task.batch.empty()) {
+        judge_batch(*this, client_task, task_queue, *submit, execcpuset, sandboxes.get());
+        return;
+    }
+
     judge_task &task = submit->judge_tasks[client_task.id];
     judge_task_result result;
 
     auto begin = chrono::system_clock::now();
 
+    {
+        // 评测任务出队后提交的评测结果才确定，直接跳过评测
+        scoped_lock guard(submit->mut);
+        if (submit->cancelled(client_task.id)) {
+            result = {task.tag, client_task.id};
+            process(*this, task_queue, *submit, result, chrono::system_clock::now() - begin);
+            return;
+        }
+    }
+
     LOG_DEBUG << "Judge: task.check_script = " << task.check_script;
 
     try {
         if (task.check_script == "compile")
             result = compile(client_task, *submit, task, execcpuset);
         else
-            result = judge_impl(client_task, *submit, task, execcpuset, [&]() {
-                auto end = chrono::system_clock::now();
-
+            result = judge_impl(client_task, *submit, task, execcpuset, sandboxes.get(), [&](const judge_task_result &partial) {
+                // 评测任务尚未结束，只更新中途的评测结果并发送评测报告，不做 ACK
                 scoped_lock guard(submit->mut);
-                process(*this, task_queue, *submit, result, end - begin);
+                submit->results[client_task.id].actions = partial.actions;
+                report_progress(*submit);
             });
     } catch (exception &ex) {
         result = {task.tag, client_task.id};
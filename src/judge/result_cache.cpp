@@ -0,0 +1,157 @@
+#include "judge/result_cache.hpp"
+
+#include <boost/lexical_cast.hpp>
+#include <boost/uuid/detail/sha1.hpp>
+#include <iomanip>
+#include <sstream>
+
+#include "logging.hpp"
+#include "server/judge_server.hpp"
+
+namespace judge {
+using namespace std;
+
+/**
+ * @brief 计算缓存键的 SHA-1，每个字段都带上长度，避免不同字段拼接后产生相同的内容
+ */
+struct key_builder {
+    boost::uuids::detail::sha1 sha;
+
+    key_builder &operator<<(const string &value) {
+        size_t length = value.size();
+        sha.process_bytes(&length, sizeof(length));
+        sha.process_bytes(value.data(), value.size());
+        return *this;
+    }
+
+    template <typename T>
+    key_builder &operator<<(const T &value) {
+        return *this << boost::lexical_cast<string>(value);
+    }
+
+    string digest() {
+        boost::uuids::detail::sha1::digest_type digest;
+        sha.get_digest(digest);
+        ostringstream os;
+        for (auto word : digest)
+            os << hex << setw(sizeof(word) * 2) << setfill('0') << (unsigned)word;
+        return os.str();
+    }
+};
+
+static bool add_assets(key_builder &builder, vector<asset_uptr> &assets) {
+    builder << assets.size();
+    for (auto &asset : assets) {
+        string content;
+        if (!asset->read_content(content)) return false;
+        builder << asset->name << content;
+    }
+    return true;
+}
+
+result_cache::result_cache(size_t capacity, set<string> excluded_categories, shared_ptr<prometheus::Registry> registry)
+    : capacity(capacity), excluded_categories(move(excluded_categories)) {
+    if (registry) {
+        lookups = &prometheus::BuildCounter()
+                       .Name("judge_system_result_cache_lookups")
+                       .Help("The number of submissions looked up in the result cache, labeled by hit or miss")
+                       .Register(*registry);
+        saved_core_seconds = &prometheus::BuildCounter()
+                                  .Name("judge_system_result_cache_saved_core_seconds")
+                                  .Help("The core-seconds of judging saved by reusing cached results")
+                                  .Register(*registry);
+    }
+}
+
+optional<string> result_cache::key_of(programming_submission &submit) const {
+    if (excluded_categories.count(submit.category)) return nullopt;
+    if (submit.judge_server && !submit.judge_server->cache_results()) return nullopt;
+
+    // 只有源代码提交的内容是确定的，Git 仓库的内容可能随时变化
+    auto source = dynamic_cast<source_code *>(submit.submission.get());
+    if (!source) return nullopt;
+
+    key_builder builder;
+    builder << submit.category << submit.prob_id << submit.updated_at << submit.fail_fast;
+    builder << source->language << source->entry_point << source->compile_command.size();
+    for (auto &command : source->compile_command) builder << command;
+    try {
+        if (!add_assets(builder, source->source_files) || !add_assets(builder, source->assist_files))
+            return nullopt;
+    } catch (exception &ex) {
+        LOG_WARN << "Unable to read submission files for result cache: " << ex.what();
+        return nullopt;
+    }
+
+    builder << submit.judge_tasks.size();
+    for (auto &task : submit.judge_tasks) {
+        // 随机测试每次使用的测试数据不同，读取或上传文件的操作结果也可能不同，评测结果不确定
+        if (task.is_random || !task.actions.empty()) return nullopt;
+
+        builder << task.tag << task.check_script << task.run_script << task.compare_script
+                << task.score.numerator() << task.score.denominator() << task.testcase_id
+                << task.depends_on << (int)task.depends_cond << task.file_depends_on << task.cores
+                << task.time_limit << task.memory_limit << task.file_limit << task.proc_limit << task.instruction_limit
+                << task.run_args.size();
+        for (auto &arg : task.run_args) builder << arg;
+    }
+    return builder.digest();
+}
+
+bool result_cache::lookup(const string &key, const string &category, vector<judge_task_result> &results) {
+    double saved;
+    {
+        scoped_lock guard(mut);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            if (lookups) lookups->Add({{"category", category}, {"result", "miss"}}).Increment();
+            return false;
+        }
+
+        entries.splice(entries.begin(), entries, it->second);
+        results = it->second->results;
+        saved = it->second->core_seconds;
+    }
+
+    if (lookups) lookups->Add({{"category", category}, {"result", "hit"}}).Increment();
+    if (saved_core_seconds) saved_core_seconds->Add({{"category", category}}).Increment(saved);
+    return true;
+}
+
+void result_cache::store(const string &key, const vector<judge_task_result> &results, double core_seconds) {
+    entry e{key, results, core_seconds, sizeof(entry) + key.size()};
+    for (auto &result : e.results) {
+        // 运行文件夹在提交评测完成后被删除，缓存的评测结果不能再引用
+        result.run_dir.clear();
+        result.data_dir.clear();
+        e.bytes += sizeof(result) + result.tag.size() + result.error_log.size() + result.report.size();
+        for (auto &action : result.actions)
+            e.bytes += sizeof(action) + action.tag.size() + action.result.size();
+    }
+    if (e.bytes > capacity) return;
+
+    scoped_lock guard(mut);
+    if (auto it = index.find(key); it != index.end()) {
+        bytes -= it->second->bytes;
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    bytes += e.bytes;
+    entries.push_front(move(e));
+    index[key] = entries.begin();
+
+    while (bytes > capacity) {
+        auto &last = entries.back();
+        bytes -= last.bytes;
+        index.erase(last.key);
+        entries.pop_back();
+    }
+}
+
+size_t result_cache::size() const {
+    scoped_lock guard(mut);
+    return bytes;
+}
+
+}  // namespace judge
@@ -0,0 +1,293 @@
+#include "judge/result_journal.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <system_error>
+
+#include "common/json_utils.hpp"
+#include "logging.hpp"
+
+namespace judge {
+using namespace std;
+using namespace nlohmann;
+
+/**
+ * @brief 提交的记录超过这个时间没有更新时视为过期，打开日志时丢弃
+ * 过期的提交通常已经被其他评测机评测，或者被评测服务器丢弃，不会再被投递
+ */
+static const time_t JOURNAL_MAX_AGE = 7 * 24 * 60 * 60;
+
+/**
+ * @brief 写入的字节数超过这个值，且超过仍需保留的记录大小的两倍时重写日志文件
+ */
+static const size_t JOURNAL_COMPACT_THRESHOLD = 64 << 20;
+
+result_journal::result_journal(const filesystem::path &path, size_t batch_size, int fsync_interval, int flush_interval)
+    : path(path), batch_size(max<size_t>(batch_size, 1)), fsync_interval(fsync_interval), flush_interval(max(flush_interval, 1)) {
+    if (path.has_parent_path()) filesystem::create_directories(path.parent_path());
+    load();
+
+    vector<string> records;
+    for (auto &[key, lines] : live)
+        records.insert(records.end(), lines.begin(), lines.end());
+    rewrite(records);
+    LOG_INFO << "Opened result journal " << path << " with " << live.size() << " unfinished submissions";
+
+    writer = thread([this] { write_loop(); });
+}
+
+result_journal::~result_journal() {
+    {
+        scoped_lock guard(mut);
+        stopping = true;
+    }
+    cond.notify_all();
+    if (writer.joinable()) writer.join();
+    if (fsync_interval >= 0) sync();
+    if (fd >= 0) close(fd);
+}
+
+string result_journal::key_of(const submission &submit) {
+    return submit.category + "/" + submit.sub_id + "/" + to_string(submit.updated_at);
+}
+
+void result_journal::append(const string &key, const judge_task &task, const judge_task_result &result) {
+    json actions = json::array();
+    for (auto &action : result.actions)
+        actions.push_back({{"tag", action.tag}, {"result", action.result}, {"success", action.success}});
+
+    json record = {
+        {"key", key},
+        {"time", time(nullptr)},
+        {"id", result.id},
+        {"tag", result.tag},
+        {"status", (int)result.status},
+        {"score", {result.score.numerator(), result.score.denominator()}},
+        {"run_time", result.run_time},
+        {"memory_used", result.memory_used},
+        {"error_log", result.error_log},
+        {"report", result.report},
+        {"run_dir", result.run_dir.string()},
+        {"data_dir", result.data_dir.string()},
+        {"actions", actions},
+        {"testcase_id", task.testcase_id},
+        {"subcase_id", task.subcase_id}};
+    // 评测日志和报告可能包含选手程序输出的非法 UTF-8 字符，替换掉以免序列化失败
+    string line = record.dump(-1, ' ', false, json::error_handler_t::replace);
+
+    scoped_lock guard(mut);
+    live[key].push_back(line);
+    live_bytes += line.size() + 1;
+    push_record(line);
+}
+
+void result_journal::complete(const string &key) {
+    scoped_lock guard(mut);
+    auto it = live.find(key);
+    if (it == live.end()) return;
+    for (auto &line : it->second) live_bytes -= line.size() + 1;
+    live.erase(it);
+
+    json record = {{"key", key}, {"time", time(nullptr)}, {"completed", true}};
+    push_record(record.dump());
+}
+
+map<size_t, result_journal::entry> result_journal::recover(const string &key) const {
+    vector<string> lines;
+    {
+        scoped_lock guard(mut);
+        auto it = live.find(key);
+        if (it == live.end()) return {};
+        lines = it->second;
+    }
+
+    map<size_t, entry> entries;
+    for (auto &line : lines) {
+        json record = json::parse(line);
+        entry e;
+        e.result.id = record.at("id").get<size_t>();
+        e.result.tag = record.at("tag").get<string>();
+        e.result.status = (status)record.at("status").get<int>();
+        e.result.score = {record.at("score").at(0).get<int>(), record.at("score").at(1).get<int>()};
+        e.result.run_time = record.at("run_time").get<double>();
+        e.result.memory_used = record.at("memory_used").get<int>();
+        e.result.error_log = record.at("error_log").get<string>();
+        e.result.report = record.at("report").get<string>();
+        e.result.run_dir = record.at("run_dir").get<string>();
+        e.result.data_dir = record.at("data_dir").get<string>();
+        for (auto &action : record.at("actions")) {
+            action_result res;
+            res.tag = action.at("tag").get<string>();
+            res.result = action.at("result").get<string>();
+            res.success = action.at("success").get<bool>();
+            e.result.actions.push_back(res);
+        }
+        e.testcase_id = record.at("testcase_id").get<int>();
+        e.subcase_id = record.at("subcase_id").get<int>();
+        entries[e.result.id] = move(e);
+    }
+    return entries;
+}
+
+void result_journal::flush() {
+    unique_lock guard(mut);
+    size_t target = appended;
+    if (written >= target) return;
+    flush_target = max(flush_target, target);
+    cond.notify_all();
+    flushed_cond.wait(guard, [&] { return written >= target; });
+}
+
+void result_journal::load() {
+    ifstream fin(path);
+    if (!fin) return;
+
+    map<string, time_t> updated;
+    string line;
+    size_t malformed = 0;
+    while (getline(fin, line)) {
+        if (line.empty()) continue;
+        json record;
+        try {
+            record = json::parse(line);
+        } catch (exception &) {
+            // 评测系统崩溃时最后一条记录可能只写入了一部分
+            ++malformed;
+            continue;
+        }
+
+        string key = record.at("key").get<string>();
+        updated[key] = record.at("time").get<time_t>();
+        if (record.contains("completed")) {
+            live.erase(key);
+        } else {
+            live[key].push_back(line);
+        }
+    }
+    if (malformed > 0) LOG_WARN << "Skipped " << malformed << " malformed records in result journal " << path;
+
+    time_t now = time(nullptr);
+    for (auto it = live.begin(); it != live.end();) {
+        if (updated[it->first] + JOURNAL_MAX_AGE < now) {
+            LOG_INFO << "Dropping expired records of " << it->first << " from result journal";
+            it = live.erase(it);
+        } else {
+            for (auto &record : it->second) live_bytes += record.size() + 1;
+            ++it;
+        }
+    }
+}
+
+bool result_journal::write_all(int out, const string &buffer) {
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        ssize_t ret = write(out, buffer.data() + offset, buffer.size() - offset);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR << "Unable to write result journal " << path << ": " << strerror(errno);
+            return false;
+        }
+        offset += ret;
+    }
+    return true;
+}
+
+void result_journal::append_file(const string &buffer) {
+    if (fd < 0) return;
+    write_all(fd, buffer);
+    file_bytes += buffer.size();
+    dirty = true;
+}
+
+void result_journal::rewrite(const vector<string> &records) {
+    // 先写入临时文件再替换，重写过程中崩溃不会丢失记录
+    filesystem::path temp = path;
+    temp += ".tmp";
+    int temp_fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (temp_fd < 0) throw system_error(errno, system_category(), "unable to create result journal " + temp.string());
+
+    string buffer;
+    for (auto &record : records) buffer += record + "\n";
+    bool success = write_all(temp_fd, buffer) && fdatasync(temp_fd) == 0;
+    close(temp_fd);
+    if (!success) throw system_error(errno, system_category(), "unable to write result journal " + temp.string());
+    filesystem::rename(temp, path);
+
+    int new_fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (new_fd < 0) throw system_error(errno, system_category(), "unable to open result journal " + path.string());
+    if (fd >= 0) close(fd);
+    fd = new_fd;
+    file_bytes = buffer.size();
+    dirty = false;
+    last_sync = chrono::steady_clock::now();
+}
+
+void result_journal::sync() {
+    if (!dirty || fd < 0) return;
+    if (fdatasync(fd) != 0)
+        LOG_ERROR << "Unable to sync result journal " << path << ": " << strerror(errno);
+    dirty = false;
+    last_sync = chrono::steady_clock::now();
+}
+
+void result_journal::push_record(const string &record) {
+    pending += record;
+    pending += '\n';
+    ++appended;
+    if (++pending_records >= batch_size) cond.notify_all();
+}
+
+void result_journal::write_loop() {
+    unique_lock guard(mut);
+    while (true) {
+        cond.wait_for(guard, chrono::milliseconds(flush_interval), [&] {
+            return stopping || pending_records >= batch_size || written < flush_target;
+        });
+
+        bool flushing = written < flush_target;
+        bool due = fsync_interval == 0 || flushing ||
+                   (fsync_interval > 0 && chrono::steady_clock::now() - last_sync >= chrono::milliseconds(fsync_interval));
+
+        if (!pending.empty()) {
+            string buffer;
+            buffer.swap(pending);
+            pending_records = 0;
+            size_t count = appended;
+
+            // 日志文件中大部分记录都属于已经完成的提交时，用仍需保留的记录重写日志文件，
+            // 此时 buffer 中未完成的提交的记录都已经包含在 live 中
+            vector<string> records;
+            bool compact = file_bytes > JOURNAL_COMPACT_THRESHOLD && file_bytes > 2 * live_bytes;
+            if (compact)
+                for (auto &[key, lines] : live)
+                    records.insert(records.end(), lines.begin(), lines.end());
+
+            guard.unlock();
+            if (compact) {
+                try {
+                    rewrite(records);
+                } catch (exception &ex) {
+                    LOG_ERROR << "Unable to compact result journal: " << ex.what();
+                    append_file(buffer);
+                }
+            } else {
+                append_file(buffer);
+            }
+            if (due && fsync_interval >= 0) sync();
+            guard.lock();
+
+            written = count;
+            flushed_cond.notify_all();
+        } else if (dirty && due && fsync_interval >= 0) {
+            guard.unlock();
+            sync();
+            guard.lock();
+        }
+
+        if (stopping && pending.empty()) break;
+    }
+}
+
+}  // namespace judge
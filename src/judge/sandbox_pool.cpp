@@ -0,0 +1,209 @@
+#include "judge/sandbox_pool.hpp"
+
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <cstring>
+
+#include "logging.hpp"
+
+namespace judge {
+using namespace std;
+namespace fs = std::filesystem;
+
+sandbox_pool::lease::lease(sandbox_pool *pool, unsigned core, fs::path dir)
+    : pool(pool), core(core), dir(move(dir)) {
+    root_dir = this->dir / "root";
+}
+
+sandbox_pool::lease::lease(lease &&other) noexcept
+    : pool(other.pool), core(other.core), dir(move(other.dir)), root_dir(move(other.root_dir)) {
+    other.pool = nullptr;
+}
+
+sandbox_pool::lease &sandbox_pool::lease::operator=(lease &&other) noexcept {
+    if (this != &other) {
+        if (pool) pool->release(core, dir);
+        pool = other.pool;
+        core = other.core;
+        dir = move(other.dir);
+        root_dir = move(other.root_dir);
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+sandbox_pool::lease::~lease() {
+    if (pool) pool->release(core, dir);
+}
+
+const fs::path &sandbox_pool::lease::root() const {
+    return root_dir;
+}
+
+sandbox_pool::lease::operator bool() const {
+    return pool != nullptr;
+}
+
+sandbox_pool::sandbox_pool(fs::path dir, fs::path chrootdir, size_t per_core, size_t tmpfs_size)
+    : dir(move(dir)), chrootdir(move(chrootdir)), per_core(per_core), tmpfs_size(tmpfs_size) {
+    resetter = thread([this] { reset_loop(); });
+}
+
+sandbox_pool::~sandbox_pool() {
+    {
+        scoped_lock guard(mut);
+        stopping = true;
+    }
+    cond.notify_all();
+    if (resetter.joinable()) resetter.join();
+
+    for (auto &[core, s] : shards)
+        for (auto &sandbox : s.ready)
+            umount2((sandbox / "root").c_str(), MNT_DETACH);
+    if (tmpfs_mounted) umount2(dir.c_str(), MNT_DETACH);
+}
+
+void sandbox_pool::prepare(const set<unsigned> &cores) {
+    // 所有运行环境的 upperdir 都保存在同一个 tmpfs 中，这样每个运行环境只需要挂载 overlay 和 /proc 两个挂载点。
+    // 每个 mount namespace 都会复制全部挂载点，挂载点越少，runguard 创建 mount namespace 越快
+    umount2(dir.c_str(), MNT_DETACH);
+    error_code ec;
+    fs::create_directories(dir, ec);
+    string tmpfs_options = "size=" + to_string(tmpfs_size * per_core * cores.size()) + ",mode=0755";
+    if (mount("tmpfs", dir.c_str(), "tmpfs", MS_NOSUID | MS_NODEV, tmpfs_options.c_str()) != 0) {
+        LOG_ERROR << "Unable to mount tmpfs on " << dir << ", sandbox pool is disabled: " << strerror(errno);
+        return;
+    }
+    tmpfs_mounted = true;
+
+    for (unsigned core : cores) {
+        shard s;
+        for (size_t i = 0; i < per_core; ++i) {
+            fs::path sandbox = dir / (to_string(core) + "-" + to_string(i));
+            if (mount_sandbox(sandbox)) {
+                s.ready.push_back(sandbox);
+                ++s.alive;
+            }
+        }
+        LOG_INFO << "Prepared " << s.alive << " sandboxes for core " << core;
+
+        scoped_lock guard(mut);
+        shards[core] = move(s);
+    }
+    cond.notify_all();
+}
+
+sandbox_pool::lease sandbox_pool::acquire(unsigned core) {
+    unique_lock guard(mut);
+    auto it = shards.find(core);
+    if (it == shards.end()) return {};
+    shard &s = it->second;
+    cond.wait(guard, [&] { return !s.ready.empty() || s.alive == 0 || stopping; });
+    if (s.ready.empty()) return {};
+
+    fs::path sandbox = move(s.ready.front());
+    s.ready.pop_front();
+    return lease(this, core, move(sandbox));
+}
+
+void sandbox_pool::release(unsigned core, const fs::path &sandbox) {
+    {
+        scoped_lock guard(mut);
+        dirty.emplace_back(core, sandbox);
+    }
+    cond.notify_all();
+}
+
+void sandbox_pool::reset_loop() {
+    unique_lock guard(mut);
+    while (true) {
+        cond.wait(guard, [&] { return !dirty.empty() || stopping; });
+        if (dirty.empty()) break;
+
+        auto [core, sandbox] = move(dirty.front());
+        dirty.pop_front();
+
+        // 卸载时评测任务已经结束，使用全新的 upperdir 重新挂载，上一个测试点写入的文件全部被丢弃
+        bool stop = stopping;
+        guard.unlock();
+        umount_sandbox(sandbox);
+        bool mounted = !stop && mount_sandbox(sandbox);
+        guard.lock();
+
+        shard &s = shards[core];
+        if (mounted) {
+            s.ready.push_back(move(sandbox));
+        } else {
+            --s.alive;
+            if (!stop) LOG_ERROR << "Sandbox " << sandbox << " is dropped since it cannot be mounted again";
+        }
+        cond.notify_all();
+    }
+}
+
+bool sandbox_pool::mount_sandbox(const fs::path &sandbox) {
+    fs::path upper = sandbox / ("upper-" + to_string(++generation)), root = sandbox / "root";
+    auto fail = [&](const string &what) {
+        LOG_ERROR << "Unable to " << what << " for sandbox " << sandbox << ": " << strerror(errno);
+        umount_sandbox(sandbox);
+        return false;
+    };
+
+    // 每次挂载都使用全新的 upperdir，保证上一个测试点写入的文件不会被看到
+    error_code ec;
+    fs::create_directories(upper, ec);
+    fs::create_directories(root, ec);
+
+    // 与 run_standard_check 创建的 work 文件夹的权限一致
+    static const struct {
+        const char *path;
+        mode_t mode;
+    } dirs[] = {{"work", 0753}, {"ofs", 0773}, {"work/judge", 0773}, {"work/compare", 0753},
+                {"work/data", 0753}, {"work/run", 0773}, {"work/feedback", 0773}};
+    for (auto &d : dirs) {
+        fs::path path = upper / d.path;
+        if (mkdir(path.c_str(), d.mode) != 0 || chmod(path.c_str(), d.mode) != 0)
+            return fail("create " + path.string());
+    }
+
+    string overlay_options = "lowerdir=" + chrootdir.string() + ",upperdir=" + (upper / "work").string() + ",workdir=" + (upper / "ofs").string();
+    if (mount("overlay", root.c_str(), "overlay", 0, overlay_options.c_str()) != 0)
+        return fail("mount overlay");
+
+    // 与 exec/utils/chroot_setup.sh 的 chroot_start 一致
+    fs::path proc = root / "proc", dev = root / "dev";
+    mkdir(proc.c_str(), 0755);
+    if (mount("/proc", proc.c_str(), nullptr, MS_BIND, nullptr) != 0)
+        return fail("bind /proc");
+
+    static const struct {
+        const char *name;
+        unsigned major, minor;
+    } devices[] = {{"full", 1, 7}, {"null", 1, 3}, {"ptmx", 5, 2}, {"random", 1, 8}, {"tty", 5, 0}, {"urandom", 1, 9}};
+    mkdir(dev.c_str(), 0755);
+    for (auto &device : devices) {
+        fs::path path = dev / device.name;
+        unlink(path.c_str());
+        if (mknod(path.c_str(), S_IFCHR | 0666, makedev(device.major, device.minor)) != 0 || chmod(path.c_str(), 0666) != 0)
+            return fail("create device " + path.string());
+    }
+    return true;
+}
+
+void sandbox_pool::umount_sandbox(const fs::path &sandbox) {
+    // 使用 MNT_DETACH 卸载 overlay 时会一并卸载其上的 /proc，即使仍有残留的进程访问运行环境也可以立刻卸载，
+    // 残留的进程看到的是已经脱离的旧文件系统
+    umount2((sandbox / "root").c_str(), MNT_DETACH);
+
+    // 旧的 upperdir 已经不再被挂载，可以直接删除
+    error_code ec;
+    for (auto &entry : fs::directory_iterator(sandbox, ec))
+        if (boost::starts_with(entry.path().filename().string(), "upper-"))
+            fs::remove_all(entry.path(), ec);
+}
+
+}  // namespace judge
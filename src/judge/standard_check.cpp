@@ -0,0 +1,775 @@
+#include "judge/standard_check.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+#include "common/defer.hpp"
+#include "config.hpp"
+#include "judge/compare.hpp"
+#include "logging.hpp"
+#include "runguard.hpp"
+
+namespace judge {
+using namespace std;
+namespace fs = std::filesystem;
+
+/**
+ * @brief 与 mkdir -m mode -p 一致，创建文件夹并设置权限（不受 umask 影响）
+ */
+static void make_directory(const fs::path &dir, fs::perms mode) {
+    fs::create_directories(dir);
+    fs::permissions(dir, mode, fs::perm_options::replace);
+}
+
+static void touch(const fs::path &file) {
+    ofstream fout(file, ios::app);
+}
+
+/**
+ * @brief 将文件内容追加到评测日志中
+ * @param header 文件非空时在内容前输出的标题，为空时不输出标题
+ */
+static void append_file(ofstream &log, const fs::path &file, const string &header = {}) {
+    ifstream fin(file);
+    if (!fin || fin.peek() == ifstream::traits_type::eof()) return;
+    if (!header.empty()) log << "\n---------- " << header << " ----------\n";
+    log << fin.rdbuf();
+}
+
+static void chown_recursive(const fs::path &dir, uid_t uid, gid_t gid) {
+    if (lchown(dir.c_str(), uid, gid) != 0)
+        LOG_WARN << "Unable to chown " << dir << ": " << strerror(errno);
+    for (auto &entry : fs::recursive_directory_iterator(dir))
+        if (lchown(entry.path().c_str(), uid, gid) != 0)
+            LOG_WARN << "Unable to chown " << entry.path() << ": " << strerror(errno);
+}
+
+static void remove_group_other_write(const fs::path &dir) {
+    constexpr auto mask = fs::perms::group_write | fs::perms::others_write;
+    fs::permissions(dir, mask, fs::perm_options::remove);
+    for (auto &entry : fs::recursive_directory_iterator(dir))
+        if (!entry.is_symlink())
+            fs::permissions(entry.path(), mask, fs::perm_options::remove);
+}
+
+static string meta_value(const map<string, string> &meta, const string &key) {
+    auto it = meta.find(key);
+    return it == meta.end() ? "" : it->second;
+}
+
+static string resource_usage(const runguard_result &result) {
+    ostringstream usage;
+    usage << "    runtime: " << result.cpu_time << "s cpu, " << result.wall_time << "s wall\n"
+          << "    memory used: " << result.memory << " bytes";
+    if (result.instructions >= 0)
+        usage << "\n    instructions: " << result.instructions << " (" << (result.perf_emulated ? "software" : "hardware") << ")";
+    return usage.str();
+}
+
+/**
+ * @brief runguard 写入运行结果记录的文件描述符，交互评测中 3 和 4 已经用于连接交互器
+ */
+static const int RECORD_FD = 5;
+
+/**
+ * @brief 边运行边比较时选手程序标准输出的管道在 runguard 中的文件描述符
+ */
+static const int STREAM_FD = 3;
+
+/**
+ * @brief 运行 runguard，runguard 通过管道直接写入运行结果记录，评测系统不必再读取和解析 meta 文件
+ * @param record runguard 写入的运行结果，runguard 没有写入完整的记录时为空
+ * @return runguard 的返回值
+ */
+static int run_runguard(process_builder &pb, const string &runguard, vector<string> args, optional<runguard_result> &record) {
+    args.insert(args.begin(), {"--out-record", to_string(RECORD_FD)});
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        throw system_error(errno, system_category(), "pipe2");
+    pb.pass_fd(fds[1], RECORD_FD);
+
+    // 记录小于管道的容量，runguard 写入时不会阻塞，因此等 runguard 结束后再读取
+    int exitcode;
+    try {
+        exitcode = pb.run(runguard, args);
+    } catch (...) {
+        close(fds[0]);
+        throw;
+    }
+    record = read_runguard_record(fds[0]);
+    close(fds[0]);
+    return exitcode;
+}
+
+/**
+ * @brief 得到 runguard 的运行结果，没有运行结果记录时（比如批量运行）读取 meta 文件
+ * @return runguard 崩溃，既没有写入记录也没有写入 meta 文件时返回空
+ */
+static optional<runguard_result> read_result(const fs::path &metafile, const optional<runguard_result> &record, ofstream &log) {
+    if (record) return record;
+    error_code ec;
+    if (fs::file_size(metafile, ec) == 0 || ec) return nullopt;
+    append_file(log, metafile);
+    return read_runguard_result(metafile);
+}
+
+/**
+ * @brief 检查测试数据和脚本是否存在
+ * @return 检查通过时返回 true，否则错误信息写入评测日志
+ */
+static bool check_environment(const standard_check_options &opt, ofstream &log) {
+    for (auto &[dir, message] : {pair{opt.datadir / "input", "input data does not exist: "},
+                                 pair{opt.datadir / "output", "output data does not exist: "},
+                                 pair{opt.compare_script, "Compare script does not exist: "},
+                                 pair{opt.run_script, "Run script does not exist: "}}) {
+        // 内置的比较器没有比较脚本
+        if (dir == opt.compare_script && opt.token_compare) continue;
+        if (!fs::is_directory(dir)) {
+            log << "Error: " << message << dir.string() << endl;
+            LOG_ERROR << message << dir;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 一个测试点运行选手程序和运行比较器的 runguard 参数
+ */
+struct runguard_commands {
+    vector<string> program, compare;
+};
+
+/**
+ * @brief 生成运行交互器的 runguard 参数
+ * 交互器与选手程序同时运行，两者不能共用同一个 upperdir，因此交互器在运行文件夹的 interactor 中挂载自己的运行环境，
+ * 只能访问测试数据、交互器和 feedback 文件夹：/compare/run /data/input /data/output /feedback
+ */
+static vector<string> interactor_command(const standard_check_options &opt, const fs::path &base, const vector<string> &common) {
+    const fs::path &rundir = opt.rundir;
+    fs::path dir = rundir / "interactor", merged = dir / "merged";
+    string runuser = get_env("RUNUSER", ""), rungroup = get_env("RUNGROUP", "");
+
+    constexpr auto rwx_wx = fs::perms(0773), rwx_rx = fs::perms(0753);
+    make_directory(dir, rwx_rx);
+    make_directory(dir / "work", rwx_rx);
+    make_directory(dir / "work" / "compare", rwx_rx);
+    make_directory(dir / "work" / "data", rwx_rx);
+    make_directory(dir / "work" / "feedback", rwx_wx);
+    make_directory(dir / "ofs", rwx_wx);
+    make_directory(merged, rwx_rx);
+
+    // 交互器的运行时间包括等待选手程序的时间，因此墙钟时间限制还要加上选手程序的时间限制
+    vector<string> command = common;
+    command.insert(command.end(), {
+        "--mount", "overlay:" + merged.string() + ":lowerdir=" + opt.chrootdir.string() + ",upperdir=" + (dir / "work").string() + ",workdir=" + (dir / "ofs").string(),
+        "--prepare-root",
+        "--mount", "bind-ro:" + opt.datadir.string() + ":" + (merged / "data").string(),
+        "--mount", "bind-ro:" + opt.compare_script.string() + ":" + (merged / "compare").string(),
+        "--mount", "bind:" + (rundir / "feedback").string() + ":" + (merged / "feedback").string(),
+        "--root", merged.string(),
+        "--work", "/feedback",
+        "--no-core-dumps",
+        "--user", runuser,
+        "--group", rungroup,
+        "--memory-limit", to_string(SCRIPT_MEM_LIMIT),
+        "--cpu-time", to_string(SCRIPT_TIME_LIMIT),
+        "--wall-time", boost::lexical_cast<string>(SCRIPT_TIME_LIMIT + 3 * opt.time_limit),
+        "--file-limit", to_string(SCRIPT_FILE_LIMIT),
+        "--standard-input-fd", "3",
+        "--standard-output-fd", "4",
+        "--standard-error-file", (base / "compare.err").string(),
+        "--out-meta", (base / "compare.meta").string(),
+        "-VONLINE_JUDGE=1",
+        "/compare/run", "/data/input", "/data/output", "/feedback"});
+    return command;
+}
+
+/**
+ * @brief 准备以 rundir/work 为可写层、以 chrootdir 为 lowerdir 的运行环境所需的文件夹
+ * @return 在 rundir/merged 挂载该运行环境的 runguard 参数
+ */
+static vector<string> root_mounts(const fs::path &rundir, const fs::path &chrootdir) {
+    constexpr auto rwx_wx = fs::perms(0773), rwx_rx = fs::perms(0753);
+    make_directory(rundir / "work", rwx_rx);
+    make_directory(rundir / "work" / "judge", rwx_wx);
+    make_directory(rundir / "work" / "compare", rwx_rx);
+    make_directory(rundir / "work" / "data", rwx_rx);
+    make_directory(rundir / "work" / "run", rwx_wx);
+    make_directory(rundir / "work" / "feedback", rwx_wx);
+    make_directory(rundir / "ofs" / "merged", rwx_wx);
+    make_directory(rundir / "merged", rwx_rx);
+    return {"--mount", "overlay:" + (rundir / "merged").string() + ":lowerdir=" + chrootdir.string() + ",upperdir=" + (rundir / "work").string() + ",workdir=" + (rundir / "ofs" / "merged").string(),
+            "--prepare-root"};
+}
+
+/**
+ * @brief 准备运行文件夹，并生成运行选手程序和比较器的 runguard 参数
+ * @param base runguard 输出文件的所在文件夹，为空时使用相对于运行文件夹的路径
+ * @param interactive 是否为交互评测，此时 compare 为运行交互器的参数，选手程序和交互器的标准输入输出为 3 号和 4 号文件描述符
+ */
+static runguard_commands prepare(const standard_check_options &opt, const fs::path &base, bool interactive = false) {
+    const fs::path &rundir = opt.rundir;
+    fs::path testin = opt.datadir / "input";
+    string runuser = get_env("RUNUSER", ""), rungroup = get_env("RUNGROUP", ""), runnetns = get_env("RUNNETNS", "");
+
+    // 设置脚本权限，确保可以直接运行
+    constexpr auto exec_perms = fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec;
+    fs::permissions(opt.run_script / "run", exec_perms, fs::perm_options::add);
+    if (!opt.token_compare) fs::permissions(opt.compare_script / "run", exec_perms, fs::perm_options::add);
+    fs::permissions(rundir, fs::perms::all, fs::perm_options::add);
+
+    for (auto file : {"program.meta", "program.err", "compare.meta", "compare.err"})
+        touch(rundir / file);
+
+    constexpr auto rwx_wx = fs::perms(0773);
+    make_directory(rundir / "run", rwx_wx);  // 运行的临时文件都在这里
+    make_directory(rundir / "feedback", rwx_wx);
+    make_directory(rundir / "ofs", rwx_wx);
+    make_directory(rundir / "ofs" / "judge", rwx_wx);
+
+    // 将测试数据文件夹（内含输入数据，且其中 testdata.in 为标准输入数据文件名），编译好的程序，运行文件夹通过 overlayfs 绑定
+    // 使用运行环境池时 chroot 环境和 /proc、/dev 已经准备好，只需要挂载本次评测的文件夹
+    fs::path merged = opt.sandbox.empty() ? rundir / "merged" : opt.sandbox;
+    string lowerdir;
+    for (auto &basedir : opt.basedirs) lowerdir += basedir + ":";
+    lowerdir += testin.string();
+    vector<string> mounts;
+    if (opt.sandbox.empty()) mounts = root_mounts(rundir, opt.chrootdir);
+    mounts.insert(mounts.end(), {
+        "--mount", "overlay:" + (merged / "judge").string() + ":lowerdir=" + lowerdir + ",upperdir=" + (rundir / "run").string() + ",workdir=" + (rundir / "ofs" / "judge").string(),
+        "--mount", "bind-ro:" + opt.run_script.string() + ":" + (merged / "run").string()});
+
+    vector<string> common;
+    if (!opt.cpuset.empty()) common.insert(common.end(), {"-P", opt.cpuset});
+    // 评测任务独占分配到的 CPU 核心，因此 runguard 可以复用这些核心的 cgroup
+    common.push_back("--reuse-cgroup");
+    string time_opt = opt.wall_time ? "--wall-time" : "--cpu-time";
+
+    runguard_commands commands;
+    auto &program = commands.program;
+    program = common;
+    if (opt.limit.memory_limit > 0) program.insert(program.end(), {"--memory-limit", to_string(opt.limit.memory_limit), "-VMEMLIMIT=" + to_string(opt.limit.memory_limit)});
+    if (opt.limit.file_limit > 0) program.insert(program.end(), {"--file-limit", to_string(opt.limit.file_limit)});
+    if (opt.limit.proc_limit > 0) program.insert(program.end(), {"--nproc", to_string(opt.limit.proc_limit)});
+    // --instruction-limit 会让 runguard 同时开启 --perf-counters，没有指令数限制时不必为计数器付出开销
+    if (opt.limit.instruction_limit > 0) program.insert(program.end(), {"--instruction-limit", to_string(opt.limit.instruction_limit)});
+    if (!runnetns.empty()) program.push_back("--netns=" + runnetns);
+    for (auto &profile : opt.seccomp_profiles) program.insert(program.end(), {"--seccomp-profile", profile.string()});
+    program.insert(program.end(), mounts.begin(), mounts.end());
+    program.insert(program.end(), {
+        "--root", merged.string(),
+        "--work", "/judge",
+        "--no-core-dumps",
+        "--user", runuser,
+        "--group", rungroup,
+        time_opt, boost::lexical_cast<string>(opt.time_limit),
+        "--standard-error-file", (base / "program.err").string(),
+        "--out-meta", (base / "program.meta").string(),
+        "-VONLINE_JUDGE=1", "--"});
+    if (interactive) {
+        // 运行脚本找不到输入文件时不重定向标准输入，标准输出重定向到自己的标准输出，也就是连接交互器的管道
+        program.insert(program.end() - 1, {"--standard-input-fd", "3", "--standard-output-fd", "4"});
+        program.insert(program.end(), {"/run/run", "", "/proc/self/fd/1", "/judge/run"});
+    } else if (opt.stream_compare) {
+        // 标准输出重定向到连接评测系统的管道，由评测系统边运行边比较
+        program.insert(program.end() - 1, {"--standard-output-fd", to_string(STREAM_FD)});
+        program.insert(program.end(), {"/run/run", "testdata.in", "/proc/self/fd/1", "/judge/run"});
+    } else {
+        program.insert(program.end(), {"/run/run", "testdata.in", "testdata.out", "/judge/run"});
+    }
+    program.insert(program.end(), opt.run_args.begin(), opt.run_args.end());
+
+    if (interactive) {
+        commands.compare = interactor_command(opt, base, common);
+        return commands;
+    }
+    // 在进程内比较时不需要运行比较器
+    if (opt.stream_compare || opt.token_compare) return commands;
+
+    // 比较选手程序输出，挂载原本程序所需的环境以及比较器所需的文件夹
+    auto &compare = commands.compare;
+    compare = common;
+    compare.insert(compare.end(), mounts.begin(), mounts.end());
+    compare.insert(compare.end(), {
+        "--mount", "bind-ro:" + opt.datadir.string() + ":" + (merged / "data").string(),
+        "--mount", "bind-ro:" + opt.compare_script.string() + ":" + (merged / "compare").string(),
+        "--mount", "bind:" + (rundir / "feedback").string() + ":" + (merged / "feedback").string(),
+        "--root", merged.string(),
+        "--work", "/judge",
+        "--no-core-dumps",
+        "--user", runuser,
+        "--group", rungroup,
+        "--memory-limit", to_string(SCRIPT_MEM_LIMIT),
+        time_opt, to_string(SCRIPT_TIME_LIMIT),
+        "--file-limit", to_string(SCRIPT_FILE_LIMIT),
+        "--standard-output-file", (base / "compare.out").string(),
+        "--standard-error-file", (base / "compare.err").string(),
+        "--out-meta", (base / "compare.meta").string(),
+        "-VONLINE_JUDGE=1",
+        "/compare/run", "/data/input", "/judge", "/data/output", "/feedback"});
+    return commands;
+}
+
+/**
+ * @brief 检查比较器是否正常结束
+ * @return 比较器超时或者出现内部错误时返回评测结果
+ */
+static optional<int> comparator_verdict(const fs::path &rundir, ofstream &log, const optional<runguard_result> &record) {
+    // 确保 feedback 文件夹的所有文件属于评测系统，以便评测系统追加内容
+    chown_recursive(rundir / "feedback", geteuid(), getegid());
+    remove_group_other_write(rundir / "feedback");
+
+    append_file(log, rundir / "compare.out", "output validator stdout messages");
+    append_file(log, rundir / "compare.err", "output validator stderr messages");
+
+    auto compare = read_result(rundir / "compare.meta", record, log);
+    if (!compare) return nullopt;
+    if (compare->time_result.find("timelimit") != string::npos) {
+        log << "Comparing aborted after " << SCRIPT_TIME_LIMIT << " seconds" << endl;
+        return E_COMPARE_ERROR;
+    }
+
+    if (!compare->internal_error.empty()) {
+        log << "Internal Error\n" << resource_usage(*compare) << endl;
+        return E_INTERNAL_ERROR;
+    }
+    return nullopt;
+}
+
+/**
+ * @brief 得到选手程序的运行结果，runguard 崩溃没有写入运行结果时返回空
+ */
+static optional<runguard_result> read_program_result(const fs::path &rundir, ofstream &log, const optional<runguard_result> &record) {
+    auto result = read_result(rundir / "program.meta", record, log);
+    if (!result) log << "\n****************runguard crash*****************" << endl;
+    return result;
+}
+
+/**
+ * @brief 检查选手程序是否正常结束
+ * @return 选手程序超时、超出内存或输出限制、崩溃或者返回值非零时返回评测结果
+ */
+static optional<int> program_verdict(const standard_check_options &opt, ofstream &log, const runguard_result &program) {
+    string usage = resource_usage(program);
+    auto verdict = [&](const char *message, int code) {
+        log << message << "\n" << usage << endl;
+        return code;
+    };
+
+    if (!program.internal_error.empty())
+        return verdict("Internal Error", E_INTERNAL_ERROR);
+
+    if (program.time_result.find("timelimit") != string::npos)
+        return verdict("Time Limit Exceeded", E_TIME_LIMIT);
+
+    if (boost::starts_with(program.memory_result, "oom"))
+        return verdict("Memory Limit Exceeded", E_MEM_LIMIT);
+
+    vector<string> truncated;
+    boost::split(truncated, program.output_truncated, boost::is_any_of(","));
+    if (find(truncated.begin(), truncated.end(), "stdout") != truncated.end())
+        return verdict("Output Limit Exceeded", E_OUTPUT_LIMIT);
+
+    switch (program.signal) {
+        case -1: break;
+        case 11: return verdict("Segmentation Fault", E_SEG_FAULT);
+        case 8: return verdict("Floating Point Exception", E_FLOATING_POINT);
+        case 9: return verdict("Memory Limit Exceeded", E_MEM_LIMIT);
+        case 31: return verdict("Restrict Function", E_RESTRICT_FUNCTION);
+        default: return verdict("Runtime Error", E_RUNTIME_ERROR);
+    }
+
+    if (!fs::exists(opt.run_script / ".ignore_exit_code") && program.exitcode > 0) {
+        log << "Non-zero exitcode " << program.exitcode << "\n" << usage << endl;
+        return E_RUNTIME_ERROR;
+    }
+    return nullopt;
+}
+
+/**
+ * @brief 根据比较器的返回值得到评测结果
+ */
+static int compare_verdict(const standard_check_options &opt, ofstream &log, int exitcode, const string &usage) {
+    if (exitcode == RESULT_PC && !fs::exists(opt.rundir / "feedback" / "score.txt")) {
+        log << "Compare script reports partial correct without score record." << endl;
+        return E_COMPARE_ERROR;
+    }
+
+    auto verdict = [&](const char *message, int code) {
+        log << message << "\n" << usage << endl;
+        return code;
+    };
+
+    switch (exitcode) {
+        case RESULT_AC: return verdict("Accepted", E_ACCEPTED);
+        case RESULT_WA: return verdict("Wrong Answer", E_WRONG_ANSWER);
+        case RESULT_PE: return verdict("Presentation Error", E_PRESENTATION_ERROR);
+        case RESULT_PC: return verdict("Partial Correct", E_PARTIAL_CORRECT);
+        default:
+            log << "Comparing failed with exitcode " << exitcode << endl;
+            return E_COMPARE_ERROR;
+    }
+}
+
+/**
+ * @brief 根据选手程序和比较器的运行结果以及比较器的返回值得到评测结果
+ * @param program_record、compare_record runguard 写入的运行结果记录，为空时读取 meta 文件
+ */
+static int judge_result(const standard_check_options &opt, ofstream &log, int exitcode,
+                        const optional<runguard_result> &program_record = nullopt, const optional<runguard_result> &compare_record = nullopt) {
+    if (auto result = comparator_verdict(opt.rundir, log, compare_record)) return *result;
+
+    auto program = read_program_result(opt.rundir, log, program_record);
+    if (!program) return E_INTERNAL_ERROR;
+    if (auto result = program_verdict(opt, log, *program)) return *result;
+
+    return compare_verdict(opt, log, exitcode, resource_usage(*program));
+}
+
+/**
+ * @brief 根据选手程序和交互器的运行结果以及交互器的返回值得到交互评测的评测结果
+ */
+static int interactive_result(const standard_check_options &opt, ofstream &log, int exitcode,
+                              const optional<runguard_result> &program_record, const optional<runguard_result> &interactor_record) {
+    if (auto result = comparator_verdict(opt.rundir, log, interactor_record)) return *result;
+
+    auto program = read_program_result(opt.rundir, log, program_record);
+    if (!program) return E_INTERNAL_ERROR;
+
+    // 交互器判定答案错误后会直接退出，选手程序随后可能因为写入关闭的管道被 SIGPIPE 杀死，或者读到 EOF 后异常退出，
+    // 此时以交互器的评测结果为准。选手程序超时或者超出内存限制时交互器等不到输出，仍然以选手程序的评测结果为准
+    bool rejected = exitcode == RESULT_WA || exitcode == RESULT_PE;
+    bool exceeded = !program->internal_error.empty() ||
+                    program->time_result.find("timelimit") != string::npos ||
+                    boost::starts_with(program->memory_result, "oom");
+    if (!rejected || exceeded)
+        if (auto result = program_verdict(opt, log, *program)) return *result;
+
+    return compare_verdict(opt, log, exitcode, resource_usage(*program));
+}
+
+/**
+ * @brief 在进程内比较选手程序的输出（run/testdata.out）和标准输出，代替通过 runguard 运行比较器
+ * 比较方式为 opt.token_compare 或者 opt.stream_compare，第一处不同的位置写入评测日志
+ * @return 比较器的返回值，输出无法读取时返回 -1
+ */
+static int compare_in_process(const standard_check_options &opt, ofstream &log) {
+    try {
+        mapped_file user(opt.rundir / "run" / "testdata.out"), answer(opt.datadir / "output" / "testdata.out");
+        compare_report report = opt.token_compare ? compare_tokens(user.view(), answer.view(), *opt.token_compare)
+                                                  : compare_output(user.view(), answer.view(), *opt.stream_compare);
+        if (report.result != RESULT_AC)
+            log << "\n---------- output validator stdout messages ----------\n" << describe_difference(user.view(), answer.view(), report);
+        return report.result;
+    } catch (system_error &e) {
+        log << "\n---------- output validator stderr messages ----------\n" << e.what() << endl;
+        return -1;
+    }
+}
+
+/**
+ * @brief 边运行边比较的结果
+ */
+struct stream_result {
+    bool rejected = false;  // 输出已经确定为 WA
+    bool exceeded = false;  // 输出超过了限制
+};
+
+/**
+ * @brief 从管道读取选手程序的输出，写入文件的同时与标准输出逐行比较
+ * 确定为 WA 或者输出超过限制时提前关闭管道，选手程序再写入时会被 SIGPIPE 杀死，不必等到超时
+ * @param fd 管道的读端，由调用方关闭
+ */
+static stream_result stream_output(int fd, const fs::path &file, string_view answer, size_t limit) {
+    stream_result result;
+    stream_checker checker(answer);
+    ofstream fout(file, ios::binary);
+    size_t size = 0;
+    vector<char> buffer(1 << 16);
+    while (true) {
+        ssize_t n = read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        // 超出限制之前的输出已经可以确定为 WA 时以 WA 为准
+        size_t accepted = min((size_t)n, limit - size);
+        size += accepted;
+        fout.write(buffer.data(), accepted);
+        if (!checker.feed({buffer.data(), accepted})) {
+            result.rejected = true;
+            break;
+        }
+        if (accepted < (size_t)n) {
+            result.exceeded = true;
+            break;
+        }
+    }
+    if (!result.rejected && !result.exceeded) result.rejected = !checker.finish();
+    return result;
+}
+
+/**
+ * @brief 边运行边比较的评测流程，比较方式为 opt.stream_compare
+ * 选手程序的标准输出通过管道交给评测系统，评测系统在另一个线程中一边写入 run/testdata.out 一边逐行比较，
+ * 确定为 WA 或者输出超过标准输出的长度加上 STREAM_CHECK_SLACK（以及输出限制）时关闭管道，提前结束选手程序。
+ * 选手程序结束后直接在进程内比较完整的输出来区分 AC 和 PE，不再通过 runguard 启动比较器。
+ */
+static int run_stream_check(const standard_check_options &opt, process_builder &pb, const string &runguard, const vector<string> &command, ofstream &log) {
+    const fs::path &rundir = opt.rundir;
+    mapped_file answer(opt.datadir / "output" / "testdata.out");
+
+    size_t limit = answer.view().size() + STREAM_CHECK_SLACK;
+    if (opt.limit.file_limit > 0) limit = min(limit, (size_t)opt.limit.file_limit * 1024);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        throw system_error(errno, system_category(), "pipe2");
+    pb.pass_fd(fds[1], STREAM_FD);
+
+    // 运行时 run 文件夹是选手程序的 overlay 的 upperdir，不能直接写入，选手程序结束后再移动进去
+    fs::path output = rundir / "program.out";
+    stream_result stream;
+    thread reader([&] {
+        // 提前关闭读端后选手程序再写入会收到 SIGPIPE，读取出错时也要关闭，否则选手程序会阻塞到超时
+        defer { close(fds[0]); };
+        try {
+            stream = stream_output(fds[0], output, answer.view(), limit);
+        } catch (exception &e) {
+            LOG_ERROR << "Unable to read output of user program in " << rundir << ": " << e.what();
+        }
+    });
+
+    LOG_DEBUG << "Running user program in " << rundir << " with streaming comparison";
+    log << flush;
+    optional<runguard_result> record;
+    try {
+        run_runguard(pb, runguard, command, record);
+    } catch (...) {
+        // 启动 runguard 之前抛出异常时（比如创建运行结果记录的管道失败），管道的写端还在 pb 中，
+        // 必须先关闭，读取线程才能读到 EOF 并结束；已经启动过 runguard 时写端已经关闭，这里什么也不做
+        pb.close_passed_fds();
+        reader.join();
+        throw;
+    }
+    reader.join();
+
+    // 读取线程没能创建输出文件时 rename 会失败
+    error_code ec;
+    fs::rename(output, rundir / "run" / "testdata.out", ec);
+    if (ec) {
+        log << "Error: unable to save the output of user program: " << ec.message() << endl;
+        LOG_ERROR << "Unable to move " << output << " into " << rundir / "run" << ": " << ec.message();
+        return E_INTERNAL_ERROR;
+    }
+
+    auto program = read_program_result(rundir, log, record);
+    if (!program) return E_INTERNAL_ERROR;
+
+    // 提前关闭管道后选手程序会被 SIGPIPE 杀死，此时以比较结果为准；超时、超出内存限制时仍然以选手程序的结果为准
+    bool aborted = !program->internal_error.empty() ||
+                   program->time_result.find("timelimit") != string::npos ||
+                   boost::starts_with(program->memory_result, "oom");
+    if (stream.exceeded && !aborted) {
+        log << "Output Limit Exceeded\n" << resource_usage(*program) << endl;
+        return E_OUTPUT_LIMIT;
+    }
+    if (!stream.rejected || aborted)
+        if (auto result = program_verdict(opt, log, *program)) return *result;
+
+    return compare_verdict(opt, log, compare_in_process(opt, log), resource_usage(*program));
+}
+
+static optional<string> find_runguard(ofstream &log) {
+    string runguard = get_env("RUNGUARD", "");
+    if (access(runguard.c_str(), X_OK) != 0) {
+        log << "Error: runguard does not exist" << endl;
+        LOG_ERROR << "runguard does not exist: " << runguard;
+        return nullopt;
+    }
+    return runguard;
+}
+
+int run_standard_check(const standard_check_options &opt, process_builder &pb) {
+    const fs::path &rundir = opt.rundir;
+
+    ofstream log(rundir / "system.out", ios::app);
+
+    if (!check_environment(opt, log)) return E_INTERNAL_ERROR;
+    auto runguard = find_runguard(log);
+    if (!runguard) return E_INTERNAL_ERROR;
+
+    auto commands = prepare(opt, {});
+
+    pb.directory(rundir);
+    pb.output(rundir / "system.out");
+
+    if (opt.stream_compare) return run_stream_check(opt, pb, *runguard, commands.program, log);
+
+    LOG_DEBUG << "Running user program in " << rundir;
+    log << flush;
+    // 我们不检查选手程序的返回值，比如 C 程序的 main 函数没有写 return 会导致返回值非零，这种不是崩溃导致的
+    optional<runguard_result> program, compare;
+    run_runguard(pb, *runguard, commands.program, program);
+
+    if (opt.token_compare) {
+        auto result = read_program_result(rundir, log, program);
+        if (!result) return E_INTERNAL_ERROR;
+        if (auto verdict = program_verdict(opt, log, *result)) return *verdict;
+        return compare_verdict(opt, log, compare_in_process(opt, log), resource_usage(*result));
+    }
+
+    if (opt.sandbox.empty()) {
+        fs::remove_all(rundir / "work" / "feedback");
+        make_directory(rundir / "work" / "feedback", fs::perms(0773));
+    }
+
+    LOG_DEBUG << "Comparator " << opt.compare_script << " comparing output";
+    int exitcode = run_runguard(pb, *runguard, commands.compare, compare);
+
+    return judge_result(opt, log, exitcode, program, compare);
+}
+
+vector<int> run_standard_check_batch(const vector<standard_check_options> &opts, process_builder &pb) {
+    vector<int> results(opts.size(), E_INTERNAL_ERROR);
+    if (opts.empty()) return results;
+
+    vector<ofstream> logs;
+    for (auto &opt : opts) logs.emplace_back(opt.rundir / "system.out", ios::app);
+
+    auto runguard = find_runguard(logs.front());
+    if (!runguard) return results;
+
+    // 所有测试点共用一个根目录：使用运行环境池时为取出的运行环境，否则由 runguard 以第一个测试点的运行文件夹为可写层挂载一次
+    const standard_check_options &first = opts.front();
+    const fs::path &batchdir = first.rundir;
+    fs::path root = first.sandbox.empty() ? batchdir / "merged" : first.sandbox;
+    vector<string> args;
+    if (!first.cpuset.empty()) args.insert(args.end(), {"-P", first.cpuset});
+    args.push_back("--reuse-cgroup");
+    if (string runnetns = get_env("RUNNETNS", ""); !runnetns.empty()) args.push_back("--netns=" + runnetns);
+    if (first.sandbox.empty()) {
+        auto mounts = root_mounts(batchdir, first.chrootdir);
+        args.insert(args.end(), mounts.begin(), mounts.end());
+        args.insert(args.end(), {"--root", root.string()});
+    }
+
+    // 每个测试点的选手程序和比较器各占一行，每一行只挂载该测试点的文件夹，runguard 的输出文件都使用绝对路径
+    ofstream batch(batchdir / "batch.args");
+    vector<size_t> batched;
+    for (size_t i = 0; i < opts.size(); ++i) {
+        if (!check_environment(opts[i], logs[i])) continue;
+        standard_check_options opt = opts[i];
+        opt.sandbox = root;
+        auto commands = prepare(opt, opt.rundir);
+        if (commands.compare.empty())
+            throw invalid_argument("in-process comparison cannot be run in a runguard batch");
+        for (auto *command : {&commands.program, &commands.compare}) {
+            if (any_of(command->begin(), command->end(), [](const string &arg) { return arg.find_first_of("\t\n") != string::npos; }))
+                throw invalid_argument("runguard argument contains tab or newline: " + boost::join(*command, " "));
+            batch << boost::join(*command, "\t") << "\n";
+        }
+        logs[i] << flush;
+        batched.push_back(i);
+    }
+    batch.close();
+    if (batched.empty()) return results;
+
+    // runguard 为每一行写入一条运行结果记录，记录的总长度可能超过管道的容量，因此写入匿名的内存文件，runguard 结束后再读取
+    args.insert(args.end(), {"--out-record", to_string(RECORD_FD), "--batch", (batchdir / "batch.args").string()});
+    int records = memfd_create("runguard-records", MFD_CLOEXEC);
+    if (records < 0) throw system_error(errno, system_category(), "memfd_create");
+    defer { close(records); };
+    int passed = fcntl(records, F_DUPFD_CLOEXEC, 0);
+    if (passed < 0) throw system_error(errno, system_category(), "fcntl");
+    pb.pass_fd(passed, RECORD_FD);
+
+    pb.directory(batchdir);
+    pb.output(batchdir / "batch.out");
+
+    LOG_DEBUG << "Running " << batched.size() << " test cases in one runguard batch " << batchdir;
+    if (int ret = pb.run(*runguard, args); ret != 0)
+        LOG_WARN << "runguard batch " << batchdir << " exited with " << ret;
+
+    if (lseek(records, 0, SEEK_SET) < 0) throw system_error(errno, system_category(), "lseek");
+    for (size_t i : batched) {
+        // runguard 中途崩溃时之后的测试点没有记录，从 meta 文件中读取
+        auto program = read_runguard_record(records);
+        auto compare = read_runguard_record(records);
+        int exitcode;
+        if (compare) {
+            exitcode = compare->exitcode;
+        } else {
+            string value = meta_value(read_runguard_metadata(opts[i].rundir / "compare.meta"), "exitcode");
+            if (value.empty()) {
+                logs[i] << "\n****************runguard crash*****************" << endl;
+                continue;
+            }
+            exitcode = stoi(value);
+        }
+        results[i] = judge_result(opts[i], logs[i], exitcode, program, compare);
+    }
+    return results;
+}
+
+int run_interactive_check(const standard_check_options &opt, process_builder &pb) {
+    const fs::path &rundir = opt.rundir;
+
+    ofstream log(rundir / "system.out", ios::app);
+
+    if (!check_environment(opt, log)) return E_INTERNAL_ERROR;
+    auto runguard = find_runguard(log);
+    if (!runguard) return E_INTERNAL_ERROR;
+
+    auto commands = prepare(opt, {}, true);
+
+    // 选手程序的输出通过 to_interactor 直接交给交互器，交互器的输出通过 to_program 交给选手程序
+    int to_interactor[2], to_program[2];
+    if (pipe2(to_interactor, O_CLOEXEC) != 0)
+        throw system_error(errno, system_category(), "pipe2");
+    if (pipe2(to_program, O_CLOEXEC) != 0) {
+        close(to_interactor[0]), close(to_interactor[1]);
+        throw system_error(errno, system_category(), "pipe2");
+    }
+
+    // runguard 启动后评测系统不再持有管道，任意一方结束后另一方都能读到 EOF
+    process_builder interactor_pb;
+    interactor_pb.directory(rundir);
+    interactor_pb.output(rundir / "system.out");
+    interactor_pb.pass_fd(to_interactor[0], 3).pass_fd(to_program[1], 4);
+
+    pb.directory(rundir);
+    pb.output(rundir / "system.out");
+    pb.pass_fd(to_program[0], 3).pass_fd(to_interactor[1], 4);
+
+    LOG_DEBUG << "Running user program with interactor " << opt.compare_script << " in " << rundir;
+    log << flush;
+    int exitcode = -1;
+    optional<runguard_result> program, interactor_result;
+    thread interactor([&] {
+        try {
+            exitcode = run_runguard(interactor_pb, *runguard, commands.compare, interactor_result);
+        } catch (exception &e) {
+            LOG_ERROR << "Unable to run interactor " << opt.compare_script << ": " << e.what();
+        }
+    });
+    try {
+        run_runguard(pb, *runguard, commands.program, program);
+    } catch (...) {
+        interactor.join();
+        throw;
+    }
+    interactor.join();
+
+    return interactive_result(opt, log, exitcode, program, interactor_result);
+}
+
+}  // namespace judge
@@ -1,6 +1,9 @@
+#include <fcntl.h>
+#include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/exception/diagnostic_information.hpp>
@@ -16,35 +19,38 @@
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
 #include <boost/program_options.hpp>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
 #include <regex>
 #include <set>
 #include <thread>
 
-#include "common/concurrent_queue.hpp"
 #include "common/messages.hpp"
 #include "common/system.hpp"
 #include "common/utils.hpp"
+#include "common/work_stealing_queue.hpp"
 #include "config.hpp"
 #include "env.hpp"
 #include "judge/choice.hpp"
 #include "judge/program_output.hpp"
 #include "judge/programming.hpp"
+#include "judge/result_cache.hpp"
+#include "judge/result_journal.hpp"
+#include "judge/sandbox_pool.hpp"
 #include "logging.hpp"
 #include "metrics.hpp"
 #include "monitor/interrupt_monitor.hpp"
 #include "monitor/prometheus.hpp"
 #include "server/forth/forth.hpp"
 #include "server/mcourse/mcourse.hpp"
+#include "server/report_coalescer.hpp"
 #include "server/sicily/sicily.hpp"
 #include "worker.hpp"
 using namespace std;
 
 namespace logging = boost::log;
 
-judge::concurrent_queue<judge::message::client_task> testcase_queue;
-judge::concurrent_queue<judge::message::core_request> core_acq_queue;
-
 struct cpuset {
     string literal;
     set<unsigned> ids;
@@ -94,7 +100,19 @@ void validate(boost::any& v, const vector<string>& values, cpuset*, int) {
 
 int sigint = 0;
 
+// 信号处理函数只能调用异步信号安全的函数，因此只把信号写入管道，
+// 由 handle_signals 线程记录日志并停止 worker（需要加锁唤醒等待中的线程）
+int signal_pipe[2];
+
 void sigintHandler(int signum) {
+    int saved_errno = errno;
+    unsigned char sig = signum;
+    // 管道已满时丢弃信号，此时之前的信号还没有处理
+    [[maybe_unused]] ssize_t ret = write(signal_pipe[1], &sig, 1);
+    errno = saved_errno;
+}
+
+void handle_signal(int signum) {
     if (signum == SIGINT) {
         if (sigint == 0) {
             LOG_ERROR << "Received SIGINT, stopping workers (Press Ctrl+C again to stop judging)";
@@ -118,6 +136,17 @@ void sigintHandler(int signum) {
     sigint++;
 }
 
+void handle_signals() {
+    prctl(PR_SET_NAME, "signal", 0, 0, 0);
+    while (true) {
+        unsigned char signum;
+        ssize_t ret = read(signal_pipe[0], &signum, 1);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret != 1) break;
+        handle_signal(signum);
+    }
+}
+
 void init_boost_log() {
     boost::log::add_common_attributes();
     auto core = boost::log::core::get();
@@ -158,6 +187,12 @@ int main(int argc, char* argv[]) {
     filesystem::path current(argv[0]);
     filesystem::path repo_dir(filesystem::weakly_canonical(current).parent_path().parent_path());
 
+    // 写端非阻塞，信号处理函数不会因为管道已满而阻塞
+    if (pipe2(signal_pipe, O_CLOEXEC) != 0 || fcntl(signal_pipe[1], F_SETFL, O_NONBLOCK) != 0) {
+        LOG_FATAL << "Unable to create signal pipe: " << strerror(errno);
+        return EXIT_FAILURE;
+    }
+    thread(handle_signals).detach();
     signal(SIGINT, sigintHandler);
     signal(SIGTERM, sigintHandler);
 
@@ -191,7 +226,21 @@ int main(int argc, char* argv[]) {
         ("enable-3", po::value<vector<string>>(), "run Matrix Judge System 3.0 submission fetcher, with configuration file path.")
         ("enable-2", po::value<vector<string>>(), "run Matrix Judge System 2.0 submission fetcher, with configuration file path.")
         ("monitor", po::value<string>(), "set monitor diagnostics to monitor system")
+        ("fail-fast", po::value<vector<string>>(), "cancel the remaining test cases of a programming submission once a test case fails, for submissions from given categories. You can either pass it from environ FAILFAST, separated by colons")
+        ("journal", po::value<string>(), "set the path of the result journal, with which submissions redelivered after restarting only judge the test cases not finished before, default to disabled. You can either pass it from environ JOURNAL")
+        ("journal-batch", po::value<size_t>(), "set the maximum number of results buffered before being written to the result journal, default to 64. You can either pass it from environ JOURNALBATCH")
+        ("journal-fsync", po::value<int>(), "set the interval in milliseconds between syncing the result journal to disk, 0 to sync after every write, negative to never sync, default to 1000. You can either pass it from environ JOURNALFSYNC")
+        ("result-cache", po::value<size_t>(), "set the size in megabytes of the result cache, with which byte-identical resubmissions reuse the previous judge results, default to 0, which means disabled. You can either pass it from environ RESULTCACHE")
+        ("no-result-cache", po::value<vector<string>>(), "disable the result cache for submissions from given categories. You can either pass it from environ NORESULTCACHE, separated by colons")
+        ("report-interval", po::value<int>(), "set the minimum interval in milliseconds between two partial reports of a submission, partial reports within the interval are coalesced, 0 to send every partial report immediately, default to 1000. You can either pass it from environ REPORTINTERVAL")
+        ("check-engine", po::value<string>(), "set how the standard check script is executed, native runs it inside the judge system, script runs exec/check/standard/run, default to native. You can either pass it from environ CHECKENGINE")
+        ("batch-check", po::value<size_t>(), "set how many standard test cases of a submission can be run by one runguard invocation, only works with the native check engine, default to 1, which means disabled. You can either pass it from environ BATCHCHECK")
+        ("stream-check", po::value<size_t>(), "compare the output of standard test cases using the diff-* compare scripts while the program is running, and stop the program once the answer is wrong or the output is longer than the expected output plus the given slack in KB, only works with the native check engine, default to 0, which means disabled. You can either pass it from environ STREAMCHECK")
+        ("no-seccomp", "do not load the syscall allow-lists shipped by languages and run scripts (exec/compile/*/seccomp, exec/run/*/seccomp) for user programs in the native check engine. You can either pass it from environ NOSECCOMP")
+        ("sandbox-pool", po::value<size_t>(), "set how many pre-mounted sandboxes are kept for each core, with which test cases reuse the chroot environment instead of mounting it for every run, only works with the native check engine, default to 0, which means disabled. You can either pass it from environ SANDBOXPOOL")
+        ("sandbox-size", po::value<size_t>(), "set the size in megabytes of the tmpfs holding the files written by a run outside its working directory in a pooled sandbox, default to 256. You can either pass it from environ SANDBOXSIZE")
         ("cores", po::value<cpuset>(), "set the cores the judge-system can make use of. You can either pass it from environ CORES")
+        ("scheduler", po::value<string>(), "set the scheduling policy of judge tasks: locality (each worker runs the tasks it pushed in order, idle workers steal), fifo, shortest (shortest expected runtime first) or fair (round-robin across submissions), default to locality. fifo, shortest and fair keep all tasks in one shared queue so that the order holds across workers. You can either pass it from environ SCHEDULER")
         ("exec-dir", po::value<string>(), "set the default predefined executables for falling back. You can either pass it from environ EXECDIR")
         ("script-dir", po::value<string>(), "set the directory with required scripts stored. You can either pass it from environ SCRIPTDIR")
         ("cache-dir", po::value<string>(), "set the directory to store cached test data, compiled spj, random test generator, compiled executables. You can either pass it from environ CACHEDIR")
@@ -205,6 +254,9 @@ int main(int argc, char* argv[]) {
         ("run-group", po::value<string>(), "set run group. You can either pass it from environ RUNGROUP")
         ("cache-random-data", po::value<size_t>(), "set the maximum number of cached generated random data, default to 100. You can either pass it from environ CACHERANDOMDATA")
         ("max-io-size", po::value<size_t>(), "set the maximum bytes to be read from a file, default to unlimited. You can either pass it from environ MAXIOSIZE")
+        ("max-inflight-submissions", po::value<size_t>(), "set the maximum number of submissions being judged at the same time, default to 0(unlimited). You can either pass it from environ MAXINFLIGHTSUBMISSIONS")
+        ("min-free-disk", po::value<unsigned>(), "set the free disk space in MB of run dir and data dir below which no more submissions will be fetched, default to 256(256MB). You can either pass it from environ MINFREEDISK")
+        ("min-free-memory", po::value<unsigned>(), "set the available memory in MB below which no more submissions will be fetched, default to 256(256MB). You can either pass it from environ MINFREEMEMORY")
         ("debug", "turn on the debug mode to disable checking whether it is in privileged mode, and not to delete submission directory to check the validity of result files. You can either pass it from environ DEBUG")
         ("help", "display this help text")
         ("version", "display version of this application")
@@ -370,6 +422,24 @@ int main(int argc, char* argv[]) {
         judge::MAX_IO_SIZE = boost::lexical_cast<unsigned>(getenv("MAXIOSIZE"));
     }
 
+    if (vm.count("max-inflight-submissions")) {
+        judge::MAX_INFLIGHT_SUBMISSIONS = vm["max-inflight-submissions"].as<size_t>();
+    } else if (getenv("MAXINFLIGHTSUBMISSIONS")) {
+        judge::MAX_INFLIGHT_SUBMISSIONS = boost::lexical_cast<size_t>(getenv("MAXINFLIGHTSUBMISSIONS"));
+    }
+
+    if (vm.count("min-free-disk")) {
+        judge::MIN_FREE_DISK = (long long)vm["min-free-disk"].as<unsigned>() << 20;
+    } else if (getenv("MINFREEDISK")) {
+        judge::MIN_FREE_DISK = (long long)boost::lexical_cast<unsigned>(getenv("MINFREEDISK")) << 20;
+    }
+
+    if (vm.count("min-free-memory")) {
+        judge::MIN_FREE_MEMORY = (long long)vm["min-free-memory"].as<unsigned>() << 20;
+    } else if (getenv("MINFREEMEMORY")) {
+        judge::MIN_FREE_MEMORY = (long long)boost::lexical_cast<unsigned>(getenv("MINFREEMEMORY")) << 20;
+    }
+
     if (vm.count("enable-sicily")) {
         auto sicily_servers = vm.at("enable-scicily").as<vector<string>>();
         for (auto& sicily_server : sicily_servers) {
@@ -466,7 +536,128 @@ int main(int argc, char* argv[]) {
 
     /*** judger ***/
 
-    judge::register_judger(make_unique<judge::programming_judger>());
+    set<string> fail_fast_categories;
+    if (vm.count("fail-fast")) {
+        for (auto& category : vm.at("fail-fast").as<vector<string>>())
+            fail_fast_categories.insert(category);
+    } else if (getenv("FAILFAST")) {
+        vector<string> categories;
+        string failfast = getenv("FAILFAST");
+        boost::split(categories, failfast, boost::is_any_of(":"));
+        fail_fast_categories.insert(categories.begin(), categories.end());
+    }
+
+    string journal_path;
+    if (vm.count("journal")) {
+        journal_path = vm["journal"].as<string>();
+    } else if (getenv("JOURNAL")) {
+        journal_path = getenv("JOURNAL");
+    }
+
+    size_t journal_batch = 64;
+    if (vm.count("journal-batch")) {
+        journal_batch = vm["journal-batch"].as<size_t>();
+    } else if (getenv("JOURNALBATCH")) {
+        journal_batch = boost::lexical_cast<size_t>(getenv("JOURNALBATCH"));
+    }
+
+    int journal_fsync = 1000;
+    if (vm.count("journal-fsync")) {
+        journal_fsync = vm["journal-fsync"].as<int>();
+    } else if (getenv("JOURNALFSYNC")) {
+        journal_fsync = boost::lexical_cast<int>(getenv("JOURNALFSYNC"));
+    }
+
+    shared_ptr<judge::result_journal> journal;
+    if (!journal_path.empty()) {
+        try {
+            journal = make_shared<judge::result_journal>(journal_path, journal_batch, journal_fsync);
+        } catch (std::exception& e) {
+            LOG_FATAL << "Unable to open result journal " << journal_path << ": " << e.what();
+            exit(1);
+        }
+    }
+
+    size_t result_cache_size = 0;
+    if (vm.count("result-cache")) {
+        result_cache_size = vm["result-cache"].as<size_t>();
+    } else if (getenv("RESULTCACHE")) {
+        result_cache_size = boost::lexical_cast<size_t>(getenv("RESULTCACHE"));
+    }
+
+    set<string> no_result_cache_categories;
+    if (vm.count("no-result-cache")) {
+        for (auto& category : vm.at("no-result-cache").as<vector<string>>())
+            no_result_cache_categories.insert(category);
+    } else if (getenv("NORESULTCACHE")) {
+        vector<string> categories;
+        string noresultcache = getenv("NORESULTCACHE");
+        boost::split(categories, noresultcache, boost::is_any_of(":"));
+        no_result_cache_categories.insert(categories.begin(), categories.end());
+    }
+
+    shared_ptr<judge::result_cache> cache;
+    if (result_cache_size > 0)
+        cache = make_shared<judge::result_cache>(result_cache_size << 20, no_result_cache_categories, judge::metrics::global_registry());
+
+    int report_interval = 1000;
+    if (vm.count("report-interval")) {
+        report_interval = vm["report-interval"].as<int>();
+    } else if (getenv("REPORTINTERVAL")) {
+        report_interval = boost::lexical_cast<int>(getenv("REPORTINTERVAL"));
+    }
+
+    shared_ptr<judge::server::report_coalescer> reporter;
+    if (report_interval > 0)
+        reporter = make_shared<judge::server::report_coalescer>(chrono::milliseconds(report_interval));
+
+    string check_engine = "native";
+    if (vm.count("check-engine")) {
+        check_engine = vm["check-engine"].as<string>();
+    } else if (getenv("CHECKENGINE")) {
+        check_engine = getenv("CHECKENGINE");
+    }
+    if (check_engine != "native" && check_engine != "script") {
+        LOG_FATAL << "Unknown check engine " << check_engine << ", should be native or script";
+        exit(1);
+    }
+    judge::NATIVE_CHECK = check_engine == "native";
+
+    if (vm.count("batch-check")) {
+        judge::BATCH_CHECK_SIZE = vm["batch-check"].as<size_t>();
+    } else if (getenv("BATCHCHECK")) {
+        judge::BATCH_CHECK_SIZE = boost::lexical_cast<size_t>(getenv("BATCHCHECK"));
+    }
+
+    if (vm.count("stream-check")) {
+        judge::STREAM_CHECK_SLACK = vm["stream-check"].as<size_t>() << 10;
+    } else if (getenv("STREAMCHECK")) {
+        judge::STREAM_CHECK_SLACK = boost::lexical_cast<size_t>(getenv("STREAMCHECK")) << 10;
+    }
+
+    if (vm.count("no-seccomp") || getenv("NOSECCOMP")) {
+        judge::SECCOMP_PROFILE = false;
+    }
+
+    size_t sandbox_pool_size = 0;
+    if (vm.count("sandbox-pool")) {
+        sandbox_pool_size = vm["sandbox-pool"].as<size_t>();
+    } else if (getenv("SANDBOXPOOL")) {
+        sandbox_pool_size = boost::lexical_cast<size_t>(getenv("SANDBOXPOOL"));
+    }
+
+    size_t sandbox_size = 256;
+    if (vm.count("sandbox-size")) {
+        sandbox_size = vm["sandbox-size"].as<size_t>();
+    } else if (getenv("SANDBOXSIZE")) {
+        sandbox_size = boost::lexical_cast<size_t>(getenv("SANDBOXSIZE"));
+    }
+
+    shared_ptr<judge::sandbox_pool> sandboxes;
+    if (sandbox_pool_size > 0 && judge::NATIVE_CHECK)
+        sandboxes = make_shared<judge::sandbox_pool>(judge::RUN_DIR / ".sandbox", judge::CHROOT_DIR, sandbox_pool_size, sandbox_size << 20);
+
+    judge::register_judger(make_unique<judge::programming_judger>(fail_fast_categories, journal, cache, reporter, sandboxes));
     judge::register_judger(make_unique<judge::choice_judger>());
     judge::register_judger(make_unique<judge::program_output_judger>());
 
@@ -523,16 +714,49 @@ int main(int argc, char* argv[]) {
 
     judge::set_running_workers(set.ids);
 
+    string scheduler = "locality";
+    if (vm.count("scheduler")) {
+        scheduler = vm["scheduler"].as<string>();
+    } else if (getenv("SCHEDULER")) {
+        scheduler = getenv("SCHEDULER");
+    }
+
+    judge::work_stealing_queue<judge::message::client_task>::policy_factory scheduling_policy;
+    try {
+        scheduling_policy = judge::get_scheduling_policy(scheduler);
+    } catch (std::exception& e) {
+        LOG_FATAL << e.what();
+        exit(1);
+    }
+    LOG_INFO << "Scheduling judge tasks with policy " << scheduler;
+
+    // 每个 worker 以自己的 CPU id 作为本地评测队列的编号
+    judge::work_stealing_queue<judge::message::client_task> testcase_queue(*set.ids.rbegin() + 1, scheduling_policy);
+
+    judge::core_allocator allocator(set.ids);
+
+    // 在 worker 开始评测之前挂载好所有运行环境
+    if (sandboxes) sandboxes->prepare(set.ids);
+
     for (unsigned i : set.ids) {
-        worker_threads.push_back(move(judge::start_worker(i, testcase_queue, core_acq_queue)));
+        worker_threads.push_back(move(judge::start_worker(i, testcase_queue, allocator)));
     }
 
     LOG_INFO << "Started " << set.ids.size() << " workers";
     worker_gauge.Set(set.ids.size());
     up_gauge.Set(1);
 
+    // 拉取线程运行在 worker 以外的 CPU 核心上，拉取和检查提交不会占用评测核心
+    vector<thread> intake_threads = judge::start_intake(set.ids, testcase_queue, allocator);
+
+    for (auto& th : intake_threads)
+        th.join();
     for (auto& th : worker_threads)
         th.join();
 
+    // 所有 worker 都已经退出，确保评测结果都写入了评测结果日志
+    if (reporter) reporter->stop();
+    if (journal) journal->flush();
+
     return 0;
 }
@@ -1,12 +1,14 @@
 #include "runguard.hpp"
+#include <unistd.h>
 #include <boost/lexical_cast.hpp>
+#include <cerrno>
 #include <fstream>
 #include <map>
 
 namespace judge {
 using namespace std;
 
-static map<string, string> read_metadata(const filesystem::path &metadata_file) {
+map<string, string> read_runguard_metadata(const filesystem::path &metadata_file) {
     map<string, string> mp;
     ifstream fin(metadata_file);
     string line;
@@ -35,7 +37,7 @@ void try_to_parse(const string &text, T &value) {
 }
 
 runguard_result read_runguard_result(const filesystem::path &metafile) {
-    auto metadata = read_metadata(metafile);
+    auto metadata = read_runguard_metadata(metafile);
     runguard_result result;
     if (metadata.count("cpu-time")) try_to_parse(metadata.at("cpu-time"), result.cpu_time);
     if (metadata.count("sys-time")) try_to_parse(metadata.at("sys-time"), result.sys_time);
@@ -44,8 +46,45 @@ runguard_result read_runguard_result(const filesystem::path &metafile) {
     if (metadata.count("exitcode")) try_to_parse(metadata.at("exitcode"), result.exitcode);
     if (metadata.count("signal")) try_to_parse(metadata.at("signal"), result.signal);
     if (metadata.count("memory-bytes")) try_to_parse(metadata.at("memory-bytes"), result.memory);
+    if (metadata.count("instructions")) try_to_parse(metadata.at("instructions"), result.instructions);
+    if (metadata.count("cycles")) try_to_parse(metadata.at("cycles"), result.cycles);
+    if (metadata.count("task-clock")) try_to_parse(metadata.at("task-clock"), result.task_clock);
+    if (metadata.count("perf-source")) result.perf_emulated = metadata.at("perf-source") == "software";
     if (metadata.count("time-result")) try_to_parse(metadata.at("time-result"), result.time_result);
     if (metadata.count("internal-error")) try_to_parse(metadata.at("internal-error"), result.internal_error);
+    if (metadata.count("memory-result")) result.memory_result = metadata.at("memory-result");
+    if (metadata.count("output-truncated")) result.output_truncated = metadata.at("output-truncated");
+    return result;
+}
+
+optional<runguard_result> read_runguard_record(int fd) {
+    runguard_record record;
+    size_t size = 0;
+    while (size < sizeof(record)) {
+        ssize_t ret = read(fd, reinterpret_cast<char *>(&record) + size, sizeof(record) - size);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) return nullopt;
+        size += ret;
+    }
+    if (record.magic != RUNGUARD_RECORD_MAGIC || record.version != RUNGUARD_RECORD_VERSION) return nullopt;
+
+    static const char *const time_results[] = {"", "soft-timelimit", "hard-timelimit"};
+    runguard_result result;
+    result.wall_time = record.wall_time;
+    result.user_time = record.user_time;
+    result.sys_time = record.sys_time;
+    result.cpu_time = record.cpu_time;
+    result.exitcode = record.exitcode;
+    result.signal = record.signal;
+    result.memory = record.memory_bytes;
+    result.instructions = record.instructions;
+    result.cycles = record.cycles;
+    result.task_clock = record.task_clock;
+    result.perf_emulated = record.perf_emulated;
+    result.time_result = record.time_result < 3 ? time_results[record.time_result] : "";
+    result.memory_result = record.oom ? "oom" : "";
+    record.internal_error[sizeof(record.internal_error) - 1] = '\0';
+    result.internal_error = record.internal_error;
     return result;
 }
 
@@ -2,6 +2,7 @@
 
 #include <boost/assign.hpp>
 #include <boost/exception/diagnostic_information.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/lexical_cast.hpp>
 #include <fstream>
 
@@ -68,6 +69,7 @@ void from_json(const json &j, judge_task &value) {
     j.at("time_limit").get_to(value.time_limit), value.time_limit /= 1000;
     assign_optional(j, value.file_limit, "file_limit");
     assign_optional(j, value.proc_limit, "proc_limit");
+    assign_optional(j, value.instruction_limit, "instruction_limit");
     assign_optional(j, value.run_args, "run_args");
     assign_optional(j, value.actions, "actions");
 }
@@ -154,6 +156,7 @@ void from_json(const json &j, programming_submission &submit) {
     if (exists(j, "standard")) from_json(j.at("standard"), submit.standard);
     if (exists(j, "compare")) from_json(j.at("compare"), submit.compare);
     if (exists(j, "random")) from_json(j.at("random"), submit.random);
+    if (exists(j, "fail_fast")) j.at("fail_fast").get_to(submit.fail_fast);
 }
 
 void from_json(const json &j, choice_question &question) {
@@ -196,6 +199,11 @@ struct programming_judge_report {
     string prob_id;
     string sub_id;
     vector<judge_task_result> results;
+
+    /**
+     * @brief 是否为增量评测报告，增量评测报告只包含上次评测报告之后变化的评测结果，每个评测结果附带其下标
+     */
+    bool delta = false;
 };
 
 void to_json(json &j, const action_result &result) {
@@ -227,6 +235,11 @@ void to_json(json &j, const programming_judge_report &report) {
          {"prob_id", report.prob_id},
          {"sub_id", report.sub_id},
          {"results", report.results}};
+    if (report.delta) {
+        j["delta"] = true;
+        for (size_t i = 0; i < report.results.size(); ++i)
+            j["results"][i]["id"] = report.results[i].id;
+    }
 }
 
 struct choice_judge_report {
@@ -270,6 +283,7 @@ void configuration::init(const filesystem::path &config_path) {
     sub_fetcher = make_unique<rabbitmq_channel>(sub_queue);
     config.at("reportQueue").get_to(report_queue);
     judge_reporter = make_unique<rabbitmq_channel>(report_queue, true);
+    assign_optional(config, delta_report, "deltaReport");
 }
 
 string configuration::category() const {
@@ -309,13 +323,49 @@ void configuration::summarize_invalid(submission &submit) {
     envelope.ack();
 }
 
+/**
+ * @brief 评测结果的摘要，摘要变化说明评测结果发生了变化，需要在增量评测报告中发送
+ */
+static size_t fingerprint(const judge_task_result &result) {
+    size_t seed = 0;
+    boost::hash_combine(seed, (int)result.status);
+    boost::hash_combine(seed, result.score.numerator());
+    boost::hash_combine(seed, result.score.denominator());
+    boost::hash_combine(seed, result.run_time);
+    boost::hash_combine(seed, result.memory_used);
+    boost::hash_combine(seed, result.error_log);
+    boost::hash_combine(seed, result.report);
+    for (auto &action : result.actions) {
+        boost::hash_combine(seed, action.tag);
+        boost::hash_combine(seed, action.result);
+        boost::hash_combine(seed, action.success);
+    }
+    return seed;
+}
+
 void summarize_programming(configuration &server, programming_submission &submit, bool ack) {
     programming_judge_report report;
     report.category = submit.category;
     report.type = submit.type;
     report.sub_id = submit.sub_id;
     report.prob_id = submit.prob_id;
-    report.results = submit.results;
+
+    if (!ack && server.delta_report) {
+        // 第一次发送中途评测报告时发送完整的评测报告，之后只发送变化的评测结果
+        vector<size_t> fingerprints(submit.results.size());
+        auto sent = any_cast<vector<size_t>>(&submit.report_state);
+        report.delta = sent && sent->size() == fingerprints.size();
+        for (size_t i = 0; i < submit.results.size(); ++i) {
+            fingerprints[i] = fingerprint(submit.results[i]);
+            if (!report.delta || (*sent)[i] != fingerprints[i])
+                report.results.push_back(submit.results[i]);
+        }
+        if (report.delta && report.results.empty()) return;
+        submit.report_state = move(fingerprints);
+    } else {
+        // 最终评测报告总是完整的
+        report.results = submit.results;
+    }
 
     if (report_to_server(server, submit, json(report).dump())) {
         LOG_DEBUG << "in summarize_programming: report_to_server(no ack) success";
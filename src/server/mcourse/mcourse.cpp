@@ -56,7 +56,8 @@ const unordered_map<status, const char *> status_string = boost::assign::map_lis
     (status::FLOATING_POINT_ERROR, "FPE")
     (status::RANDOM_GEN_ERROR, "RG")
     (status::COMPARE_ERROR, "CP")
-    (status::SYSTEM_ERROR, "IE");
+    (status::SYSTEM_ERROR, "IE")
+    (status::SKIPPED, "");
 // clang-format on
 
 configuration::configuration()
@@ -682,6 +683,10 @@ void configuration::summarize_invalid(submission &submit) {
     BOOST_THROW_EXCEPTION(judge_exception() << "Invalid submission " << submit);
 }
 
+bool configuration::cache_results() const {
+    return false;
+}
+
 static json get_error_report(const status &stat, const judge_task_result &result) {
     error_report report;
     report.result = status_string.at(stat);
@@ -737,6 +742,7 @@ static bool summarize_random_check(configuration &, boost::rational<int> &total_
             if (task_result.status == status::PENDING) continue;
             if (task_result.status == status::RUNNING) continue;
             if (task_result.status == status::DEPENDENCY_NOT_SATISFIED) continue;
+            if (task_result.status == status::SKIPPED) continue;
             exists = true;
 
             if (task_result.status == status::ACCEPTED) {
@@ -779,6 +785,7 @@ static bool summarize_standard_check(configuration &, boost::rational<int> &tota
             if (task_result.status == status::PENDING) continue;
             if (task_result.status == status::RUNNING) continue;
             if (task_result.status == status::DEPENDENCY_NOT_SATISFIED) continue;
+            if (task_result.status == status::SKIPPED) continue;
             exists = true;
 
             if (task_result.status == status::ACCEPTED) {
@@ -833,6 +840,7 @@ static bool summarize_static_check(configuration &, boost::rational<int> &total_
             if (task_result.status == status::PENDING) continue;
             if (task_result.status == status::RUNNING) continue;
             if (task_result.status == status::DEPENDENCY_NOT_SATISFIED) continue;
+            if (task_result.status == status::SKIPPED) continue;
             exists = true;
 
             try {
@@ -888,6 +896,7 @@ static bool summarize_memory_check(configuration &, boost::rational<int> &total_
             if (task_result.status == status::PENDING) continue;
             if (task_result.status == status::RUNNING) continue;
             if (task_result.status == status::DEPENDENCY_NOT_SATISFIED) continue;
+            if (task_result.status == status::SKIPPED) continue;
             exists = true;
 
             if (task_result.status == status::ACCEPTED) {
@@ -937,6 +946,7 @@ static bool summarize_gtest_check(configuration &, boost::rational<int> &total_s
             if (task_result.status == status::PENDING) continue;
             if (task_result.status == status::RUNNING) continue;
             if (task_result.status == status::DEPENDENCY_NOT_SATISFIED) continue;
+            if (task_result.status == status::SKIPPED) continue;
             exists = true;
 
             score = submit.judge_tasks[i].score;
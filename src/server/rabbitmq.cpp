@@ -65,10 +65,8 @@ void rabbitmq_channel::message_write_loop() {
     LOG_DEBUG << "Start message write loop for exchange: " << queue.exchange;
     pending_message message;
     while (!server_shutdown) {
-        if (!write_queue.try_pop(message)) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            continue;
-        };
+        // 阻塞等待新的报告，超时后检查是否需要退出
+        if (!write_queue.pop_for(message, std::chrono::milliseconds(100))) continue;
         AmqpClient::BasicMessage::ptr_t msg = AmqpClient::BasicMessage::Create(message.message);
         for (int retry = 0;; retry++) {
             try {
@@ -0,0 +1,107 @@
+#include "server/report_coalescer.hpp"
+
+#include "logging.hpp"
+#include "server/judge_server.hpp"
+
+namespace judge::server {
+using namespace std;
+
+/**
+ * @brief 后台线程无法获得提交锁时，等待多久后重试发送中途评测报告
+ */
+static constexpr chrono::milliseconds RETRY_INTERVAL(10);
+
+report_coalescer::report_coalescer(chrono::milliseconds interval)
+    : interval(interval) {
+    flusher = thread([this] { flush_loop(); });
+}
+
+report_coalescer::~report_coalescer() {
+    stop();
+}
+
+void report_coalescer::report(submission &submit) {
+    auto now = chrono::steady_clock::now();
+    {
+        scoped_lock guard(mut);
+        // 后台线程已经停止时不再合并，直接发送
+        if (!stopping) {
+            state &s = states[&submit];
+            if (now - s.last_report < interval) {
+                if (!s.pending) {
+                    s.pending = true;
+                    cond.notify_all();
+                }
+                return;
+            }
+            s.last_report = now;
+            s.pending = false;
+        }
+    }
+    submit.judge_server->summarize(submit, false);
+}
+
+void report_coalescer::complete(submission &submit) {
+    scoped_lock guard(mut);
+    states.erase(&submit);
+}
+
+void report_coalescer::stop() {
+    {
+        scoped_lock guard(mut);
+        stopping = true;
+    }
+    cond.notify_all();
+    if (flusher.joinable()) flusher.join();
+}
+
+void report_coalescer::flush_loop() {
+    unique_lock guard(mut);
+    while (!stopping) {
+        auto now = chrono::steady_clock::now();
+        auto next = chrono::steady_clock::time_point::max();
+
+        submission *due = nullptr;
+        unique_lock<mutex> submit_guard;
+        for (auto &[submit, s] : states) {
+            if (!s.pending) continue;
+            auto deadline = s.last_report + interval;
+            if (deadline > now) {
+                next = min(next, deadline);
+                continue;
+            }
+
+            // worker 持有提交锁时会等待 mut，因此这里只能尝试获得提交锁，失败时稍后重试
+            submit_guard = unique_lock(submit->mut, try_to_lock);
+            if (!submit_guard.owns_lock()) {
+                next = min(next, now + RETRY_INTERVAL);
+                continue;
+            }
+
+            s.pending = false;
+            s.last_report = now;
+            due = submit;
+            break;
+        }
+
+        if (!due) {
+            if (next == chrono::steady_clock::time_point::max())
+                cond.wait(guard);
+            else
+                cond.wait_until(guard, next);
+            continue;
+        }
+
+        // 持有提交锁时提交不会完成评测，也就不会被销毁，发送评测报告时可以释放 mut
+        guard.unlock();
+        try {
+            due->judge_server->summarize(*due, false);
+        } catch (exception &ex) {
+            LOG_ERROR << "Unable to send partial report of " << *due << ": " << ex.what();
+        }
+        submit_guard.unlock();
+        guard.lock();
+    }
+}
+
+}  // namespace judge::server
@@ -37,7 +37,8 @@ const unordered_map<status, const char *> status_string = boost::assign::map_lis
     (status::FLOATING_POINT_ERROR, "Runtime Error")
     (status::RANDOM_GEN_ERROR, "Other") // Sicily 评测不包含此项
     (status::COMPARE_ERROR, "Wrong Answer") // Sicily 评测若遇到 spj 崩溃则认为评测结果是 WA
-    (status::SYSTEM_ERROR, "Other");
+    (status::SYSTEM_ERROR, "Other")
+    (status::SKIPPED, "Other"); // 被跳过的测试点不会决定评测结果
 // clang-format on
 
 configuration::configuration()
@@ -203,6 +204,8 @@ static bool fetch_queue(configuration &sicily, programming_submission &submit) {
     submit.submission = move(prog);
     submit.config = {};
     submit.type = "programming";
+    // Sicily 的评测结果为第一个未通过的测试点的评测结果，因此不需要评测剩余的测试点
+    submit.fail_fast = true;
 
     return true;
 }
@@ -0,0 +1,181 @@
+#include "core_allocator.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+
+#include "logging.hpp"
+
+namespace judge {
+using namespace std;
+namespace fs = std::filesystem;
+
+static int read_topology_value(const fs::path &path) {
+    int value = 0;
+    ifstream fin(path);
+    if (!(fin >> value)) return 0;
+    return value;
+}
+
+cpu_topology cpu_topology::read(unsigned cpu) {
+    cpu_topology result;
+    result.cpu = cpu;
+
+    fs::path cpudir = fs::path("/sys/devices/system/cpu") / ("cpu" + to_string(cpu));
+    result.core_id = read_topology_value(cpudir / "topology" / "core_id");
+    result.package_id = read_topology_value(cpudir / "topology" / "physical_package_id");
+
+    // CPU 所属的 NUMA 节点以 nodeX 的符号链接出现在 CPU 目录下
+    error_code ec;
+    for (auto &entry : fs::directory_iterator(cpudir, ec)) {
+        string name = entry.path().filename().string();
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+            all_of(name.begin() + 4, name.end(), ::isdigit)) {
+            result.node = stoi(name.substr(4));
+            break;
+        }
+    }
+    return result;
+}
+
+static vector<cpu_topology> read_topology(const set<unsigned> &cores) {
+    vector<cpu_topology> result;
+    for (unsigned core : cores) result.push_back(cpu_topology::read(core));
+    return result;
+}
+
+core_allocator::core_allocator(const set<unsigned> &cores)
+    : core_allocator(read_topology(cores)) {}
+
+core_allocator::core_allocator(const vector<cpu_topology> &topology) {
+    for (auto &cpu : topology) {
+        states[cpu.cpu].topology = cpu;
+        LOG_DEBUG << "CPU " << cpu.cpu << ": core " << cpu.core_id << ", package " << cpu.package_id << ", node " << cpu.node;
+    }
+}
+
+core_allocator::core_state &core_allocator::at(unsigned core) {
+    return states.at(core);
+}
+
+void core_allocator::park(unsigned core) {
+    scoped_lock lock(mut);
+    at(core).state = activity::PARKED;
+    cond.notify_all();
+}
+
+bool core_allocator::unpark(unsigned core) {
+    scoped_lock lock(mut);
+    core_state &state = at(core);
+    if (state.reserved) return false;
+    state.state = activity::BUSY;
+    return true;
+}
+
+void core_allocator::wait_released(unsigned core) {
+    unique_lock lock(mut);
+    core_state &state = at(core);
+    cond.wait(lock, [&] { return !state.reserved || interrupted; });
+}
+
+bool core_allocator::pick(unsigned requester, const vector<unsigned> &chosen, unsigned &result) const {
+    const cpu_topology &origin = states.at(requester).topology;
+
+    bool found = false;
+    tuple<bool, bool, bool, bool, unsigned> best;
+    for (auto &[cpu, state] : states) {
+        if (cpu == requester || state.reserved || state.state == activity::BUSY) continue;
+
+        bool sibling = false;
+        for (unsigned c : chosen) {
+            auto &other = states.at(c).topology;
+            if (other.package_id == state.topology.package_id && other.core_id == state.topology.core_id)
+                sibling = true;
+        }
+
+        // 优先选择：空闲的 worker（而不是其他排队的申请者）、同一 NUMA 节点、不与已分配核心互为超线程、同一 CPU 插槽
+        auto score = make_tuple(state.state == activity::WAITING,
+                                state.topology.node != origin.node,
+                                sibling,
+                                state.topology.package_id != origin.package_id,
+                                cpu);
+        if (!found || score < best) {
+            found = true;
+            best = score;
+            result = cpu;
+        }
+    }
+    return found;
+}
+
+void core_allocator::unreserve(const vector<unsigned> &cores) {
+    // 第一个核心为申请者自己的核心，不是被占用的核心
+    for (size_t i = 1; i < cores.size(); ++i)
+        at(cores[i]).reserved = false;
+}
+
+vector<unsigned> core_allocator::acquire(unsigned core, size_t count) {
+    unique_lock lock(mut);
+    vector<unsigned> chosen = {core};
+    if (count > states.size()) {
+        LOG_WARN << "Judge task requires " << count << " cores, but only " << states.size() << " workers are running";
+        count = states.size();
+    }
+    if (count <= 1) return chosen;
+
+    core_state &self = at(core);
+    self.state = activity::WAITING;
+    requests.push_back(core);
+
+    while (true) {
+        if (interrupted || self.reserved) {
+            // 申请者的核心被队头的申请者占用了，放弃申请，以免两个申请者互相等待
+            unreserve(chosen);
+            requests.erase(find(requests.begin(), requests.end(), core));
+            self.state = activity::PARKED;
+            cond.notify_all();
+            return {};
+        }
+
+        if (requests.front() == core) {
+            unsigned next;
+            while (chosen.size() < count && pick(core, chosen, next)) {
+                at(next).reserved = true;
+                chosen.push_back(next);
+            }
+            if (chosen.size() == count) break;
+        }
+
+        cond.wait(lock);
+    }
+
+    requests.pop_front();
+    self.state = activity::BUSY;
+    // 被占用的核心可能是其他排队的申请者，需要唤醒它们放弃申请；下一个申请者成为队头
+    cond.notify_all();
+    return chosen;
+}
+
+void core_allocator::release(const vector<unsigned> &cores) {
+    scoped_lock lock(mut);
+    unreserve(cores);
+    cond.notify_all();
+}
+
+size_t core_allocator::idle_cores() const {
+    scoped_lock lock(mut);
+    size_t result = 0;
+    for (auto &[cpu, state] : states)
+        if (state.state == activity::PARKED && !state.reserved)
+            ++result;
+    return result;
+}
+
+void core_allocator::interrupt() {
+    scoped_lock lock(mut);
+    interrupted = true;
+    cond.notify_all();
+}
+
+}  // namespace judge
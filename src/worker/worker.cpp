@@ -5,10 +5,15 @@
 #include <boost/algorithm/string/join.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/stacktrace.hpp>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <stdexcept>
 
 #include "common/defer.hpp"
 #include "common/exceptions.hpp"
+#include "common/system.hpp"
+#include "config.hpp"
 #include "logging.hpp"
 
 namespace judge {
@@ -62,16 +67,30 @@ void report_error(const std::string &message) {
     call_monitor(-1, [&](monitor &m) { m.report_error(-1, message); });
 }
 
+// 拉取线程等待评测服务器的新提交或者等待准入条件满足时阻塞在 intake_cond 上，
+// 提交评测结束、worker 空闲或者停止 worker 时唤醒
+static mutex intake_mutex;
+static condition_variable intake_cond;
+
+static void notify_intake() {
+    { scoped_lock lock(intake_mutex); }
+    intake_cond.notify_all();
+}
+
 vector<unique_ptr<submission>> finished_submissions;
 
 /**
  * @brief 提交结束，要求释放 submission 所占内存
  */
 static void finish_submission(submission &submit) {
-    scoped_lock guard(server_mutex);
-    unsigned judge_id = submit.judge_id;
-    finished_submissions.push_back(move(submissions.at(judge_id)));
-    submissions.erase(judge_id);
+    {
+        scoped_lock guard(server_mutex);
+        unsigned judge_id = submit.judge_id;
+        finished_submissions.push_back(move(submissions.at(judge_id)));
+        submissions.erase(judge_id);
+    }
+    // 正在评测的提交数减少，拉取线程可以分发新的提交
+    notify_intake();
 }
 
 static map<string, unique_ptr<judger>> judgers;
@@ -99,58 +118,215 @@ static void report_failure(unique_ptr<submission> &submit) {
 }
 
 /**
- * @brief 向每个评测服务器拉取一个提交
- * 如果遇到评测队列为空的情况，worker 需要调用 fetch_submission 函数来拉取评测
- * 
+ * @brief 从评测服务器拉取一个提交，并提前检查提交的合法性
+ * 不合法的提交将直接返回给评测服务器，不会进入评测队列。
+ * @param category 评测服务器的名称
+ * @param server 评测服务器
+ * @param submit 保存拉取到的合法提交
+ * @return true 如果获取到了合法的提交
+ */
+static bool prefetch_submission(const string &category, judge_server &server, unique_ptr<submission> &submit) {
+    // 评测服务器的连接需要和返回评测结果互斥，verify 也要求占有全局锁
+    scoped_lock guard(server_mutex);
+
+    bool success = false;  // 是否成功拉到合法的提交
+    try {
+        if (server.fetch_submission(submit)) {
+            submit->judge_server = &server;
+            if (!judgers.count(submit->type))
+                throw runtime_error("Unrecognized submission type " + submit->type);
+            LOG_BEGIN(submit->prob_id + "-" + submit->sub_id);
+            if (judgers[submit->type]->verify(*submit)) {
+                success = true;
+            } else {
+                LOG_INFO << "Invalid submission";
+                report_failure(submit);
+            }
+            LOG_END();
+        }
+    } catch (exception &ex) {
+        LOG_WARN << "Found invalid submission from " << category << ' ' << ex.what() << endl
+                 << boost::diagnostic_information(ex);
+    } catch (...) {
+        LOG_WARN << "Found invalid submission from " << category << ' ' << endl;
+    }
+    if (!success) submit.reset();
+    return success;
+}
+
+/**
+ * @brief 将已经检查过的提交登记为正在评测的提交，并分发评测任务
+ * @param submit 通过 prefetch_submission 拉取到的提交
  * @param task_queue 评测服务端发送评测信息的队列
- * @return true 如果获取到了提交
- * 限制拉取提交的总数
  */
-static bool fetch_submission(int worker_id, concurrent_queue<message::client_task> &task_queue) {
+static void dispatch_submission(unique_ptr<submission> &&submit, work_stealing_queue<message::client_task> &task_queue) {
     unique_lock guard(server_mutex);
+    LOG_BEGIN(submit->prob_id + "-" + submit->sub_id);
+    LOG_INFO << "Judging submission";
+    unsigned judge_id = global_judge_id++;
+    submit->judge_id = judge_id;
+    call_monitor(-1, [&](monitor &m) { m.start_submission(*submit); });
+    submission &dispatched = *submit;
+    submissions[judge_id] = move(submit);
+
+    // 在分发评测任务时，提交可能会对缓存文件夹上只读锁，而此时其他提交已经提前对缓存文件夹上读锁时，
+    // 将导致分发评测任务等待锁释放，如果不释放 server_mutex，那么当前提交将占有 server_mutex，
+    // 从而阻止其他提交的评测任务继续评测，导致死锁。因此分发时确保不占用 server_mutex，以便允许
+    // 提交等待到可以评测时再继续。
+    guard.unlock();
+    try {
+        judgers[dispatched.type]->distribute(task_queue, dispatched);
+    } catch (exception &ex) {
+        LOG_ERROR << "Unable to distribute submission: " << ex.what() << endl
+                  << boost::diagnostic_information(ex);
+    }
+    LOG_END();
+}
 
-    bool success = false;  // 是否成功拉到评测任务
-    // 尝试从服务器拉取提交，每次都向所有的评测服务器拉取评测任务
-    for (auto &[category, server] : judge_servers) {
-        unique_ptr<judge::submission> submission;
-        LOG_BEGIN(category);
-        try {
-            if (server->fetch_submission(submission)) {
-                submission->judge_server = server.get();
-                if (!judgers.count(submission->type))
-                    throw runtime_error("Unrecognized submission type " + submission->type);
-                LOG_BEGIN(submission->prob_id + "-" + submission->sub_id);
-                if (judgers[submission->type]->verify(*submission)) {
-                    LOG_INFO << "Judging submission";
-                    unsigned judge_id = global_judge_id++;
-                    submission->judge_id = judge_id;
-                    call_monitor(worker_id, [&](monitor &m) { m.start_submission(*submission); });
-                    submissions[judge_id] = move(submission);
-
-                    // 在分发评测任务时，提交可能会对缓存文件夹上只读锁，而此时其他提交已经提前对缓存文件夹上读锁时，
-                    // 将导致分发评测任务等待锁释放，如果不释放 server_mutex，那么当前提交将占有 server_mutex，
-                    // 从而阻止其他提交的评测任务继续评测，导致死锁。因此分发时确保不占用 server_mutex，以便允许
-                    // 提交等待到可以评测时再继续。
-                    guard.unlock();
-                    judgers[submissions[judge_id]->type]->distribute(task_queue, *submissions[judge_id]);
-                    success = true;
-                } else {
-                    LOG_INFO << "Invalid submission";
-                    report_failure(submission);
-                }
-                LOG_END();
+work_stealing_queue<message::client_task>::policy_factory get_scheduling_policy(const string &name) {
+    using policy_ptr = unique_ptr<scheduling_policy<message::client_task>>;
+    if (name == "locality") {
+        return [] { return policy_ptr(make_unique<locality_policy<message::client_task>>()); };
+    } else if (name == "fifo") {
+        return [] { return policy_ptr(make_unique<fifo_policy<message::client_task>>()); };
+    } else if (name == "shortest") {
+        return [] {
+            return policy_ptr(make_unique<shortest_first_policy<message::client_task>>(
+                [](const message::client_task &task) { return task.expect_runtime; }));
+        };
+    } else if (name == "fair") {
+        return [] {
+            return policy_ptr(make_unique<fair_share_policy<message::client_task>>(
+                [](const message::client_task &task) { return task.submit->judge_id; }));
+        };
+    } else {
+        throw invalid_argument("Unrecognized scheduling policy " + name);
+    }
+}
+
+// 正在评测的 worker 数量，停止 worker 时需要等待所有正在评测的 worker 不再产生新的评测任务后才能退出
+static atomic<size_t> judging_workers = 0;
+// 正在运行的拉取线程数量，停止 worker 时需要等待所有拉取线程分发完已经拉取的提交后 worker 才能退出
+static atomic<size_t> running_intakes = 0;
+// 所有 worker 共享的评测队列，停止 worker 时需要唤醒所有等待中的 worker
+static work_stealing_queue<message::client_task> *dispatch_queue = nullptr;
+// 所有 worker 共享的核心分配器，停止评测时需要唤醒所有等待核心的 worker
+static core_allocator *dispatch_allocator = nullptr;
+
+// 评测服务器没有提交时，拉取线程等待的时长，之后再次拉取提交
+static constexpr chrono::milliseconds FETCH_INTERVAL(10);
+// 准入条件不满足时，拉取线程重新检查准入条件的最长间隔，因为磁盘和内存的变化不会唤醒拉取线程
+static constexpr chrono::milliseconds ADMISSION_INTERVAL(100);
+
+static void wait_intake(chrono::milliseconds timeout) {
+    unique_lock lock(intake_mutex);
+    intake_cond.wait_for(lock, timeout);
+}
+
+/**
+ * @brief 检查是否可以向评测队列分发新的提交
+ * 只有在以下条件都满足时才分发新的提交：
+ * 1. 正在评测的提交数没有达到 MAX_INFLIGHT_SUBMISSIONS；
+ * 2. 评测队列中的评测任务少于空闲的 worker 数，否则新提交的评测任务只能在评测队列中排队；
+ * 3. RUN_DIR 和 DATA_DIR 所在文件系统的空闲空间不少于 MIN_FREE_DISK；
+ * 4. 系统可用内存不少于 MIN_FREE_MEMORY。
+ * 多个拉取线程可能同时通过检查，因此实际分发的提交可能略多于空闲 worker 数。
+ * @return 不能分发新提交的原因，可以分发时返回空字符串
+ */
+static string check_admission(work_stealing_queue<message::client_task> &task_queue, core_allocator &allocator) {
+    if (MAX_INFLIGHT_SUBMISSIONS > 0) {
+        scoped_lock guard(server_mutex);
+        if (submissions.size() >= MAX_INFLIGHT_SUBMISSIONS)
+            return "too many submissions in flight";
+    }
+
+    if (task_queue.size() >= allocator.idle_cores())
+        return "no idle workers";
+
+    // 获取空闲空间或可用内存失败时返回 -1，此时不限制分发
+    vector<filesystem::path> dirs = {RUN_DIR};
+    if (USE_DATA_DIR) dirs.push_back(DATA_DIR);
+    for (auto &dir : dirs) {
+        long long space = get_free_disk_space(dir.c_str());
+        if (space >= 0 && space < MIN_FREE_DISK)
+            return "insufficient disk space in " + dir.string();
+    }
+
+    long long memory = get_available_memory();
+    if (memory >= 0 && memory < MIN_FREE_MEMORY)
+        return "insufficient memory";
+
+    return "";
+}
+
+/**
+ * @brief 拉取线程函数，负责从一个评测服务器拉取提交并分发评测任务
+ * 拉取线程提前拉取并检查下一个提交，在准入条件满足时分发该提交的评测任务，
+ * 因此 worker 占有的核心只会用于评测，拉取提交、解析和检查提交的开销不会影响评测的计时。
+ * @param category 评测服务器的名称
+ * @param server 评测服务器
+ * @param task_queue 评测服务端发送评测信息的队列
+ * @param allocator 核心分配器，用于获取空闲的 worker 数
+ */
+static void intake_loop(const string &category, judge_server &server, work_stealing_queue<message::client_task> &task_queue, core_allocator &allocator) {
+    LOG_BEGIN(category);
+
+    unique_ptr<submission> submit;
+    string blocked;  // 上一次不能分发提交的原因，避免重复输出日志
+    while (!stopping_judging) {
+        if (!submit) {
+            // 停止 worker 时不再拉取新的提交
+            if (stopping_workers) break;
+            if (!prefetch_submission(category, server, submit)) {
+                wait_intake(FETCH_INTERVAL);  // 这里必须等待，不可以忙等
+                continue;
             }
-        } catch (exception &ex) {
-            LOG_WARN << "Found invalid submission from " << category << ' ' << ex.what() << endl
-                     << boost::diagnostic_information(ex);
-            success = false;
-        } catch (...) {
-            LOG_WARN << "Found invalid submission from " << category << ' ' << endl;
-            success = false;
         }
-        LOG_END();
+
+        // 停止 worker 时已经拉取的提交不再等待准入条件，直接分发评测，以免该提交丢失
+        string reason = stopping_workers ? "" : check_admission(task_queue, allocator);
+        if (!reason.empty()) {
+            if (reason != blocked)
+                LOG_DEBUG << "Submission " << submit->prob_id << "-" << submit->sub_id << " is waiting for admission: " << reason;
+            blocked = reason;
+            wait_intake(ADMISSION_INTERVAL);
+            continue;
+        }
+
+        blocked.clear();
+        dispatch_submission(move(submit), task_queue);
     }
-    return success;
+
+    if (submit)
+        LOG_WARN << "Judging stopped, drop prefetched submission " << submit->prob_id << "-" << submit->sub_id;
+
+    LOG_END();
+}
+
+/**
+ * @brief 获取下一个评测任务，没有评测任务时阻塞等待
+ * 空闲 worker 在评测队列上阻塞，直到拉取线程或者其他 worker 推送了新的评测任务、或者停止 worker 时才会被唤醒。
+ * @param task_queue 评测服务端发送评测信息的队列
+ * @param client_task 保存获取到的评测任务
+ * @return 是否获取到了评测任务，返回 false 表示 worker 需要退出
+ */
+static bool next_task(work_stealing_queue<message::client_task> &task_queue, message::client_task &client_task) {
+    while (!stopping_judging) {
+        if (task_queue.try_pop(client_task)) return true;
+
+        if (stopping_workers) {
+            // 如果需要停止 worker，在评测队列为空时自然退出 worker。
+            // 但拉取线程可能还在分发已经拉取的提交，正在评测的 worker 也可能推送新的评测任务，
+            // 因此需要等到拉取线程全部退出并且没有 worker 在评测时才退出。
+            if (judging_workers == 0 && running_intakes == 0) return false;
+            // 计数器变化和唤醒之间存在间隙，因此只等待有限的时长，之后重新检查计数器
+            if (task_queue.pop_for(client_task, FETCH_INTERVAL)) return true;
+            continue;
+        }
+
+        if (task_queue.wait_pop(client_task)) return true;
+    }
+    return false;
 }
 
 /**
@@ -167,46 +343,38 @@ static bool fetch_submission(int worker_id, concurrent_queue<message::client_tas
  * 对于需要进行缓存的文件：
  *     CACHE_DIR
  */
-static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &task_queue, concurrent_queue<message::core_request> &core_queue) {
+static void worker_loop(size_t core_id, work_stealing_queue<message::client_task> &task_queue, core_allocator &allocator) {
     call_monitor(core_id, [&](monitor &m) { m.worker_state_changed(core_id, worker_state::START, ""); });
     LOG_BEGIN("worker" + to_string(core_id));
 
     while (true) {
-        if (stopping_judging) break;
-
         {
-            // 从队列中读取核心请求
-            message::core_request core_request;
-            if (core_queue.try_pop(core_request)) {
-                {
-                    scoped_lock lock(*core_request.write_lock);
-                    core_request.core_ids->push_back(core_id);
-                    core_request.lock->count_down();
-                }
-                {
-                    unique_lock lock(*core_request.mut);
-                    core_request.cv->wait(lock);
-                }
-            }
-
             // 从队列中读取评测信息
             message::client_task client_task;
-            {
-                if (!task_queue.try_pop(client_task)) {
-                    if (stopping_workers) {
-                        // 如果需要停止 worker，在评测队列为空时自然退出 worker。
-                        // 因为 stop 导致不再获取提交时，不会产生新的评测任务。
-                        // 可能存在极限情况：try_pop 之后另一个 worker 推送了
-                        // 新评测任务，此时另一个 worker 来完成提交的评测。
-                        break;
-                    }
-
-                    if (!fetch_submission(core_id, task_queue)) {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(10));  // 10ms，这里必须等待，不可以忙等，否则会挤占返回评测结果的执行权
-                    }
-                    continue;
-                }
+            allocator.park(core_id);
+            // 出现了空闲的 worker，拉取线程可以分发新的提交
+            notify_intake();
+            if (!next_task(task_queue, client_task)) break;
+
+            vector<unsigned> cpus = {(unsigned)core_id};
+            if (!allocator.unpark(core_id) ||
+                (client_task.cores > 1 && (cpus = allocator.acquire(core_id, client_task.cores)).empty())) {
+                // 当前核心已经被其他多核评测任务占用，将评测任务放回评测队列交给其他 worker 评测，
+                // 等待核心被释放后再继续评测
+                task_queue.push(client_task);
+                allocator.wait_released(core_id);
+                continue;
             }
+            defer {
+                // 评测结束后立刻释放多核评测任务占用的其他核心
+                allocator.release(cpus);
+            };
+
+            ++judging_workers;
+            defer {
+                // 停止 worker 时，最后一个评测结束的 worker 需要唤醒等待退出的 worker
+                if (--judging_workers == 0 && stopping_workers) task_queue.wake_all();
+            };
 
             LOG_DEBUG << "Fetched submission. client_task.name = " << client_task.name;
 
@@ -222,24 +390,8 @@ static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &
 
                 LOG_DEBUG << "After fetching submission, submission's type = " << client_task.submit->type;  //debug
 
-                vector<size_t> cpus = {core_id};
-                if (client_task.cores > 1 /* TODO: check if cores <= workers */) {
-                    message::core_request request;
-                    boost::latch latch(client_task.cores - 1);
-                    std::mutex write_lock, mut;
-                    std::condition_variable cv;
-                    request.core_ids = &cpus;
-                    request.lock = &latch;
-                    request.write_lock = &write_lock;
-                    request.cv = &cv;
-                    request.mut = &mut;
-
-                    for (size_t i = 1; i < client_task.cores; ++i)
-                        core_queue.push(request);
-                    latch.wait();
-                }
                 vector<string> execcpuset;
-                for (size_t i : cpus) execcpuset.push_back(to_string(i));
+                for (unsigned i : cpus) execcpuset.push_back(to_string(i));
                 LOG_BEGIN(client_task.submit->category + "-" + client_task.submit->prob_id + "-" + client_task.submit->sub_id + "-" + to_string(client_task.id) + "-" + client_task.name);
                 try {
                     LOG_DEBUG << "in worker: try to judge, call judger.judge()";
@@ -264,12 +416,16 @@ static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &
     call_monitor(core_id, [&](monitor &m) { m.worker_state_changed(core_id, worker_state::STOPPED, ""); });
 }
 
-thread start_worker(size_t core_id, concurrent_queue<message::client_task> &task_queue, concurrent_queue<message::core_request> &core_queue) {
+thread start_worker(size_t core_id, work_stealing_queue<message::client_task> &task_queue, core_allocator &allocator) {
     LOG_DEBUG << "Start worker" << core_id;
+    dispatch_queue = &task_queue;
+    dispatch_allocator = &allocator;
 
-    thread thd([core_id, &task_queue, &core_queue] {
+    thread thd([core_id, &task_queue, &allocator] {
         prctl(PR_SET_NAME, ("worker" + to_string(core_id)).c_str(), 0, 0, 0);
-        worker_loop(core_id, task_queue, core_queue);
+        // 当前 worker 推送的评测任务进入自己的本地队列，使得后续评测任务仍在当前核心上评测
+        task_queue.attach(core_id);
+        worker_loop(core_id, task_queue, allocator);
     });
 
     // 设置当前线程（客户端线程）的 CPU 亲和性，要求操作系统将 thd 线程放在指定的 cpuset 上运行
@@ -282,14 +438,54 @@ thread start_worker(size_t core_id, concurrent_queue<message::client_task> &task
     return thd;
 }
 
+vector<thread> start_intake(const set<unsigned> &worker_cores, work_stealing_queue<message::client_task> &task_queue, core_allocator &allocator) {
+    dispatch_queue = &task_queue;
+    dispatch_allocator = &allocator;
+
+    // 拉取线程运行在 worker 以外的 CPU 核心上，避免影响评测的计时
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    bool pinned = false;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &set) == 0) {
+        for (unsigned core : worker_cores) CPU_CLR(core, &set);
+        pinned = CPU_COUNT(&set) > 0;
+    }
+    if (!pinned)
+        LOG_WARN << "No CPU cores left for submission intake, intake threads may disturb the time measurement of workers";
+
+    vector<thread> threads;
+    for (auto &[category, server] : judge_servers) {
+        LOG_DEBUG << "Start intake of " << category;
+        ++running_intakes;
+        thread thd([&category = category, &server = *server, &task_queue, &allocator] {
+            prctl(PR_SET_NAME, "intake", 0, 0, 0);
+            intake_loop(category, server, task_queue, allocator);
+            // 最后一个退出的拉取线程需要唤醒等待退出的 worker
+            if (--running_intakes == 0) task_queue.wake_all();
+        });
+
+        if (pinned) {
+            int ret = pthread_setaffinity_np(thd.native_handle(), sizeof(cpu_set_t), &set);
+            if (ret != 0) throw std::system_error(ret, std::system_category());
+        }
+        threads.push_back(move(thd));
+    }
+    return threads;
+}
+
 void stop_workers() {
     stopping_workers = true;
+    if (dispatch_queue) dispatch_queue->wake_all();
+    notify_intake();
 
     call_monitor(0, [&](monitor &m) { m.interrupt_submissions(); });
 }
 
 void stop_judging() {
     stopping_judging = true;
+    if (dispatch_queue) dispatch_queue->wake_all();
+    notify_intake();
+    if (dispatch_allocator) dispatch_allocator->interrupt();
 
     call_monitor(0, [&](monitor &m) { m.interrupt_judge_tasks(); });
 }
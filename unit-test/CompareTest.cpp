@@ -0,0 +1,139 @@
+#include "judge/compare.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace judge;
+namespace fs = std::filesystem;
+
+static int compare(string_view user, string_view answer, compare_mode mode) {
+    return compare_output(user, answer, mode).result;
+}
+
+TEST(CompareTest, ParseMode) {
+    EXPECT_EQ(parse_compare_mode("diff-all"), compare_mode::all);
+    EXPECT_EQ(parse_compare_mode("diff-ign-space"), compare_mode::ignore_space);
+    EXPECT_EQ(parse_compare_mode("diff-ign-trailing"), compare_mode::ignore_trailing);
+    EXPECT_FALSE(parse_compare_mode("testlib").has_value());
+}
+
+TEST(CompareTest, DiffAll) {
+    EXPECT_EQ(compare("1 2\n3\n", "1 2\n3\n", compare_mode::all), RESULT_AC);
+    EXPECT_EQ(compare("1 2\r\n3\r\n", "1 2\n3\n", compare_mode::all), RESULT_AC);
+    EXPECT_EQ(compare("1 2\n3", "1 2\n3\n", compare_mode::all), RESULT_PE);
+    EXPECT_EQ(compare("1 2 \n3\n", "1 2\n3\n", compare_mode::all), RESULT_PE);
+    EXPECT_EQ(compare("1  2\n3\n", "1 2\n3\n", compare_mode::all), RESULT_PE);
+    EXPECT_EQ(compare("1 2\n\n3\n", "1 2\n3\n", compare_mode::all), RESULT_PE);
+    EXPECT_EQ(compare("1 2\n4\n", "1 2\n3\n", compare_mode::all), RESULT_WA);
+    EXPECT_EQ(compare("12\n3\n", "1 2\n3\n", compare_mode::all), RESULT_WA);
+    EXPECT_EQ(compare("", "1\n", compare_mode::all), RESULT_WA);
+    EXPECT_EQ(compare("\n \n", "", compare_mode::all), RESULT_PE);
+}
+
+TEST(CompareTest, DiffIgnoreTrailing) {
+    EXPECT_EQ(compare("1 2  \n3", "1 2\n3\n", compare_mode::ignore_trailing), RESULT_AC);
+    EXPECT_EQ(compare("1 2\n\n\n3\n\n", "1 2\n3\n", compare_mode::ignore_trailing), RESULT_AC);
+    EXPECT_EQ(compare("1\t2\n3\n", "1 2\n3\n", compare_mode::ignore_trailing), RESULT_PE);
+    EXPECT_EQ(compare("a", "a\r\na\r  ", compare_mode::ignore_trailing), RESULT_WA);
+}
+
+TEST(CompareTest, DiffIgnoreSpace) {
+    EXPECT_EQ(compare("1 \t 2  \n\n3", "1 2\n3\n", compare_mode::ignore_space), RESULT_AC);
+    EXPECT_EQ(compare("1 2\n3 4\n", "1 2\n3 5\n", compare_mode::ignore_space), RESULT_WA);
+    EXPECT_EQ(compare("1 2\n3 4\n", "1 2\n3 4\n5\n", compare_mode::ignore_space), RESULT_WA);
+}
+
+TEST(CompareTest, LargeOutput) {
+    // 超过 SIMD 块大小的输出，第一处不同位于中间
+    string answer;
+    for (int i = 0; i < 10000; ++i) answer += to_string(i) + " " + to_string(i * i) + "\n";
+    string user = answer;
+    EXPECT_EQ(compare(user, answer, compare_mode::all), RESULT_AC);
+
+    size_t pos = answer.find("\n5000 ") + 1;
+    user[pos] = '6';
+    compare_report report = compare_output(user, answer, compare_mode::all);
+    EXPECT_EQ(report.result, RESULT_WA);
+    EXPECT_EQ(report.user_offset, pos);
+    EXPECT_EQ(line_column(user, report.user_offset), (pair<size_t, size_t>{5001, 1}));
+
+    user = answer;
+    user.insert(pos - 1, "  ");
+    report = compare_output(user, answer, compare_mode::all);
+    EXPECT_EQ(report.result, RESULT_PE);
+    EXPECT_EQ(line_column(user, report.user_offset).first, 5000u);
+    EXPECT_EQ(line_column(answer, report.answer_offset).first, 5000u);
+}
+
+TEST(CompareTest, MappedFile) {
+    fs::path dir = fs::temp_directory_path() / "compare_test";
+    fs::create_directories(dir);
+    ofstream(dir / "user.out") << "1 2\n";
+    ofstream(dir / "answer.out") << "1 2\n";
+    ofstream(dir / "empty.out");
+
+    EXPECT_EQ(compare_files(dir / "user.out", dir / "answer.out", compare_mode::all).result, RESULT_AC);
+    EXPECT_EQ(compare_files(dir / "empty.out", dir / "answer.out", compare_mode::all).result, RESULT_WA);
+    EXPECT_THROW(compare_files(dir / "missing.out", dir / "answer.out", compare_mode::all), system_error);
+    fs::remove_all(dir);
+}
+
+TEST(CompareTest, StreamChecker) {
+    auto check = [](string_view output, string_view answer, size_t chunk) {
+        stream_checker checker(answer);
+        for (size_t i = 0; i < output.size(); i += chunk)
+            if (!checker.feed(output.substr(i, chunk))) return false;
+        return checker.finish();
+    };
+    for (size_t chunk : {1, 3, 64}) {
+        EXPECT_TRUE(check("1 2\n3\n", "1 2\n3\n", chunk));
+        EXPECT_TRUE(check("1  2 \r\n\n3", "1 2\n3\n\n", chunk));
+        EXPECT_FALSE(check("1 2\n4\n", "1 2\n3\n", chunk));
+        EXPECT_FALSE(check("1 2\n", "1 2\n3\n", chunk));
+        EXPECT_FALSE(check("1 2\n3\n4\n", "1 2\n3\n", chunk));
+    }
+
+    // 第一行错误时不需要读完之后的输出
+    stream_checker checker("1\n2\n");
+    EXPECT_TRUE(checker.feed("1\n3"));
+    EXPECT_FALSE(checker.feed("\n"));
+}
+
+TEST(CompareTest, TokenCompare) {
+    EXPECT_FALSE(parse_token_compare("diff-all"));
+    EXPECT_FALSE(parse_token_compare("tokens"));
+    auto opt = parse_token_compare("token:abs=1e-6,rel=1e-4,ignore-case,unordered-lines");
+    ASSERT_TRUE(opt);
+    EXPECT_DOUBLE_EQ(opt->absolute_error, 1e-6);
+    EXPECT_DOUBLE_EQ(opt->relative_error, 1e-4);
+    EXPECT_TRUE(opt->ignore_case && opt->unordered_lines);
+    EXPECT_THROW(parse_token_compare("token:abs="), invalid_argument);
+    EXPECT_THROW(parse_token_compare("token:abs=-1"), invalid_argument);
+    EXPECT_THROW(parse_token_compare("token:exact"), invalid_argument);
+
+    auto compare = [](string_view user, string_view answer, string_view name) {
+        return compare_tokens(user, answer, *parse_token_compare(name)).result;
+    };
+    EXPECT_EQ(compare("1  2\r\n\n3", "1 2\n3\n", "token"), RESULT_AC);
+    EXPECT_EQ(compare("1 2 3 4", "1 2 3", "token"), RESULT_WA);
+    EXPECT_EQ(compare("1.0", "1", "token"), RESULT_WA);
+    EXPECT_EQ(compare("1.0 -2e-7", "1 0", "token:abs=1e-6"), RESULT_AC);
+    EXPECT_EQ(compare("1.00001", "1", "token:abs=1e-6"), RESULT_WA);
+    EXPECT_EQ(compare("100001", "100000", "token:rel=1e-4"), RESULT_AC);
+    EXPECT_EQ(compare("nan", "nan", "token:abs=1e-6"), RESULT_AC);
+    EXPECT_EQ(compare("1x", "1.0x", "token:abs=1e-6"), RESULT_WA);
+    EXPECT_EQ(compare("Yes", "YES", "token"), RESULT_WA);
+    EXPECT_EQ(compare("Yes", "YES", "token:ignore-case"), RESULT_AC);
+    EXPECT_EQ(compare("b 2\n\na 1\n", "a 1\nb 2\n", "token:unordered-lines"), RESULT_AC);
+    EXPECT_EQ(compare("b 2 a 1\n", "a 1\nb 2\n", "token:unordered-lines"), RESULT_WA);
+
+    // 第一处不同的位置为不同的 token 的开头
+    auto report = compare_tokens("12 3.5\n", "12 3.25\n", token_compare_options());
+    EXPECT_EQ(report.result, RESULT_WA);
+    EXPECT_EQ(report.user_offset, 3u);
+    EXPECT_EQ(report.answer_offset, 3u);
+}
@@ -0,0 +1,105 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "common/concurrent_queue.hpp"
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace judge;
+
+TEST(ConcurrentQueueTest, MovesMoveOnlyElements) {
+    concurrent_queue<unique_ptr<int>> queue;
+    for (int i = 0; i < 3; ++i) queue.push(make_unique<int>(i));
+
+    unique_ptr<int> value;
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(*value, i);
+    }
+    EXPECT_FALSE(queue.try_pop(value));
+}
+
+TEST(ConcurrentQueueTest, WaitPopWakesUpOnPushAndWake) {
+    concurrent_queue<int> queue;
+    int value;
+
+    thread producer([&] {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        queue.push(42);
+    });
+    EXPECT_TRUE(queue.wait_pop(value));
+    EXPECT_EQ(value, 42);
+    producer.join();
+
+    thread waker([&] {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        queue.wake_all();
+    });
+    EXPECT_FALSE(queue.wait_pop(value));
+    waker.join();
+
+    queue.wake_one();
+    EXPECT_FALSE(queue.wait_pop(value));
+    EXPECT_FALSE(queue.pop_for(value, chrono::milliseconds(10)));
+}
+
+TEST(ConcurrentQueueTest, BoundedQueueBlocksWhenFull) {
+    bounded_queue<int> queue(3);
+    EXPECT_EQ(queue.capacity(), 4);
+    for (int i = 0; i < 4; ++i) ASSERT_TRUE(queue.try_push(int(i)));
+    EXPECT_FALSE(queue.try_push(4));
+    EXPECT_FALSE(queue.push_for(4, chrono::milliseconds(10)));
+
+    thread consumer([&] {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        int value;
+        ASSERT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(value, 0);
+    });
+    EXPECT_TRUE(queue.push(4));
+    consumer.join();
+
+    int value;
+    for (int i = 1; i <= 4; ++i) {
+        ASSERT_TRUE(queue.pop_for(value, chrono::milliseconds(10)));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(queue.pop_for(value, chrono::milliseconds(10)));
+}
+
+template <typename Queue, typename Push>
+static void concurrent_push_pop(Queue &queue, Push push) {
+    const size_t producers = 4, consumers = 4, tasks = 20000;
+    atomic<size_t> sum = 0, popped = 0;
+
+    vector<thread> threads;
+    for (size_t i = 0; i < producers; ++i)
+        threads.emplace_back([&] {
+            for (size_t j = 0; j < tasks; ++j) push(queue, j);
+        });
+    for (size_t i = 0; i < consumers; ++i)
+        threads.emplace_back([&] {
+            size_t value;
+            while (popped < producers * tasks) {
+                if (!queue.pop_for(value, chrono::milliseconds(10))) continue;
+                sum += value;
+                ++popped;
+            }
+        });
+    for (auto &thd : threads) thd.join();
+
+    EXPECT_EQ(popped, producers * tasks);
+    EXPECT_EQ(sum, producers * tasks * (tasks - 1) / 2);
+}
+
+TEST(ConcurrentQueueTest, ConcurrentPushPop) {
+    concurrent_queue<size_t> unbounded;
+    concurrent_push_pop(unbounded, [](auto &queue, size_t value) { queue.push(value); });
+
+    // 容量远小于任务数，写者会频繁阻塞
+    bounded_queue<size_t> bounded(64);
+    concurrent_push_pop(bounded, [](auto &queue, size_t value) { ASSERT_TRUE(queue.push(move(value))); });
+}
@@ -0,0 +1,85 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "core_allocator.hpp"
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace judge;
+
+// 两个 NUMA 节点，每个节点两个物理核心，每个物理核心两个超线程
+static vector<cpu_topology> make_topology() {
+    vector<cpu_topology> topology;
+    for (unsigned cpu = 0; cpu < 8; ++cpu) {
+        cpu_topology t;
+        t.cpu = cpu;
+        t.core_id = cpu / 2;
+        t.package_id = cpu / 4;
+        t.node = cpu / 4;
+        topology.push_back(t);
+    }
+    return topology;
+}
+
+TEST(CoreAllocatorTest, PrefersSameNodeAndNoSiblings) {
+    core_allocator allocator(make_topology());
+    for (unsigned cpu = 0; cpu < 8; ++cpu) allocator.park(cpu);
+    EXPECT_EQ(allocator.idle_cores(), 8);
+
+    ASSERT_TRUE(allocator.unpark(0));
+    auto cores = allocator.acquire(0, 2);
+    // cpu 1 与 cpu 0 互为超线程，应该优先选择同一节点的另一个物理核心
+    EXPECT_EQ(cores, (vector<unsigned>{0, 2}));
+    EXPECT_EQ(allocator.idle_cores(), 6);
+
+    // 被占用的核心不能领取评测任务
+    EXPECT_FALSE(allocator.unpark(2));
+
+    allocator.release(cores);
+    EXPECT_TRUE(allocator.unpark(2));
+}
+
+TEST(CoreAllocatorTest, ClampsToWorkerCount) {
+    core_allocator allocator(make_topology());
+    for (unsigned cpu = 0; cpu < 8; ++cpu) allocator.park(cpu);
+    ASSERT_TRUE(allocator.unpark(3));
+    auto cores = allocator.acquire(3, 100);
+    EXPECT_EQ(cores.size(), 8);
+    EXPECT_EQ(cores.front(), 3);
+    allocator.release(cores);
+}
+
+TEST(CoreAllocatorTest, ConcurrentRequestsDoNotDeadlock) {
+    vector<cpu_topology> topology = make_topology();
+    topology.resize(2);
+    core_allocator allocator(topology);
+
+    // 两个 worker 同时领取到需要两个核心的评测任务，其中一个申请失败后等待另一个完成
+    atomic<int> finished = 0;
+    auto worker = [&](unsigned cpu) {
+        while (true) {
+            allocator.park(cpu);
+            if (!allocator.unpark(cpu)) {
+                allocator.wait_released(cpu);
+                continue;
+            }
+            auto cores = allocator.acquire(cpu, 2);
+            if (cores.empty()) {
+                allocator.wait_released(cpu);
+                continue;
+            }
+            EXPECT_EQ(cores.size(), 2);
+            this_thread::sleep_for(chrono::milliseconds(10));
+            allocator.release(cores);
+            ++finished;
+            break;
+        }
+        allocator.park(cpu);
+    };
+
+    thread a(worker, 0), b(worker, 1);
+    a.join();
+    b.join();
+    EXPECT_EQ(finished, 2);
+}
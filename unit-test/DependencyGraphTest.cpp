@@ -0,0 +1,47 @@
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "judge/dependency_graph.hpp"
+
+using namespace std;
+using namespace judge;
+
+TEST(DependencyGraphTest, ChildrenAndRoots) {
+    // 0: 编译，1、2 依赖编译，3 依赖 1，4 不依赖任何任务
+    dependency_graph graph({-1, 0, 0, 1, -1});
+    EXPECT_EQ(graph.size(), 5);
+    EXPECT_EQ(graph.roots(), (vector<size_t>{0, 4}));
+    EXPECT_EQ(graph.children(0), (vector<size_t>{1, 2}));
+    EXPECT_EQ(graph.children(1), (vector<size_t>{3}));
+    EXPECT_TRUE(graph.children(2).empty());
+}
+
+TEST(DependencyGraphTest, RejectsForwardDependency) {
+    EXPECT_THROW(dependency_graph({-1, 1}), invalid_argument);
+    EXPECT_THROW(dependency_graph({2, -1, -1}), invalid_argument);
+}
+
+TEST(DependencyGraphTest, TracksCompletion) {
+    dependency_graph graph({-1, 0, 0, 1});
+    EXPECT_EQ(graph.pending(), 4);
+
+    EXPECT_TRUE(graph.start(0));
+    EXPECT_FALSE(graph.start(0));
+    EXPECT_EQ(graph.running(), 1);
+
+    EXPECT_TRUE(graph.finish(0));
+    EXPECT_FALSE(graph.finish(0));
+    EXPECT_TRUE(graph.start(1));
+    EXPECT_TRUE(graph.skip(2));
+    EXPECT_FALSE(graph.skip(1));
+    EXPECT_EQ(graph.running(), 1);
+    EXPECT_EQ(graph.pending(), 1);
+    EXPECT_EQ(graph.finished(), 2);
+    EXPECT_FALSE(graph.completed());
+
+    EXPECT_TRUE(graph.finish(1));
+    EXPECT_TRUE(graph.skip(3));
+    EXPECT_EQ(graph.running(), 0);
+    EXPECT_TRUE(graph.completed());
+}
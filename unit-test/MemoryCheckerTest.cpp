@@ -258,7 +258,7 @@ protected:
 
 #define TEST_TASK(source, func, stage1, stage2, check)                               \
     do {                                                                             \
-        concurrent_queue<message::client_task> task_queue;                           \
+        work_stealing_queue<message::client_task> task_queue;                        \
         judge::server::mock::configuration mock_judge_server;                        \
         programming_submission prog;                                                 \
         prog.judge_server = &mock_judge_server;                                      \
@@ -58,7 +58,7 @@ protected:
     }
 
     void test(const string &lang, const string &filename, const string &source) {
-        concurrent_queue<message::client_task> task_queue;
+        work_stealing_queue<message::client_task> task_queue;
         judge::server::mock::configuration mock_judge_server;
         programming_submission prog;
         prog.judge_server = &mock_judge_server;
@@ -122,7 +122,7 @@ protected:
 
 #define TEST_TASK(random_source, standard_source, submission_source, compilation_stage, random_stage) \
     do {                                                                                              \
-        concurrent_queue<message::client_task> task_queue;                                            \
+        work_stealing_queue<message::client_task> task_queue;                                         \
         judge::server::mock::configuration mock_judge_server;                                         \
         programming_submission prog;                                                                  \
         prog.judge_server = &mock_judge_server;                                                       \
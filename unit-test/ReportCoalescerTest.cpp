@@ -0,0 +1,59 @@
+#include <atomic>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "judge/programming.hpp"
+#include "server/judge_server.hpp"
+#include "server/report_coalescer.hpp"
+
+using namespace std;
+using namespace judge;
+using namespace judge::server;
+
+struct counting_server : public judge_server {
+    atomic<int> partial_reports = 0;
+    atomic<int> final_reports = 0;
+
+    string category() const override { return "mock"; }
+    void init(const filesystem::path &) override {}
+    bool fetch_submission(unique_ptr<submission> &) override { return false; }
+    void summarize(submission &, bool ack) override { ++(ack ? final_reports : partial_reports); }
+    void summarize_invalid(submission &) override {}
+    const executable_manager &get_executable_manager() const override { throw logic_error("unused"); }
+};
+
+TEST(ReportCoalescerTest, CoalescePartialReports) {
+    counting_server server;
+    programming_submission submit;
+    submit.judge_server = &server;
+
+    report_coalescer reporter(chrono::milliseconds(100));
+    for (int i = 0; i < 50; ++i) {
+        scoped_lock guard(submit.mut);
+        reporter.report(submit);
+    }
+
+    // 第一次报告立刻发送，之后的报告合并为一次，在间隔结束后发送
+    EXPECT_EQ(server.partial_reports, 1);
+    this_thread::sleep_for(chrono::milliseconds(300));
+    EXPECT_EQ(server.partial_reports, 2);
+}
+
+TEST(ReportCoalescerTest, CompleteDropsPendingReport) {
+    counting_server server;
+    programming_submission submit;
+    submit.judge_server = &server;
+
+    report_coalescer reporter(chrono::milliseconds(100));
+    {
+        scoped_lock guard(submit.mut);
+        reporter.report(submit);
+        reporter.report(submit);
+        reporter.complete(submit);
+        server.summarize(submit, true);
+    }
+
+    this_thread::sleep_for(chrono::milliseconds(300));
+    EXPECT_EQ(server.partial_reports, 1);
+    EXPECT_EQ(server.final_reports, 1);
+}
@@ -0,0 +1,76 @@
+#include "gtest/gtest.h"
+#include "judge/result_cache.hpp"
+
+using namespace std;
+using namespace judge;
+
+static unique_ptr<programming_submission> make_submission(const string &source) {
+    auto submit = make_unique<programming_submission>();
+    submit->category = "mock";
+    submit->prob_id = "1";
+    submit->sub_id = "1";
+    submit->updated_at = 0;
+    submit->judge_server = nullptr;
+
+    auto program = make_unique<source_code>();
+    program->language = "cpp";
+    program->source_files.push_back(make_unique<text_asset>("main.cpp", source));
+    submit->submission = move(program);
+
+    judge_task task;
+    task.tag = "compile";
+    task.time_limit = 1;
+    submit->judge_tasks.push_back(task);
+    return submit;
+}
+
+TEST(ResultCacheTest, KeyDependsOnContent) {
+    result_cache cache(1 << 20);
+    auto a = make_submission("int main() {}");
+    auto b = make_submission("int main() {}");
+    auto c = make_submission("int main() { return 1; }");
+
+    auto key = cache.key_of(*a);
+    ASSERT_TRUE(key);
+    EXPECT_EQ(key, cache.key_of(*b));
+    EXPECT_NE(key, cache.key_of(*c));
+
+    // 题目更新后旧的评测结果失效
+    b->updated_at = 1;
+    EXPECT_NE(key, cache.key_of(*b));
+
+    // 随机测试的评测结果不确定
+    c->judge_tasks[0].is_random = true;
+    EXPECT_FALSE(cache.key_of(*c));
+
+    result_cache excluded(1 << 20, {"mock"});
+    EXPECT_FALSE(excluded.key_of(*a));
+}
+
+TEST(ResultCacheTest, EvictLeastRecentlyUsed) {
+    judge_task_result result("compile", 0);
+    result.status = status::ACCEPTED;
+    result.report = string(1000, 'x');
+    result.run_dir = "/tmp/run";
+
+    result_cache probe(1 << 20);
+    probe.store("a", {result}, 1);
+    size_t capacity = probe.size() * 5 / 2;
+
+    // 只能容纳两个评测结果
+    result_cache cache(capacity);
+    cache.store("a", {result}, 1);
+    cache.store("b", {result}, 1);
+
+    vector<judge_task_result> results;
+    ASSERT_TRUE(cache.lookup("a", "mock", results));
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_EQ(results[0].status, status::ACCEPTED);
+    EXPECT_TRUE(results[0].run_dir.empty());
+
+    cache.store("c", {result}, 1);
+    EXPECT_TRUE(cache.lookup("a", "mock", results));
+    EXPECT_FALSE(cache.lookup("b", "mock", results));
+    EXPECT_TRUE(cache.lookup("c", "mock", results));
+    EXPECT_LE(cache.size(), capacity);
+}
@@ -0,0 +1,87 @@
+#include <filesystem>
+#include <fstream>
+
+#include "gtest/gtest.h"
+#include "judge/result_journal.hpp"
+
+using namespace std;
+using namespace judge;
+
+static filesystem::path journal_path() {
+    filesystem::path path = filesystem::temp_directory_path() / "judge-system-test" / "journal.jsonl";
+    filesystem::remove(path);
+    return path;
+}
+
+TEST(ResultJournalTest, RecoverAfterReopen) {
+    filesystem::path path = journal_path();
+    judge_task task;
+    task.testcase_id = 2;
+    task.subcase_id = 7;
+
+    {
+        result_journal journal(path, 2, 0);
+        judge_task_result compile("compile", 0);
+        compile.status = status::ACCEPTED;
+        compile.score = 1;
+        journal.append("mock/1/0", task, compile);
+
+        judge_task_result wrong("random", 1);
+        wrong.status = status::PARTIAL_CORRECT;
+        wrong.score = {1, 3};
+        wrong.run_time = 0.5;
+        wrong.report = "line 1\nline 2";
+        wrong.actions.push_back({"stdout", "42", true});
+        journal.append("mock/1/0", task, wrong);
+
+        journal.append("mock/2/0", task, compile);
+        journal.complete("mock/2/0");
+    }
+
+    // 模拟评测系统崩溃时写入了一半的记录
+    ofstream(path, ios::app) << "{\"key\":\"mock/1/0\",";
+
+    result_journal journal(path);
+    EXPECT_TRUE(journal.recover("mock/2/0").empty());
+    EXPECT_TRUE(journal.recover("mock/1/1").empty());
+
+    auto entries = journal.recover("mock/1/0");
+    ASSERT_EQ(entries.size(), 2);
+    auto &result = entries.at(1).result;
+    EXPECT_EQ(result.status, status::PARTIAL_CORRECT);
+    EXPECT_EQ(result.tag, "random");
+    EXPECT_EQ(result.score, boost::rational<int>(1, 3));
+    EXPECT_EQ(result.run_time, 0.5);
+    EXPECT_EQ(result.report, "line 1\nline 2");
+    ASSERT_EQ(result.actions.size(), 1);
+    EXPECT_EQ(result.actions[0].result, "42");
+    EXPECT_EQ(entries.at(1).testcase_id, 2);
+    EXPECT_EQ(entries.at(1).subcase_id, 7);
+}
+
+TEST(ResultJournalTest, CompletedSubmissionsAreCompacted) {
+    filesystem::path path = journal_path();
+    judge_task task;
+    judge_task_result result("test", 0);
+    result.status = status::WRONG_ANSWER;
+
+    {
+        result_journal journal(path, 64, -1);
+        for (int i = 0; i < 100; ++i) {
+            journal.append("mock/" + to_string(i) + "/0", task, result);
+            if (i != 42) journal.complete("mock/" + to_string(i) + "/0");
+        }
+        journal.flush();
+    }
+
+    // 重新打开日志时只保留未完成的提交的记录
+    result_journal journal(path);
+    EXPECT_EQ(journal.recover("mock/42/0").size(), 1);
+    EXPECT_TRUE(journal.recover("mock/41/0").empty());
+
+    ifstream fin(path);
+    string line;
+    size_t lines = 0;
+    while (getline(fin, line)) ++lines;
+    EXPECT_EQ(lines, 1);
+}
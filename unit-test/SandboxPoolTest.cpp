@@ -0,0 +1,45 @@
+#include <fstream>
+
+#include "common/defer.hpp"
+#include "gtest/gtest.h"
+#include "judge/sandbox_pool.hpp"
+
+using namespace std;
+using namespace judge;
+namespace fs = std::filesystem;
+
+TEST(SandboxPoolTest, ResetDiscardsWrittenFiles) {
+    fs::path root = fs::temp_directory_path() / ("sandbox-pool-" + to_string(getpid()));
+    fs::create_directories(root / "chroot" / "tmp");
+    ofstream(root / "chroot" / "hello") << "hello";
+    defer { fs::remove_all(root); };
+
+    {
+        sandbox_pool pool(root / "pool", root / "chroot", 1, 1 << 20);
+        pool.prepare({0});
+
+        fs::path sandbox_root;
+        {
+            auto sandbox = pool.acquire(0);
+            // 挂载需要 root 权限
+            if (!sandbox) GTEST_SKIP() << "Unable to mount sandboxes";
+            sandbox_root = sandbox.root();
+            EXPECT_TRUE(fs::exists(sandbox_root / "hello"));
+            EXPECT_TRUE(fs::exists(sandbox_root / "dev" / "null"));
+            EXPECT_TRUE(fs::is_directory(sandbox_root / "judge"));
+            ofstream(sandbox_root / "tmp" / "leftover") << "leftover";
+        }
+
+        // 每个核心只有一个运行环境，再次取出时一定是重置后的同一个运行环境
+        auto sandbox = pool.acquire(0);
+        ASSERT_TRUE(sandbox);
+        EXPECT_EQ(sandbox.root(), sandbox_root);
+        EXPECT_TRUE(fs::exists(sandbox.root() / "hello"));
+        EXPECT_FALSE(fs::exists(sandbox.root() / "tmp" / "leftover"));
+
+        // 没有运行环境的核心返回空的 lease
+        EXPECT_FALSE(pool.acquire(1));
+    }
+
+    EXPECT_FALSE(fs::exists(root / "chroot" / "tmp" / "leftover"));
+}
@@ -0,0 +1,114 @@
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "common/scheduling_policy.hpp"
+#include "common/work_stealing_queue.hpp"
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace judge;
+
+// 测试用的任务：(分组, 预计运行时间)
+typedef pair<unsigned, double> task;
+
+static vector<task> drain(scheduling_policy<task> &policy) {
+    vector<task> result;
+    task t;
+    while (policy.pop(t)) result.push_back(t);
+    return result;
+}
+
+TEST(SchedulingPolicyTest, FIFOPolicy) {
+    fifo_policy<task> policy;
+    policy.push({0, 3});
+    policy.push({0, 1});
+    policy.push({1, 2});
+    EXPECT_EQ(drain(policy), (vector<task>{{0, 3}, {0, 1}, {1, 2}}));
+    EXPECT_TRUE(policy.empty());
+}
+
+TEST(SchedulingPolicyTest, ShortestFirstPolicy) {
+    shortest_first_policy<task> policy([](const task &t) { return t.second; });
+    policy.push({0, 3});
+    policy.push({1, 1});
+    policy.push({2, 2});
+    policy.push({3, 1});
+
+    task t;
+    ASSERT_TRUE(policy.steal(t));
+    EXPECT_EQ(t, task(1, 1));
+    // 预计运行时间相同时先进先出
+    EXPECT_EQ(drain(policy), (vector<task>{{3, 1}, {2, 2}, {0, 3}}));
+}
+
+TEST(SchedulingPolicyTest, FairSharePolicy) {
+    fair_share_policy<task> policy([](const task &t) { return t.first; });
+    // 提交 0 有大量评测任务，提交 1 和 2 在其之后到达
+    for (int i = 0; i < 4; ++i) policy.push({0, i});
+    policy.push({1, 0});
+    policy.push({2, 0});
+    policy.push({1, 1});
+
+    EXPECT_EQ(drain(policy), (vector<task>{{0, 0}, {1, 0}, {2, 0}, {0, 1}, {1, 1}, {0, 2}, {0, 3}}));
+}
+
+TEST(SchedulingPolicyTest, QueueUsesPolicy) {
+    work_stealing_queue<task> queue(0, [] {
+        return unique_ptr<scheduling_policy<task>>(make_unique<shortest_first_policy<task>>([](const task &t) { return t.second; }));
+    });
+    queue.push({0, 5});
+    queue.push({1, 1});
+
+    task t;
+    ASSERT_TRUE(queue.try_pop(t));
+    EXPECT_EQ(t, task(1, 1));
+    ASSERT_TRUE(queue.try_pop(t));
+    EXPECT_EQ(t, task(0, 5));
+}
+
+TEST(SchedulingPolicyTest, OrderIsGlobalAcrossWorkers) {
+    work_stealing_queue<task> queue(2, [] {
+        return unique_ptr<scheduling_policy<task>>(make_unique<shortest_first_policy<task>>([](const task &t) { return t.second; }));
+    });
+    thread([&] {
+        queue.attach(0);
+        queue.push({0, 5});
+    }).join();
+    thread([&] {
+        queue.attach(1);
+        queue.push({1, 1});
+    }).join();
+
+    // worker 0 取出的是所有 worker 推送的元素中最短的，而不是自己推送的元素
+    thread([&] {
+        queue.attach(0);
+        task t;
+        ASSERT_TRUE(queue.try_pop(t));
+        EXPECT_EQ(t, task(1, 1));
+    }).join();
+}
+
+TEST(SchedulingPolicyTest, RemoveIfKeepsOrder) {
+    auto odd = [](const task &t) { return t.first % 2 == 1; };
+
+    fifo_policy<task> fifo;
+    for (unsigned i = 0; i < 5; ++i) fifo.push({i, 0});
+    EXPECT_EQ(fifo.remove_if(odd), 2);
+    EXPECT_EQ(drain(fifo), (vector<task>{{0, 0}, {2, 0}, {4, 0}}));
+
+    shortest_first_policy<task> shortest([](const task &t) { return t.second; });
+    for (unsigned i = 0; i < 5; ++i) shortest.push({i, 5.0 - i});
+    EXPECT_EQ(shortest.remove_if(odd), 2);
+    EXPECT_EQ(drain(shortest), (vector<task>{{4, 1}, {2, 3}, {0, 5}}));
+
+    // 分组 1 的元素全部被移除后退出轮转
+    fair_share_policy<task> fair([](const task &t) { return t.first; });
+    fair.push({0, 0});
+    fair.push({1, 0});
+    fair.push({0, 1});
+    fair.push({1, 1});
+    fair.push({2, 0});
+    EXPECT_EQ(fair.remove_if(odd), 2);
+    EXPECT_EQ(drain(fair), (vector<task>{{0, 0}, {2, 0}, {0, 1}}));
+}
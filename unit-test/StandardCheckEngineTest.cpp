@@ -0,0 +1,314 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+
+#include "common/utils.hpp"
+#include "config.hpp"
+#include "gtest/gtest.h"
+#include "judge/standard_check.hpp"
+#include "runguard.hpp"
+#include "time_result.hpp"
+
+using namespace std;
+using namespace judge;
+namespace fs = std::filesystem;
+
+/**
+ * 用脚本代替 runguard，只根据环境变量写入 meta 文件并返回比较器的返回值，
+ * 从而在没有 root 权限和 chroot 环境时检查评测流程和评测结果的判定
+ */
+static const char *FAKE_RUNGUARD = R"(#!/bin/bash
+echo "$@" >> runguard.args
+if [[ " $* " == *" --batch "* ]]; then
+    while [ "$1" != "--batch" ]; do shift; done
+    while IFS=$'\t' read -r -a args; do
+        "$0" "${args[@]}"
+    done < "$2"
+    exit 0
+fi
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --out-meta) meta="$2"; shift ;;
+        --standard-output-fd) output="$2"; shift ;;
+    esac
+    shift
+done
+if [[ "$meta" == *program.meta ]]; then
+    # 边运行边比较时选手程序的输出写入管道，PROGRAM_REPEAT 非空时一直输出直到管道被关闭
+    if [ -n "$PROGRAM_OUTPUT" ]; then
+        printf "$PROGRAM_OUTPUT" >&$output
+        [ -n "$PROGRAM_REPEAT" ] && yes "$PROGRAM_REPEAT" >&$output
+    fi
+    printf "cpu-time: 0.1\nwall-time: 0.2\nmemory-bytes: 1024\nexitcode: 0\n$PROGRAM_META" > "$meta"
+    exit 0
+fi
+printf "cpu-time: 0.01\nwall-time: 0.01\nexitcode: $COMPARE_EXIT\n" > "$meta"
+exit $COMPARE_EXIT
+)";
+
+class StandardCheckEngineTest : public ::testing::Test {
+protected:
+    fs::path root;
+    standard_check_options opt;
+
+    void SetUp() override {
+        root = fs::temp_directory_path() / ("standard-check-" + to_string(getpid()));
+        fs::remove_all(root);
+        for (auto dir : {"data/input", "data/output", "run-script", "compare-script", "rundir"})
+            fs::create_directories(root / dir);
+        for (auto file : {"run-script/run", "compare-script/run"})
+            ofstream(root / file) << "#!/bin/sh\n";
+        ofstream(root / "runguard") << FAKE_RUNGUARD;
+        fs::permissions(root / "runguard", fs::perms::owner_all);
+        set_env("RUNGUARD", (root / "runguard").string(), true);
+
+        opt.datadir = root / "data";
+        opt.time_limit = 1;
+        opt.rundir = root / "rundir";
+        opt.run_script = root / "run-script";
+        opt.compare_script = root / "compare-script";
+    }
+
+    void TearDown() override {
+        fs::remove_all(root);
+    }
+
+    int run(const string &program_meta, int compare_exit, bool interactive = false) {
+        process_builder pb;
+        pb.environment("PROGRAM_META", program_meta);
+        pb.environment("COMPARE_EXIT", compare_exit);
+        if (!interactive) return run_standard_check(opt, pb);
+        // 交互器的 runguard 由 run_interactive_check 另外启动，只能通过评测系统的环境变量传递
+        set_env("COMPARE_EXIT", to_string(compare_exit), true);
+        return run_interactive_check(opt, pb);
+    }
+};
+
+TEST_F(StandardCheckEngineTest, CompareResult) {
+    EXPECT_EQ(run("", 42), E_ACCEPTED);
+    auto log = read_file_content(opt.rundir / "system.out", "");
+    EXPECT_NE(log.find("Accepted\n    runtime: 0.1s cpu, 0.2s wall"), string::npos);
+
+    EXPECT_EQ(run("", 43), E_WRONG_ANSWER);
+    // 比较器返回部分正确但没有给出分数
+    EXPECT_EQ(run("", 54), E_COMPARE_ERROR);
+    EXPECT_EQ(run("", 1), E_COMPARE_ERROR);
+}
+
+TEST_F(StandardCheckEngineTest, ProgramResult) {
+    EXPECT_EQ(run("time-result: hard-timelimit\n", 42), E_TIME_LIMIT);
+    EXPECT_EQ(run("memory-result: oom\n", 42), E_MEM_LIMIT);
+    EXPECT_EQ(run("output-truncated: stderr,stdout\n", 42), E_OUTPUT_LIMIT);
+    EXPECT_EQ(run("signal: 11\n", 42), E_SEG_FAULT);
+    EXPECT_EQ(run("internal-error: failed\n", 42), E_INTERNAL_ERROR);
+    EXPECT_EQ(run("exitcode: 1\n", 42), E_RUNTIME_ERROR);
+
+    fs::remove_all(opt.datadir / "output");
+    EXPECT_EQ(run("", 42), E_INTERNAL_ERROR);
+}
+
+TEST_F(StandardCheckEngineTest, InstructionLimit) {
+    // 假的 runguard 直接给出 time-result，这里只检查参数的传递和结果的解析，判定见 RunguardTimeLimitTest
+    opt.limit.instruction_limit = 1000;
+    EXPECT_EQ(run("instructions: 2000\ncycles: 2000\ntask-clock: 0.000002\nperf-source: software\ntime-result: soft-timelimit\n", 42), E_TIME_LIMIT);
+
+    auto args = read_file_content(opt.rundir / "runguard.args", "");
+    EXPECT_NE(args.find("--instruction-limit 1000"), string::npos);
+    EXPECT_EQ(args.find("--perf-counters"), string::npos);
+    auto log = read_file_content(opt.rundir / "system.out", "");
+    EXPECT_NE(log.find("instructions: 2000 (software)"), string::npos);
+
+    auto result = read_runguard_result(opt.rundir / "program.meta");
+    EXPECT_EQ(result.instructions, 2000);
+    EXPECT_EQ(result.cycles, 2000);
+    EXPECT_DOUBLE_EQ(result.task_clock, 0.000002);
+    EXPECT_TRUE(result.perf_emulated);
+}
+
+TEST_F(StandardCheckEngineTest, Interactive) {
+    EXPECT_EQ(run("", 42, true), E_ACCEPTED);
+    // 交互器判定答案错误后退出，选手程序写入关闭的管道
+    EXPECT_EQ(run("signal: 13\n", 43, true), E_WRONG_ANSWER);
+    EXPECT_EQ(run("signal: 11\n", 42, true), E_SEG_FAULT);
+    EXPECT_EQ(run("time-result: hard-timelimit\n", 43, true), E_TIME_LIMIT);
+
+    auto args = read_file_content(opt.rundir / "runguard.args", "");
+    EXPECT_NE(args.find("--standard-input-fd 3 --standard-output-fd 4 -- /run/run  /proc/self/fd/1 /judge/run"), string::npos);
+    EXPECT_NE(args.find("/compare/run /data/input /data/output /feedback"), string::npos);
+}
+
+TEST_F(StandardCheckEngineTest, StreamCompare) {
+    ofstream(opt.datadir / "output" / "testdata.out") << "1 2\n3\n";
+    opt.stream_compare = compare_mode::all;
+    STREAM_CHECK_SLACK = 1024;
+    auto stream = [&](const string &output, const string &repeat = "", const string &program_meta = "") {
+        process_builder pb;
+        pb.environment("PROGRAM_META", program_meta);
+        pb.environment("PROGRAM_OUTPUT", output);
+        pb.environment("PROGRAM_REPEAT", repeat);
+        return run_standard_check(opt, pb);
+    };
+
+    EXPECT_EQ(stream("1 2\\n3\\n"), E_ACCEPTED);
+    EXPECT_EQ(read_file_content(opt.rundir / "run" / "testdata.out", ""), "1 2\n3\n");
+    // 不再通过 runguard 运行比较器
+    auto args = read_file_content(opt.rundir / "runguard.args", "");
+    EXPECT_EQ(count(args.begin(), args.end(), '\n'), 1);
+    EXPECT_NE(args.find("--standard-output-fd 3 -- /run/run testdata.in /proc/self/fd/1 /judge/run"), string::npos);
+
+    EXPECT_EQ(stream("1 2 \\n3\\n"), E_PRESENTATION_ERROR);
+
+    // 第一行错误后不再等待选手程序输出，选手程序写入关闭的管道
+    EXPECT_EQ(stream("1 3\\n", "0", "signal: 13\n"), E_WRONG_ANSWER);
+    auto log = read_file_content(opt.rundir / "system.out", "");
+    EXPECT_NE(log.find("user output: line 1, column 3: 3\\n"), string::npos);
+
+    // 之后的空行都被忽略，但是输出超过了标准输出的长度加上 STREAM_CHECK_SLACK
+    EXPECT_EQ(stream("1 2\\n3\\n", " ", "signal: 13\n"), E_OUTPUT_LIMIT);
+    EXPECT_EQ(fs::file_size(opt.rundir / "run" / "testdata.out"), 6 + 1024u);
+
+    EXPECT_EQ(stream("1 2\\n3\\n", "", "time-result: hard-timelimit\n"), E_TIME_LIMIT);
+    STREAM_CHECK_SLACK = 0;
+}
+
+TEST_F(StandardCheckEngineTest, TokenCompare) {
+    ofstream(opt.datadir / "output" / "testdata.out") << "1 0.5\nyes\n";
+    opt.compare_script.clear();
+    opt.token_compare = parse_token_compare("token:abs=1e-6,ignore-case");
+    // 假的 runguard 不会运行选手程序，直接写入选手程序的输出
+    auto token = [&](const string &output, const string &program_meta = "") {
+        fs::create_directories(opt.rundir / "run");
+        ofstream(opt.rundir / "run" / "testdata.out") << output;
+        return run(program_meta, 1);
+    };
+
+    EXPECT_EQ(token("1.0000001 5e-1 YES"), E_ACCEPTED);
+    // 不再通过 runguard 运行比较器
+    auto args = read_file_content(opt.rundir / "runguard.args", "");
+    EXPECT_EQ(count(args.begin(), args.end(), '\n'), 1);
+
+    EXPECT_EQ(token("1 0.51\nyes\n"), E_WRONG_ANSWER);
+    auto log = read_file_content(opt.rundir / "system.out", "");
+    EXPECT_NE(log.find("user output: line 1, column 3: 0.51\\n"), string::npos);
+    EXPECT_EQ(token("1 0.5\nyes\n", "exitcode: 1\n"), E_RUNTIME_ERROR);
+
+    fs::remove(opt.rundir / "run" / "testdata.out");
+    EXPECT_EQ(run("", 1), E_COMPARE_ERROR);
+}
+
+TEST_F(StandardCheckEngineTest, Batch) {
+    vector<standard_check_options> opts(3, opt);
+    for (size_t i = 0; i < opts.size(); ++i) {
+        opts[i].rundir = root / ("rundir-" + to_string(i));
+        fs::create_directories(opts[i].rundir);
+    }
+    opts[2].datadir = root / "missing";
+
+    process_builder pb;
+    pb.environment("PROGRAM_META", "");
+    pb.environment("COMPARE_EXIT", 43);
+    EXPECT_EQ(run_standard_check_batch(opts, pb), vector<int>({E_WRONG_ANSWER, E_WRONG_ANSWER, E_INTERNAL_ERROR}));
+
+    // 两个测试点的选手程序和比较器只启动了一次 runguard，根目录只在批量运行的命令行中挂载一次
+    auto args = read_file_content(opts[0].rundir / "runguard.args", "");
+    EXPECT_EQ(count(args.begin(), args.end(), '\n'), 5);
+    string batch = args.substr(0, args.find('\n')), entries = args.substr(batch.size());
+    EXPECT_NE(batch.find("--batch"), string::npos);
+    EXPECT_NE(batch.find("--prepare-root"), string::npos);
+    EXPECT_NE(batch.find("--out-record"), string::npos);
+    EXPECT_EQ(entries.find("--prepare-root"), string::npos);
+    EXPECT_NE(entries.find("--root " + (opts[0].rundir / "merged").string()), string::npos);
+    EXPECT_NE(entries.find((opts[1].rundir / "program.meta").string()), string::npos);
+
+    auto log = read_file_content(opts[1].rundir / "system.out", "");
+    EXPECT_NE(log.find("Wrong Answer\n    runtime: 0.1s cpu, 0.2s wall"), string::npos);
+}
+
+TEST(RunguardTimeLimitTest, InstructionLimit) {
+    runguard_options opt;
+    opt.use_cpu_limit = opt.use_wall_limit = true;
+    opt.cpu_limit = {1, 2};
+    opt.wall_limit = {2, 3};
+    perf_result counters;
+    counters.instructions = 2000;
+
+    // 没有指令数限制时按照 CPU 时间和时钟时间判定
+    auto result = check_soft_limits(opt, 1.5, 2.5, counters);
+    EXPECT_TRUE(result.cpu);
+    EXPECT_TRUE(result.wall);
+
+    // 设置了指令数限制时只按照指令数判定
+    opt.instruction_limit = 1000;
+    result = check_soft_limits(opt, 1.5, 2.5, counters);
+    EXPECT_TRUE(result.cpu);
+    EXPECT_FALSE(result.wall);
+    counters.instructions = 1000;
+    result = check_soft_limits(opt, 1.5, 2.5, counters);
+    EXPECT_FALSE(result.cpu);
+    EXPECT_FALSE(result.wall);
+
+    // 性能计数器无法打开时仍然按照时间判定
+    result = check_soft_limits(opt, 0.5, 2.5, nullopt);
+    EXPECT_FALSE(result.cpu);
+    EXPECT_TRUE(result.wall);
+}
+
+TEST(RunguardRecordTest, ReadRecord) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    runguard_record record{};
+    record.magic = RUNGUARD_RECORD_MAGIC;
+    record.version = RUNGUARD_RECORD_VERSION;
+    record.exitcode = 139;
+    record.signal = 11;
+    record.cpu_time = 0.25;
+    record.memory_bytes = 4096;
+    record.instructions = record.cycles = -1;
+    record.time_result = 2;
+    strcpy(record.internal_error, "failed");
+    ASSERT_EQ(write(fds[1], &record, sizeof(record)), (ssize_t)sizeof(record));
+    // runguard 崩溃时只写入了一部分
+    ASSERT_EQ(write(fds[1], &record, sizeof(record) / 2), (ssize_t)sizeof(record) / 2);
+    close(fds[1]);
+
+    auto result = read_runguard_record(fds[0]);
+    ASSERT_TRUE(result);
+    EXPECT_EQ(result->exitcode, 139);
+    EXPECT_EQ(result->signal, 11);
+    EXPECT_DOUBLE_EQ(result->cpu_time, 0.25);
+    EXPECT_EQ(result->memory, 4096);
+    EXPECT_EQ(result->instructions, -1);
+    EXPECT_EQ(result->time_result, "hard-timelimit");
+    EXPECT_EQ(result->memory_result, "");
+    EXPECT_EQ(result->internal_error, "failed");
+    EXPECT_FALSE(read_runguard_record(fds[0]));
+    close(fds[0]);
+}
+
+TEST(ProcessBuilderTest, PassFdSwapped) {
+    // 两个 fd 互换编号：后一项的 fd 恰好是前一项的 target，不能被前一项的 dup2 覆盖
+    int a[2], b[2];
+    ASSERT_EQ(pipe2(a, O_CLOEXEC), 0);
+    ASSERT_EQ(pipe2(b, O_CLOEXEC), 0);
+    ASSERT_EQ(dup3(a[1], 100, O_CLOEXEC), 100);
+    ASSERT_EQ(dup3(b[1], 101, O_CLOEXEC), 101);
+    close(a[1]);
+    close(b[1]);
+
+    process_builder pb;
+    pb.pass_fd(100, 101).pass_fd(101, 100);
+    EXPECT_EQ(pb.run("bash", "-c", "echo a >&100; echo b >&101"), 0);
+    EXPECT_EQ(fcntl(100, F_GETFD), -1);
+    EXPECT_EQ(fcntl(101, F_GETFD), -1);
+
+    char buf[8] = {};
+    EXPECT_EQ(read(a[0], buf, sizeof(buf)), 2);
+    EXPECT_STREQ(buf, "b\n");
+    memset(buf, 0, sizeof(buf));
+    EXPECT_EQ(read(b[0], buf, sizeof(buf)), 2);
+    EXPECT_STREQ(buf, "a\n");
+    close(a[0]);
+    close(b[0]);
+}
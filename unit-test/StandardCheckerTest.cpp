@@ -68,7 +68,7 @@ protected:
 };
 
 TEST_F(StandardCheckerTest, CompilationTimeLimitTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -87,7 +87,7 @@ int main() {
 }
 
 TEST_F(StandardCheckerTest, AcceptedTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -109,7 +109,7 @@ int main() {
 }
 
 TEST_F(StandardCheckerTest, WrongAnswerTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -130,8 +130,31 @@ int main () {
     EXPECT_EQ(prog.results[2].status, status::WRONG_ANSWER);
 }
 
+TEST_F(StandardCheckerTest, FailFastTest) {
+    work_stealing_queue<message::client_task> task_queue;
+    judge::server::mock::configuration mock_judge_server;
+    programming_submission prog;
+    prog.judge_server = &mock_judge_server;
+    prepare(prog, R"(#include <iostream>
+int main () {
+    int a;
+    std::cin >> a;
+    std::cout << a + 1;
+    return 0;
+})");
+    programming_judger judger({"mock"});
+
+    push_submission(judger, task_queue, prog);
+    worker_loop(judger, task_queue);
+
+    // 第一个测试点未通过后，第二个测试点不再评测
+    EXPECT_EQ(prog.results[0].status, status::ACCEPTED);
+    EXPECT_EQ(prog.results[1].status, status::WRONG_ANSWER);
+    EXPECT_EQ(prog.results[2].status, status::SKIPPED);
+}
+
 TEST_F(StandardCheckerTest, PresentationErrorTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -153,7 +176,7 @@ int main () {
 }
 
 TEST_F(StandardCheckerTest, CompilationErrorTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -174,7 +197,7 @@ int main() {
 }
 
 TEST_F(StandardCheckerTest, TimeLimitExceededTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -195,7 +218,7 @@ int main () {
 }
 
 TEST_F(StandardCheckerTest, MemoryLimitExceededTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -218,7 +241,7 @@ int main () {
 }
 
 TEST_F(StandardCheckerTest, FloatingPointErrorTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -240,7 +263,7 @@ int main() {
 }
 
 TEST_F(StandardCheckerTest, SegmentationFaultTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -262,7 +285,7 @@ int main() {
 }
 
 TEST_F(StandardCheckerTest, RuntimeErrorTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -282,7 +305,7 @@ int main() {
 }
 
 TEST_F(StandardCheckerTest, RestrictFunctionPassTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -302,7 +325,7 @@ int main() {
 }
 
 TEST_F(StandardCheckerTest, RestrictFunctionFailTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -62,7 +62,7 @@ inline void print() {
 };
 
 TEST_F(StaticCheckerTest, NoWarningTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -81,7 +81,7 @@ int main() {
 }
 
 TEST_F(StaticCheckerTest, Priority3Test) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -101,7 +101,7 @@ int main() {
 }
 
 TEST_F(StaticCheckerTest, Priority2Test) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -0,0 +1,124 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "common/work_stealing_queue.hpp"
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace judge;
+
+TEST(WorkStealingQueueTest, SharedQueueIsFIFO) {
+    work_stealing_queue<int> queue;
+    for (int i = 0; i < 5; ++i) queue.push(i);
+    EXPECT_EQ(queue.size(), 5);
+
+    int value;
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(queue.try_pop(value));
+}
+
+TEST(WorkStealingQueueTest, LocalQueueIsFIFOAndStolenFromBack) {
+    work_stealing_queue<int> queue(2);
+    thread owner([&] {
+        queue.attach(0);
+        for (int i = 0; i < 4; ++i) queue.push(i);
+
+        // 本地队列先进先出
+        int value;
+        ASSERT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(value, 0);
+    });
+    owner.join();
+
+    thread thief([&] {
+        queue.attach(1);
+
+        // 窃取时从队尾开始取
+        int value;
+        ASSERT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(value, 3);
+        ASSERT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(value, 2);
+    });
+    thief.join();
+
+    thread owner_again([&] {
+        queue.attach(0);
+        int value;
+        ASSERT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(value, 1);
+        EXPECT_FALSE(queue.try_pop(value));
+    });
+    owner_again.join();
+}
+
+TEST(WorkStealingQueueTest, WaitPopWakesUpOnPushAndWake) {
+    work_stealing_queue<int> queue(1);
+    int value;
+
+    thread producer([&] {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        queue.push(42);
+    });
+    EXPECT_TRUE(queue.wait_pop(value));
+    EXPECT_EQ(value, 42);
+    producer.join();
+
+    thread waker([&] {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        queue.wake_all();
+    });
+    EXPECT_FALSE(queue.wait_pop(value));
+    waker.join();
+
+    queue.wake_one();
+    EXPECT_FALSE(queue.wait_pop(value));
+    EXPECT_FALSE(queue.pop_for(value, chrono::milliseconds(10)));
+}
+
+TEST(WorkStealingQueueTest, ConcurrentPushPop) {
+    const size_t workers = 8, tasks = 10000;
+    work_stealing_queue<size_t> queue(workers);
+    atomic<size_t> sum = 0, popped = 0;
+
+    vector<thread> threads;
+    for (size_t i = 0; i < workers; ++i) {
+        threads.emplace_back([&, i] {
+            queue.attach(i);
+            for (size_t j = 0; j < tasks; ++j) queue.push(j);
+
+            size_t value;
+            while (queue.try_pop(value)) {
+                sum += value;
+                ++popped;
+            }
+        });
+    }
+    for (auto &thd : threads) thd.join();
+
+    EXPECT_EQ(popped, workers * tasks);
+    EXPECT_EQ(sum, workers * tasks * (tasks - 1) / 2);
+    EXPECT_EQ(queue.size(), 0);
+}
+
+TEST(WorkStealingQueueTest, RemoveIfFromAllSlots) {
+    work_stealing_queue<int> queue(2);
+    thread owner([&] {
+        queue.attach(0);
+        for (int i = 0; i < 4; ++i) queue.push(i);
+    });
+    owner.join();
+    for (int i = 4; i < 8; ++i) queue.push(i);
+
+    EXPECT_EQ(queue.remove_if([](int value) { return value % 2 == 0; }), 4);
+    EXPECT_EQ(queue.size(), 4);
+
+    int value, sum = 0;
+    while (queue.try_pop(value)) sum += value;
+    EXPECT_EQ(sum, 1 + 3 + 5 + 7);
+}
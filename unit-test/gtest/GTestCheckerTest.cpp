@@ -82,7 +82,7 @@ protected:
     } while (0)
 
 TEST_F(GTestCheckerTest, AbnormalTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -98,7 +98,7 @@ TEST_F(GTestCheckerTest, AbnormalTest) {
 }
 
 TEST_F(GTestCheckerTest, FailureTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -121,7 +121,7 @@ TEST_F(GTestCheckerTest, FailureTest) {
 }
 
 TEST_F(GTestCheckerTest, PassTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -144,7 +144,7 @@ TEST_F(GTestCheckerTest, PassTest) {
 }
 
 TEST_F(GTestCheckerTest, PassTestWithDisabledTests) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -168,7 +168,7 @@ TEST_F(GTestCheckerTest, PassTestWithDisabledTests) {
 }
 
 TEST_F(GTestCheckerTest, FilteredPassTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -192,7 +192,7 @@ TEST_F(GTestCheckerTest, FilteredPassTest) {
 }
 
 TEST_F(GTestCheckerTest, NoCaseTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
@@ -216,7 +216,7 @@ TEST_F(GTestCheckerTest, NoCaseTest) {
 }
 
 TEST_F(GTestCheckerTest, TimeLimitTest) {
-    concurrent_queue<message::client_task> task_queue;
+    work_stealing_queue<message::client_task> task_queue;
     judge::server::mock::configuration mock_judge_server;
     programming_submission prog;
     prog.judge_server = &mock_judge_server;
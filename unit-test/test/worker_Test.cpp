@@ -9,12 +9,12 @@
 namespace judge {
 using namespace std;
 
-void push_submission(const judger &j, concurrent_queue<message::client_task> &task_queue, submission &submit) {
+void push_submission(const judger &j, work_stealing_queue<message::client_task> &task_queue, submission &submit) {
     EXPECT_TRUE(j.verify(submit));
     EXPECT_TRUE(j.distribute(task_queue, submit));
 }
 
-void worker_loop(const judger &j, concurrent_queue<message::client_task> &task_queue) {
+void worker_loop(const judger &j, work_stealing_queue<message::client_task> &task_queue) {
     while (true) {
         message::client_task task;
         if (!task_queue.try_pop(task)) break;